@@ -0,0 +1,497 @@
+#!/usr/bin/env python3
+"""Benchmark suite: built-in models on deterministic synthetic corpora.
+
+Every model in ``tinybpe/models/models.json`` is loaded in its own child
+process and measured on each corpus:
+
+- ``encode``, ``count``, ``decode``: throughput in MB/s (UTF-8 bytes of
+  the corpus) and tokens/s, best of ``--repeat`` runs
+- ``latency``: p50 / p99 of ``encode()`` on the corpus cut into documents
+- ``stream``: ``StreamDecoder.push()`` one token at a time, tokens/s
+- ``load``: cold ``from_pretrained()`` time and the child's peak RSS
+
+Corpora are generated from a fixed seed, so two runs on the same machine
+measure the same text.  Results are written as JSON; ``--compare`` prints
+the ratio of every metric against an earlier results file.  When
+``tiktoken`` is installed, the OpenAI encodings are measured with it too.
+
+Usage::
+
+    python benchmarks/bench_suite.py -o before.json
+    python benchmarks/bench_suite.py -o after.json --compare before.json
+    python benchmarks/bench_suite.py --models cl100k_base --corpora prose code
+"""
+
+from __future__ import annotations
+
+import argparse
+import datetime
+import json
+import multiprocessing
+import os
+import platform
+import random
+import statistics
+import subprocess
+import sys
+import time
+from typing import Any, Callable
+
+# ---------------------------------------------------------------------------
+# Corpora
+# ---------------------------------------------------------------------------
+
+_WORD_LIST = (
+    "the of and to in is was for that with as on by at from his an were are which this be or have had not "
+    "one but they all their has been its new who more also when after first there can two time would other "
+    "into only some over most world state people system between during under year city may three known "
+    "number such called through while both city house part found where small made well long each government "
+    "because however since later many several school between public company music power water history often "
+    "against used model train token language data result network paper study large number method value"
+)
+_WORDS = _WORD_LIST.split()
+
+_PUNCT = [",", ",", ";", ":", " -", "'s", " (see above)", " —"]
+
+
+def _prose(rng: random.Random, size: int, newlines: bool = True) -> str:
+    """English-like sentences grouped into paragraphs."""
+    out: list[str] = []
+    n = 0
+    while n < size:
+        words = [rng.choice(_WORDS) for _ in range(rng.randint(6, 22))]
+        if rng.random() < 0.3:
+            words.insert(rng.randrange(len(words)), str(rng.randint(1, 2030)))
+        if rng.random() < 0.4:
+            i = rng.randrange(1, len(words))
+            words[i - 1] += rng.choice(_PUNCT)
+        sentence = " ".join(words)
+        sentence = sentence[0].upper() + sentence[1:] + rng.choice(".....?!")
+        sep = "\n\n" if newlines and rng.random() < 0.15 else " "
+        out.append(sentence + sep)
+        n += len(sentence) + len(sep)
+    return "".join(out)
+
+
+def _code(rng: random.Random, size: int) -> str:
+    """Python-like source: functions, loops, calls, literals and comments."""
+    names = ["data", "value", "index", "result", "buffer", "count", "node", "items", "total", "key", "config"]
+    out: list[str] = []
+    n = 0
+    while n < size:
+        fn = f"{rng.choice(names)}_{rng.choice(names)}"
+        args = ", ".join(rng.sample(names, rng.randint(1, 3)))
+        lines = [f"def {fn}({args}):", f'    """Return the {rng.choice(_WORDS)} of {rng.choice(names)}."""']
+        for _ in range(rng.randint(3, 10)):
+            indent = "    " * rng.randint(1, 3)
+            kind = rng.random()
+            a, b = rng.choice(names), rng.choice(names)
+            if kind < 0.25:
+                lines.append(f"{indent}for {a} in range({rng.randint(0, 4096)}):")
+            elif kind < 0.45:
+                lines.append(f"{indent}if {a} >= {b} and not {a}.{rng.choice(names)}:")
+            elif kind < 0.7:
+                lines.append(f"{indent}{a}[{b}] = {a}.get({b!r}, {rng.random():.4f}) * {rng.randint(2, 99)}")
+            elif kind < 0.85:
+                lines.append(f"{indent}# {' '.join(rng.choice(_WORDS) for _ in range(rng.randint(3, 9)))}")
+            else:
+                lines.append(f'{indent}raise ValueError(f"bad {a}: {{{b}!r}}")')
+        lines.append(f"    return {rng.choice(names)}\n\n")
+        block = "\n".join(lines)
+        out.append(block)
+        n += len(block)
+    return "".join(out)
+
+
+# Fullwidth comma (3 times), ideographic full stop (twice) and comma, fullwidth ! and ?, corner brackets
+_CJK_PUNCT = "\uff0c\uff0c\uff0c\u3002\u3002\u3001\uff01\uff1f\u300c\u300d"
+
+
+def _cjk(rng: random.Random, size: int) -> str:
+    """Chinese, Japanese and Korean text with CJK punctuation."""
+    ranges = [(0x4E00, 0x62FF), (0x4E00, 0x62FF), (0x3041, 0x3096), (0x30A1, 0x30FA), (0xAC00, 0xB7FF)]
+    out: list[str] = []
+    n = 0
+    while n < size:
+        lo, hi = rng.choice(ranges)
+        clause = "".join(chr(rng.randint(lo, hi)) for _ in range(rng.randint(4, 18)))
+        if rng.random() < 0.1:
+            clause += str(rng.randint(1, 9999))
+        clause += rng.choice(_CJK_PUNCT) + ("\n" if rng.random() < 0.05 else "")
+        out.append(clause)
+        n += len(clause.encode("utf-8"))
+    return "".join(out)
+
+
+_EMOJI = [chr(c) for c in range(0x1F600, 0x1F650)] + [chr(c) for c in range(0x1F300, 0x1F380)]
+_EMOJI_SEQUENCES = [
+    "\U0001f468\u200d\U0001f469\u200d\U0001f467",  # family (ZWJ)
+    "\U0001f44d\U0001f3fd",  # skin tone modifier
+    "\U0001f1fa\U0001f1f8",  # flag (regional indicators)
+    "\u2764\ufe0f",  # variation selector
+]
+
+
+def _emoji(rng: random.Random, size: int) -> str:
+    """Short chat messages dense with emoji and emoji sequences."""
+    out: list[str] = []
+    n = 0
+    while n < size:
+        parts = []
+        for _ in range(rng.randint(2, 8)):
+            r = rng.random()
+            if r < 0.45:
+                parts.append(rng.choice(_WORDS))
+            elif r < 0.85:
+                parts.append(rng.choice(_EMOJI) * rng.randint(1, 3))
+            else:
+                parts.append(rng.choice(_EMOJI_SEQUENCES))
+        message = " ".join(parts) + "\n"
+        out.append(message)
+        n += len(message.encode("utf-8"))
+    return "".join(out)
+
+
+def _unsplit(rng: random.Random, size: int) -> str:
+    """One long document without newlines (a single chunk for "none" models)."""
+    return _prose(rng, size, newlines=False)
+
+
+# name → (generator, document size in bytes for the latency measurement)
+CORPORA: dict[str, tuple[Callable[[random.Random, int], str], int]] = {
+    "prose": (_prose, 1 << 10),
+    "code": (_code, 1 << 10),
+    "cjk": (_cjk, 1 << 10),
+    "emoji": (_emoji, 1 << 10),
+    "unsplit": (_unsplit, 64 << 10),
+}
+
+
+def make_corpus(name: str, size: int, seed: int) -> str:
+    """Deterministic corpus of about ``size`` UTF-8 bytes."""
+    gen, _ = CORPORA[name]
+    return gen(random.Random(f"{seed}:{name}"), size)
+
+
+def split_documents(text: str, doc_size: int) -> list[str]:
+    """Cut text into documents of about ``doc_size`` characters.
+
+    Cuts go at the next whitespace if one is near, else (CJK, long words)
+    right at ``doc_size``.
+    """
+    docs = []
+    pos = 0
+    while pos < len(text):
+        end = pos + doc_size
+        for i in range(end, min(end + 64, len(text))):
+            if text[i].isspace():
+                end = i
+                break
+        docs.append(text[pos:end])
+        pos = end
+    return docs
+
+
+# ---------------------------------------------------------------------------
+# Measurement
+# ---------------------------------------------------------------------------
+
+
+def best_time(fn: Callable[[], object], repeat: int) -> float:
+    """Best wall time of ``repeat`` calls, after one warm-up call."""
+    fn()
+    best = float("inf")
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        fn()
+        best = min(best, time.perf_counter() - t0)
+    return best
+
+
+def throughput(n_bytes: int, n_tokens: int, seconds: float) -> dict[str, float]:
+    return {
+        "seconds": seconds,
+        "mb_s": n_bytes / seconds / 1e6,
+        "tokens_s": n_tokens / seconds,
+    }
+
+
+def latency(fn: Callable[[str], object], docs: list[str]) -> dict[str, float]:
+    """p50 / p99 / mean of ``fn(doc)`` in microseconds."""
+    for doc in docs[:8]:
+        fn(doc)
+    times = []
+    for doc in docs:
+        t0 = time.perf_counter_ns()
+        fn(doc)
+        times.append((time.perf_counter_ns() - t0) / 1e3)
+    times.sort()
+    return {
+        "docs": len(times),
+        "p50_us": times[len(times) // 2],
+        "p99_us": times[min(len(times) - 1, (len(times) * 99) // 100)],
+        "mean_us": statistics.fmean(times),
+    }
+
+
+def peak_rss_mb() -> float | None:
+    """Peak resident set size of this process, or None where unsupported."""
+    try:
+        import resource
+    except ImportError:
+        return None
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Bytes on macOS, KiB elsewhere
+    return rss / 1e6 if sys.platform == "darwin" else rss * 1024 / 1e6
+
+
+def bench_tinybpe(model: str, corpora: dict[str, str], repeat: int, stream_max: int) -> dict[str, Any]:
+    import array
+
+    from tinybpe import Tokenizer
+
+    # The child process is fresh, so this is a cold load of the model
+    rss_before = peak_rss_mb()
+    t0 = time.perf_counter()
+    tok = Tokenizer.from_pretrained(model)
+    load = time.perf_counter() - t0
+    result: dict[str, Any] = {
+        "load_s": load,
+        "rss_base_mb": rss_before,
+        "rss_after_load_mb": peak_rss_mb(),
+        "corpora": {},
+    }
+
+    for name, text in corpora.items():
+        n_bytes = len(text.encode("utf-8"))
+        ids = tok.encode(text)
+        n_tokens = len(ids)
+        ids_array = array.array("I", ids)
+        docs = split_documents(text, CORPORA[name][1])
+        stream_ids = ids[:stream_max]
+
+        def stream(stream_ids: list[int] = stream_ids) -> None:
+            dec = tok.stream_decoder(errors="replace")
+            push = dec.push
+            for i in stream_ids:
+                push(i)
+            dec.flush()
+
+        result["corpora"][name] = {
+            "bytes": n_bytes,
+            "tokens": n_tokens,
+            "bytes_per_token": n_bytes / max(n_tokens, 1),
+            "encode": throughput(n_bytes, n_tokens, best_time(lambda text=text: tok.encode(text), repeat)),
+            "count": throughput(n_bytes, n_tokens, best_time(lambda text=text: tok.count_tokens(text), repeat)),
+            "decode": throughput(n_bytes, n_tokens, best_time(lambda a=ids_array: tok.decode(a), repeat)),
+            "latency": latency(tok.encode, docs),
+            "stream": {
+                "tokens": len(stream_ids),
+                "tokens_s": len(stream_ids) / best_time(stream, max(1, repeat // 2)),
+            },
+        }
+
+    result["peak_rss_mb"] = peak_rss_mb()
+    return result
+
+
+def bench_tiktoken(model: str, corpora: dict[str, str], repeat: int) -> dict[str, Any] | None:
+    """The same encode / count / decode / latency numbers with tiktoken."""
+    try:
+        import tiktoken
+    except ImportError:
+        return None
+    try:
+        t0 = time.perf_counter()
+        enc = tiktoken.get_encoding(model)
+        load = time.perf_counter() - t0
+    except Exception as e:  # unknown encoding, no network for the ranks file, ...
+        return {"error": f"{type(e).__name__}: {e}"}
+
+    result: dict[str, Any] = {"version": tiktoken.__version__, "load_s": load, "corpora": {}}
+    for name, text in corpora.items():
+        n_bytes = len(text.encode("utf-8"))
+        ids = enc.encode(text, disallowed_special=())
+        docs = split_documents(text, CORPORA[name][1])
+
+        def encode(text: str) -> list[int]:
+            return enc.encode(text, disallowed_special=())
+
+        result["corpora"][name] = {
+            "tokens": len(ids),
+            "encode": throughput(n_bytes, len(ids), best_time(lambda text=text: encode(text), repeat)),
+            "count": throughput(n_bytes, len(ids), best_time(lambda text=text: len(encode(text)), repeat)),
+            "decode": throughput(n_bytes, len(ids), best_time(lambda ids=ids: enc.decode(ids), repeat)),
+            "latency": latency(encode, docs),
+        }
+    return result
+
+
+def _worker(model: str, args: dict[str, Any]) -> dict[str, Any]:
+    """One model in a fresh process, so load time and RSS are its own."""
+    import warnings
+
+    warnings.simplefilter("ignore")  # registry warnings about unusable special tokens
+    corpora = {name: make_corpus(name, args["size"], args["seed"]) for name in args["corpora"]}
+    result = bench_tinybpe(model, corpora, args["repeat"], args["stream_tokens"])
+    if args["tiktoken"]:
+        tk = bench_tiktoken(model, corpora, args["repeat"])
+        if tk is not None:
+            result["tiktoken"] = tk
+    return result
+
+
+# ---------------------------------------------------------------------------
+# Reporting
+# ---------------------------------------------------------------------------
+
+
+def metadata(args: argparse.Namespace) -> dict[str, Any]:
+    import tinybpe
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    try:
+        commit = subprocess.run(
+            ["git", "rev-parse", "HEAD"], cwd=here, capture_output=True, text=True, check=True
+        ).stdout.strip()
+        dirty = bool(
+            subprocess.run(
+                ["git", "status", "--porcelain", "--untracked-files=no"], cwd=here, capture_output=True, text=True
+            ).stdout.strip()
+        )
+    except (OSError, subprocess.CalledProcessError):
+        commit, dirty = None, None
+    return {
+        "tinybpe": tinybpe.__version__,
+        "commit": commit,
+        "dirty": dirty,
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(timespec="seconds"),
+        "python": platform.python_version(),
+        "platform": platform.platform(),
+        "machine": platform.machine(),
+        "cpu_count": os.cpu_count(),
+        "size": args.size,
+        "seed": args.seed,
+        "repeat": args.repeat,
+    }
+
+
+def print_table(results: dict[str, Any]) -> None:
+    header = (
+        f"{'model':<12} {'corpus':<8} {'tok/B':>6} {'enc MB/s':>9} {'Mtok/s':>7} {'cnt MB/s':>9} "
+        f"{'dec MB/s':>9} {'p50 us':>8} {'p99 us':>8} {'stream Mt/s':>11}"
+    )
+    print(header)
+    print("-" * len(header))
+    for model, r in results.items():
+        if "error" in r:
+            print(f"{model:<12} error: {r['error']}")
+            continue
+        for name, c in r["corpora"].items():
+            print(
+                f"{model:<12} {name:<8} {1 / c['bytes_per_token']:>6.3f} {c['encode']['mb_s']:>9.2f} "
+                f"{c['encode']['tokens_s'] / 1e6:>7.2f} {c['count']['mb_s']:>9.2f} {c['decode']['mb_s']:>9.1f} "
+                f"{c['latency']['p50_us']:>8.1f} {c['latency']['p99_us']:>8.1f} "
+                f"{c['stream']['tokens_s'] / 1e6:>11.2f}"
+            )
+            tk = r.get("tiktoken", {}).get("corpora", {}).get(name)
+            if tk:
+                print(
+                    f"{'  tiktoken':<12} {name:<8} {'':>6} {tk['encode']['mb_s']:>9.2f} "
+                    f"{tk['encode']['tokens_s'] / 1e6:>7.2f} {tk['count']['mb_s']:>9.2f} "
+                    f"{tk['decode']['mb_s']:>9.1f} {tk['latency']['p50_us']:>8.1f} {tk['latency']['p99_us']:>8.1f}"
+                )
+        print(f"{model:<12} load {r['load_s'] * 1e3:.1f} ms, peak RSS {r['peak_rss_mb'] or 0:.0f} MB")
+
+
+# (path in a corpus result, True if larger is better)
+_COMPARED = [
+    (("encode", "mb_s"), True),
+    (("count", "mb_s"), True),
+    (("decode", "mb_s"), True),
+    (("stream", "tokens_s"), True),
+    (("latency", "p50_us"), False),
+    (("latency", "p99_us"), False),
+]
+
+
+def print_comparison(results: dict[str, Any], meta: dict[str, Any], baseline: dict[str, Any]) -> None:
+    """Speedup of every metric over a baseline results file (>1 = better)."""
+    base = baseline["results"]
+    for key in ("size", "seed", "machine", "cpu_count"):
+        if baseline["meta"].get(key) != meta[key]:
+            print(f"\nWarning: baseline {key} is {baseline['meta'].get(key)!r}, this run {meta[key]!r}")
+    print(f"\nSpeedup vs {baseline['meta'].get('commit') or 'baseline'} (>1.00 is faster)")
+    print(f"{'model':<12} {'corpus':<8} " + " ".join(f"{'.'.join(k):>14}" for k, _ in _COMPARED))
+    for model, r in results.items():
+        if model not in base or "corpora" not in r or "corpora" not in base[model]:
+            continue
+        for name, c in r["corpora"].items():
+            old = base[model]["corpora"].get(name)
+            if old is None:
+                continue
+            cells = []
+            for (section, key), higher in _COMPARED:
+                new_v, old_v = c[section][key], old[section][key]
+                ratio = (new_v / old_v if higher else old_v / new_v) if new_v and old_v else float("nan")
+                cells.append(f"{ratio:>14.2f}")
+            print(f"{model:<12} {name:<8} " + " ".join(cells))
+        load_ratio = base[model]["load_s"] / r["load_s"]
+        rss_delta = (r["peak_rss_mb"] or 0) - (base[model].get("peak_rss_mb") or 0)
+        print(f"{model:<12} load {load_ratio:.2f}x, peak RSS {rss_delta:+.1f} MB")
+
+
+def main() -> None:
+    import warnings
+
+    warnings.simplefilter("ignore")  # registry warnings about unusable special tokens
+    from tinybpe import list_models
+
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--models", nargs="+", default=None, help="models to run (default: all built-in models)")
+    parser.add_argument("--corpora", nargs="+", default=list(CORPORA), choices=list(CORPORA))
+    parser.add_argument("--size", type=int, default=1 << 20, help="bytes per corpus (default: 1 MiB)")
+    parser.add_argument("--repeat", type=int, default=5, help="timed runs per measurement; the best is kept")
+    parser.add_argument("--seed", type=int, default=0, help="corpus seed")
+    parser.add_argument("--stream-tokens", type=int, default=100_000, help="tokens pushed in the stream test")
+    parser.add_argument("--no-tiktoken", action="store_true", help="skip tiktoken even when installed")
+    parser.add_argument("-o", "--output", help="write results to this JSON file")
+    parser.add_argument("--compare", help="earlier JSON results to compare against")
+    args = parser.parse_args()
+
+    models = args.models or list_models()
+    worker_args = {
+        "corpora": args.corpora,
+        "size": args.size,
+        "seed": args.seed,
+        "repeat": args.repeat,
+        "stream_tokens": args.stream_tokens,
+        "tiktoken": not args.no_tiktoken,
+    }
+
+    # A fresh process per model: load time is cold and peak RSS is the model's own
+    ctx = multiprocessing.get_context("spawn")
+    results: dict[str, Any] = {}
+    for model in models:
+        print(f"[{model}] ...", file=sys.stderr, flush=True)
+        with ctx.Pool(1) as pool:
+            try:
+                results[model] = pool.apply(_worker, (model, worker_args))
+            except Exception as e:  # a model file that fails to load
+                results[model] = {"error": f"{type(e).__name__}: {e}"}
+
+    print_table(results)
+    meta = metadata(args)
+    report = {"meta": meta, "results": results}
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+        print(f"\nResults written to {args.output}")
+    if args.compare:
+        with open(args.compare, encoding="utf-8") as f:
+            print_comparison(results, meta, json.load(f))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Generate ``src/bpe_unicode_tables.h`` — character classes for the native pre-tokenizer.
+
+The C scanner in ``src/bpe_pretokenize.c`` needs to know, for every
+codepoint, whether the ``regex`` module treats it as ``\\p{L}``,
+``\\p{N}`` or ``\\s``.  This script asks ``regex`` itself, so the native
+scanner splits text exactly like ``regex.findall`` with the pattern from
+``models/models.json`` — rerun it after upgrading ``regex`` to pick up a
+newer Unicode version.
+
+Usage::
+
+    python scripts/gen_unicode_tables.py            # writes src/bpe_unicode_tables.h
+    python scripts/gen_unicode_tables.py -o out.h
+
+Dependencies: ``regex`` (already a runtime dependency).
+"""
+
+from __future__ import annotations
+
+import argparse
+from pathlib import Path
+
+import regex
+
+# Must match enum bpe_char_class in src/bpe_pretokenize.c
+CLASS_OTHER = 0
+CLASS_LETTER = 1
+CLASS_NUMBER = 2
+CLASS_SPACE = 3
+
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+N_CODEPOINTS = 0x110000
+
+
+def _classify() -> bytearray:
+    """Return one class byte per codepoint (surrogates are CLASS_OTHER)."""
+    letter = regex.compile(r"\p{L}")
+    number = regex.compile(r"\p{N}")
+    space = regex.compile(r"\s")
+
+    classes = bytearray(N_CODEPOINTS)
+    for cp in range(N_CODEPOINTS):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        ch = chr(cp)
+        if letter.match(ch):
+            classes[cp] = CLASS_LETTER
+        elif number.match(ch):
+            classes[cp] = CLASS_NUMBER
+        elif space.match(ch):
+            classes[cp] = CLASS_SPACE
+    return classes
+
+
+def _format_rows(values: bytes | list[int], per_line: int = 32) -> str:
+    """Format integers as comma-separated C initializer lines."""
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ",".join(str(v) for v in values[i : i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def generate() -> str:
+    """Build the two-stage lookup table and return the header text."""
+    classes = _classify()
+
+    # Stage 2: deduplicated 256-codepoint blocks; stage 1: block index per block.
+    blocks: list[bytes] = []
+    block_index: dict[bytes, int] = {}
+    stage1: list[int] = []
+    for start in range(0, N_CODEPOINTS, BLOCK_SIZE):
+        block = bytes(classes[start : start + BLOCK_SIZE])
+        if block not in block_index:
+            block_index[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(block_index[block])
+    assert len(blocks) <= 256, "stage-1 entries no longer fit in uint8_t"
+
+    stage2 = b"".join(blocks)
+    return f"""/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * GENERATED by scripts/gen_unicode_tables.py from the `regex` module
+ * (version {regex.__version__}) — do not edit by hand.
+ *
+ * Two-stage codepoint → character-class table for bpe_pretokenize.c:
+ *   class = bpe_ucd_stage2[bpe_ucd_stage1[cp >> {BLOCK_SHIFT}] * {BLOCK_SIZE} + (cp & {BLOCK_SIZE - 1})]
+ *
+ * Classes: 0 = other, 1 = \\p{{L}}, 2 = \\p{{N}}, 3 = \\s.
+ */
+
+#ifndef SRC_BPE_UNICODE_TABLES_H
+#define SRC_BPE_UNICODE_TABLES_H
+
+#include <stdint.h>
+
+#define BPE_UCD_BLOCK_SHIFT {BLOCK_SHIFT}
+#define BPE_UCD_BLOCK_MASK {BLOCK_SIZE - 1}
+
+static const uint8_t bpe_ucd_stage1[{len(stage1)}] = {{
+{_format_rows(stage1)}
+}};
+
+static const uint8_t bpe_ucd_stage2[{len(stage2)}] = {{
+{_format_rows(stage2, per_line=64)}
+}};
+
+#endif  /* SRC_BPE_UNICODE_TABLES_H */
+"""
+
+
+def main() -> None:
+    """CLI entry point."""
+    default_out = Path(__file__).resolve().parent.parent / "src" / "bpe_unicode_tables.h"
+    parser = argparse.ArgumentParser(description="Generate Unicode class tables for the native pre-tokenizer.")
+    parser.add_argument("-o", "--output", default=str(default_out), help="Output header path.")
+    args = parser.parse_args()
+
+    Path(args.output).write_text(generate(), encoding="utf-8")
+    print(f"Wrote {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -15,18 +15,36 @@ ext_modules = [
             "src/bpe_common.c",
             "src/bpe_trainer.c",
             "src/bpe_tokenizer.c",
+            "src/bpe_image.c",
+            "src/bpe_cache.c",
+            "src/bpe_thread.c",
+            "src/bpe_pretokenize.c",
+            "src/bpe_special.c",
+            "src/bpe_store.c",
+            "src/bpe_ingest.c",
         ],
         depends=[
             "src/_tree_core.h",
             "src/bpe_common.h",
             "src/bpe_trainer.h",
             "src/bpe_tokenizer.h",
+            "src/bpe_image.h",
+            "src/bpe_cache.h",
+            "src/bpe_thread.h",
+            "src/bpe_pretokenize.h",
+            "src/bpe_special.h",
+            "src/bpe_store.h",
+            "src/bpe_ingest.h",
+            "src/bpe_unicode_tables.h",
         ],
         # NB: on 64-bit Windows, sys.platform is "win32" (historical).
         # MSVC uses /W* flags instead of -W*, so pass nothing here.
         extra_compile_args={
             "win32": [],
-        }.get(sys.platform, ["-Wall", "-Wextra", "-std=c99"]),
+        }.get(sys.platform, ["-Wall", "-Wextra", "-std=c99", "-pthread"]),
+        extra_link_args={
+            "win32": [],
+        }.get(sys.platform, ["-pthread"]),
     )
 ]
 
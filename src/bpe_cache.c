@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Bounded chunk → token IDs cache — see bpe_cache.h.
+ */
+
+#include "bpe_cache.h"
+#include "bpe_thread.h"
+#include <string.h>
+
+/* LRU list terminator. */
+#define CACHE_NIL UINT32_MAX
+
+/* --------------------------------------------------------------------------
+ * One cached chunk: 64 bytes, key and IDs inline.
+ * -------------------------------------------------------------------------- */
+struct cache_entry {
+    uint64_t hash;
+    uint32_t prev, next;                    /* LRU neighbours (MRU first) */
+    bpe_id_t ids[BPE_CACHE_IDS_MAX];
+    unsigned char key_len;
+    unsigned char n_ids;
+    unsigned char key[BPE_CACHE_KEY_MAX];
+};
+
+/* --------------------------------------------------------------------------
+ * A shard: fixed entry pool, linear-probing index of entry numbers and an
+ * exact LRU list, all guarded by `lock`.
+ * -------------------------------------------------------------------------- */
+struct cache_shard {
+    bpe_mutex_t *lock;
+    struct cache_entry *entries;  /* `capacity` records                */
+    uint32_t *index;              /* entry + 1 per slot, 0 = empty     */
+    size_t mask;                  /* index slots - 1                   */
+    uint32_t capacity;
+    uint32_t size;                /* entries in use: [0, size)         */
+    uint32_t head, tail;          /* most / least recently used        */
+    uint64_t hits, misses;
+};
+
+struct bpe_cache {
+    struct cache_shard *shards;
+    unsigned int n_shards;        /* power of two                       */
+    size_t capacity;
+};
+
+/* FNV-1a plus a 64-bit finalizer: plain FNV barely changes its top bits
+ * when only the last bytes differ.  The top bits pick the shard, the low
+ * bits the index slot. */
+static uint64_t cache_hash(const unsigned char *key, size_t len) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ key[i]) * UINT64_C(0x100000001b3);
+    }
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return h;
+}
+
+static struct cache_shard *cache_shard_of(struct bpe_cache *cache,
+                                          uint64_t hash) {
+    return &cache->shards[(hash >> 58) & (cache->n_shards - 1)];
+}
+
+/* ==========================================================================
+ * Shard internals (caller holds the shard lock)
+ * ========================================================================== */
+
+/* Index slot holding the entry for key, or the empty slot ending its probe. */
+static size_t shard_find_slot(const struct cache_shard *sh, uint64_t hash,
+                              const unsigned char *key, size_t len) {
+    size_t i = (size_t)hash & sh->mask;
+    for (;;) {
+        uint32_t v = sh->index[i];
+        if (v == 0) {
+            return i;
+        }
+        const struct cache_entry *e = &sh->entries[v - 1];
+        if (e->hash == hash && e->key_len == len
+            && memcmp(e->key, key, len) == 0) {
+            return i;
+        }
+        i = (i + 1) & sh->mask;
+    }
+}
+
+/* Remove entry `e` from the index, shifting later probe members back so
+ * no tombstones are needed. */
+static void shard_index_remove(struct cache_shard *sh, uint32_t e) {
+    size_t i = (size_t)sh->entries[e].hash & sh->mask;
+    while (sh->index[i] != e + 1) {
+        i = (i + 1) & sh->mask;
+    }
+
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & sh->mask;
+        uint32_t v = sh->index[j];
+        if (v == 0) {
+            break;
+        }
+        /* Move v into the hole unless its home slot lies in (i, j] */
+        size_t home = (size_t)sh->entries[v - 1].hash & sh->mask;
+        int in_range = (i <= j) ? (home > i && home <= j)
+                                : (home > i || home <= j);
+        if (!in_range) {
+            sh->index[i] = v;
+            i = j;
+        }
+    }
+    sh->index[i] = 0;
+}
+
+static void shard_unlink(struct cache_shard *sh, uint32_t e) {
+    struct cache_entry *en = &sh->entries[e];
+    if (en->prev != CACHE_NIL) {
+        sh->entries[en->prev].next = en->next;
+    }
+    else {
+        sh->head = en->next;
+    }
+    if (en->next != CACHE_NIL) {
+        sh->entries[en->next].prev = en->prev;
+    }
+    else {
+        sh->tail = en->prev;
+    }
+}
+
+static void shard_push_front(struct cache_shard *sh, uint32_t e) {
+    struct cache_entry *en = &sh->entries[e];
+    en->prev = CACHE_NIL;
+    en->next = sh->head;
+    if (sh->head != CACHE_NIL) {
+        sh->entries[sh->head].prev = e;
+    }
+    sh->head = e;
+    if (sh->tail == CACHE_NIL) {
+        sh->tail = e;
+    }
+}
+
+static void shard_reset(struct cache_shard *sh) {
+    memset(sh->index, 0, (sh->mask + 1) * sizeof(uint32_t));
+    sh->size = 0;
+    sh->head = sh->tail = CACHE_NIL;
+    sh->hits = sh->misses = 0;
+}
+
+/* ==========================================================================
+ * Public API
+ * ========================================================================== */
+
+struct bpe_cache *bpe_cache_new(size_t capacity) {
+    if (capacity == 0 || capacity >= UINT32_MAX) {
+        return NULL;
+    }
+
+    unsigned int n_shards = 1;
+    while (n_shards * 2 <= BPE_CACHE_SHARDS && n_shards * 2 <= capacity) {
+        n_shards *= 2;
+    }
+
+    struct bpe_cache *cache = bpe_malloc(sizeof(struct bpe_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->n_shards = n_shards;
+    cache->capacity = capacity;
+    cache->shards = bpe_malloc(n_shards * sizeof(struct cache_shard));
+    if (cache->shards == NULL) {
+        bpe_free(cache);
+        return NULL;
+    }
+    memset(cache->shards, 0, n_shards * sizeof(struct cache_shard));
+
+    for (unsigned int s = 0; s < n_shards; s++) {
+        struct cache_shard *sh = &cache->shards[s];
+        sh->capacity = (uint32_t)(capacity / n_shards
+                                  + (s < capacity % n_shards));
+
+        size_t slots = 4;
+        while (slots < (size_t)sh->capacity * 2) {
+            slots *= 2;
+        }
+        sh->mask = slots - 1;
+        sh->lock = bpe_mutex_new();
+        sh->entries = bpe_malloc(sh->capacity * sizeof(struct cache_entry));
+        sh->index = bpe_malloc(slots * sizeof(uint32_t));
+        if (sh->lock == NULL || sh->entries == NULL || sh->index == NULL) {
+            bpe_cache_free(cache);
+            return NULL;
+        }
+        shard_reset(sh);
+    }
+    return cache;
+}
+
+void bpe_cache_free(struct bpe_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (unsigned int s = 0; s < cache->n_shards; s++) {
+        bpe_mutex_free(cache->shards[s].lock);
+        bpe_free(cache->shards[s].entries);
+        bpe_free(cache->shards[s].index);
+    }
+    bpe_free(cache->shards);
+    bpe_free(cache);
+}
+
+size_t bpe_cache_get(struct bpe_cache *cache, const unsigned char *key,
+                     size_t key_len, bpe_id_t *out) {
+    if (key_len == 0 || key_len > BPE_CACHE_KEY_MAX) {
+        return 0;
+    }
+    uint64_t hash = cache_hash(key, key_len);
+    struct cache_shard *sh = cache_shard_of(cache, hash);
+    size_t n = 0;
+
+    bpe_mutex_lock(sh->lock);
+    uint32_t v = sh->index[shard_find_slot(sh, hash, key, key_len)];
+    if (v != 0) {
+        uint32_t e = v - 1;
+        const struct cache_entry *en = &sh->entries[e];
+        n = en->n_ids;
+        memcpy(out, en->ids, n * sizeof(bpe_id_t));
+        if (sh->head != e) {
+            shard_unlink(sh, e);
+            shard_push_front(sh, e);
+        }
+        sh->hits++;
+    }
+    else {
+        sh->misses++;
+    }
+    bpe_mutex_unlock(sh->lock);
+    return n;
+}
+
+void bpe_cache_put(struct bpe_cache *cache, const unsigned char *key,
+                   size_t key_len, const bpe_id_t *ids, size_t n_ids) {
+    if (key_len == 0 || key_len > BPE_CACHE_KEY_MAX
+        || n_ids == 0 || n_ids > BPE_CACHE_IDS_MAX) {
+        return;
+    }
+    uint64_t hash = cache_hash(key, key_len);
+    struct cache_shard *sh = cache_shard_of(cache, hash);
+
+    bpe_mutex_lock(sh->lock);
+    size_t slot = shard_find_slot(sh, hash, key, key_len);
+    if (sh->index[slot] != 0) {
+        /* Another thread inserted it since our miss */
+        bpe_mutex_unlock(sh->lock);
+        return;
+    }
+
+    uint32_t e;
+    if (sh->size < sh->capacity) {
+        e = sh->size++;
+    }
+    else {
+        /* Evict the least recently used entry and re-probe: removing it
+         * may have shifted the slot we found */
+        e = sh->tail;
+        shard_unlink(sh, e);
+        shard_index_remove(sh, e);
+        slot = shard_find_slot(sh, hash, key, key_len);
+    }
+
+    struct cache_entry *en = &sh->entries[e];
+    en->hash = hash;
+    en->key_len = (unsigned char)key_len;
+    en->n_ids = (unsigned char)n_ids;
+    memcpy(en->key, key, key_len);
+    memcpy(en->ids, ids, n_ids * sizeof(bpe_id_t));
+    sh->index[slot] = e + 1;
+    shard_push_front(sh, e);
+    bpe_mutex_unlock(sh->lock);
+}
+
+void bpe_cache_stats(struct bpe_cache *cache, uint64_t *hits,
+                     uint64_t *misses, size_t *size, size_t *capacity) {
+    uint64_t h = 0, m = 0;
+    size_t n = 0;
+
+    for (unsigned int s = 0; s < cache->n_shards; s++) {
+        struct cache_shard *sh = &cache->shards[s];
+        bpe_mutex_lock(sh->lock);
+        h += sh->hits;
+        m += sh->misses;
+        n += sh->size;
+        bpe_mutex_unlock(sh->lock);
+    }
+    if (hits) {
+        *hits = h;
+    }
+    if (misses) {
+        *misses = m;
+    }
+    if (size) {
+        *size = n;
+    }
+    if (capacity) {
+        *capacity = cache->capacity;
+    }
+}
+
+void bpe_cache_clear(struct bpe_cache *cache) {
+    for (unsigned int s = 0; s < cache->n_shards; s++) {
+        struct cache_shard *sh = &cache->shards[s];
+        bpe_mutex_lock(sh->lock);
+        shard_reset(sh);
+        bpe_mutex_unlock(sh->lock);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Bounded chunk → token IDs cache for the encoder.
+ *
+ * Pre-tokenized text repeats the same short chunks (" the", ",", " and")
+ * over and over, and each occurrence would otherwise re-run the whole
+ * merge loop.  The cache maps a chunk's bytes (as seen by BPE, i.e.
+ * after any byte remap) to the IDs it encodes to.
+ *
+ * ## Design
+ *
+ * Entries are fixed 64-byte records holding the key and the IDs inline,
+ * so only chunks of at most BPE_CACHE_KEY_MAX bytes that encode to at
+ * most BPE_CACHE_IDS_MAX IDs are cached — which covers the words that
+ * dominate real text.  A lookup hashes the key once (FNV-1a), probes an
+ * open-addressing index of entry numbers and compares one record.
+ *
+ * The cache is split into up to BPE_CACHE_SHARDS independent shards,
+ * chosen by the key hash, each with its own mutex, exact LRU list and
+ * hit/miss counters.  Encoder threads running without the GIL therefore
+ * rarely contend.  When a shard is full, inserting evicts its least
+ * recently used entry.
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It is pure C99 plus the
+ * bpe_thread mutex.
+ */
+
+#ifndef SRC_BPE_CACHE_H
+#define SRC_BPE_CACHE_H
+
+#include "bpe_common.h"
+
+/* Longest cacheable chunk, in bytes. */
+#define BPE_CACHE_KEY_MAX 22
+/* Most IDs a cached chunk may encode to. */
+#define BPE_CACHE_IDS_MAX 5
+/* Upper bound on the number of independently locked shards. */
+#define BPE_CACHE_SHARDS 16
+
+struct bpe_cache;
+
+/* --------------------------------------------------------------------------
+ * Create a cache holding at most `capacity` entries (capacity ≥ 1, at
+ * most UINT32_MAX - 1).  Returns NULL on allocation failure.
+ * -------------------------------------------------------------------------- */
+struct bpe_cache *bpe_cache_new(size_t capacity);
+
+/* --------------------------------------------------------------------------
+ * Free a cache.  Safe to call with NULL.
+ * -------------------------------------------------------------------------- */
+void bpe_cache_free(struct bpe_cache *cache);
+
+/* --------------------------------------------------------------------------
+ * Look up a chunk.  On a hit, copies its IDs to out[] (room for
+ * BPE_CACHE_IDS_MAX) and returns their number; on a miss returns 0.
+ * Keys longer than BPE_CACHE_KEY_MAX always miss without being counted.
+ * Thread-safe.
+ * -------------------------------------------------------------------------- */
+size_t bpe_cache_get(struct bpe_cache *cache, const unsigned char *key,
+                     size_t key_len, bpe_id_t *out);
+
+/* --------------------------------------------------------------------------
+ * Insert a chunk's IDs, evicting the shard's least recently used entry
+ * if it is full.  Ignored if the key or the ID list is too long to cache,
+ * or the key is already present.  Thread-safe.
+ * -------------------------------------------------------------------------- */
+void bpe_cache_put(struct bpe_cache *cache, const unsigned char *key,
+                   size_t key_len, const bpe_id_t *ids, size_t n_ids);
+
+/* --------------------------------------------------------------------------
+ * Counters summed over all shards.  Any output pointer may be NULL.
+ * -------------------------------------------------------------------------- */
+void bpe_cache_stats(struct bpe_cache *cache, uint64_t *hits,
+                     uint64_t *misses, size_t *size, size_t *capacity);
+
+/* --------------------------------------------------------------------------
+ * Drop every entry and reset the counters.
+ * -------------------------------------------------------------------------- */
+void bpe_cache_clear(struct bpe_cache *cache);
+
+#endif  /* SRC_BPE_CACHE_H */
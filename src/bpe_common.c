@@ -5,8 +5,10 @@
  * Common utilities: merge pair validation and Python-aware memory management.
  *
  * This is one of only two files (along with bpe_module.c) that include
- * <Python.h>.  The memory allocator uses PyMem_Malloc / PyMem_Free so
- * Python's garbage collector can account for C-level allocations.
+ * <Python.h>.  The memory allocator uses the PyMem_Raw* family so
+ * Python's memory tracing (tracemalloc) accounts for C-level
+ * allocations, while encode/decode and the worker pool can still
+ * allocate with the GIL released.
  *
  * In an embedded / non-Python context, replace bpe_malloc / bpe_free
  * with wrappers around the platform's malloc / free — all other C files
@@ -48,7 +50,7 @@ static int pair_cmp_func(struct avl_node *a, struct avl_node *b) {
  * -------------------------------------------------------------------------- */
 int bpe_check(const bpe_pair_t *pairs, size_t len) {
     /* Phase 1: reachability */
-    unsigned long max_id = 256;
+    size_t max_id = 256;
     for (size_t i = 0; i < len; i++) {
         if (pairs[i].left >= max_id || pairs[i].right >= max_id) {
             return 0;
@@ -78,15 +80,29 @@ int bpe_check(const bpe_pair_t *pairs, size_t len) {
 }
 
 /* --------------------------------------------------------------------------
- * Allocate memory via PyMem_Malloc.
+ * Allocate memory via PyMem_RawMalloc.
  *
- * PyMem_Malloc is a thin wrapper around the platform allocator that
- * Python's GC can track.  On failure, PyErr_NoMemory() sets a Python
- * MemoryError so the caller can simply return NULL.
+ * Unlike PyMem_Malloc, the raw allocator is safe to call without holding
+ * the GIL.  On failure, PyErr_NoMemory() sets a Python MemoryError so the
+ * caller can simply return NULL — but only when the calling thread holds
+ * the GIL.  GIL-free callers see a bare NULL and must raise MemoryError
+ * themselves once they re-acquire it.
  * -------------------------------------------------------------------------- */
 void *bpe_malloc(size_t size) {
-    void *p = PyMem_Malloc(size);
-    if (p == NULL) {
+    void *p = PyMem_RawMalloc(size);
+    if (p == NULL && PyGILState_Check()) {
+        PyErr_NoMemory();
+    }
+    return p;
+}
+
+/* --------------------------------------------------------------------------
+ * Resize memory via PyMem_RawRealloc.  Same error contract as
+ * bpe_malloc(); the original block stays valid on failure.
+ * -------------------------------------------------------------------------- */
+void *bpe_realloc(void *ptr, size_t size) {
+    void *p = PyMem_RawRealloc(ptr, size);
+    if (p == NULL && PyGILState_Check()) {
         PyErr_NoMemory();
     }
     return p;
@@ -98,6 +114,6 @@ void *bpe_malloc(size_t size) {
  * -------------------------------------------------------------------------- */
 void bpe_free(void *ptr) {
     if (ptr) {
-        PyMem_Free(ptr);
+        PyMem_RawFree(ptr);
     }
 }
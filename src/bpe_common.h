@@ -5,11 +5,13 @@
  * Common types and utilities shared across the BPE trainer and tokenizer.
  *
  * This module provides:
+ *   - bpe_id_t    — a token ID (32 bits)
  *   - bpe_pair_t  — a BPE merge pair (left_id, right_id) → new_id
  *   - bpe_piece_t — a training chunk (sequence of token IDs)
  *   - bpe_check() — validates a merge pair sequence
- *   - bpe_malloc() / bpe_free() — memory management (wraps PyMem)
+ *   - bpe_malloc() / bpe_realloc() / bpe_free() — memory management (wraps PyMem_Raw)
  *   - bpe_pair_cmp() — lexicographic pair comparison
+ *   - bpe_pair_key() / bpe_pair_hash() — pair hashing for flat tables
  *   - bpe_utf8_length_from_head() — UTF-8 leading-byte decoder
  *
  * Design note:
@@ -23,6 +25,17 @@
 
 #include "_tree_core.h"
 
+/* --------------------------------------------------------------------------
+ * Token ID.
+ *
+ * 32 bits hold any vocabulary (the largest shipped model, llama4, has
+ * about 440k tokens) at half the memory traffic of unsigned long in the
+ * encode and training loops.  BPE_ID_MAX is never a valid ID: it marks
+ * "no merge" (BPE_RANK_NONE) and out-of-range input.
+ * -------------------------------------------------------------------------- */
+typedef uint32_t bpe_id_t;
+#define BPE_ID_MAX UINT32_MAX
+
 /* --------------------------------------------------------------------------
  * BPE merge pair: (left_token_id, right_token_id)
  *
@@ -31,20 +44,24 @@
  * the time this merge is applied (IDs 0-255 for base bytes, then
  * sequential for each new token).  -------------------------------------------------------------------------- */
 struct bpe_pair_s {
-    unsigned long left;
-    unsigned long right;
+    bpe_id_t left;
+    bpe_id_t right;
 };
 
 /* --------------------------------------------------------------------------
  * Training piece: a mutable sequence of token IDs.
  *
- * Represents one chunk of the training corpus (e.g. one regex-split
- * segment or one line of text).  During training, adjacent pairs are
- * merged in-place — the `len` shrinks and `ids` is compacted.
+ * Represents one distinct chunk of the training corpus (e.g. one
+ * regex-split word) together with how many times it occurs.  The IDs
+ * live in the trainer's shared token arena, starting at `start`.
+ * During training, adjacent pairs are merged in-place — the `len`
+ * shrinks and the IDs are compacted — and every pair counts `count`
+ * times.
  * -------------------------------------------------------------------------- */
 struct bpe_piece_s {
-    unsigned long *ids;  /* dynamically allocated token ID sequence */
+    size_t start;        /* offset of the first token ID in the arena */
     size_t len;          /* current length (shrinks as merges apply)  */
+    uint64_t count;      /* occurrences of this piece in the corpus   */
 };
 
 typedef struct bpe_pair_s bpe_pair_t;
@@ -120,13 +137,42 @@ static inline int bpe_pair_cmp(const bpe_pair_t *p1, const bpe_pair_t *p2) {
 }
 
 /* --------------------------------------------------------------------------
- * Allocate memory using Python's PyMem_Malloc.
+ * Pack a merge pair into a single 64-bit hash key.
+ *
+ * Token IDs are bounded by the vocabulary size, which always fits in
+ * 32 bits, so (left, right) maps to a unique 64-bit integer.
+ * -------------------------------------------------------------------------- */
+static inline uint64_t bpe_pair_key(bpe_id_t left, bpe_id_t right) {
+    return ((uint64_t)left << 32) | (uint64_t)right;
+}
+
+/* --------------------------------------------------------------------------
+ * Fibonacci hashing of a packed pair key.
  *
- * Raises a Python MemoryError (via PyErr_NoMemory) on failure.
- * In the C extension context this integrates with Python's GC tracking.
+ * Multiplies by 2^64 / φ and keeps the top `bits` bits, which spreads
+ * consecutive token IDs evenly over a power-of-two table.
+ * -------------------------------------------------------------------------- */
+static inline size_t bpe_pair_hash(uint64_t key, unsigned int bits) {
+    return (size_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits));
+}
+
+/* --------------------------------------------------------------------------
+ * Allocate memory using Python's PyMem_RawMalloc.
+ *
+ * Safe to call with or without the GIL.  On failure returns NULL, and
+ * raises a Python MemoryError (via PyErr_NoMemory) if the calling thread
+ * holds the GIL.
  * -------------------------------------------------------------------------- */
 void *bpe_malloc(size_t size);
 
+/* --------------------------------------------------------------------------
+ * Resize a block allocated by bpe_malloc() (PyMem_RawRealloc semantics).
+ *
+ * On failure the original block is left untouched and NULL is returned
+ * (with MemoryError raised when the GIL is held, as for bpe_malloc).
+ * -------------------------------------------------------------------------- */
+void *bpe_realloc(void *ptr, size_t size);
+
 /* --------------------------------------------------------------------------
  * Free memory allocated by bpe_malloc().
  * No-op if ptr is NULL.
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Binary model image (.tbmb) — see bpe_image.h.
+ */
+
+#include "bpe_image.h"
+#include <string.h>
+
+/* Round n up to the section alignment. */
+static size_t image_align(size_t n) {
+    return (n + (BPE_IMAGE_ALIGN - 1)) & ~(size_t)(BPE_IMAGE_ALIGN - 1);
+}
+
+/* --------------------------------------------------------------------------
+ * Section placement shared by bpe_image_size() and bpe_image_write().
+ * -------------------------------------------------------------------------- */
+static void image_layout(const struct bpe_merges *merges,
+                         const struct bpe_vocab *vocab,
+                         struct bpe_image_header *h) {
+    size_t table_size = (merges->mask + 1) * sizeof(struct bpe_merges_entry);
+    size_t offsets_size = (vocab->vocab_size + 1) * sizeof(uint64_t);
+
+    h->table_offset = image_align(sizeof(struct bpe_image_header));
+    h->offsets_offset = image_align((size_t)h->table_offset + table_size);
+    h->bytes_offset = image_align((size_t)h->offsets_offset + offsets_size);
+    h->bytes_size = vocab->offsets[vocab->vocab_size];
+}
+
+size_t bpe_image_size(const struct bpe_merges *merges,
+                      const struct bpe_vocab *vocab) {
+    struct bpe_image_header h;
+    image_layout(merges, vocab, &h);
+    return (size_t)(h.bytes_offset + h.bytes_size);
+}
+
+/* --------------------------------------------------------------------------
+ * Write the header and the three sections; padding is zero-filled so the
+ * output is deterministic.  Everything goes through memcpy, so dst needs
+ * no particular alignment.
+ * -------------------------------------------------------------------------- */
+void bpe_image_write(void *dst, const struct bpe_merges *merges,
+                     const struct bpe_vocab *vocab,
+                     const unsigned char *remap) {
+    unsigned char *out = dst;
+    struct bpe_image_header h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BPE_IMAGE_MAGIC, sizeof(h.magic));
+    h.version = BPE_IMAGE_VERSION;
+    h.byte_order = BPE_IMAGE_BYTE_ORDER;
+    h.n_merges = vocab->vocab_size - 256;
+    h.table_bits = merges->bits;
+    if (remap) {
+        h.has_remap = 1;
+        memcpy(h.remap, remap, sizeof(h.remap));
+    }
+    image_layout(merges, vocab, &h);
+
+    size_t size = (size_t)(h.bytes_offset + h.bytes_size);
+    memset(out, 0, size);
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + h.table_offset, merges->table,
+           (merges->mask + 1) * sizeof(struct bpe_merges_entry));
+    memcpy(out + h.offsets_offset, vocab->offsets,
+           (vocab->vocab_size + 1) * sizeof(uint64_t));
+    memcpy(out + h.bytes_offset, vocab->bytes, (size_t)h.bytes_size);
+}
+
+/* Does [offset, offset + len) lie inside an image of `size` bytes? */
+static int section_fits(uint64_t offset, uint64_t len, size_t size) {
+    return offset % 8 == 0 && offset <= size && len <= size - offset;
+}
+
+/* --------------------------------------------------------------------------
+ * Header checks first, then one sequential pass over each table: the
+ * merges table must hold exactly n_merges entries with in-range ranks
+ * (so lookups always reach an empty slot), and the vocab offsets must be
+ * monotonic and end at bytes_size.
+ * -------------------------------------------------------------------------- */
+enum bpe_image_status bpe_image_open(const void *image, size_t size,
+                                     struct bpe_merges *merges,
+                                     struct bpe_vocab *vocab) {
+    const unsigned char *base = image;
+    const struct bpe_image_header *h = image;
+
+    if (size < sizeof(*h) || memcmp(base, BPE_IMAGE_MAGIC, 8) != 0) {
+        return BPE_IMAGE_BAD_MAGIC;
+    }
+    if ((uintptr_t)image % 8 != 0) {
+        return BPE_IMAGE_BAD_ALIGNMENT;
+    }
+    if (h->byte_order != BPE_IMAGE_BYTE_ORDER) {
+        return BPE_IMAGE_BAD_BYTE_ORDER;
+    }
+    if (h->version > BPE_IMAGE_VERSION) {
+        return BPE_IMAGE_BAD_VERSION;
+    }
+
+    /* Ranks are 32-bit; the table must keep its load factor ≤ 0.5 */
+    if (h->n_merges == 0 || h->n_merges > UINT32_MAX - 256
+        || h->table_bits < 4 || h->table_bits > 40
+        || ((uint64_t)1 << h->table_bits) < h->n_merges * 2) {
+        return BPE_IMAGE_CORRUPT;
+    }
+    uint64_t capacity = (uint64_t)1 << h->table_bits;
+    uint64_t vocab_size = 256 + h->n_merges;
+    if (!section_fits(h->table_offset,
+                      capacity * sizeof(struct bpe_merges_entry), size)
+        || !section_fits(h->offsets_offset,
+                         (vocab_size + 1) * sizeof(uint64_t), size)
+        || h->bytes_offset > size || h->bytes_size > size - h->bytes_offset) {
+        return BPE_IMAGE_CORRUPT;
+    }
+
+    const struct bpe_merges_entry *table =
+        (const struct bpe_merges_entry *)(base + h->table_offset);
+    uint64_t occupied = 0;
+    for (uint64_t i = 0; i < capacity; i++) {
+        uint32_t rank = table[i].rank;
+        if (rank != 0) {
+            if (rank < 256 || rank >= vocab_size) {
+                return BPE_IMAGE_CORRUPT;
+            }
+            occupied++;
+        }
+    }
+    if (occupied != h->n_merges) {
+        return BPE_IMAGE_CORRUPT;
+    }
+
+    const uint64_t *offsets = (const uint64_t *)(base + h->offsets_offset);
+    if (offsets[0] != 0 || offsets[vocab_size] != h->bytes_size) {
+        return BPE_IMAGE_CORRUPT;
+    }
+    for (uint64_t i = 0; i < vocab_size; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return BPE_IMAGE_CORRUPT;
+        }
+    }
+
+    merges->table = table;
+    merges->bits = h->table_bits;
+    merges->mask = (size_t)(capacity - 1);
+    merges->n_merges = (size_t)h->n_merges;
+    merges->mem = NULL;
+
+    vocab->offsets = offsets;
+    vocab->bytes = base + h->bytes_offset;
+    vocab->vocab_size = (size_t)vocab_size;
+    /* Wide reads must stay inside the image */
+    uint64_t readable = size - h->bytes_offset;
+    vocab->wide_end = readable >= BPE_DECODE_WIDE
+                          ? readable - BPE_DECODE_WIDE + 1 : 0;
+    vocab->mem = NULL;
+    return BPE_IMAGE_OK;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Binary model image (.tbmb) — a tokenizer's lookup tables, ready to use
+ * in place.
+ *
+ * A `.tbm` file stores only the merge list, so every load rebuilds the
+ * merges hash table and the vocabulary.  An image stores the finished
+ * structures instead, in exactly the layout bpe_merges and bpe_vocab
+ * use in memory.  Opening one is a handful of header checks: the
+ * returned structs point straight into the caller's buffer, typically a
+ * read-only mmap of the file, whose pages the OS shares between every
+ * process that maps it (including forked workers).
+ *
+ * ## Layout (native byte order, sections 64-byte aligned)
+ *
+ *   offset  size
+ *        0     8  magic "TinyBPEB"
+ *        8     4  version (BPE_IMAGE_VERSION)
+ *       12     4  byte-order mark 0x01020304
+ *       16     8  n_merges
+ *       24     4  table_bits — log2 of the merges table capacity
+ *       28     4  has_remap  — 1 if remap[] holds a byte permutation
+ *       32     8  table_offset   → struct bpe_merges_entry[2^table_bits]
+ *       40     8  offsets_offset → uint64_t[256 + n_merges + 1]
+ *       48     8  bytes_offset   → token bytes
+ *       56     8  bytes_size
+ *       64   256  remap[256]
+ *
+ * The byte remap is not used by the C core; it travels with the image so
+ * a file holds a complete model, like `.tbm`.
+ *
+ * ## Trust
+ *
+ * bpe_image_open() checks the header, the section bounds and the vocab
+ * offsets (so decoding never reads outside the image) but not the merges
+ * table entries: an image is trusted to have been written by
+ * bpe_image_write().
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It is pure C99.
+ */
+
+#ifndef SRC_BPE_IMAGE_H
+#define SRC_BPE_IMAGE_H
+
+#include "bpe_tokenizer.h"
+
+#define BPE_IMAGE_MAGIC "TinyBPEB"
+#define BPE_IMAGE_VERSION 1
+#define BPE_IMAGE_BYTE_ORDER 0x01020304u
+#define BPE_IMAGE_ALIGN 64
+
+/* Fixed-size image header (320 bytes). */
+struct bpe_image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t n_merges;
+    uint32_t table_bits;
+    uint32_t has_remap;
+    uint64_t table_offset;
+    uint64_t offsets_offset;
+    uint64_t bytes_offset;
+    uint64_t bytes_size;
+    unsigned char remap[256];
+};
+
+/* Result of bpe_image_open(). */
+enum bpe_image_status {
+    BPE_IMAGE_OK = 0,
+    BPE_IMAGE_BAD_MAGIC,        /* not a .tbmb image                  */
+    BPE_IMAGE_BAD_VERSION,      /* written by a newer version          */
+    BPE_IMAGE_BAD_BYTE_ORDER,   /* written on a different-endian host  */
+    BPE_IMAGE_BAD_ALIGNMENT,    /* buffer not 8-byte aligned           */
+    BPE_IMAGE_CORRUPT,          /* truncated or inconsistent           */
+};
+
+/* --------------------------------------------------------------------------
+ * Size in bytes of the image bpe_image_write() produces for these tables.
+ * -------------------------------------------------------------------------- */
+size_t bpe_image_size(const struct bpe_merges *merges,
+                      const struct bpe_vocab *vocab);
+
+/* --------------------------------------------------------------------------
+ * Serialize the tables into dst, which must hold bpe_image_size() bytes;
+ * it needs no particular alignment (bpe_image_open() does, to read the
+ * image in place).  remap is a 256-byte permutation or NULL.
+ * -------------------------------------------------------------------------- */
+void bpe_image_write(void *dst, const struct bpe_merges *merges,
+                     const struct bpe_vocab *vocab,
+                     const unsigned char *remap);
+
+/* --------------------------------------------------------------------------
+ * Validate an image and point *merges and *vocab into it (their `mem`
+ * is set to NULL: the tables are borrowed, and the image must outlive
+ * them).  Nothing is copied; validation is one sequential pass over the
+ * merges table and one over the vocab offsets.
+ * -------------------------------------------------------------------------- */
+enum bpe_image_status bpe_image_open(const void *image, size_t size,
+                                     struct bpe_merges *merges,
+                                     struct bpe_vocab *vocab);
+
+#endif  /* SRC_BPE_IMAGE_H */
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Native corpus ingestion — see bpe_ingest.h.
+ */
+
+#include "bpe_ingest.h"
+#include "bpe_thread.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Segments per worker thread in one batch: a little slack so threads
+ * that finish early can pick up another segment. */
+#define INGEST_SEGMENTS_PER_THREAD 2
+
+/* One distinct chunk of a segment: text at offset, and its count. */
+struct chunk_entry {
+    size_t offset;
+    size_t len;
+    uint64_t count;
+};
+
+struct segment {
+    size_t begin;                 /* offsets into the batch buffer    */
+    size_t end;
+    struct chunk_entry *chunks;   /* in order of first occurrence     */
+    size_t chunks_len;
+    size_t chunks_cap;
+    size_t *table;                /* chunk index + 1, 0 = empty slot  */
+    size_t mask;
+    int failed;
+};
+
+struct ingest {
+    bpe_train_ctx_t *ctx;
+    enum bpe_pretokenizer kind;
+    size_t segment_size;
+    unsigned char *buf;           /* batch text                        */
+    size_t len;
+    size_t cap;
+    size_t pending;               /* start of text not yet segmented   */
+    struct segment *segs;
+    size_t segs_len;
+    size_t segs_cap;
+};
+
+static uint64_t chunk_hash(const unsigned char *s, size_t len) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);  /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ s[i]) * UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+static int segment_table_grow(struct segment *seg, const unsigned char *text) {
+    size_t capacity = seg->mask ? (seg->mask + 1) * 2 : 1024;
+    size_t *table = bpe_malloc(capacity * sizeof(size_t));
+    if (table == NULL) {
+        return -1;
+    }
+    memset(table, 0, capacity * sizeof(size_t));
+
+    for (size_t n = 0; n < seg->chunks_len; n++) {
+        const struct chunk_entry *c = &seg->chunks[n];
+        size_t i = (size_t)chunk_hash(text + c->offset, c->len)
+                   & (capacity - 1);
+        while (table[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        table[i] = n + 1;
+    }
+
+    bpe_free(seg->table);
+    seg->table = table;
+    seg->mask = capacity - 1;
+    return 0;
+}
+
+/* Count one occurrence of text[offset, offset + len).  -1 on allocation
+ * failure. */
+static int segment_count(struct segment *seg, const unsigned char *text,
+                         size_t offset, size_t len) {
+    if ((seg->chunks_len + 1) * 2 > seg->mask + 1
+        && segment_table_grow(seg, text) < 0) {
+        return -1;
+    }
+
+    size_t i = (size_t)chunk_hash(text + offset, len) & seg->mask;
+    while (seg->table[i]) {
+        struct chunk_entry *c = &seg->chunks[seg->table[i] - 1];
+        if (c->len == len
+            && memcmp(text + c->offset, text + offset, len) == 0) {
+            c->count++;
+            return 0;
+        }
+        i = (i + 1) & seg->mask;
+    }
+
+    if (seg->chunks_len == seg->chunks_cap) {
+        size_t cap = seg->chunks_cap ? seg->chunks_cap * 2 : 256;
+        struct chunk_entry *chunks =
+            bpe_realloc(seg->chunks, cap * sizeof(struct chunk_entry));
+        if (chunks == NULL) {
+            return -1;
+        }
+        seg->chunks = chunks;
+        seg->chunks_cap = cap;
+    }
+    struct chunk_entry *c = &seg->chunks[seg->chunks_len];
+    c->offset = offset;
+    c->len = len;
+    c->count = 1;
+    seg->table[i] = ++seg->chunks_len;
+    return 0;
+}
+
+/* Pre-tokenize segment s and count its chunks.  Chunks of one byte
+ * hold no pair and are skipped, as bpe_train_ctx_add() would. */
+static void segment_count_task(void *arg, size_t s) {
+    struct ingest *in = arg;
+    struct segment *seg = &in->segs[s];
+    const unsigned char *text = in->buf + seg->begin;
+    size_t len = seg->end - seg->begin;
+
+    for (size_t pos = 0; pos < len;) {
+        size_t end = bpe_pretokenize_next(in->kind, text, len, pos);
+        if (end - pos > 1 && segment_count(seg, text, pos, end - pos) < 0) {
+            seg->failed = 1;
+            return;
+        }
+        pos = end;
+    }
+}
+
+static int ingest_push(struct ingest *in, size_t begin, size_t end) {
+    if (in->segs_len == in->segs_cap) {
+        size_t cap = in->segs_cap ? in->segs_cap * 2 : 16;
+        struct segment *segs =
+            bpe_realloc(in->segs, cap * sizeof(struct segment));
+        if (segs == NULL) {
+            return -1;
+        }
+        in->segs = segs;
+        in->segs_cap = cap;
+    }
+    struct segment *seg = &in->segs[in->segs_len++];
+    memset(seg, 0, sizeof(*seg));
+    seg->begin = begin;
+    seg->end = end;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Cut the pending text of the current file into segments.  At the end
+ * of the file (eof) the rest becomes the last segment; otherwise text
+ * after the last usable cut waits for more input.
+ * -------------------------------------------------------------------------- */
+static int ingest_cut(struct ingest *in, int eof) {
+    while (in->len - in->pending >= in->segment_size) {
+        const unsigned char *text = in->buf + in->pending;
+        size_t cut = bpe_pretokenize_line_cut(in->kind, text, in->segment_size);
+        if (cut == 0) {
+            /* A line longer than a segment: cut after it, if it ended */
+            cut = bpe_pretokenize_line_cut(in->kind, text,
+                                           in->len - in->pending);
+        }
+        if (cut == 0) {
+            break;
+        }
+        if (ingest_push(in, in->pending, in->pending + cut) < 0) {
+            return -1;
+        }
+        in->pending += cut;
+    }
+    if (eof && in->len > in->pending) {
+        if (ingest_push(in, in->pending, in->len) < 0) {
+            return -1;
+        }
+        in->pending = in->len;
+    }
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Count the batch's segments on the worker threads, add their chunks to
+ * the context in segment order, and move the pending text to the front
+ * of the buffer.
+ * -------------------------------------------------------------------------- */
+static int ingest_flush(struct ingest *in) {
+    bpe_train_ctx_t *ctx = in->ctx;
+    unsigned int threads = ctx->n_threads ? ctx->n_threads : bpe_cpu_count();
+    int err = 0;
+
+    bpe_parallel_for(in->segs_len, threads, segment_count_task, in);
+
+    for (size_t s = 0; s < in->segs_len; s++) {
+        struct segment *seg = &in->segs[s];
+        err |= seg->failed;
+        for (size_t k = 0; k < seg->chunks_len && !err; k++) {
+            const struct chunk_entry *c = &seg->chunks[k];
+            const char *text = (const char *)in->buf + seg->begin + c->offset;
+            if (bpe_train_ctx_add(ctx, text, c->len, c->count) < 0) {
+                err = 1;
+            }
+        }
+        bpe_free(seg->chunks);
+        bpe_free(seg->table);
+    }
+    in->segs_len = 0;
+
+    memmove(in->buf, in->buf + in->pending, in->len - in->pending);
+    in->len -= in->pending;
+    in->pending = 0;
+    return err ? -1 : 0;
+}
+
+/* Make room for more input: count full batches, grow for long lines. */
+static int ingest_reserve(struct ingest *in) {
+    if (in->len < in->cap) {
+        return 0;
+    }
+    if (in->segs_len && ingest_flush(in) < 0) {
+        return -1;
+    }
+    if (in->len == in->cap) {
+        unsigned char *buf = bpe_realloc(in->buf, in->cap * 2);
+        if (buf == NULL) {
+            return -1;
+        }
+        in->buf = buf;
+        in->cap *= 2;
+    }
+    return 0;
+}
+
+int bpe_ingest_files(bpe_train_ctx_t *ctx, const char *const *paths,
+                     size_t n_paths, enum bpe_pretokenizer kind,
+                     size_t segment_size, size_t *failed) {
+    struct ingest in;
+    int result = BPE_INGEST_OK;
+
+    memset(&in, 0, sizeof(in));
+    in.ctx = ctx;
+    in.kind = kind;
+    in.segment_size = segment_size ? segment_size : BPE_INGEST_SEGMENT_SIZE;
+    ctx->store_error = 0;
+
+    unsigned int threads = ctx->n_threads ? ctx->n_threads : bpe_cpu_count();
+    in.cap = in.segment_size * INGEST_SEGMENTS_PER_THREAD * threads;
+    in.buf = bpe_malloc(in.cap);
+    if (in.buf == NULL) {
+        return BPE_INGEST_ERR_MEMORY;
+    }
+
+    for (size_t f = 0; f < n_paths && result == BPE_INGEST_OK; f++) {
+        FILE *fp = fopen(paths[f], "rb");
+        if (fp == NULL) {
+            *failed = f;
+            result = BPE_INGEST_ERR_IO;
+            break;
+        }
+
+        for (;;) {
+            if (ingest_reserve(&in) < 0) {
+                result = BPE_INGEST_ERR_MEMORY;
+                break;
+            }
+            size_t n = fread(in.buf + in.len, 1, in.cap - in.len, fp);
+            in.len += n;
+            if (n == 0 && ferror(fp)) {
+                int saved = errno ? errno : EIO;
+                *failed = f;
+                result = BPE_INGEST_ERR_IO;
+                errno = saved;
+                break;
+            }
+            if (ingest_cut(&in, n == 0) < 0) {
+                result = BPE_INGEST_ERR_MEMORY;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        fclose(fp);
+    }
+
+    if (result == BPE_INGEST_OK && in.segs_len && ingest_flush(&in) < 0) {
+        result = BPE_INGEST_ERR_MEMORY;
+    }
+    for (size_t s = 0; s < in.segs_len; s++) {
+        bpe_free(in.segs[s].chunks);
+        bpe_free(in.segs[s].table);
+    }
+    bpe_free(in.segs);
+    bpe_free(in.buf);
+    return result;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Native corpus ingestion for the trainer: read files, pre-tokenize and
+ * count pieces without a Python object per piece.
+ *
+ * ## Pipeline
+ *
+ * Files are read in order into a batch buffer of a few segments per
+ * thread.  Each file's text is cut into segments of about
+ * `segment_size` bytes at bpe_pretokenize_line_cut() boundaries, so a
+ * segment pre-tokenizes on its own exactly as inside its file.  The
+ * segments of a batch are pre-tokenized on the bpe_thread pool, each
+ * into its own hash table of distinct chunks and their counts, kept in
+ * first-occurrence order.  The tables are then added to the training
+ * context in segment order, so pieces reach it in the same first-seen
+ * order, with the same counts, as adding every chunk of every file one
+ * by one.
+ *
+ * A file with no usable cut (the "none" pattern, or text without line
+ * breaks) is one segment; the buffer grows to hold it.
+ *
+ * Runs without the Python GIL.
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It uses C stdio for file
+ * access.
+ */
+
+#ifndef SRC_BPE_INGEST_H
+#define SRC_BPE_INGEST_H
+
+#include "bpe_trainer.h"
+#include "bpe_pretokenize.h"
+
+/* Default segment size: large enough to amortize a table per segment. */
+#define BPE_INGEST_SEGMENT_SIZE ((size_t)1 << 20)
+
+/* Return values of bpe_ingest_files(). */
+#define BPE_INGEST_OK 0
+#define BPE_INGEST_ERR_IO (-1)       /* see errno and *failed */
+#define BPE_INGEST_ERR_MEMORY (-2)
+
+/* --------------------------------------------------------------------------
+ * Add the pre-tokenized chunks of every file in `paths` to ctx, as
+ * bpe_train_ctx_add() with a count of 1 per occurrence would.
+ *
+ * Files are read as raw bytes (UTF-8; invalid bytes are single "other"
+ * characters to the pre-tokenizer).  ctx->n_threads workers count the
+ * chunks.  segment_size = 0 selects BPE_INGEST_SEGMENT_SIZE.
+ *
+ * Returns BPE_INGEST_OK, BPE_INGEST_ERR_IO if paths[*failed] cannot be
+ * opened or read (errno is set), or BPE_INGEST_ERR_MEMORY; then
+ * ctx->store_error is nonzero if a scratch file could not grow.  On
+ * error, ctx holds the pieces of the batches added so far.
+ * -------------------------------------------------------------------------- */
+int bpe_ingest_files(bpe_train_ctx_t *ctx, const char *const *paths,
+                     size_t n_paths, enum bpe_pretokenizer kind,
+                     size_t segment_size, size_t *failed);
+
+#endif  /* SRC_BPE_INGEST_H */
@@ -5,10 +5,14 @@
  * CPython extension module — Python bindings for the BPE C library.
  *
  * This is one of only two files (along with bpe_common.c) that include
- * <Python.h>.  It defines three Python types:
+ * <Python.h>.  It defines four Python types:
  *
  *   bpe.Trainer     — wraps bpe_train_ctx_t for BPE training
- *   bpe.Tokenizer   — wraps bpe_merges + bpe_vocab for encode/decode
+ *   bpe.Model       — owns bpe_merges + bpe_vocab, built from a merge list
+ *                     or a bpe_image buffer; shared by Tokenizers
+ *   bpe.Tokenizer   — encode/decode over a Model, with an optional
+ *                     bpe_cache of chunk encodings
+ *                     (GIL released; encode_batch runs on bpe_thread)
  *   bpe.BytesRemap  — callable byte-level permutation for tiktoken compat
  *
  * All algorithmic work is delegated to the pure-C modules bpe_trainer
@@ -19,6 +23,35 @@
 #include <Python.h>
 #include "bpe_trainer.h"
 #include "bpe_tokenizer.h"
+#include "bpe_image.h"
+#include "bpe_cache.h"
+#include "bpe_thread.h"
+#include "bpe_pretokenize.h"
+#include "bpe_special.h"
+#include "bpe_ingest.h"
+
+/* Inputs below this many bytes (encode) or IDs (decode) keep the GIL:
+ * releasing and re-acquiring it costs more than the work itself. */
+#define BPE_GIL_RELEASE_MIN 256
+
+/* --------------------------------------------------------------------------
+ * Convert a Python int to a token ID.  BPE_ID_MAX is reserved (no-rank /
+ * unknown marker), so valid IDs are [0, 2**32 - 1).  Returns -1 with
+ * OverflowError (negative or too large) or TypeError set.
+ * -------------------------------------------------------------------------- */
+static int id_from_object(PyObject *o, bpe_id_t *id) {
+    unsigned long v = PyLong_AsUnsignedLong(o);
+    if (v == (unsigned long)-1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (v >= BPE_ID_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "Token IDs must be below 2**32 - 1.");
+        return -1;
+    }
+    *id = (bpe_id_t)v;
+    return 0;
+}
 
 /* =========================================================================
  * Trainer
@@ -28,18 +61,40 @@ typedef struct {
     PyObject_HEAD
     PyObject *list_merges;       /* Python list of (left, right) tuples */
     bpe_train_ctx_t ctx;         /* C training context                   */
+    int busy;                    /* a step runs with the GIL released    */
 } TrainerObject;
 
-/* ---- Trainer.__init__(self, list_bytes) ---- */
-
-static int trainer_init(TrainerObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"list_bytes", NULL};
-    PyObject *list = NULL;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &list)) {
+/* Claim the trainer for a GIL-free operation.  Returns -1 with
+ * RuntimeError set if another thread is already using it. */
+static int trainer_acquire(TrainerObject *self) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Trainer is already in use by another thread.");
         return -1;
     }
+    self->busy = 1;
+    return 0;
+}
+
+/* Set the exception for a failed bpe_train_ctx_add(): OSError when a
+ * spill file could not grow (e.g. the disk is full), else MemoryError. */
+static void trainer_add_error(TrainerObject *self) {
+    if (self->ctx.store_error) {
+        errno = self->ctx.store_error;
+        PyErr_SetFromErrno(PyExc_OSError);
+    }
+    else {
+        PyErr_NoMemory();
+    }
+}
 
+/* --------------------------------------------------------------------------
+ * Add list_bytes (with optional per-piece counts) to the context.
+ * Returns -1 with an exception set; pieces added before the bad item
+ * stay in the context.
+ * -------------------------------------------------------------------------- */
+static int trainer_add_pieces(TrainerObject *self, PyObject *list,
+                              PyObject *counts) {
     if (!PyList_Check(list)) {
         PyErr_SetString(PyExc_TypeError,
                         "Expected a list of bytes-like objects.");
@@ -47,60 +102,265 @@ static int trainer_init(TrainerObject *self, PyObject *args, PyObject *kwds) {
     }
 
     Py_ssize_t list_len = PyList_Size(list);
-    self->list_merges = NULL;
 
-    if (list_len == 0) {
-        PyErr_SetString(PyExc_ValueError,
-                        "The list must not be empty.");
+    if (counts != Py_None
+        && (!PyList_Check(counts) || PyList_Size(counts) != list_len)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "\"counts\" must be a list of ints, one per piece.");
         return -1;
     }
 
-    self->ctx.rank = BPE_TRAIN_RANK_INIT;
-    self->ctx.pieces_len = (size_t)list_len;
-    self->ctx.pieces = bpe_malloc(list_len * sizeof(bpe_piece_t));
-
     for (Py_ssize_t i = 0; i < list_len; i++) {
         PyObject *item = PyList_GetItem(list, i);
+        const char *bytes;
+        Py_ssize_t size;
 
         if (PyBytes_Check(item)) {
-            Py_ssize_t size = PyBytes_Size(item);
-            const char *bytes = PyBytes_AsString(item);
-            bpe_train_ctx_idx_init(&self->ctx, i, bytes, (size_t)size);
+            size = PyBytes_Size(item);
+            bytes = PyBytes_AsString(item);
         }
         else if (PyByteArray_Check(item)) {
-            Py_ssize_t size = PyByteArray_Size(item);
-            const char *bytes = PyByteArray_AsString(item);
-            bpe_train_ctx_idx_init(&self->ctx, i, bytes, (size_t)size);
+            size = PyByteArray_Size(item);
+            bytes = PyByteArray_AsString(item);
         }
         else {
-            /* Only free pieces that were actually initialized (0..i-1) */
-            for (Py_ssize_t j = 0; j < i; j++) {
-                bpe_free(self->ctx.pieces[j].ids);
-                self->ctx.pieces[j].ids = NULL;
-            }
-            bpe_free(self->ctx.pieces);
-            self->ctx.pieces = NULL;
-            self->ctx.pieces_len = 0;
             PyErr_SetString(PyExc_TypeError,
                             "Each element must be bytes or bytearray.");
             return -1;
         }
+
+        unsigned long long count = 1;
+        if (counts != Py_None) {
+            PyObject *c = PyList_GetItem(counts, i);
+            count = PyLong_Check(c) ? PyLong_AsUnsignedLongLong(c) : 0;
+            if (count == 0 || PyErr_Occurred()) {
+                PyErr_Clear();
+                PyErr_SetString(PyExc_ValueError,
+                                "Each count must be a positive int.");
+                return -1;
+            }
+        }
+
+        if (bpe_train_ctx_add(&self->ctx, bytes, (size_t)size,
+                              (uint64_t)count) < 0) {
+            trainer_add_error(self);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ---- Trainer.__init__(self, list_bytes, counts=None, num_threads=0,
+ *                       spill_dir=None, memory_limit=0) ---- */
+
+static int trainer_init(TrainerObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"list_bytes", "counts", "num_threads",
+                             "spill_dir", "memory_limit", NULL};
+    PyObject *list = NULL;
+    PyObject *counts = Py_None;
+    int num_threads = 0;
+    PyObject *spill_dir_o = Py_None;
+    PyObject *spill_dir = NULL;
+    Py_ssize_t memory_limit = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OiOn", kwlist, &list,
+                                     &counts, &num_threads, &spill_dir_o,
+                                     &memory_limit)) {
+        return -1;
+    }
+    if (spill_dir_o != Py_None
+        && !PyUnicode_FSConverter(spill_dir_o, &spill_dir)) {
+        return -1;
+    }
+
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"num_threads\" must be >= 0 (0 = all cores).");
+        goto fail;
+    }
+    if (memory_limit < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"memory_limit\" must be >= 0 (0 = no limit).");
+        goto fail;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Trainer is already in use by another thread.");
+        goto fail;
+    }
+
+    if (PyList_Check(list) && PyList_Size(list) == 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "The list must not be empty.");
+        goto fail;
+    }
+
+    bpe_train_ctx_free(&self->ctx);
+    Py_CLEAR(self->list_merges);
+    bpe_train_ctx_init(&self->ctx);
+    self->ctx.n_threads = (unsigned int)num_threads;
+    self->ctx.memory_limit = (size_t)memory_limit;
+
+    if (spill_dir != NULL
+        && bpe_train_ctx_spill(&self->ctx,
+                               PyBytes_AS_STRING(spill_dir)) < 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, spill_dir_o);
+        goto fail;
+    }
+    Py_CLEAR(spill_dir);
+
+    if (trainer_add_pieces(self, list, counts) < 0) {
+        bpe_train_ctx_free(&self->ctx);
+        return -1;
     }
 
     self->list_merges = PyList_New(0);
-    return 0;
+    return self->list_merges ? 0 : -1;
+
+fail:
+    Py_XDECREF(spill_dir);
+    return -1;
 }
 
-/* ---- Trainer.__dealloc__ ---- */
+/* ---- Trainer.add(list_bytes, counts=None) ---- */
 
-static void trainer_dealloc(TrainerObject *self) {
-    if (self->ctx.pieces) {
-        for (size_t i = 0; i < self->ctx.pieces_len; i++) {
-            bpe_free(self->ctx.pieces[i].ids);
+static PyObject *trainer_add(TrainerObject *self, PyObject *args,
+                             PyObject *kwds) {
+    static char *kwlist[] = {"list_bytes", "counts", NULL};
+    PyObject *list = NULL;
+    PyObject *counts = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &list,
+                                     &counts)) {
+        return NULL;
+    }
+    if (self->list_merges == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Trainer is not initialized.");
+        return NULL;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Trainer is already in use by another thread.");
+        return NULL;
+    }
+    if (self->ctx.stats != NULL || self->ctx.rank != BPE_TRAIN_RANK_INIT) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Pieces cannot be added once training has started.");
+        return NULL;
+    }
+    if (trainer_add_pieces(self, list, counts) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* ---- Trainer.add_files(paths, pretokenizer="bytelevel",
+ *                        segment_size=0) ---- */
+
+static PyObject *trainer_add_files(TrainerObject *self, PyObject *args,
+                                   PyObject *kwds) {
+    static char *kwlist[] = {"paths", "pretokenizer", "segment_size", NULL};
+    PyObject *paths_o = NULL;
+    const char *pretokenizer = "bytelevel";
+    Py_ssize_t segment_size = 0;
+    enum bpe_pretokenizer kind;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|sn", kwlist, &paths_o,
+                                     &pretokenizer, &segment_size)) {
+        return NULL;
+    }
+    if (strcmp(pretokenizer, "bytelevel") == 0) {
+        kind = BPE_PRETOK_BYTELEVEL;
+    }
+    else if (strcmp(pretokenizer, "none") == 0) {
+        kind = BPE_PRETOK_NONE;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+                     "Unknown pretokenizer \"%s\" "
+                     "(expected \"bytelevel\" or \"none\").",
+                     pretokenizer);
+        return NULL;
+    }
+    if (segment_size < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"segment_size\" must be >= 0 (0 = default).");
+        return NULL;
+    }
+    if (self->list_merges == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Trainer is not initialized.");
+        return NULL;
+    }
+    if (self->ctx.stats != NULL || self->ctx.rank != BPE_TRAIN_RANK_INIT) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Pieces cannot be added once training has started.");
+        return NULL;
+    }
+
+    PyObject *paths = PySequence_Fast(paths_o,
+                                      "\"paths\" must be a sequence.");
+    if (paths == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n_paths = PySequence_Fast_GET_SIZE(paths);
+    PyObject **encoded = PyMem_Calloc(n_paths ? (size_t)n_paths : 1,
+                                      sizeof(PyObject *));
+    const char **names = PyMem_Calloc(n_paths ? (size_t)n_paths : 1,
+                                      sizeof(const char *));
+    PyObject *result = NULL;
+    Py_ssize_t i;
+
+    if (encoded == NULL || names == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < n_paths; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(paths, i);
+        if (!PyUnicode_FSConverter(item, &encoded[i])) {
+            goto done;
+        }
+        names[i] = PyBytes_AS_STRING(encoded[i]);
+    }
+
+    if (trainer_acquire(self) < 0) {
+        goto done;
+    }
+    size_t failed = 0;
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = bpe_ingest_files(&self->ctx, names, (size_t)n_paths, kind,
+                          (size_t)segment_size, &failed);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    if (rc == BPE_INGEST_ERR_IO) {
+        PyErr_SetFromErrnoWithFilenameObject(
+            PyExc_OSError, PySequence_Fast_GET_ITEM(paths, failed));
+    }
+    else if (rc == BPE_INGEST_ERR_MEMORY) {
+        trainer_add_error(self);
+    }
+    else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+
+done:
+    if (encoded != NULL) {
+        for (i = 0; i < n_paths; i++) {
+            Py_XDECREF(encoded[i]);
         }
-        bpe_free(self->ctx.pieces);
-        self->ctx.pieces = NULL;
     }
+    PyMem_Free(encoded);
+    PyMem_Free(names);
+    Py_DECREF(paths);
+    return result;
+}
+
+/* ---- Trainer.__dealloc__ ---- */
+
+static void trainer_dealloc(TrainerObject *self) {
+    bpe_train_ctx_free(&self->ctx);
 
     Py_XDECREF(self->list_merges);
     Py_TYPE(self)->tp_free((PyObject *)self);
@@ -123,21 +383,223 @@ static PyObject *trainer_get_n_merges(TrainerObject *self, void *Py_UNUSED(closu
 
 static PyObject *trainer_step(TrainerObject *self, PyObject *Py_UNUSED(args)) {
     bpe_pair_t pair;
-    unsigned long count = bpe_get_max_count_pair(&pair, &self->ctx);
+    uint64_t count;
+
+    if (self->list_merges == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Trainer is not initialized.");
+        return NULL;
+    }
+    if (trainer_acquire(self) < 0) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    count = bpe_get_max_count_pair(&pair, &self->ctx);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
 
     if (count) {
-        PyObject *pair_tuple = Py_BuildValue("(ii)", pair.left, pair.right);
-        if (PyList_Append(self->list_merges, pair_tuple) < 0) {
-            Py_DECREF(pair_tuple);
+        PyObject *pair_tuple = Py_BuildValue("(kk)",
+                                             (unsigned long)pair.left,
+                                             (unsigned long)pair.right);
+        if (pair_tuple == NULL
+            || PyList_Append(self->list_merges, pair_tuple) < 0) {
+            Py_XDECREF(pair_tuple);
             return NULL;
         }
 
-        return Py_BuildValue("(Oii)", pair_tuple, self->ctx.rank, count);
+        return Py_BuildValue("(NkK)", pair_tuple,
+                             (unsigned long)self->ctx.rank,
+                             (unsigned long long)count);
     }
 
+    if (self->ctx.failed) {
+        return PyErr_NoMemory();
+    }
     Py_RETURN_NONE;
 }
 
+/* ---- Trainer.train(n_merges=None, min_frequency=1, target_vocab_size=0,
+ *                    progress_every=0, callback=None) → int ---- */
+
+/* Steps run GIL-free between two visits to Python: each visit appends
+ * the batch's merges to list_merges, checks for signals and, every
+ * progress_every steps, calls the callback. */
+#define TRAINER_BATCH_MAX 4096
+
+static PyObject *trainer_train(TrainerObject *self, PyObject *args,
+                               PyObject *kwds) {
+    static char *kwlist[] = {"n_merges", "min_frequency",
+                             "target_vocab_size", "progress_every",
+                             "callback", NULL};
+    PyObject *n_merges_o = Py_None;
+    unsigned long long min_frequency = 1;
+    Py_ssize_t target_vocab_size = 0;
+    Py_ssize_t progress_every = 0;
+    PyObject *callback = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OKnnO", kwlist,
+                                     &n_merges_o, &min_frequency,
+                                     &target_vocab_size, &progress_every,
+                                     &callback)) {
+        return NULL;
+    }
+    if (self->list_merges == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Trainer is not initialized.");
+        return NULL;
+    }
+
+    /* ---- How many steps: the smallest of the limits given ---- */
+    size_t limit = SIZE_MAX;
+    if (n_merges_o != Py_None) {
+        Py_ssize_t n = PyLong_AsSsize_t(n_merges_o);
+        if (n == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (n < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                            "\"n_merges\" must be >= 0.");
+            return NULL;
+        }
+        limit = (size_t)n;
+    }
+    if (target_vocab_size < 0 || progress_every < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"target_vocab_size\" and \"progress_every\" "
+                        "must be >= 0.");
+        return NULL;
+    }
+    if (target_vocab_size > 0) {
+        /* The vocabulary is IDs 0 .. rank */
+        size_t vocab = (size_t)self->ctx.rank + 1;
+        size_t room = (size_t)target_vocab_size > vocab
+                          ? (size_t)target_vocab_size - vocab
+                          : 0;
+        if (room < limit) {
+            limit = room;
+        }
+    }
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "\"callback\" must be callable.");
+        return NULL;
+    }
+    if (callback != Py_None && progress_every == 0) {
+        progress_every = 1;
+    }
+
+    size_t batch_max = TRAINER_BATCH_MAX;
+    if (callback != Py_None && (size_t)progress_every < batch_max) {
+        batch_max = (size_t)progress_every;
+    }
+    if (limit < batch_max) {
+        batch_max = limit;
+    }
+    bpe_pair_t *pairs = bpe_malloc((batch_max ? batch_max : 1)
+                                   * sizeof(bpe_pair_t));
+    uint64_t *counts = bpe_malloc((batch_max ? batch_max : 1)
+                                  * sizeof(uint64_t));
+    if (pairs == NULL || counts == NULL) {
+        bpe_free(pairs);
+        bpe_free(counts);
+        return PyErr_NoMemory();
+    }
+    if (trainer_acquire(self) < 0) {
+        bpe_free(pairs);
+        bpe_free(counts);
+        return NULL;
+    }
+
+    /* Total for the callback: 0 when only exhaustion or min_frequency
+     * can end training */
+    size_t total = limit == SIZE_MAX ? 0 : limit;
+    size_t done = 0;
+    int error = 0;
+
+    /* The latest merge, kept across batches: a batch that finds no pair
+     * still owes the callback its final report */
+    bpe_pair_t last = {0, 0};
+    uint64_t last_count = 0;
+    size_t reported = 0;
+
+    while (done < limit) {
+        /* Steps until the next progress report (or a full batch) */
+        size_t want = limit - done;
+        if (callback != Py_None) {
+            size_t to_report = (size_t)progress_every
+                               - done % (size_t)progress_every;
+            if (to_report < want) {
+                want = to_report;
+            }
+        }
+        if (want > batch_max) {
+            want = batch_max;
+        }
+
+        size_t got;
+        Py_BEGIN_ALLOW_THREADS
+        got = bpe_train(&self->ctx, want, (uint64_t)min_frequency, pairs,
+                        counts);
+        Py_END_ALLOW_THREADS
+
+        /* Materialize this batch's merges */
+        for (size_t i = 0; i < got && !error; i++) {
+            PyObject *pair_tuple = Py_BuildValue(
+                "(kk)", (unsigned long)pairs[i].left,
+                (unsigned long)pairs[i].right);
+            if (pair_tuple == NULL
+                || PyList_Append(self->list_merges, pair_tuple) < 0) {
+                error = 1;
+            }
+            Py_XDECREF(pair_tuple);
+        }
+        done += got;
+        if (error) {
+            break;
+        }
+        if (self->ctx.failed) {
+            PyErr_NoMemory();
+            error = 1;
+            break;
+        }
+
+        if (got > 0) {
+            last = pairs[got - 1];
+            last_count = counts[got - 1];
+        }
+
+        int finished = got < want || done == limit;
+        if (callback != Py_None && done > reported
+            && (done % (size_t)progress_every == 0 || finished)) {
+            /* No merge since `last`, so ctx.rank is still its rank */
+            PyObject *r = PyObject_CallFunction(
+                callback, "n n (kk) k K", (Py_ssize_t)done,
+                (Py_ssize_t)total, (unsigned long)last.left,
+                (unsigned long)last.right, (unsigned long)self->ctx.rank,
+                (unsigned long long)last_count);
+            if (r == NULL) {
+                error = 1;
+                break;
+            }
+            Py_DECREF(r);
+            reported = done;
+        }
+        if (finished) {
+            break;
+        }
+        if (PyErr_CheckSignals() < 0) {
+            error = 1;
+            break;
+        }
+    }
+
+    self->busy = 0;
+    bpe_free(pairs);
+    bpe_free(counts);
+    if (error) {
+        return NULL;
+    }
+    return PyLong_FromSize_t(done);
+}
+
 /* ---- Trainer.load_merges(merges) — for continue-training ---- */
 
 static PyObject *trainer_load_merges(TrainerObject *self, PyObject *args,
@@ -173,6 +635,9 @@ static PyObject *trainer_load_merges(TrainerObject *self, PyObject *args,
     }
 
     bpe_pair_t *pairs = bpe_malloc(merges_size * sizeof(bpe_pair_t));
+    if (pairs == NULL) {
+        return NULL;
+    }
 
     for (Py_ssize_t i = 0; i < merges_size; i++) {
         PyObject *item = PyList_GetItem(list_merges, i);
@@ -185,9 +650,8 @@ static PyObject *trainer_load_merges(TrainerObject *self, PyObject *args,
         PyObject *left = PyTuple_GetItem(item, 0);
         PyObject *right = PyTuple_GetItem(item, 1);
 
-        pairs[i].left = PyLong_AsUnsignedLong(left);
-        pairs[i].right = PyLong_AsUnsignedLong(right);
-        if (PyErr_Occurred()) {
+        if (id_from_object(left, &pairs[i].left) < 0
+            || id_from_object(right, &pairs[i].right) < 0) {
             bpe_free(pairs);
             return NULL;
         }
@@ -200,54 +664,128 @@ static PyObject *trainer_load_merges(TrainerObject *self, PyObject *args,
         return NULL;
     }
 
+    if (trainer_acquire(self) < 0) {
+        bpe_free(pairs);
+        return NULL;
+    }
+
     Py_XDECREF(self->list_merges);
     self->list_merges = list_merges;
     Py_INCREF(self->list_merges);
 
-    bpe_apply_merges(&self->ctx, pairs, (size_t)merges_size);
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = bpe_apply_merges(&self->ctx, pairs, (size_t)merges_size);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     bpe_free(pairs);
+    if (rc < 0) {
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    }
 
     Py_RETURN_NONE;
 }
 
 /* =========================================================================
- * Tokenizer
+ * Model — the immutable merges table and vocabulary
+ *
+ * Building the tables is the expensive part of constructing a Tokenizer,
+ * and they never change afterwards, so they live in a separate object
+ * that any number of Tokenizers can reference.  Per-instance state
+ * (special tokens, pre-tokenizer, streaming cache) stays in Tokenizer.
  * ========================================================================= */
 
+/* Parse a bytes_maps list into remap[256].  Returns -1 with ValueError
+ * set unless it is a permutation of 0-255. */
+static int parse_bytes_maps(PyObject *list, unsigned char *remap) {
+    if (!PyList_Check(list) || PyList_Size(list) != 256) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"bytes_maps\" must be a list of exactly "
+                        "256 integers.");
+        return -1;
+    }
+    int seen[256] = {0};
+    for (Py_ssize_t i = 0; i < 256; i++) {
+        long val = PyLong_AsLong(PyList_GetItem(list, i));
+        if (val == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (val < 0 || val > 255 || seen[val]) {
+            PyErr_SetString(PyExc_ValueError,
+                            "\"bytes_maps\" must be a permutation "
+                            "of 0-255.");
+            return -1;
+        }
+        seen[val] = 1;
+        remap[i] = (unsigned char)val;
+    }
+    return 0;
+}
+
 typedef struct {
     PyObject_HEAD
     PyObject *list_merges;              /* Python list of merge tuples      */
-    PyObject *dict_special_tokens;      /* bytes → id  (or NULL)            */
-    PyObject *dict_inverse_special;     /* id → bytes (or NULL)             */
-
-    bpe_pair_t *pairs;                  /* C array of merge pairs           */
-    size_t pairs_size;
-    struct bpe_merges *merges;          /* AVL tree: pair → rank            */
+                                        /* (built lazily for an image)      */
+    struct bpe_merges *merges;          /* hash table: pair → rank          */
     struct bpe_vocab *vocab;            /* flat array: id → bytes           */
-
-    unsigned char bytes_cache[4];       /* streaming decode cache           */
-    unsigned long bytes_cache_size;
-} TokenizerObject;
-
-/* ---- Tokenizer.__init__(self, merges, special_tokens=None) ---- */
-
-static int tokenizer_init(TokenizerObject *self, PyObject *args,
-                          PyObject *kwds) {
-    static char *kwlist[] = {"merges", "special_tokens", NULL};
-    PyObject *list_merges = NULL;
-    PyObject *dict_special_tokens = NULL;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist,
-                                     &list_merges, &dict_special_tokens)) {
+    Py_buffer image;                    /* .tbmb image backing both tables  */
+                                        /* (image.obj == NULL if none)      */
+    int has_remap;
+    unsigned char remap[256];           /* the model's bytes_maps           */
+    PyObject *weakreflist;
+} ModelObject;
+
+static PyTypeObject model_type;
+
+/* Point self->merges and self->vocab into a .tbmb image.  The buffer is
+ * held until dealloc; nothing is copied. */
+static int model_open_image(ModelObject *self, PyObject *obj) {
+    if (PyObject_GetBuffer(obj, &self->image, PyBUF_SIMPLE) < 0) {
         return -1;
     }
 
-    if (!PyList_Check(list_merges)) {
-        PyErr_SetString(PyExc_TypeError,
-                        "\"merges\" must be a list of (left, right) tuples.");
+    self->merges = bpe_malloc(sizeof(struct bpe_merges));
+    self->vocab = bpe_malloc(sizeof(struct bpe_vocab));
+    if (self->merges == NULL || self->vocab == NULL) {
         return -1;
     }
+    memset(self->merges, 0, sizeof(struct bpe_merges));
+    memset(self->vocab, 0, sizeof(struct bpe_vocab));
+
+    switch (bpe_image_open(self->image.buf, (size_t)self->image.len,
+                           self->merges, self->vocab)) {
+    case BPE_IMAGE_OK:
+        return 0;
+    case BPE_IMAGE_BAD_MAGIC:
+        PyErr_SetString(PyExc_ValueError, "Not a TinyBPE binary model image.");
+        break;
+    case BPE_IMAGE_BAD_VERSION:
+        PyErr_Format(PyExc_ValueError,
+                     "Binary model version %u is newer than the supported "
+                     "version (%d).",
+                     (unsigned int)((const struct bpe_image_header *)
+                                        self->image.buf)->version,
+                     BPE_IMAGE_VERSION);
+        break;
+    case BPE_IMAGE_BAD_BYTE_ORDER:
+        PyErr_SetString(PyExc_ValueError,
+                        "Binary model was written on a machine with a "
+                        "different byte order.");
+        break;
+    case BPE_IMAGE_BAD_ALIGNMENT:
+        PyErr_SetString(PyExc_ValueError,
+                        "Binary model buffer must be 8-byte aligned.");
+        break;
+    default:
+        PyErr_SetString(PyExc_ValueError,
+                        "Binary model image is truncated or corrupt.");
+        break;
+    }
+    return -1;
+}
 
+/* Validate a list of (left, right) tuples and build both tables. */
+static int model_build(ModelObject *self, PyObject *list_merges) {
     Py_ssize_t merges_size = PyList_Size(list_merges);
     if (merges_size == 0) {
         PyErr_SetString(PyExc_ValueError,
@@ -255,127 +793,581 @@ static int tokenizer_init(TokenizerObject *self, PyObject *args,
         return -1;
     }
 
-    /* Init all pointer fields to NULL for safe cleanup on error */
-    self->pairs = NULL;
-    self->merges = NULL;
-    self->vocab = NULL;
-    self->list_merges = NULL;
-    self->dict_special_tokens = NULL;
-    self->dict_inverse_special = NULL;
-
-    /* ---- special tokens ---- */
-    if (dict_special_tokens) {
-        if (PyDict_Check(dict_special_tokens)
-            && PyDict_Size(dict_special_tokens) != 0) {
-            self->dict_special_tokens = dict_special_tokens;
-            Py_INCREF(self->dict_special_tokens);
-
-            /* Build inverse mapping: id → bytes */
-            PyObject *inv = PyDict_New();
-            PyObject *key, *value;
-            Py_ssize_t pos = 0;
-            while (PyDict_Next(dict_special_tokens, &pos, &key, &value)) {
-                PyDict_SetItem(inv, value, key);
-            }
-            self->dict_inverse_special = inv;
-        }
-        else {
-            self->dict_special_tokens = NULL;
-            self->dict_inverse_special = NULL;
-            PyErr_WarnEx(PyExc_UserWarning,
-                         "special_tokens must be a non-empty dict.", 1);
-        }
-    }
-    else {
-        self->dict_special_tokens = NULL;
-        self->dict_inverse_special = NULL;
-    }
-
     /* ---- Copy pairs into C array, validating each element ---- */
-    self->pairs_size = (size_t)merges_size;
-    self->pairs = bpe_malloc(merges_size * sizeof(bpe_pair_t));
+    bpe_pair_t *pairs = bpe_malloc(merges_size * sizeof(bpe_pair_t));
+    if (pairs == NULL) {
+        return -1;
+    }
 
     for (Py_ssize_t i = 0; i < merges_size; i++) {
         PyObject *item = PyList_GetItem(list_merges, i);
         if (!item || !PyTuple_Check(item) || PyTuple_Size(item) != 2) {
             PyErr_SetString(PyExc_TypeError,
                             "Each element must be a tuple of (left, right).");
+            bpe_free(pairs);
             return -1;
         }
         PyObject *left = PyTuple_GetItem(item, 0);
         PyObject *right = PyTuple_GetItem(item, 1);
 
-        self->pairs[i].left = PyLong_AsUnsignedLong(left);
-        self->pairs[i].right = PyLong_AsUnsignedLong(right);
-        if (PyErr_Occurred()) {
+        if (id_from_object(left, &pairs[i].left) < 0
+            || id_from_object(right, &pairs[i].right) < 0) {
+            bpe_free(pairs);
             return -1;
         }
     }
 
-    if (!bpe_check(self->pairs, self->pairs_size)) {
-        bpe_free(self->pairs);
-        self->pairs = NULL;
+    if (!bpe_check(pairs, (size_t)merges_size)) {
+        bpe_free(pairs);
         PyErr_SetString(PyExc_ValueError, "Invalid merge sequence.");
         return -1;
     }
 
-    self->list_merges = list_merges;
-    Py_INCREF(self->list_merges);
-
-    /* Build the merges search tree and vocab */
-    self->merges = bpe_merges_build(self->pairs, self->pairs_size);
-    if (self->merges == NULL) {
+    /* Build the merges hash table and vocab */
+    self->merges = bpe_merges_build(pairs, (size_t)merges_size);
+    self->vocab = self->merges
+                      ? bpe_vocab_build(pairs, (size_t)merges_size)
+                      : NULL;
+    bpe_free(pairs);
+    if (self->vocab == NULL) {
         return -1;
     }
-    self->vocab = bpe_vocab_build(self->pairs, self->pairs_size);
-    if (self->vocab == NULL) {
-        bpe_merges_free(self->merges);
-        self->merges = NULL;
+
+    self->list_merges = list_merges;
+    Py_INCREF(self->list_merges);
+    return 0;
+}
+
+/* ---- Model.__init__(self, merges, bytes_maps=None) ---- */
+
+static int model_init(ModelObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"merges", "bytes_maps", NULL};
+    PyObject *merges = NULL;
+    PyObject *list_bytes_maps = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &merges,
+                                     &list_bytes_maps)) {
+        return -1;
+    }
+    if (self->merges != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Model is already initialized.");
         return -1;
     }
-    self->bytes_cache_size = 0;
 
-    return 0;
+    if (list_bytes_maps != Py_None) {
+        if (parse_bytes_maps(list_bytes_maps, self->remap) < 0) {
+            return -1;
+        }
+        self->has_remap = 1;
+    }
+
+    if (PyList_Check(merges)) {
+        return model_build(self, merges);
+    }
+    if (PyObject_CheckBuffer(merges)) {
+        return model_open_image(self, merges);
+    }
+    PyErr_SetString(PyExc_TypeError,
+                    "\"merges\" must be a list of (left, right) tuples "
+                    "or a binary model image.");
+    return -1;
 }
 
-/* ---- Tokenizer.__dealloc__ ---- */
+/* ---- Model.__dealloc__ ---- */
 
-static void tokenizer_dealloc(TokenizerObject *self) {
-    bpe_free(self->pairs);
-    self->pairs = NULL;
+static void model_dealloc(ModelObject *self) {
+    if (self->weakreflist != NULL) {
+        PyObject_ClearWeakRefs((PyObject *)self);
+    }
     bpe_merges_free(self->merges);
     self->merges = NULL;
     bpe_vocab_free(self->vocab);
     self->vocab = NULL;
-
+    if (self->image.obj) {
+        PyBuffer_Release(&self->image);
+    }
     Py_XDECREF(self->list_merges);
-    Py_XDECREF(self->dict_special_tokens);
-    Py_XDECREF(self->dict_inverse_special);
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
-/* ---- Tokenizer.merges (getter) ---- */
+/* Every getter below needs the tables; a Model whose __init__ failed
+ * (or never ran) has none. */
+static int model_check(ModelObject *self) {
+    if (self->vocab == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Model is not initialized.");
+        return -1;
+    }
+    return 0;
+}
 
-static PyObject *tokenizer_get_merges(TokenizerObject *self,
-                                      void *Py_UNUSED(closure)) {
+/* ---- Model.merges (getter) ---- */
+
+/* An image stores only the merges table; the list is rebuilt from the
+ * table slots (rank - 256 is the merge index) on first access. */
+static PyObject *merges_list_from_table(const struct bpe_merges *merges) {
+    PyObject *list = PyList_New((Py_ssize_t)merges->n_merges);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (size_t slot = 0; slot <= merges->mask; slot++) {
+        const struct bpe_merges_entry *e = &merges->table[slot];
+        if (e->rank == 0) {
+            continue;
+        }
+        size_t index = (size_t)e->rank - 256;
+        if (e->rank < 256 || index >= merges->n_merges
+            || PyList_GET_ITEM(list, (Py_ssize_t)index) != NULL) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Binary model image is truncated or corrupt.");
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyObject *pair = Py_BuildValue("(kk)",
+                                       (unsigned long)(e->key >> 32),
+                                       (unsigned long)(uint32_t)e->key);
+        if (pair == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)index, pair);
+    }
+    for (size_t i = 0; i < merges->n_merges; i++) {
+        if (PyList_GET_ITEM(list, (Py_ssize_t)i) == NULL) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Binary model image is truncated or corrupt.");
+            Py_DECREF(list);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+static PyObject *model_get_merges(ModelObject *self,
+                                  void *Py_UNUSED(closure)) {
+    if (model_check(self) < 0) {
+        return NULL;
+    }
+    if (self->list_merges == NULL) {
+        PyObject *list = merges_list_from_table(self->merges);
+        if (list == NULL) {
+            return NULL;
+        }
+        /* Building the list can run other threads (via GC); keep the
+         * first result if one of them got here too. */
+        if (self->list_merges == NULL) {
+            self->list_merges = list;
+        }
+        else {
+            Py_DECREF(list);
+        }
+    }
     Py_INCREF(self->list_merges);
     return self->list_merges;
 }
 
-/* ---- Tokenizer.vocab (getter) → dict[int, bytes] ---- */
+/* ---- Model.vocab (getter) → dict[int, bytes] ---- */
 
-static PyObject *tokenizer_get_vocab(TokenizerObject *self,
-                                     void *Py_UNUSED(closure)) {
+static PyObject *model_get_vocab(ModelObject *self,
+                                 void *Py_UNUSED(closure)) {
+    if (model_check(self) < 0) {
+        return NULL;
+    }
     PyObject *vocab = PyDict_New();
+    if (vocab == NULL) {
+        return NULL;
+    }
     for (size_t i = 0; i < self->vocab->vocab_size; i++) {
         PyObject *key = PyLong_FromSize_t(i);
         PyObject *value = PyBytes_FromStringAndSize(
-            (char *)self->vocab->tokens[i].bytes,
-            (Py_ssize_t)self->vocab->tokens[i].size);
-        PyDict_SetItem(vocab, key, value);
+            (const char *)bpe_vocab_token(self->vocab, i),
+            (Py_ssize_t)bpe_vocab_token_size(self->vocab, i));
+        if (key == NULL || value == NULL
+            || PyDict_SetItem(vocab, key, value) < 0) {
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            Py_DECREF(vocab);
+            return NULL;
+        }
         Py_DECREF(key);
         Py_DECREF(value);
     }
+    return vocab;
+}
+
+/* ---- Model.n_vocab / Model.bytes_maps (getters) ---- */
+
+static PyObject *model_get_n_vocab(ModelObject *self,
+                                   void *Py_UNUSED(closure)) {
+    if (model_check(self) < 0) {
+        return NULL;
+    }
+    return PyLong_FromSize_t(self->vocab->vocab_size);
+}
+
+static PyObject *model_get_bytes_maps(ModelObject *self,
+                                      void *Py_UNUSED(closure)) {
+    if (!self->has_remap) {
+        Py_RETURN_NONE;
+    }
+    PyObject *list = PyList_New(256);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < 256; i++) {
+        PyList_SET_ITEM(list, i, PyLong_FromLong(self->remap[i]));
+    }
+    return list;
+}
+
+/* =========================================================================
+ * Tokenizer
+ * ========================================================================= */
+
+/* --------------------------------------------------------------------------
+ * Special tokens for the native text path: an open-addressing table keyed
+ * by the token's *unmapped* UTF-8 bytes, so pre-tokenized chunks can be
+ * matched before byte remapping and without creating Python objects.
+ * -------------------------------------------------------------------------- */
+struct special_entry {
+    const unsigned char *bytes;         /* into special_table.blob, NULL = empty */
+    size_t size;
+    bpe_id_t id;
+};
+
+struct special_table {
+    struct special_entry *slots;        /* power-of-two capacity, or NULL  */
+    size_t mask;
+    unsigned char *blob;                /* all token bytes                  */
+    size_t min_size, max_size;
+
+    /* The same tokens in dict order, for finding them inside text */
+    struct bpe_scanner *scanner;        /* NULL = no tokens                 */
+    bpe_id_t *ids;                      /* token ID per scanner pattern     */
+    size_t n;
+};
+
+static size_t special_hash(const unsigned char *bytes, size_t size) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);  /* FNV-1a */
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * UINT64_C(0x100000001b3);
+    }
+    return (size_t)h;
+}
+
+/* Whole-chunk lookup.  Pure C, callable without the GIL. */
+static int special_table_find(const struct special_table *t,
+                              const unsigned char *bytes, size_t size,
+                              bpe_id_t *id) {
+    if (t->slots == NULL || size < t->min_size || size > t->max_size) {
+        return 0;
+    }
+    for (size_t i = special_hash(bytes, size) & t->mask;;
+         i = (i + 1) & t->mask) {
+        const struct special_entry *e = &t->slots[i];
+        if (e->bytes == NULL) {
+            return 0;
+        }
+        if (e->size == size && memcmp(e->bytes, bytes, size) == 0) {
+            *id = e->id;
+            return 1;
+        }
+    }
+}
+
+static void special_table_free(struct special_table *t) {
+    bpe_scanner_free(t->scanner);
+    bpe_free(t->slots);
+    bpe_free(t->blob);
+    bpe_free(t->ids);
+    t->scanner = NULL;
+    t->slots = NULL;
+    t->blob = NULL;
+    t->ids = NULL;
+    t->n = 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Build the table from the bytes → id dict.  `inverse` undoes the byte
+ * remap that the Python layer applied to the keys (NULL = identity).
+ * Non-bytes and empty keys are skipped; the rest become scanner patterns
+ * 0 .. n-1 in dict order.  Returns -1 with an exception set.
+ * -------------------------------------------------------------------------- */
+static int special_table_build(struct special_table *t, PyObject *dict,
+                               const unsigned char *inverse) {
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    size_t n = 0, blob_size = 0;
+
+    memset(t, 0, sizeof(*t));
+    t->min_size = SIZE_MAX;
+
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        if (PyBytes_Check(key) && PyBytes_GET_SIZE(key) > 0) {
+            n++;
+            blob_size += (size_t)PyBytes_GET_SIZE(key);
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    size_t capacity = 8;
+    while (capacity < 2 * n) {
+        capacity <<= 1;
+    }
+    const unsigned char **patterns = bpe_malloc(n * sizeof(*patterns));
+    size_t *sizes = bpe_malloc(n * sizeof(size_t));
+    t->slots = bpe_malloc(capacity * sizeof(struct special_entry));
+    t->blob = bpe_malloc(blob_size);
+    t->ids = bpe_malloc(n * sizeof(bpe_id_t));
+    if (patterns == NULL || sizes == NULL || t->slots == NULL
+        || t->blob == NULL || t->ids == NULL) {
+        bpe_free(patterns);
+        bpe_free(sizes);
+        special_table_free(t);
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(t->slots, 0, capacity * sizeof(struct special_entry));
+    t->mask = capacity - 1;
+
+    unsigned char *dst = t->blob;
+    pos = 0;
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        if (!PyBytes_Check(key) || PyBytes_GET_SIZE(key) == 0) {
+            continue;
+        }
+        bpe_id_t id;
+        if (id_from_object(value, &id) < 0) {
+            bpe_free(patterns);
+            bpe_free(sizes);
+            special_table_free(t);
+            return -1;
+        }
+
+        size_t size = (size_t)PyBytes_GET_SIZE(key);
+        const unsigned char *src = (const unsigned char *)PyBytes_AS_STRING(key);
+        for (size_t k = 0; k < size; k++) {
+            dst[k] = inverse ? inverse[src[k]] : src[k];
+        }
+
+        size_t i = special_hash(dst, size) & t->mask;
+        while (t->slots[i].bytes != NULL) {
+            i = (i + 1) & t->mask;
+        }
+        t->slots[i].bytes = dst;
+        t->slots[i].size = size;
+        t->slots[i].id = id;
+        if (size < t->min_size) {
+            t->min_size = size;
+        }
+        if (size > t->max_size) {
+            t->max_size = size;
+        }
+        patterns[t->n] = dst;
+        sizes[t->n] = size;
+        t->ids[t->n++] = id;
+        dst += size;
+    }
+
+    t->scanner = bpe_scanner_build(patterns, sizes, t->n);
+    bpe_free(patterns);
+    bpe_free(sizes);
+    if (t->scanner == NULL) {
+        special_table_free(t);
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    PyObject_HEAD
+    ModelObject *model;                 /* shared merges table + vocab      */
+    PyObject *dict_special_tokens;      /* bytes → id  (or NULL)            */
+    PyObject *dict_inverse_special;     /* id → bytes (or NULL)             */
+
+    const struct bpe_merges *merges;    /* model->merges (borrowed)         */
+    const struct bpe_vocab *vocab;      /* model->vocab (borrowed)          */
+
+    unsigned char bytes_cache[4];       /* streaming decode cache           */
+    unsigned long bytes_cache_size;
+
+    /* Native text path (encode_text, str chunks in encode_batch) */
+    int pretokenizer;                   /* enum bpe_pretokenizer, -1 = off  */
+    int has_remap;
+    unsigned char remap[256];           /* byte permutation before BPE      */
+    unsigned char inverse[256];         /* its inverse, for decode_text     */
+    struct special_table specials;      /* whole-chunk special matches      */
+
+    struct bpe_cache *cache;            /* chunk → IDs, NULL = disabled     */
+} TokenizerObject;
+
+/* ---- Tokenizer.__init__(self, merges, special_tokens=None,
+ *                         pretokenizer=None, bytes_maps=None,
+ *                         encode_cache_size=0) ---- */
+
+static int tokenizer_init(TokenizerObject *self, PyObject *args,
+                          PyObject *kwds) {
+    static char *kwlist[] = {"merges", "special_tokens", "pretokenizer",
+                             "bytes_maps", "encode_cache_size", NULL};
+    PyObject *list_merges = NULL;
+    PyObject *dict_special_tokens = NULL;
+    const char *pretokenizer = NULL;
+    PyObject *list_bytes_maps = Py_None;
+    Py_ssize_t encode_cache_size = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OzOn", kwlist,
+                                     &list_merges, &dict_special_tokens,
+                                     &pretokenizer, &list_bytes_maps,
+                                     &encode_cache_size)) {
+        return -1;
+    }
+    if (encode_cache_size < 0
+        || (uint64_t)encode_cache_size >= UINT32_MAX) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"encode_cache_size\" must be >= 0 and below 2**32 "
+                        "(0 = no cache).");
+        return -1;
+    }
+
+    /* Init all pointer fields to NULL for safe cleanup on error */
+    self->model = NULL;
+    self->merges = NULL;
+    self->vocab = NULL;
+    self->dict_special_tokens = NULL;
+    self->dict_inverse_special = NULL;
+    self->specials.slots = NULL;
+    self->specials.blob = NULL;
+    self->bytes_cache_size = 0;
+    self->cache = NULL;
+
+    /* ---- model: shared as given, or built from a list / image ---- */
+    if (PyObject_TypeCheck(list_merges, &model_type)) {
+        if (model_check((ModelObject *)list_merges) < 0) {
+            return -1;
+        }
+        Py_INCREF(list_merges);
+        self->model = (ModelObject *)list_merges;
+    }
+    else {
+        self->model = (ModelObject *)PyObject_CallFunctionObjArgs(
+            (PyObject *)&model_type, list_merges, NULL);
+        if (self->model == NULL) {
+            return -1;
+        }
+    }
+    self->merges = self->model->merges;
+    self->vocab = self->model->vocab;
+
+    /* ---- native pre-tokenizer and byte remap ---- */
+    if (pretokenizer == NULL) {
+        self->pretokenizer = -1;
+    }
+    else if (strcmp(pretokenizer, "bytelevel") == 0) {
+        self->pretokenizer = BPE_PRETOK_BYTELEVEL;
+    }
+    else if (strcmp(pretokenizer, "none") == 0) {
+        self->pretokenizer = BPE_PRETOK_NONE;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+                     "Unknown pretokenizer \"%s\" "
+                     "(expected \"bytelevel\", \"none\" or None).",
+                     pretokenizer);
+        return -1;
+    }
+
+    self->has_remap = 0;
+    if (list_bytes_maps != Py_None) {
+        if (parse_bytes_maps(list_bytes_maps, self->remap) < 0) {
+            return -1;
+        }
+        for (int i = 0; i < 256; i++) {
+            self->inverse[self->remap[i]] = (unsigned char)i;
+        }
+        self->has_remap = 1;
+    }
+
+    /* ---- special tokens ---- */
+    if (dict_special_tokens) {
+        if (PyDict_Check(dict_special_tokens)
+            && PyDict_Size(dict_special_tokens) != 0) {
+            self->dict_special_tokens = dict_special_tokens;
+            Py_INCREF(self->dict_special_tokens);
+
+            /* Build inverse mapping: id → bytes */
+            PyObject *inv = PyDict_New();
+            PyObject *key, *value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(dict_special_tokens, &pos, &key, &value)) {
+                PyDict_SetItem(inv, value, key);
+            }
+            self->dict_inverse_special = inv;
+
+            if (special_table_build(&self->specials, dict_special_tokens,
+                                    self->has_remap ? self->inverse
+                                                    : NULL) < 0) {
+                return -1;
+            }
+        }
+        else {
+            self->dict_special_tokens = NULL;
+            self->dict_inverse_special = NULL;
+            PyErr_WarnEx(PyExc_UserWarning,
+                         "special_tokens must be a non-empty dict.", 1);
+        }
+    }
+    else {
+        self->dict_special_tokens = NULL;
+        self->dict_inverse_special = NULL;
+    }
+
+    /* ---- encode cache ---- */
+    if (encode_cache_size > 0) {
+        self->cache = bpe_cache_new((size_t)encode_cache_size);
+        if (self->cache == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ---- Tokenizer.__dealloc__ ---- */
+
+static void tokenizer_dealloc(TokenizerObject *self) {
+    special_table_free(&self->specials);
+    bpe_cache_free(self->cache);
+
+    Py_XDECREF(self->model);
+    Py_XDECREF(self->dict_special_tokens);
+    Py_XDECREF(self->dict_inverse_special);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/* ---- Tokenizer.merges / Tokenizer.model (getters) ---- */
+
+static PyObject *tokenizer_get_merges(TokenizerObject *self,
+                                      void *Py_UNUSED(closure)) {
+    return model_get_merges(self->model, NULL);
+}
+
+static PyObject *tokenizer_get_model(TokenizerObject *self,
+                                     void *Py_UNUSED(closure)) {
+    Py_INCREF(self->model);
+    return (PyObject *)self->model;
+}
+
+/* ---- Tokenizer.vocab (getter) → dict[int, bytes] ---- */
+
+static PyObject *tokenizer_get_vocab(TokenizerObject *self,
+                                     void *Py_UNUSED(closure)) {
+    PyObject *vocab = model_get_vocab(self->model, NULL);
+    if (vocab == NULL) {
+        return NULL;
+    }
 
     /* Merge in inverse special tokens (id → bytes) */
     if (self->dict_inverse_special) {
@@ -397,131 +1389,1764 @@ static PyObject *tokenizer_get_n_vocab(TokenizerObject *self,
     if (self->dict_special_tokens) {
         special_size = PyDict_Size(self->dict_special_tokens);
     }
-    return PyLong_FromSize_t(self->vocab->vocab_size + (size_t)special_size);
+    return PyLong_FromSize_t(self->vocab->vocab_size + (size_t)special_size);
+}
+
+/* Convert a C array of token IDs into a new Python list. */
+static PyObject *ids_to_list(const bpe_id_t *ids, size_t len) {
+    PyObject *ids_list = PyList_New((Py_ssize_t)len);
+    if (ids_list == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        PyObject *id = PyLong_FromUnsignedLong((unsigned long)ids[i]);
+        if (id == NULL) {
+            Py_DECREF(ids_list);
+            return NULL;
+        }
+        PyList_SET_ITEM(ids_list, (Py_ssize_t)i, id);
+    }
+    return ids_list;
+}
+
+/* ---- ID buffers: array('I') results, out= targets, decode inputs ---- */
+
+/* array.array('I', [0]), repeated to allocate result arrays. */
+static PyObject *ids_array_template;
+
+/* --------------------------------------------------------------------------
+ * Item size of a buffer of integers (struct codes b/B/h/H/i/I/l/L/q/Q, in
+ * native order), or 0 with TypeError for anything else.
+ * -------------------------------------------------------------------------- */
+static Py_ssize_t ids_buffer_itemsize(const Py_buffer *view) {
+    const char *fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=') {
+        fmt++;
+    }
+    if (fmt[0] != '\0' && fmt[1] == '\0' && strchr("bBhHiIlLqQ", fmt[0])
+        && (view->itemsize == 1 || view->itemsize == 2
+            || view->itemsize == 4 || view->itemsize == 8)) {
+        return view->itemsize;
+    }
+    PyErr_Format(PyExc_TypeError,
+                 "Expected a buffer of integers, got format \"%s\".",
+                 view->format ? view->format : "B");
+    return 0;
+}
+
+/* Does the buffer hold signed integers? */
+static int ids_buffer_signed(const Py_buffer *view) {
+    const char *fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=') {
+        fmt++;
+    }
+    return strchr("bhilq", fmt[0]) != NULL;
+}
+
+/* Store ids[0..n) into a buffer of 4- or 8-byte integers. */
+static void ids_store(void *dst, Py_ssize_t itemsize,
+                      const bpe_id_t *ids, size_t n) {
+    if (itemsize == 4) {
+        memcpy(dst, ids, n * sizeof(bpe_id_t));
+    }
+    else {
+        uint64_t *out = dst;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = (uint64_t)ids[i];
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Load n IDs from an integer buffer.  Negative values, and values that do
+ * not fit a token ID, become BPE_ID_MAX, which decode() reports as an
+ * unknown token.
+ * -------------------------------------------------------------------------- */
+static void ids_load(bpe_id_t *ids, const void *src, Py_ssize_t itemsize,
+                     int is_signed, size_t n) {
+#define IDS_LOAD(T, OUT_OF_RANGE)                                       \
+    for (size_t i = 0; i < n; i++) {                                    \
+        T v = ((const T *)src)[i];                                      \
+        ids[i] = (OUT_OF_RANGE) ? BPE_ID_MAX : (bpe_id_t)v;             \
+    }
+    if (is_signed) {
+        switch (itemsize) {
+        case 1:  IDS_LOAD(int8_t, v < 0)  break;
+        case 2:  IDS_LOAD(int16_t, v < 0) break;
+        case 4:  IDS_LOAD(int32_t, v < 0) break;
+        default: IDS_LOAD(int64_t, v < 0 || v > BPE_ID_MAX) break;
+        }
+    }
+    else {
+        switch (itemsize) {
+        case 1:  IDS_LOAD(uint8_t, 0)  break;
+        case 2:  IDS_LOAD(uint16_t, 0) break;
+        case 4:  IDS_LOAD(uint32_t, 0) break;
+        default: IDS_LOAD(uint64_t, v > BPE_ID_MAX) break;
+        }
+    }
+#undef IDS_LOAD
+}
+
+/* --------------------------------------------------------------------------
+ * BPE-encode one chunk in place: ids[] holds its `len` base IDs (bytes
+ * after any remap) on entry and its token IDs on return.  Chunks short
+ * enough to cache are looked up first and stored after a miss.  Returns
+ * the number of IDs, or 0 on allocation failure.  Pure C: runs without
+ * the GIL.
+ * -------------------------------------------------------------------------- */
+static size_t tokenizer_encode_chunk(const TokenizerObject *self,
+                                     bpe_id_t *ids, size_t len) {
+    /* Single bytes need no merging: not worth a cache slot */
+    if (self->cache == NULL || len < 2 || len > BPE_CACHE_KEY_MAX) {
+        return bpe_encode_inplace(ids, len, self->merges);
+    }
+
+    unsigned char key[BPE_CACHE_KEY_MAX];
+    for (size_t k = 0; k < len; k++) {
+        key[k] = (unsigned char)ids[k];
+    }
+    /* A hit never holds more IDs than the chunk has bytes */
+    size_t n = bpe_cache_get(self->cache, key, len, ids);
+    if (n != 0) {
+        return n;
+    }
+    n = bpe_encode_inplace(ids, len, self->merges);
+    if (n != 0) {
+        bpe_cache_put(self->cache, key, len, ids, n);
+    }
+    return n;
+}
+
+/* ---- Tokenizer.encode(bytes) → list[int] ---- */
+
+static PyObject *tokenizer_encode(TokenizerObject *self, PyObject *bytes_o) {
+    /* Type check */
+    if (!PyBytes_Check(bytes_o)) {
+        PyErr_SetString(PyExc_TypeError, "encode() argument must be bytes.");
+        return NULL;
+    }
+
+    /* Check for special token match */
+    if (self->dict_special_tokens) {
+        PyObject *token_id = PyDict_GetItem(self->dict_special_tokens, bytes_o);
+        if (token_id) {
+            Py_INCREF(token_id);
+            PyObject *ids_list = PyList_New(1);
+            PyList_SetItem(ids_list, 0, token_id);
+            return ids_list;
+        }
+    }
+
+    Py_ssize_t text_bytes_size = PyBytes_Size(bytes_o);
+    if (text_bytes_size == 0) {
+        return PyList_New(0);
+    }
+    if ((size_t)text_bytes_size > BPE_ENCODE_MAX_BYTES) {
+        PyErr_SetString(PyExc_ValueError,
+                        "encode() input is too long (limit is 4 GiB per chunk).");
+        return NULL;
+    }
+    char *text_bytes = PyBytes_AsString(bytes_o);
+
+    if (self->cache && text_bytes_size <= BPE_CACHE_KEY_MAX) {
+        bpe_id_t small[BPE_CACHE_KEY_MAX];
+        for (Py_ssize_t k = 0; k < text_bytes_size; k++) {
+            small[k] = (unsigned char)text_bytes[k];
+        }
+        size_t n = tokenizer_encode_chunk(self, small,
+                                          (size_t)text_bytes_size);
+        if (n == 0) {
+            return PyErr_NoMemory();
+        }
+        return ids_to_list(small, n);
+    }
+
+    /* bpe_encode() is pure C over immutable tables: let other threads run */
+    size_t ids_len;
+    bpe_id_t *ids;
+    if (text_bytes_size >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        ids = bpe_encode(&ids_len, self->merges, text_bytes,
+                         (size_t)text_bytes_size);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        ids = bpe_encode(&ids_len, self->merges, text_bytes,
+                         (size_t)text_bytes_size);
+    }
+    if (ids == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    PyObject *ids_list = ids_to_list(ids, ids_len);
+    bpe_free(ids);
+    return ids_list;
+}
+
+/* ---- native text path: pre-tokenize + remap + BPE in one pass ---- */
+
+/* --------------------------------------------------------------------------
+ * Encode one pre-tokenized chunk of raw UTF-8 into ids[] (room for `len`
+ * IDs): a special token's ID if `match_special` and the chunk is one,
+ * else the remapped bytes BPE-encoded.  Returns the number of IDs, or 0 on
+ * allocation failure.  Pure C: runs without the GIL.
+ * -------------------------------------------------------------------------- */
+static size_t tokenizer_encode_piece(const TokenizerObject *self,
+                                     const unsigned char *text, size_t len,
+                                     int match_special, bpe_id_t *ids) {
+    if (match_special
+        && special_table_find(&self->specials, text, len, ids)) {
+        return 1;
+    }
+    bpe_encode_seed(ids, text, len, self->has_remap ? self->remap : NULL);
+    return tokenizer_encode_chunk(self, ids, len);
+}
+
+/* --------------------------------------------------------------------------
+ * Split UTF-8 text with the configured pre-tokenizer and encode every
+ * chunk straight into out[], which must hold at least `len` IDs (a chunk
+ * never yields more IDs than bytes).  With `match_special`, chunks equal
+ * to a special token become its ID, as in encode().  Returns the number of
+ * IDs, or (size_t)-1 on allocation failure.  Pure C: runs without the GIL.
+ * -------------------------------------------------------------------------- */
+static size_t tokenizer_encode_utf8(const TokenizerObject *self,
+                                    const unsigned char *text, size_t len,
+                                    int match_special, bpe_id_t *out) {
+    enum bpe_pretokenizer kind = (enum bpe_pretokenizer)self->pretokenizer;
+    size_t n = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t end = bpe_pretokenize_next(kind, text, len, pos);
+        size_t m = tokenizer_encode_piece(self, text + pos, end - pos,
+                                          match_special, out + n);
+        if (m == 0) {
+            return (size_t)-1;
+        }
+        n += m;
+        pos = end;
+    }
+    return n;
+}
+
+/* ---- Tokenizer.encode_text(str) → list[int] ---- */
+
+static PyObject *tokenizer_encode_text(TokenizerObject *self,
+                                       PyObject *text_o) {
+    if (!PyUnicode_Check(text_o)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "encode_text() argument must be str.");
+        return NULL;
+    }
+    if (self->pretokenizer < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "encode_text() requires a tokenizer constructed "
+                        "with a pretokenizer.");
+        return NULL;
+    }
+
+    Py_ssize_t size;
+    const char *text = PyUnicode_AsUTF8AndSize(text_o, &size);
+    if (text == NULL) {
+        return NULL;
+    }
+    if (size == 0) {
+        return PyList_New(0);
+    }
+    if ((size_t)size > BPE_ENCODE_MAX_BYTES) {
+        PyErr_SetString(PyExc_ValueError,
+                        "encode_text() input is too long "
+                        "(limit is 4 GiB per call).");
+        return NULL;
+    }
+
+    bpe_id_t *ids = bpe_malloc((size_t)size * sizeof(bpe_id_t));
+    if (ids == NULL) {
+        return NULL;
+    }
+
+    size_t ids_len;
+    if (size >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        ids_len = tokenizer_encode_utf8(self, (const unsigned char *)text,
+                                        (size_t)size, 1, ids);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        ids_len = tokenizer_encode_utf8(self, (const unsigned char *)text,
+                                        (size_t)size, 1, ids);
+    }
+    if (ids_len == (size_t)-1) {
+        bpe_free(ids);
+        return PyErr_NoMemory();
+    }
+
+    PyObject *ids_list = ids_to_list(ids, ids_len);
+    bpe_free(ids);
+    return ids_list;
+}
+
+/* ---- Tokenizer.encode_chunks(list[str], match_special=True,
+ *                             max_tokens=-1) → list[int] ---- */
+
+/* --------------------------------------------------------------------------
+ * For a pattern that only the regex module can split: the chunks arrive
+ * as str and are converted, remapped and encoded here, sparing a bytes
+ * object and a call per chunk.  Chunks are short, so the GIL is kept.
+ * encode() passes match_special=False for text between special tokens.
+ *
+ * Shared with count_chunks(): `count_only` encodes every chunk at the
+ * start of one scratch buffer and returns just the count.
+ * -------------------------------------------------------------------------- */
+static PyObject *encode_chunks_run(TokenizerObject *self, PyObject *args,
+                                   PyObject *kwargs, int count_only) {
+    static char *kwlist[] = {"chunks", "match_special", "max_tokens", NULL};
+    static char *kwlist_count[] = {"chunks", "match_special", NULL};
+    const char *name = count_only ? "count_chunks" : "encode_chunks";
+    PyObject *list_chunks;
+    int match_special = 1;
+    Py_ssize_t max_tokens = -1;
+
+    if (count_only
+            ? !PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist_count,
+                                           &list_chunks, &match_special)
+            : !PyArg_ParseTupleAndKeywords(args, kwargs, "O|pn", kwlist,
+                                           &list_chunks, &match_special,
+                                           &max_tokens)) {
+        return NULL;
+    }
+    if (!PyList_Check(list_chunks)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument must be a list of str.", name);
+        return NULL;
+    }
+
+    /* ---- Pass 1: UTF-8 of every chunk (cached by str), buffer size ---- */
+    Py_ssize_t n_chunks = PyList_GET_SIZE(list_chunks);
+    size_t total = 0, longest = 0;
+    for (Py_ssize_t c = 0; c < n_chunks; c++) {
+        PyObject *item = PyList_GET_ITEM(list_chunks, c);
+        Py_ssize_t size;
+        if (!PyUnicode_Check(item)) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() argument must be a list of str.", name);
+            return NULL;
+        }
+        if (PyUnicode_AsUTF8AndSize(item, &size) == NULL) {
+            return NULL;
+        }
+        if ((size_t)size > BPE_ENCODE_MAX_BYTES) {
+            PyErr_Format(PyExc_ValueError,
+                         "%s() chunk is too long "
+                         "(limit is 4 GiB per chunk).", name);
+            return NULL;
+        }
+        total += (size_t)size;
+        if ((size_t)size > longest) {
+            longest = (size_t)size;
+        }
+    }
+
+    size_t room = count_only ? longest : total;
+    bpe_id_t *ids = bpe_malloc((room ? room : 1) * sizeof(bpe_id_t));
+    if (ids == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    /* ---- Pass 2: encode each chunk straight into ids ---- */
+    size_t limit = max_tokens < 0 ? SIZE_MAX : (size_t)max_tokens;
+    size_t n = 0;
+    for (Py_ssize_t c = 0; c < n_chunks && n < limit; c++) {
+        Py_ssize_t size;
+        const char *text = PyUnicode_AsUTF8AndSize(
+            PyList_GET_ITEM(list_chunks, c), &size);
+        if (size == 0) {
+            continue;
+        }
+        size_t m = tokenizer_encode_piece(self, (const unsigned char *)text,
+                                          (size_t)size, match_special,
+                                          count_only ? ids : ids + n);
+        if (m == 0) {
+            bpe_free(ids);
+            return PyErr_NoMemory();
+        }
+        n += m;
+    }
+
+    PyObject *result = count_only
+                           ? PyLong_FromSize_t(n)
+                           : ids_to_list(ids, n < limit ? n : limit);
+    bpe_free(ids);
+    return result;
+}
+
+static PyObject *tokenizer_encode_chunks(TokenizerObject *self,
+                                         PyObject *args, PyObject *kwargs) {
+    return encode_chunks_run(self, args, kwargs, 0);
+}
+
+/* ---- Tokenizer.count_chunks(list[str], match_special=True) → int ---- */
+
+static PyObject *tokenizer_count_chunks(TokenizerObject *self,
+                                        PyObject *args, PyObject *kwargs) {
+    return encode_chunks_run(self, args, kwargs, 1);
+}
+
+/* ---- special tokens inside text: allowed / disallowed sets ---- */
+
+/* Codes of a special-token mask: one byte per scanner pattern. */
+enum {
+    SPECIAL_ORDINARY = 0,       /* encoded as plain text                */
+    SPECIAL_ALLOWED = 1,        /* encoded as its special token ID      */
+    SPECIAL_DISALLOWED = 2      /* its presence raises ValueError       */
+};
+
+/* --------------------------------------------------------------------------
+ * Parse the `mask` argument: None (every special token allowed) or bytes
+ * holding one code per special token, in special_tokens dict order.
+ * Sets *mask (NULL for None) and *check when a code is DISALLOWED.
+ * Returns -1 with an exception set.
+ * -------------------------------------------------------------------------- */
+static int special_mask_parse(const TokenizerObject *self, PyObject *mask_o,
+                              const unsigned char **mask, int *check) {
+    *mask = NULL;
+    *check = 0;
+    if (mask_o == Py_None) {
+        return 0;
+    }
+    if (!PyBytes_Check(mask_o)) {
+        PyErr_SetString(PyExc_TypeError, "mask must be bytes or None.");
+        return -1;
+    }
+    if ((size_t)PyBytes_GET_SIZE(mask_o) != self->specials.n) {
+        PyErr_Format(PyExc_ValueError,
+                     "mask must have one byte per special token "
+                     "(%zu), got %zd.",
+                     self->specials.n, PyBytes_GET_SIZE(mask_o));
+        return -1;
+    }
+    *mask = (const unsigned char *)PyBytes_AS_STRING(mask_o);
+    for (size_t i = 0; i < self->specials.n; i++) {
+        if ((*mask)[i] > SPECIAL_DISALLOWED) {
+            PyErr_SetString(PyExc_ValueError,
+                            "mask codes must be 0 (ordinary), 1 (allowed) "
+                            "or 2 (disallowed).");
+            return -1;
+        }
+        *check |= (*mask)[i] == SPECIAL_DISALLOWED;
+    }
+    return 0;
+}
+
+/* Index of the first disallowed special token in text, or SIZE_MAX.
+ * Pure C: runs without the GIL. */
+static size_t special_find_disallowed(const TokenizerObject *self,
+                                      const unsigned char *text, size_t len,
+                                      const unsigned char *mask) {
+    size_t index, size;
+    if (bpe_scanner_find(self->specials.scanner, text, len, 0, mask,
+                         SPECIAL_DISALLOWED, &index, &size) < len) {
+        return index;
+    }
+    return SIZE_MAX;
+}
+
+/* tiktoken's error for a disallowed special token found in the input. */
+static void special_raise_disallowed(const TokenizerObject *self,
+                                     size_t index) {
+    size_t size;
+    const unsigned char *bytes =
+        bpe_scanner_pattern(self->specials.scanner, index, &size);
+    PyObject *token = PyUnicode_DecodeUTF8((const char *)bytes,
+                                           (Py_ssize_t)size, "replace");
+    if (token == NULL) {
+        return;
+    }
+    PyErr_Format(PyExc_ValueError,
+                 "Encountered text corresponding to disallowed special "
+                 "token %R.\n"
+                 "Pass it in allowed_special to encode it as a special "
+                 "token, or leave it out of disallowed_special to encode "
+                 "it as normal text.",
+                 token);
+    Py_DECREF(token);
+}
+
+/* --------------------------------------------------------------------------
+ * encode() core: cut UTF-8 text at every allowed special token (leftmost-
+ * longest), pre-tokenize and encode the text in between, and emit each
+ * token's ID.  Ordinary text never matches special tokens as whole
+ * chunks, so tokens that are not allowed stay plain text.
+ *
+ * Encoding stops at the first chunk that brings the count to `limit` or
+ * more (SIZE_MAX = no limit); the IDs beyond it are not trimmed.  With
+ * `count_only`, every segment is encoded at out[0] and only the count is
+ * kept.  out[] must hold `len` IDs.  Returns the number of IDs, or
+ * (size_t)-1 on allocation failure.  Pure C: runs without the GIL.
+ * -------------------------------------------------------------------------- */
+static size_t tokenizer_encode_special_utf8(const TokenizerObject *self,
+                                            const unsigned char *text,
+                                            size_t len,
+                                            const unsigned char *mask,
+                                            size_t limit, int count_only,
+                                            bpe_id_t *out) {
+    const struct special_table *t = &self->specials;
+    enum bpe_pretokenizer kind = (enum bpe_pretokenizer)self->pretokenizer;
+    size_t n = 0;
+    size_t pos = 0;
+
+    while (pos < len && n < limit) {
+        size_t index = 0, size = 0;
+        size_t start = len;
+        if (t->scanner) {
+            start = bpe_scanner_find(t->scanner, text, len, pos, mask,
+                                     SPECIAL_ALLOWED, &index, &size);
+        }
+
+        /* Ordinary text up to the token, chunk by chunk */
+        const unsigned char *seg = text + pos;
+        size_t seg_len = start - pos;
+        for (size_t at = 0; at < seg_len && n < limit;) {
+            size_t end = bpe_pretokenize_next(kind, seg, seg_len, at);
+            size_t m = tokenizer_encode_piece(self, seg + at, end - at, 0,
+                                              count_only ? out : out + n);
+            if (m == 0) {
+                return (size_t)-1;
+            }
+            n += m;
+            at = end;
+        }
+        if (start == len || n >= limit) {
+            break;
+        }
+        if (!count_only) {
+            out[n] = t->ids[index];
+        }
+        n++;
+        pos = start + size;
+    }
+    return n;
+}
+
+/* Shared argument handling of encode_special() and count_special(). */
+static int encode_special_args(TokenizerObject *self, const char *name,
+                               PyObject *text_o, PyObject *mask_o,
+                               const unsigned char **text, size_t *len,
+                               const unsigned char **mask, int *check) {
+    if (self->pretokenizer < 0) {
+        PyErr_Format(PyExc_ValueError,
+                     "%s() requires a tokenizer constructed "
+                     "with a pretokenizer.", name);
+        return -1;
+    }
+    if (special_mask_parse(self, mask_o, mask, check) < 0) {
+        return -1;
+    }
+    Py_ssize_t size;
+    *text = (const unsigned char *)PyUnicode_AsUTF8AndSize(text_o, &size);
+    if (*text == NULL) {
+        return -1;
+    }
+    if ((size_t)size > BPE_ENCODE_MAX_BYTES) {
+        PyErr_Format(PyExc_ValueError,
+                     "%s() input is too long (limit is 4 GiB per call).",
+                     name);
+        return -1;
+    }
+    *len = (size_t)size;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Run the disallowed check and tokenizer_encode_special_utf8(), releasing
+ * the GIL for long text.  Nothing is encoded if a disallowed token is
+ * found.  Returns the number of IDs, or (size_t)-1 with an exception set.
+ * -------------------------------------------------------------------------- */
+static size_t encode_special_run(TokenizerObject *self,
+                                 const unsigned char *text, size_t len,
+                                 const unsigned char *mask, int check,
+                                 size_t limit, int count_only,
+                                 bpe_id_t *out) {
+    size_t disallowed = SIZE_MAX;
+    size_t n = 0;
+
+    if (len >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        if (check) {
+            disallowed = special_find_disallowed(self, text, len, mask);
+        }
+        if (disallowed == SIZE_MAX) {
+            n = tokenizer_encode_special_utf8(self, text, len, mask, limit,
+                                              count_only, out);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        if (check) {
+            disallowed = special_find_disallowed(self, text, len, mask);
+        }
+        if (disallowed == SIZE_MAX) {
+            n = tokenizer_encode_special_utf8(self, text, len, mask, limit,
+                                              count_only, out);
+        }
+    }
+    if (disallowed != SIZE_MAX) {
+        special_raise_disallowed(self, disallowed);
+        return (size_t)-1;
+    }
+    if (n == (size_t)-1) {
+        PyErr_NoMemory();
+    }
+    return n;
+}
+
+/* ---- Tokenizer.encode_special(str, mask=None, max_tokens=-1) → list[int] ---- */
+
+static PyObject *tokenizer_encode_special(TokenizerObject *self,
+                                          PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"text", "mask", "max_tokens", NULL};
+    PyObject *text_o;
+    PyObject *mask_o = Py_None;
+    Py_ssize_t max_tokens = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|On", kwlist,
+                                     &text_o, &mask_o, &max_tokens)) {
+        return NULL;
+    }
+    const unsigned char *text, *mask;
+    size_t len;
+    int check;
+    if (encode_special_args(self, "encode_special", text_o, mask_o,
+                            &text, &len, &mask, &check) < 0) {
+        return NULL;
+    }
+    size_t limit = max_tokens < 0 ? SIZE_MAX : (size_t)max_tokens;
+    if (len == 0 || limit == 0) {
+        return PyList_New(0);
+    }
+
+    bpe_id_t *ids = bpe_malloc(len * sizeof(bpe_id_t));
+    if (ids == NULL) {
+        return PyErr_NoMemory();
+    }
+    size_t ids_len = encode_special_run(self, text, len, mask, check, limit,
+                                        0, ids);
+    if (ids_len == (size_t)-1) {
+        bpe_free(ids);
+        return NULL;
+    }
+
+    PyObject *ids_list = ids_to_list(ids, ids_len < limit ? ids_len : limit);
+    bpe_free(ids);
+    return ids_list;
+}
+
+/* ---- Tokenizer.count_special(str, mask=None) → int ---- */
+
+/* len(encode_special(text, mask)) without a list or an int per token:
+ * each segment is encoded into the same scratch buffer. */
+static PyObject *tokenizer_count_special(TokenizerObject *self,
+                                         PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"text", "mask", NULL};
+    PyObject *text_o;
+    PyObject *mask_o = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|O", kwlist,
+                                     &text_o, &mask_o)) {
+        return NULL;
+    }
+    const unsigned char *text, *mask;
+    size_t len;
+    int check;
+    if (encode_special_args(self, "count_special", text_o, mask_o,
+                            &text, &len, &mask, &check) < 0) {
+        return NULL;
+    }
+    if (len == 0) {
+        return PyLong_FromLong(0);
+    }
+
+    bpe_id_t small[BPE_CACHE_KEY_MAX];
+    bpe_id_t *ids = len <= BPE_CACHE_KEY_MAX
+                        ? small
+                        : bpe_malloc(len * sizeof(bpe_id_t));
+    if (ids == NULL) {
+        return PyErr_NoMemory();
+    }
+    size_t n = encode_special_run(self, text, len, mask, check, SIZE_MAX, 1,
+                                  ids);
+    if (ids != small) {
+        bpe_free(ids);
+    }
+    if (n == (size_t)-1) {
+        return NULL;
+    }
+    return PyLong_FromSize_t(n);
+}
+
+/* ---- Tokenizer.split_special(str, mask=None) → list[str | int] ---- */
+
+/* encode() for a pattern only the regex module can split: the text
+ * between allowed special tokens comes back as str, each token as its
+ * ID.  Empty text between tokens is left out. */
+static PyObject *tokenizer_split_special(TokenizerObject *self,
+                                         PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"text", "mask", NULL};
+    PyObject *text_o;
+    PyObject *mask_o = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|O", kwlist,
+                                     &text_o, &mask_o)) {
+        return NULL;
+    }
+    const unsigned char *mask;
+    int check;
+    if (special_mask_parse(self, mask_o, &mask, &check) < 0) {
+        return NULL;
+    }
+
+    Py_ssize_t size;
+    const char *text = PyUnicode_AsUTF8AndSize(text_o, &size);
+    if (text == NULL) {
+        return NULL;
+    }
+    const struct special_table *t = &self->specials;
+    const unsigned char *utf8 = (const unsigned char *)text;
+    size_t len = (size_t)size;
+
+    if (t->scanner && check) {
+        size_t disallowed = special_find_disallowed(self, utf8, len, mask);
+        if (disallowed != SIZE_MAX) {
+            special_raise_disallowed(self, disallowed);
+            return NULL;
+        }
+    }
+
+    PyObject *parts = PyList_New(0);
+    if (parts == NULL) {
+        return NULL;
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        size_t index = 0, match = 0;
+        size_t start = len;
+        if (t->scanner) {
+            start = bpe_scanner_find(t->scanner, utf8, len, pos, mask,
+                                     SPECIAL_ALLOWED, &index, &match);
+        }
+        if (start > pos) {
+            /* Tokens are whole UTF-8 sequences, so the cut is clean */
+            PyObject *part;
+            if (pos == 0 && start == len) {
+                part = text_o;
+                Py_INCREF(part);
+            }
+            else {
+                part = PyUnicode_DecodeUTF8(text + pos,
+                                            (Py_ssize_t)(start - pos), NULL);
+            }
+            if (part == NULL || PyList_Append(parts, part) < 0) {
+                Py_XDECREF(part);
+                Py_DECREF(parts);
+                return NULL;
+            }
+            Py_DECREF(part);
+        }
+        if (start == len) {
+            break;
+        }
+        PyObject *id = PyLong_FromUnsignedLong(t->ids[index]);
+        if (id == NULL || PyList_Append(parts, id) < 0) {
+            Py_XDECREF(id);
+            Py_DECREF(parts);
+            return NULL;
+        }
+        Py_DECREF(id);
+        pos = start + match;
+    }
+    return parts;
+}
+
+/* ---- Tokenizer.stable_prefix(str) → int ---- */
+
+/* bpe_pretokenize_stable_prefix() in code points, as Python indexes a str:
+ * count the bytes that are not UTF-8 continuation bytes. */
+static size_t stable_prefix_chars(enum bpe_pretokenizer kind,
+                                  const unsigned char *text, size_t len) {
+    size_t prefix = bpe_pretokenize_stable_prefix(kind, text, len);
+    size_t n_chars = 0;
+    for (size_t i = 0; i < prefix; i++) {
+        n_chars += (text[i] & 0xC0) != 0x80;
+    }
+    return n_chars;
+}
+
+static PyObject *tokenizer_stable_prefix(TokenizerObject *self,
+                                         PyObject *text_o) {
+    if (!PyUnicode_Check(text_o)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "stable_prefix() argument must be str.");
+        return NULL;
+    }
+    if (self->pretokenizer < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "stable_prefix() requires a tokenizer constructed "
+                        "with a pretokenizer.");
+        return NULL;
+    }
+
+    Py_ssize_t size;
+    const char *text = PyUnicode_AsUTF8AndSize(text_o, &size);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    enum bpe_pretokenizer kind = (enum bpe_pretokenizer)self->pretokenizer;
+    size_t n_chars;
+    if (size >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        n_chars = stable_prefix_chars(kind, (const unsigned char *)text,
+                                      (size_t)size);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        n_chars = stable_prefix_chars(kind, (const unsigned char *)text,
+                                      (size_t)size);
+    }
+    return PyLong_FromSize_t(n_chars);
+}
+
+/* ---- decode helper: copy a run of vocab IDs into the output ---- */
+
+static unsigned char *tokenizer_decode_run(TokenizerObject *self,
+                                           unsigned char *dst,
+                                           const unsigned char *dst_end,
+                                           const bpe_id_t *ids,
+                                           size_t ids_len) {
+    if (ids_len >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        dst = bpe_decode_into(dst, dst_end, self->vocab, ids, ids_len);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        dst = bpe_decode_into(dst, dst_end, self->vocab, ids, ids_len);
+    }
+    return dst;
+}
+
+/* ---- decode helpers: gather IDs, size the output, fill it ---- */
+
+/* Gather a list of ints or a buffer of integers into a bpe_malloc'd
+ * array.  IDs that do not fit a bpe_id_t become BPE_ID_MAX, reported as
+ * unknown tokens by tokenizer_decode_plan().  `name` labels the
+ * TypeError. */
+static bpe_id_t *decode_gather(PyObject *ids_o, size_t *ids_len,
+                               const char *name) {
+    Py_ssize_t size;
+    bpe_id_t *ids;
+
+    if (PyList_Check(ids_o)) {
+        size = PyList_GET_SIZE(ids_o);
+        ids = bpe_malloc((size ? size : 1) * sizeof(bpe_id_t));
+        if (ids == NULL) {
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < size; i++) {
+            if (id_from_object(PyList_GET_ITEM(ids_o, i), &ids[i]) < 0) {
+                if (!PyErr_ExceptionMatches(PyExc_OverflowError)) {
+                    bpe_free(ids);
+                    return NULL;
+                }
+                PyErr_Clear();
+                ids[i] = BPE_ID_MAX;
+            }
+        }
+    }
+    else if (PyObject_CheckBuffer(ids_o)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(ids_o, &view,
+                               PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+            return NULL;
+        }
+        Py_ssize_t itemsize = ids_buffer_itemsize(&view);
+        if (itemsize == 0) {
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+        size = view.len / itemsize;
+        ids = bpe_malloc((size ? size : 1) * sizeof(bpe_id_t));
+        if (ids == NULL) {
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+        ids_load(ids, view.buf, itemsize, ids_buffer_signed(&view),
+                 (size_t)size);
+        PyBuffer_Release(&view);
+    }
+    else {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument must be a list of ints or a buffer of "
+                     "integers.", name);
+        return NULL;
+    }
+    *ids_len = (size_t)size;
+    return ids;
+}
+
+/* --------------------------------------------------------------------------
+ * Decode pass 1: add the byte length of ids to *total.  Special tokens'
+ * bytes are appended, in order, to *specials (a list created on first
+ * use); unknown IDs are warned about and set to BPE_ID_MAX so pass 2
+ * skips them.  Returns -1 with an exception set on failure.
+ * -------------------------------------------------------------------------- */
+static int tokenizer_decode_plan(TokenizerObject *self, bpe_id_t *ids,
+                                 size_t ids_len, size_t *total,
+                                 PyObject **specials) {
+    size_t vocab_size = self->vocab->vocab_size;
+
+    for (size_t i = 0; i < ids_len; i++) {
+        size_t token_size;
+        if (ids[i] < vocab_size) {
+            token_size = bpe_vocab_token_size(self->vocab, ids[i]);
+        }
+        else {
+            PyObject *special_bytes = NULL;
+            if (self->dict_inverse_special) {
+                PyObject *key =
+                    PyLong_FromUnsignedLong((unsigned long)ids[i]);
+                if (key == NULL) {
+                    return -1;
+                }
+                special_bytes = PyDict_GetItem(self->dict_inverse_special,
+                                               key);
+                Py_DECREF(key);
+            }
+            if (special_bytes && !PyBytes_Check(special_bytes)) {
+                PyErr_Format(PyExc_TypeError,
+                             "Special token %lu must be bytes, not %.100s.",
+                             (unsigned long)ids[i],
+                             Py_TYPE(special_bytes)->tp_name);
+                return -1;
+            }
+            if (special_bytes) {
+                if (*specials == NULL
+                    && (*specials = PyList_New(0)) == NULL) {
+                    return -1;
+                }
+                if (PyList_Append(*specials, special_bytes) < 0) {
+                    return -1;
+                }
+                token_size = (size_t)PyBytes_GET_SIZE(special_bytes);
+            }
+            else {
+                bpe_id_t token_id = ids[i];
+                ids[i] = BPE_ID_MAX;
+                token_size = 0;
+                if (!self->dict_inverse_special) {
+                    if (PyErr_WarnEx(PyExc_UserWarning,
+                                     "No special_tokens defined.", 1) < 0) {
+                        return -1;
+                    }
+                }
+                else if (PyErr_WarnFormat(PyExc_UserWarning, 1,
+                                          "Unknown token ID (%lu)",
+                                          (unsigned long)token_id) < 0) {
+                    return -1;
+                }
+            }
+        }
+        if (token_size > (size_t)PY_SSIZE_T_MAX - *total) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        *total += token_size;
+    }
+    return 0;
+}
+
+/* Decode pass 2: write the bytes planned by tokenizer_decode_plan() at
+ * dst, runs of vocab IDs through bpe_decode_into() (dst_end bounds its
+ * wide stores).  Returns the end of what was written. */
+static unsigned char *tokenizer_decode_fill(TokenizerObject *self,
+                                            const bpe_id_t *ids,
+                                            size_t ids_len,
+                                            PyObject *specials,
+                                            unsigned char *dst,
+                                            const unsigned char *dst_end) {
+    size_t vocab_size = self->vocab->vocab_size;
+    size_t run = 0;              /* start of the pending run of vocab IDs */
+    Py_ssize_t n_special = 0;
+
+    for (size_t i = 0; i <= ids_len; i++) {
+        if (i < ids_len && ids[i] < vocab_size) {
+            continue;
+        }
+        if (i > run) {
+            dst = tokenizer_decode_run(self, dst, dst_end, ids + run,
+                                       i - run);
+        }
+        run = i + 1;
+        if (i < ids_len && ids[i] != BPE_ID_MAX) {
+            PyObject *special_bytes = PyList_GET_ITEM(specials, n_special++);
+            size_t len = (size_t)PyBytes_GET_SIZE(special_bytes);
+            memcpy(dst, PyBytes_AS_STRING(special_bytes), len);
+            dst += len;
+        }
+    }
+    return dst;
+}
+
+/* ---- Tokenizer.decode(list[int] | buffer) → bytes ---- */
+/* ---- Tokenizer.decode_text(list[int] | buffer) → str ---- */
+
+/* decode() returns the bytes as the model stores them; decode_text()
+ * also undoes the byte remap and decodes UTF-8 (strictly). */
+static PyObject *tokenizer_decode_ids(TokenizerObject *self, PyObject *ids_o,
+                                      int as_text) {
+    size_t ids_len;
+    bpe_id_t *ids = decode_gather(ids_o, &ids_len,
+                                  as_text ? "decode_text" : "decode");
+    if (ids == NULL) {
+        return NULL;
+    }
+
+    /* ---- Size the output, then fill one bytes object in place ---- */
+    size_t total = 0;
+    PyObject *specials = NULL;
+    PyObject *result = NULL;
+    if (tokenizer_decode_plan(self, ids, ids_len, &total, &specials) == 0) {
+        result = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)total);
+    }
+    if (result) {
+        unsigned char *dst = (unsigned char *)PyBytes_AS_STRING(result);
+        tokenizer_decode_fill(self, ids, ids_len, specials, dst, dst + total);
+    }
+    Py_XDECREF(specials);
+    bpe_free(ids);
+
+    if (result && as_text) {
+        /* Remap in place: result is not shared yet */
+        unsigned char *buf = (unsigned char *)PyBytes_AS_STRING(result);
+        if (self->has_remap && total >= BPE_GIL_RELEASE_MIN) {
+            Py_BEGIN_ALLOW_THREADS
+            bpe_remap_bytes(buf, buf, total, self->inverse);
+            Py_END_ALLOW_THREADS
+        }
+        else if (self->has_remap) {
+            bpe_remap_bytes(buf, buf, total, self->inverse);
+        }
+        PyObject *text = PyUnicode_DecodeUTF8((const char *)buf,
+                                              (Py_ssize_t)total, NULL);
+        Py_DECREF(result);
+        result = text;
+    }
+    return result;
+}
+
+static PyObject *tokenizer_decode(TokenizerObject *self, PyObject *ids_o) {
+    return tokenizer_decode_ids(self, ids_o, 0);
+}
+
+static PyObject *tokenizer_decode_text(TokenizerObject *self,
+                                       PyObject *ids_o) {
+    return tokenizer_decode_ids(self, ids_o, 1);
+}
+
+/* ---- Tokenizer.encode_batch(list[list[bytes]], num_threads=0) ---- */
+
+/* One input chunk; special is the ID of an exact special token
+ * (BPE_ID_MAX = none), is_text a str segment that still needs native
+ * pre-tokenization. */
+struct batch_chunk {
+    const char *bytes;
+    size_t size;
+    bpe_id_t special;
+    int is_text;
+};
+
+/* One document: a run of chunks and, after encoding, its token IDs. */
+struct batch_doc {
+    size_t first;            /* index of the first chunk            */
+    size_t n_chunks;
+    size_t n_bytes;          /* total chunk bytes (upper bound on IDs) */
+    bpe_id_t *ids;           /* encoded IDs, bpe_malloc'd           */
+    size_t ids_len;
+};
+
+struct batch_ctx {
+    const TokenizerObject *tok;
+    const struct batch_chunk *chunks;
+    struct batch_doc *docs;
+    int failed;              /* set (racily, monotonically) on OOM  */
+};
+
+/* Worker task: encode every chunk of one document.  Runs without the GIL. */
+static void encode_batch_task(void *arg, size_t index) {
+    struct batch_ctx *ctx = arg;
+    struct batch_doc *doc = &ctx->docs[index];
+
+    /* A chunk of n bytes never yields more than n IDs (specials: 1) */
+    size_t cap = doc->n_bytes + doc->n_chunks;
+    doc->ids = bpe_malloc(cap * sizeof(bpe_id_t));
+    if (doc->ids == NULL) {
+        ctx->failed = 1;
+        return;
+    }
+
+    size_t len = 0;
+    for (size_t c = doc->first; c < doc->first + doc->n_chunks; c++) {
+        const struct batch_chunk *chunk = &ctx->chunks[c];
+        if (chunk->special != BPE_ID_MAX) {
+            doc->ids[len++] = chunk->special;
+            continue;
+        }
+        if (chunk->size == 0) {
+            continue;
+        }
+        if (chunk->is_text) {
+            size_t n = tokenizer_encode_utf8(ctx->tok,
+                                             (const unsigned char *)chunk->bytes,
+                                             chunk->size, 1,
+                                             doc->ids + len);
+            if (n == (size_t)-1) {
+                ctx->failed = 1;
+                return;
+            }
+            len += n;
+            continue;
+        }
+
+        bpe_id_t *ids = doc->ids + len;
+        for (size_t k = 0; k < chunk->size; k++) {
+            ids[k] = (unsigned char)chunk->bytes[k];
+        }
+        size_t n = tokenizer_encode_chunk(ctx->tok, ids, chunk->size);
+        if (n == 0) {
+            ctx->failed = 1;
+            return;
+        }
+        len += n;
+    }
+    doc->ids_len = len;
+}
+
+/* Every chunk of a set of documents, collected with the GIL held. */
+struct batch {
+    struct batch_doc *docs;
+    struct batch_chunk *chunks;
+    /* Owned references keep every chunk alive while the GIL is released,
+     * even if another thread mutates the input lists meanwhile. */
+    PyObject **refs;
+    Py_ssize_t n_docs;       /* documents whose ids need freeing    */
+    size_t n_refs;
+};
+
+static void batch_release(struct batch *b) {
+    for (size_t i = 0; i < b->n_refs; i++) {
+        Py_DECREF(b->refs[i]);
+    }
+    if (b->docs) {
+        for (Py_ssize_t d = 0; d < b->n_docs; d++) {
+            bpe_free(b->docs[d].ids);
+        }
+    }
+    bpe_free(b->refs);
+    bpe_free(b->chunks);
+    bpe_free(b->docs);
+}
+
+/* --------------------------------------------------------------------------
+ * Validate list[list[bytes | str]] and collect chunk pointers and special
+ * token IDs into *b.  Returns -1 with an exception set on failure; the
+ * caller must batch_release() *b either way.
+ * -------------------------------------------------------------------------- */
+static int batch_collect(TokenizerObject *self, PyObject *list_docs,
+                         struct batch *b) {
+    memset(b, 0, sizeof(*b));
+    if (!PyList_Check(list_docs)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "\"chunks\" must be a list of lists of bytes.");
+        return -1;
+    }
+
+    /* ---- Pass 1: count chunks, validate shapes ---- */
+    Py_ssize_t n_docs = PyList_Size(list_docs);
+    size_t n_chunks = 0;
+    for (Py_ssize_t d = 0; d < n_docs; d++) {
+        PyObject *doc = PyList_GetItem(list_docs, d);
+        if (!PyList_Check(doc)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "\"chunks\" must be a list of lists of bytes.");
+            return -1;
+        }
+        n_chunks += (size_t)PyList_Size(doc);
+    }
+
+    b->docs = bpe_malloc((n_docs ? n_docs : 1) * sizeof(struct batch_doc));
+    b->chunks = bpe_malloc((n_chunks ? n_chunks : 1)
+                           * sizeof(struct batch_chunk));
+    b->refs = bpe_malloc((n_chunks ? n_chunks : 1) * sizeof(PyObject *));
+    if (b->docs == NULL || b->chunks == NULL || b->refs == NULL) {
+        return -1;
+    }
+
+    /* ---- Pass 2: collect chunk pointers and special token IDs ---- */
+    struct batch_chunk *chunks = b->chunks;
+    size_t c = 0;
+    for (Py_ssize_t d = 0; d < n_docs; d++) {
+        PyObject *doc = PyList_GetItem(list_docs, d);
+        Py_ssize_t doc_len = PyList_Size(doc);
+        struct batch_doc *bd = &b->docs[d];
+
+        bd->first = c;
+        bd->n_chunks = 0;
+        bd->n_bytes = 0;
+        bd->ids = NULL;
+        bd->ids_len = 0;
+        b->n_docs = d + 1;
+
+        for (Py_ssize_t k = 0; k < doc_len && c < n_chunks; k++, c++) {
+            PyObject *item = PyList_GetItem(doc, k);
+            chunks[c].special = BPE_ID_MAX;
+            chunks[c].is_text = 0;
+
+            if (PyBytes_Check(item)) {
+                chunks[c].bytes = PyBytes_AS_STRING(item);
+                chunks[c].size = (size_t)PyBytes_GET_SIZE(item);
+            }
+            else if (PyUnicode_Check(item) && self->pretokenizer >= 0) {
+                Py_ssize_t size;
+                chunks[c].bytes = PyUnicode_AsUTF8AndSize(item, &size);
+                if (chunks[c].bytes == NULL) {
+                    return -1;
+                }
+                chunks[c].size = (size_t)size;
+                chunks[c].is_text = 1;
+            }
+            else {
+                PyErr_SetString(PyExc_TypeError,
+                                self->pretokenizer >= 0
+                                    ? "Each chunk must be bytes or str."
+                                    : "Each chunk must be bytes.");
+                return -1;
+            }
+            Py_INCREF(item);
+            b->refs[b->n_refs++] = item;
+
+            if (chunks[c].size > BPE_ENCODE_MAX_BYTES) {
+                PyErr_SetString(PyExc_ValueError,
+                                "Chunk is too long "
+                                "(limit is 4 GiB per chunk).");
+                return -1;
+            }
+
+            if (self->dict_special_tokens && !chunks[c].is_text) {
+                PyObject *token_id =
+                    PyDict_GetItem(self->dict_special_tokens, item);
+                if (token_id
+                    && id_from_object(token_id, &chunks[c].special) < 0) {
+                    return -1;
+                }
+            }
+            bd->n_chunks++;
+            bd->n_bytes += chunks[c].size;
+        }
+    }
+    return 0;
+}
+
+static PyObject *tokenizer_encode_batch(TokenizerObject *self, PyObject *args,
+                                        PyObject *kwds) {
+    static char *kwlist[] = {"chunks", "num_threads", NULL};
+    PyObject *list_docs = NULL;
+    int num_threads = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist,
+                                     &list_docs, &num_threads)) {
+        return NULL;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"num_threads\" must be >= 0 (0 = all cores).");
+        return NULL;
+    }
+
+    struct batch b;
+    PyObject *result = NULL;
+    if (batch_collect(self, list_docs, &b) < 0) {
+        goto done;
+    }
+
+    /* ---- Encode all documents on the worker pool, GIL released ---- */
+    struct batch_ctx ctx = {self, b.chunks, b.docs, 0};
+    Py_BEGIN_ALLOW_THREADS
+    bpe_parallel_for((size_t)b.n_docs, (unsigned int)num_threads,
+                     encode_batch_task, &ctx);
+    Py_END_ALLOW_THREADS
+
+    if (ctx.failed) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    /* ---- Build list[list[int]] ---- */
+    result = PyList_New(b.n_docs);
+    if (result == NULL) {
+        goto done;
+    }
+    for (Py_ssize_t d = 0; d < b.n_docs; d++) {
+        PyObject *ids_list = ids_to_list(b.docs[d].ids, b.docs[d].ids_len);
+        if (ids_list == NULL) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, d, ids_list);
+    }
+
+done:
+    if (result == NULL && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    batch_release(&b);
+    return result;
+}
+
+/* ---- Tokenizer.encode_to_array(chunks, out=None) ---- */
+
+static PyObject *tokenizer_encode_to_array(TokenizerObject *self,
+                                           PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"chunks", "out", NULL};
+    PyObject *list_chunks = NULL;
+    PyObject *out = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist,
+                                     &list_chunks, &out)) {
+        return NULL;
+    }
+    if (!PyList_Check(list_chunks)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "\"chunks\" must be a list of bytes.");
+        return NULL;
+    }
+
+    /* One document: reuse the batch machinery on [chunks] */
+    PyObject *list_docs = PyList_New(1);
+    if (list_docs == NULL) {
+        return NULL;
+    }
+    Py_INCREF(list_chunks);
+    PyList_SET_ITEM(list_docs, 0, list_chunks);
+
+    struct batch b;
+    PyObject *result = NULL;
+    int rc = batch_collect(self, list_docs, &b);
+    Py_DECREF(list_docs);
+    if (rc < 0) {
+        goto done;
+    }
+
+    struct batch_ctx ctx = {self, b.chunks, b.docs, 0};
+    if (b.docs[0].n_bytes >= BPE_GIL_RELEASE_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        encode_batch_task(&ctx, 0);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        encode_batch_task(&ctx, 0);
+    }
+    if (ctx.failed) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    const struct batch_doc *doc = &b.docs[0];
+    if (out == Py_None) {
+        result = PySequence_Repeat(ids_array_template,
+                                   (Py_ssize_t)doc->ids_len);
+        if (result == NULL) {
+            goto done;
+        }
+        Py_buffer view;
+        if (PyObject_GetBuffer(result, &view, PyBUF_WRITABLE) < 0) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        ids_store(view.buf, 4, doc->ids, doc->ids_len);
+        PyBuffer_Release(&view);
+    }
+    else {
+        Py_buffer view;
+        if (PyObject_GetBuffer(out, &view,
+                               PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE
+                               | PyBUF_FORMAT) < 0) {
+            goto done;
+        }
+        Py_ssize_t itemsize = ids_buffer_itemsize(&view);
+        if (itemsize != 0 && itemsize < 4) {
+            PyErr_SetString(PyExc_TypeError,
+                            "\"out\" must hold 4- or 8-byte integers.");
+        }
+        else if (itemsize != 0
+                 && (size_t)(view.len / itemsize) < doc->ids_len) {
+            PyErr_Format(PyExc_ValueError,
+                         "\"out\" holds %zd IDs, %zu needed.",
+                         view.len / itemsize, doc->ids_len);
+        }
+        else if (itemsize != 0) {
+            ids_store(view.buf, itemsize, doc->ids, doc->ids_len);
+            result = PyLong_FromSize_t(doc->ids_len);
+        }
+        PyBuffer_Release(&view);
+    }
+
+done:
+    if (result == NULL && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    batch_release(&b);
+    return result;
+}
+
+/* ---- Tokenizer.encode_to_shard(data, path, index_path, ...) ---- */
+
+/* Input bytes per encode task, and tasks per thread in one round: a round
+ * holds about n_threads * 4 MiB of text and its IDs in memory. */
+#define BPE_SHARD_TASK_BYTES ((size_t)1 << 20)
+#define BPE_SHARD_TASKS_PER_THREAD 4
+
+/* One non-empty document of the input. */
+struct shard_doc {
+    size_t start, end;       /* byte span in the input                */
+    size_t n_ids;            /* IDs written, eot included             */
+};
+
+/* A run of consecutive documents, encoded by one worker. */
+struct shard_task {
+    size_t first_doc, n_docs;
+    size_t n_bytes;
+    void *out;               /* n_ids IDs of `itemsize` bytes, bpe_malloc'd */
+    size_t n_ids;
+};
+
+struct shard_ctx {
+    const TokenizerObject *tok;
+    const unsigned char *text;
+    size_t len;
+    const unsigned char *sep;
+    size_t sep_len;
+    long eot;                /* appended to every document, -1 = none */
+    int itemsize;            /* 2 or 4                                */
+    unsigned int n_threads;
+    struct shard_doc *docs;
+    size_t docs_cap;
+    struct shard_task *tasks;
+    size_t max_tasks;
+    int failed;              /* set (racily, monotonically) on OOM    */
+    /* Totals */
+    size_t n_docs;
+    uint64_t n_tokens;
+};
+
+/* Offset of the next separator at or after pos, or len. */
+static size_t shard_find_separator(const struct shard_ctx *ctx, size_t pos) {
+    if (ctx->sep_len == 0) {
+        return ctx->len;
+    }
+    while (ctx->len - pos >= ctx->sep_len) {
+        const unsigned char *p = memchr(ctx->text + pos, ctx->sep[0],
+                                        ctx->len - pos - ctx->sep_len + 1);
+        if (p == NULL) {
+            break;
+        }
+        if (memcmp(p, ctx->sep, ctx->sep_len) == 0) {
+            return (size_t)(p - ctx->text);
+        }
+        pos = (size_t)(p - ctx->text) + 1;
+    }
+    return ctx->len;
 }
 
-/* ---- Tokenizer.encode(bytes) → list[int] ---- */
+/* Worker task: encode the documents of one task, narrowed to itemsize. */
+static void shard_encode_task(void *arg, size_t index) {
+    struct shard_ctx *ctx = arg;
+    struct shard_task *task = &ctx->tasks[index];
 
-static PyObject *tokenizer_encode(TokenizerObject *self, PyObject *bytes_o) {
-    /* Type check */
-    if (!PyBytes_Check(bytes_o)) {
-        PyErr_SetString(PyExc_TypeError, "encode() argument must be bytes.");
-        return NULL;
+    /* A document of n bytes never yields more than n IDs, plus its eot */
+    bpe_id_t *ids = bpe_malloc((task->n_bytes + task->n_docs)
+                               * sizeof(bpe_id_t));
+    if (ids == NULL) {
+        ctx->failed = 1;
+        return;
     }
 
-    /* Check for special token match */
-    if (self->dict_special_tokens) {
-        PyObject *token_id = PyDict_GetItem(self->dict_special_tokens, bytes_o);
-        if (token_id) {
-            Py_INCREF(token_id);
-            PyObject *ids_list = PyList_New(1);
-            PyList_SetItem(ids_list, 0, token_id);
-            return ids_list;
+    size_t n = 0;
+    for (size_t d = task->first_doc; d < task->first_doc + task->n_docs; d++) {
+        struct shard_doc *doc = &ctx->docs[d];
+        size_t m = tokenizer_encode_utf8(ctx->tok, ctx->text + doc->start,
+                                         doc->end - doc->start, 1,
+                                         ids + n);
+        if (m == (size_t)-1) {
+            bpe_free(ids);
+            ctx->failed = 1;
+            return;
+        }
+        if (ctx->eot >= 0) {
+            ids[n + m++] = (bpe_id_t)ctx->eot;
         }
+        doc->n_ids = m;
+        n += m;
     }
 
-    Py_ssize_t text_bytes_size = PyBytes_Size(bytes_o);
-    if (text_bytes_size == 0) {
-        return PyList_New(0);
+    if (ctx->itemsize == 2) {
+        uint16_t *narrow = bpe_malloc((n ? n : 1) * sizeof(uint16_t));
+        if (narrow == NULL) {
+            bpe_free(ids);
+            ctx->failed = 1;
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            narrow[i] = (uint16_t)ids[i];
+        }
+        bpe_free(ids);
+        task->out = narrow;
     }
-    char *text_bytes = PyBytes_AsString(bytes_o);
-
-    size_t ids_len;
-    unsigned long *ids = bpe_encode(&ids_len, self->merges,
-                                    text_bytes, text_bytes_size);
-    if (ids == NULL) {
-        return NULL;
+    else {
+        task->out = ids;
     }
+    task->n_ids = n;
+}
 
-    PyObject *ids_list = PyList_New((Py_ssize_t)ids_len);
-    for (size_t i = 0; i < ids_len; i++) {
-        PyObject *id = PyLong_FromUnsignedLong(ids[i]);
-        PyList_SetItem(ids_list, (Py_ssize_t)i, id);
+/* --------------------------------------------------------------------------
+ * Split the input into documents and encode them round by round: each
+ * round fills up to max_tasks tasks of about BPE_SHARD_TASK_BYTES, runs
+ * them on the pool, then appends their IDs to `out` and the running
+ * token offset after each document to `index`, in input order.  Runs
+ * without the GIL.  Returns 0, -1 on allocation failure, -2 if a
+ * document exceeds BPE_ENCODE_MAX_BYTES, -3 on a write error to `out`
+ * or -4 on one to `index` (errno is set).
+ * -------------------------------------------------------------------------- */
+static int shard_run(struct shard_ctx *ctx, FILE *out, FILE *index) {
+    uint64_t offset = 0;
+    if (fwrite(&offset, sizeof(offset), 1, index) != 1) {
+        return -4;
     }
 
-    bpe_free(ids);
-    return ids_list;
-}
+    size_t pos = 0;
+    while (pos < ctx->len) {
+        /* ---- Collect a round of tasks ---- */
+        size_t n_tasks = 0, n_docs = 0;
+        while (n_tasks < ctx->max_tasks && pos < ctx->len) {
+            struct shard_task *task = &ctx->tasks[n_tasks];
+            task->first_doc = n_docs;
+            task->n_docs = 0;
+            task->n_bytes = 0;
+            task->out = NULL;
+            task->n_ids = 0;
+
+            while (pos < ctx->len && task->n_bytes < BPE_SHARD_TASK_BYTES) {
+                size_t end = shard_find_separator(ctx, pos);
+                size_t next = end < ctx->len ? end + ctx->sep_len : end;
+                if (end > pos) {
+                    if (end - pos > BPE_ENCODE_MAX_BYTES) {
+                        return -2;
+                    }
+                    if (n_docs == ctx->docs_cap) {
+                        size_t cap = ctx->docs_cap ? 2 * ctx->docs_cap : 1024;
+                        void *p = bpe_realloc(ctx->docs,
+                                              cap * sizeof(struct shard_doc));
+                        if (p == NULL) {
+                            return -1;
+                        }
+                        ctx->docs = p;
+                        ctx->docs_cap = cap;
+                    }
+                    ctx->docs[n_docs].start = pos;
+                    ctx->docs[n_docs].end = end;
+                    n_docs++;
+                    task->n_docs++;
+                    task->n_bytes += end - pos;
+                }
+                pos = next;
+            }
+            if (task->n_docs > 0) {
+                n_tasks++;
+            }
+        }
 
-/* ---- Tokenizer.decode(list[int]) → bytes ---- */
+        /* ---- Encode in parallel ---- */
+        bpe_parallel_for(n_tasks, ctx->n_threads, shard_encode_task, ctx);
+
+        /* ---- Append in order ---- */
+        int rc = ctx->failed ? -1 : 0;
+        for (size_t t = 0; t < n_tasks; t++) {
+            struct shard_task *task = &ctx->tasks[t];
+            if (rc == 0
+                && fwrite(task->out, (size_t)ctx->itemsize, task->n_ids, out)
+                       != task->n_ids) {
+                rc = -3;
+            }
+            for (size_t d = task->first_doc;
+                 rc == 0 && d < task->first_doc + task->n_docs; d++) {
+                offset += ctx->docs[d].n_ids;
+                if (fwrite(&offset, sizeof(offset), 1, index) != 1) {
+                    rc = -4;
+                }
+            }
+            bpe_free(task->out);
+            task->out = NULL;
+        }
+        if (rc < 0) {
+            return rc;
+        }
+        ctx->n_docs += n_docs;
+    }
+    ctx->n_tokens = offset;
+    return 0;
+}
 
-static PyObject *tokenizer_decode(TokenizerObject *self, PyObject *list_ids) {
-    Py_ssize_t size = PyList_Size(list_ids);
-    if (size == 0) {
-        return PyBytes_FromString("");
+/* Largest ID the tokenizer can emit: the vocab or a special token. */
+static size_t tokenizer_max_id(const TokenizerObject *self) {
+    size_t max_id = self->vocab->vocab_size - 1;
+    if (self->specials.slots != NULL) {
+        for (size_t i = 0; i <= self->specials.mask; i++) {
+            const struct special_entry *e = &self->specials.slots[i];
+            if (e->bytes != NULL && e->id > max_id) {
+                max_id = e->id;
+            }
+        }
     }
+    return max_id;
+}
 
-    unsigned long *ids = bpe_malloc(size * sizeof(unsigned long));
-    if (ids == NULL) {
+static PyObject *tokenizer_encode_to_shard(TokenizerObject *self,
+                                           PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"data", "path", "index_path", "separator",
+                             "eot", "itemsize", "num_threads", NULL};
+    Py_buffer data;
+    PyObject *path = NULL, *index_path = NULL;
+    const char *sep = "\n";
+    Py_ssize_t sep_len = 1;
+    long eot = -1;
+    int itemsize = 4;
+    int num_threads = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*O&O&|y#lii", kwlist,
+                                     &data, PyUnicode_FSConverter, &path,
+                                     PyUnicode_FSConverter, &index_path,
+                                     &sep, &sep_len, &eot, &itemsize,
+                                     &num_threads)) {
         return NULL;
     }
-    size_t ids_buf_len = 0;
-    PyObject *result = PyBytes_FromString("");
 
-    for (Py_ssize_t i = 0; i < size; i++) {
-        PyObject *item_id = PyList_GetItem(list_ids, i);
-        unsigned long token_id = PyLong_AsUnsignedLong(item_id);
+    PyObject *result = NULL;
+    FILE *out = NULL, *index = NULL;
+    struct shard_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
 
-        if (token_id >= self->vocab->vocab_size) {
-            /* Flush accumulated vocab tokens first */
-            if (ids_buf_len) {
-                size_t bytes_size;
-                char *c_bytes = bpe_decode(&bytes_size, self->vocab,
-                                           ids, ids_buf_len);
-                if (c_bytes == NULL) {
-                    bpe_free(ids);
-                    Py_DECREF(result);
-                    return NULL;
-                }
+    if (self->pretokenizer < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "encode_to_shard() requires a tokenizer constructed "
+                        "with a pretokenizer.");
+        goto done;
+    }
+    if (itemsize != 2 && itemsize != 4) {
+        PyErr_SetString(PyExc_ValueError, "\"itemsize\" must be 2 or 4.");
+        goto done;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "\"num_threads\" must be >= 0 (0 = all cores).");
+        goto done;
+    }
+    size_t id_limit = itemsize == 2 ? (size_t)UINT16_MAX
+                                    : (size_t)BPE_ID_MAX - 1;
+    if (eot < -1 || (eot >= 0 && (unsigned long)eot > id_limit)) {
+        PyErr_Format(PyExc_ValueError,
+                     "\"eot\" must be -1 or a token ID up to %zu.", id_limit);
+        goto done;
+    }
+    if (tokenizer_max_id(self) > id_limit) {
+        PyErr_Format(PyExc_ValueError,
+                     "Token IDs up to %zu do not fit in %d bytes.",
+                     tokenizer_max_id(self), itemsize);
+        goto done;
+    }
 
-                PyObject *chunk = PyBytes_FromStringAndSize(
-                    c_bytes, (Py_ssize_t)bytes_size);
-                PyBytes_Concat(&result, chunk);
-                Py_DECREF(chunk);
-                bpe_free(c_bytes);
-                ids_buf_len = 0;
-            }
+    out = fopen(PyBytes_AS_STRING(path), "wb");
+    if (out == NULL) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        goto done;
+    }
+    index = fopen(PyBytes_AS_STRING(index_path), "wb");
+    if (index == NULL) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, index_path);
+        goto done;
+    }
 
-            /* Look up special token */
-            if (self->dict_inverse_special) {
-                PyObject *special_bytes =
-                    PyDict_GetItem(self->dict_inverse_special, item_id);
-                if (special_bytes) {
-                    PyBytes_Concat(&result, special_bytes);
-                }
-                else {
-                    PyErr_WarnFormat(PyExc_UserWarning, 1,
-                                     "Unknown token ID (%lu)", token_id);
-                }
-            }
-            else {
-                PyErr_WarnEx(PyExc_UserWarning, "No special_tokens defined.", 1);
-            }
-        }
-        else {
-            ids[ids_buf_len++] = token_id;
-        }
+    ctx.tok = self;
+    ctx.text = data.buf;
+    ctx.len = (size_t)data.len;
+    ctx.sep = (const unsigned char *)sep;
+    ctx.sep_len = (size_t)sep_len;
+    ctx.eot = eot;
+    ctx.itemsize = itemsize;
+    ctx.n_threads = (unsigned int)num_threads;
+    ctx.max_tasks = (size_t)(num_threads ? (unsigned int)num_threads
+                                         : bpe_cpu_count())
+                    * BPE_SHARD_TASKS_PER_THREAD;
+    ctx.tasks = bpe_malloc(ctx.max_tasks * sizeof(struct shard_task));
+    if (ctx.tasks == NULL) {
+        goto done;
     }
 
-    /* Flush remaining vocab tokens */
-    if (ids_buf_len) {
-        size_t bytes_size;
-        char *c_bytes = bpe_decode(&bytes_size, self->vocab,
-                                   ids, ids_buf_len);
-        if (c_bytes == NULL) {
-            bpe_free(ids);
-            Py_DECREF(result);
-            return NULL;
-        }
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = shard_run(&ctx, out, index);
+    if (rc == 0 && fflush(out) != 0) {
+        rc = -3;
+    }
+    if (rc == 0 && fflush(index) != 0) {
+        rc = -4;
+    }
+    Py_END_ALLOW_THREADS
 
-        PyObject *chunk = PyBytes_FromStringAndSize(
-            c_bytes, (Py_ssize_t)bytes_size);
-        PyBytes_Concat(&result, chunk);
-        Py_DECREF(chunk);
-        bpe_free(c_bytes);
+    if (rc == -1) {
+        PyErr_NoMemory();
+    }
+    else if (rc == -2) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Document is too long (limit is 4 GiB per document).");
+    }
+    else if (rc == -3 || rc == -4) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError,
+                                             rc == -3 ? path : index_path);
+    }
+    else {
+        result = Py_BuildValue("nK", (Py_ssize_t)ctx.n_docs,
+                               (unsigned long long)ctx.n_tokens);
     }
 
-    bpe_free(ids);
+done:
+    if (out != NULL && fclose(out) != 0 && result != NULL) {
+        Py_CLEAR(result);
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    }
+    if (index != NULL && fclose(index) != 0 && result != NULL) {
+        Py_CLEAR(result);
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, index_path);
+    }
+    if (result == NULL && out != NULL) {
+        remove(PyBytes_AS_STRING(path));
+    }
+    if (result == NULL && index != NULL) {
+        remove(PyBytes_AS_STRING(index_path));
+    }
+    bpe_free(ctx.docs);
+    bpe_free(ctx.tasks);
+    Py_XDECREF(path);
+    Py_XDECREF(index_path);
+    PyBuffer_Release(&data);
     return result;
 }
 
@@ -540,7 +3165,7 @@ static PyObject *tokenizer_cache_decode(TokenizerObject *self,
     if (token_id < self->vocab->vocab_size) {
         size_t bytes_size;
         char *c_bytes = bpe_decode_one(&bytes_size, self->vocab,
-                                       token_id, self->bytes_cache,
+                                       (bpe_id_t)token_id, self->bytes_cache,
                                        &self->bytes_cache_size);
         if (c_bytes == NULL) {
             return NULL;
@@ -591,6 +3216,36 @@ static PyObject *tokenizer_cache_decode(TokenizerObject *self,
     Py_RETURN_NONE;
 }
 
+/* ---- Tokenizer.to_image(bytes_maps=None) → bytes ---- */
+
+static PyObject *tokenizer_to_image(TokenizerObject *self, PyObject *args,
+                                    PyObject *kwds) {
+    static char *kwlist[] = {"bytes_maps", NULL};
+    PyObject *list_bytes_maps = Py_None;
+    unsigned char remap[256];
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist,
+                                     &list_bytes_maps)) {
+        return NULL;
+    }
+    if (list_bytes_maps != Py_None
+        && parse_bytes_maps(list_bytes_maps, remap) < 0) {
+        return NULL;
+    }
+
+    size_t size = bpe_image_size(self->merges, self->vocab);
+    if (size > PY_SSIZE_T_MAX) {
+        return PyErr_NoMemory();
+    }
+    PyObject *image = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)size);
+    if (image == NULL) {
+        return NULL;
+    }
+    bpe_image_write(PyBytes_AS_STRING(image), self->merges, self->vocab,
+                    list_bytes_maps != Py_None ? remap : NULL);
+    return image;
+}
+
 /* ---- Tokenizer.cache_clean() ---- */
 
 static PyObject *tokenizer_cache_clean(TokenizerObject *self,
@@ -599,6 +3254,232 @@ static PyObject *tokenizer_cache_clean(TokenizerObject *self,
     Py_RETURN_NONE;
 }
 
+/* ---- Tokenizer.encode_cache_info() → dict ---- */
+
+static PyObject *tokenizer_encode_cache_info(TokenizerObject *self,
+                                             PyObject *Py_UNUSED(args)) {
+    uint64_t hits = 0, misses = 0;
+    size_t size = 0, capacity = 0;
+
+    if (self->cache) {
+        bpe_cache_stats(self->cache, &hits, &misses, &size, &capacity);
+    }
+    return Py_BuildValue("{s:K,s:K,s:n,s:n}",
+                         "hits", (unsigned long long)hits,
+                         "misses", (unsigned long long)misses,
+                         "size", (Py_ssize_t)size,
+                         "capacity", (Py_ssize_t)capacity);
+}
+
+/* ---- Tokenizer.encode_cache_clear() ---- */
+
+static PyObject *tokenizer_encode_cache_clear(TokenizerObject *self,
+                                              PyObject *Py_UNUSED(args)) {
+    if (self->cache) {
+        bpe_cache_clear(self->cache);
+    }
+    Py_RETURN_NONE;
+}
+
+/* =========================================================================
+ * StreamDecoder — incremental decode of one token stream
+ * ========================================================================= */
+
+/* A push that decodes to at most this many bytes is assembled on the
+ * stack, so the usual one-token push allocates nothing but its str. */
+#define STREAM_STACK_BYTES 512
+
+static PyTypeObject tokenizer_type;
+
+typedef struct {
+    PyObject_HEAD
+    TokenizerObject *tokenizer;         /* vocab, specials and remap        */
+    PyObject *errors_o;                 /* codec error handler name         */
+    const char *errors;                 /* its UTF-8, owned by errors_o     */
+    unsigned char pending[4];           /* incomplete UTF-8 tail (≤ 3)      */
+    size_t n_pending;
+    int busy;                           /* a push runs without the GIL      */
+} StreamDecoderObject;
+
+/* Start of a UTF-8 sequence at the end of buf[0 .. len) that more bytes
+ * could still complete, or len if there is none.  Invalid bytes are not
+ * held back: the codec's error handler deals with them. */
+static size_t utf8_incomplete_tail(const unsigned char *buf, size_t len) {
+    size_t i = len;
+    while (i > 0 && len - i < 3 && (buf[i - 1] & 0xC0) == 0x80) {
+        i--;
+    }
+    if (i == 0) {
+        return len;
+    }
+    size_t need = (size_t)bpe_utf8_length_from_head(buf[i - 1]);
+    return need > len - (i - 1) ? i - 1 : len;
+}
+
+/* ---- StreamDecoder.__init__(self, tokenizer, errors="strict") ---- */
+
+static int stream_decoder_init(StreamDecoderObject *self, PyObject *args,
+                               PyObject *kwds) {
+    static char *kwlist[] = {"tokenizer", "errors", NULL};
+    PyObject *tokenizer = NULL;
+    PyObject *errors_o = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|U", kwlist,
+                                     &tokenizer_type, &tokenizer,
+                                     &errors_o)) {
+        return -1;
+    }
+    if (errors_o == NULL) {
+        errors_o = PyUnicode_FromString("strict");
+    }
+    else {
+        Py_INCREF(errors_o);
+    }
+    if (errors_o == NULL) {
+        return -1;
+    }
+    const char *errors = PyUnicode_AsUTF8(errors_o);
+    PyObject *handler = errors ? PyCodec_LookupError(errors) : NULL;
+    if (handler == NULL) {
+        Py_DECREF(errors_o);
+        return -1;
+    }
+    Py_DECREF(handler);
+
+    Py_INCREF(tokenizer);
+    Py_XSETREF(self->tokenizer, (TokenizerObject *)tokenizer);
+    Py_XSETREF(self->errors_o, errors_o);
+    self->errors = errors;
+    self->n_pending = 0;
+    self->busy = 0;
+    return 0;
+}
+
+static void stream_decoder_dealloc(StreamDecoderObject *self) {
+    Py_XDECREF(self->tokenizer);
+    Py_XDECREF(self->errors_o);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int stream_decoder_check(StreamDecoderObject *self) {
+    if (self->tokenizer == NULL) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "StreamDecoder is not initialized.");
+        return -1;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "StreamDecoder is in use by another thread.");
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- StreamDecoder.push(int | list[int] | buffer) → str ---- */
+
+/* --------------------------------------------------------------------------
+ * Decode the pending tail plus the new tokens into one buffer, undo the
+ * byte remap, and return everything up to the last complete character;
+ * the rest (at most 3 bytes) waits for the next push.  Only the end of
+ * the buffer is held back, so a partial character followed by a special
+ * token is flushed before it, through the error handler.
+ * -------------------------------------------------------------------------- */
+static PyObject *stream_decoder_push(StreamDecoderObject *self,
+                                     PyObject *ids_o) {
+    if (stream_decoder_check(self) < 0) {
+        return NULL;
+    }
+    TokenizerObject *tok = self->tokenizer;
+    bpe_id_t one;
+    bpe_id_t *ids = &one;
+    size_t ids_len = 1;
+
+    if (PyLong_Check(ids_o)) {
+        if (id_from_object(ids_o, &one) < 0) {
+            if (!PyErr_ExceptionMatches(PyExc_OverflowError)) {
+                return NULL;
+            }
+            PyErr_Clear();
+            one = BPE_ID_MAX;
+        }
+    }
+    else {
+        ids = decode_gather(ids_o, &ids_len, "push");
+        if (ids == NULL) {
+            return NULL;
+        }
+    }
+
+    unsigned char stack[STREAM_STACK_BYTES];
+    unsigned char *buf = NULL;
+    size_t held = self->n_pending;
+    size_t total = held;
+    PyObject *specials = NULL;
+    PyObject *result = NULL;
+
+    if (tokenizer_decode_plan(tok, ids, ids_len, &total, &specials) == 0) {
+        buf = total <= sizeof(stack) ? stack : bpe_malloc(total);
+    }
+    if (buf) {
+        memcpy(buf, self->pending, held);
+        self->busy = 1;
+        tokenizer_decode_fill(tok, ids, ids_len, specials, buf + held,
+                              buf + total);
+        self->busy = 0;
+        if (tok->has_remap) {
+            bpe_remap_bytes(buf + held, buf + held, total - held,
+                            tok->inverse);
+        }
+
+        size_t emit = utf8_incomplete_tail(buf, total);
+        self->n_pending = total - emit;
+        memcpy(self->pending, buf + emit, self->n_pending);
+        result = PyUnicode_DecodeUTF8((const char *)buf, (Py_ssize_t)emit,
+                                      self->errors);
+    }
+
+    if (buf != stack) {
+        bpe_free(buf);
+    }
+    Py_XDECREF(specials);
+    if (ids != &one) {
+        bpe_free(ids);
+    }
+    return result;
+}
+
+/* ---- StreamDecoder.flush() → str ---- */
+
+static PyObject *stream_decoder_flush(StreamDecoderObject *self,
+                                      PyObject *Py_UNUSED(args)) {
+    if (stream_decoder_check(self) < 0) {
+        return NULL;
+    }
+    size_t n = self->n_pending;
+    self->n_pending = 0;
+    return PyUnicode_DecodeUTF8((const char *)self->pending, (Py_ssize_t)n,
+                                self->errors);
+}
+
+/* ---- StreamDecoder.reset() ---- */
+
+static PyObject *stream_decoder_reset(StreamDecoderObject *self,
+                                      PyObject *Py_UNUSED(args)) {
+    if (stream_decoder_check(self) < 0) {
+        return NULL;
+    }
+    self->n_pending = 0;
+    Py_RETURN_NONE;
+}
+
+/* ---- StreamDecoder.pending → bytes ---- */
+
+static PyObject *stream_decoder_get_pending(StreamDecoderObject *self,
+                                            void *Py_UNUSED(closure)) {
+    return PyBytes_FromStringAndSize((const char *)self->pending,
+                                     (Py_ssize_t)self->n_pending);
+}
+
 /* =========================================================================
  * BytesRemap — callable byte permutation (for tiktoken compat)
  * ========================================================================= */
@@ -668,14 +3549,14 @@ static PyObject *bytes_remap_call(BytesRemapObject *self, PyObject *args,
         return NULL;
     }
 
-    unsigned char *buf = bpe_malloc((size_t)bytes_size);
-    for (Py_ssize_t i = 0; i < bytes_size; i++) {
-        buf[i] = self->_map[(unsigned char)bytes[i]];
+    /* Permute straight into the result */
+    PyObject *result = PyBytes_FromStringAndSize(NULL, bytes_size);
+    if (result == NULL) {
+        return NULL;
     }
-
-    PyObject *result = PyBytes_FromStringAndSize((const char *)buf,
-                                                 bytes_size);
-    bpe_free(buf);
+    bpe_remap_bytes((unsigned char *)PyBytes_AS_STRING(result),
+                    (const unsigned char *)bytes, (size_t)bytes_size,
+                    self->_map);
     return result;
 }
 
@@ -695,7 +3576,31 @@ static PyMethodDef trainer_methods[] = {
     {"step",        (PyCFunction)trainer_step,        METH_NOARGS,
      "Perform one BPE training step.\n\n"
      "Returns (pair, rank, frequency) or None if no more pairs."},
-    {"load_merges", (PyCFunction)trainer_load_merges, METH_VARARGS | METH_KEYWORDS,
+    {"add",         (PyCFunction)(void (*)(void))trainer_add,
+     METH_VARARGS | METH_KEYWORDS,
+     "Add more pieces (and optional counts) before training starts.\n\n"
+     "Lets a corpus be fed in batches, e.g. from an iterator, instead of\n"
+     "as one list."},
+    {"add_files",   (PyCFunction)(void (*)(void))trainer_add_files,
+     METH_VARARGS | METH_KEYWORDS,
+     "Read, pre-tokenize and count the pieces of the files in paths\n"
+     "natively, before training starts.\n\n"
+     "pretokenizer is \"bytelevel\" or \"none\" (whole files).  Files are\n"
+     "cut into segments of about segment_size bytes (0 = 1 MiB) at line\n"
+     "breaks and counted on num_threads threads with the GIL released.\n"
+     "Pieces are added as if every chunk of every file were added in\n"
+     "order."},
+    {"train",       (PyCFunction)(void (*)(void))trainer_train,
+     METH_VARARGS | METH_KEYWORDS,
+     "Run up to n_merges steps (None = until no pair is left) in C with\n"
+     "the GIL released; returns the number performed.\n\n"
+     "Stops early before a pair occurring fewer than min_frequency times,\n"
+     "or once the vocabulary (256 + merges, loaded ones included) reaches\n"
+     "target_vocab_size (0 = no target).  callback(step, total, pair,\n"
+     "rank, frequency) is called every progress_every steps (default 1)\n"
+     "and after the last one."},
+    {"load_merges", (PyCFunction)(void (*)(void))trainer_load_merges,
+     METH_VARARGS | METH_KEYWORDS,
      "Load existing merges for continue-training."},
     {NULL}  /* Sentinel */
 };
@@ -704,7 +3609,9 @@ static PyTypeObject trainer_type = {
     .ob_base = PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "bpe.Trainer",
     .tp_doc = PyDoc_STR("BPE trainer implemented in C.\n\n"
-                         "Construct with a list of bytes or bytearray chunks."),
+                         "Construct with a list of bytes or bytearray chunks,\n"
+                         "optional per-chunk counts and num_threads (0 = all\n"
+                         "cores).  The GIL is released during step()."),
     .tp_basicsize = sizeof(TrainerObject),
     .tp_itemsize = 0,
     .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
@@ -715,9 +3622,41 @@ static PyTypeObject trainer_type = {
     .tp_methods = trainer_methods,
 };
 
+static PyGetSetDef model_getset[] = {
+    {"merges",     (getter)model_get_merges,     NULL,
+     "List of merge pairs defining the vocabulary.", NULL},
+    {"vocab",      (getter)model_get_vocab,      NULL,
+     "Vocabulary dict mapping token ID → bytes (no special tokens).", NULL},
+    {"n_vocab",    (getter)model_get_n_vocab,    NULL,
+     "Vocabulary size (256 + n_merges).", NULL},
+    {"bytes_maps", (getter)model_get_bytes_maps, NULL,
+     "The byte permutation stored with the model, or None.", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject model_type = {
+    .ob_base = PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "bpe.Model",
+    .tp_doc = PyDoc_STR("Immutable BPE merges table and vocabulary.\n\n"
+                         "Construct with a list of merge pairs or a binary\n"
+                         "model image, and optionally the model's bytes_maps.\n"
+                         "Pass it as `merges` to any number of Tokenizers to\n"
+                         "share one copy of the tables."),
+    .tp_basicsize = sizeof(ModelObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)model_init,
+    .tp_dealloc = (destructor)model_dealloc,
+    .tp_weaklistoffset = offsetof(ModelObject, weakreflist),
+    .tp_getset = model_getset,
+};
+
 static PyGetSetDef tokenizer_getset[] = {
     {"merges",  (getter)tokenizer_get_merges,   NULL,
      "List of merge pairs defining the vocabulary.", NULL},
+    {"model",   (getter)tokenizer_get_model,    NULL,
+     "The (possibly shared) Model holding the merges table and vocab.", NULL},
     {"vocab",   (getter)tokenizer_get_vocab,    NULL,
      "Vocabulary dict mapping token ID → bytes.", NULL},
     {"n_vocab", (getter)tokenizer_get_n_vocab,  NULL,
@@ -729,11 +3668,86 @@ static PyMethodDef tokenizer_methods[] = {
     {"encode",       (PyCFunction)tokenizer_encode,       METH_O,
      "Encode bytes into a list of token IDs."},
     {"decode",       (PyCFunction)tokenizer_decode,       METH_O,
-     "Decode a list of token IDs into bytes."},
+     "Decode token IDs into bytes.\n\n"
+     "Accepts a list of ints or any contiguous buffer of integers\n"
+     "(array.array, numpy, memoryview) of 1, 2, 4 or 8 bytes per item."},
+    {"decode_text",  (PyCFunction)tokenizer_decode_text,  METH_O,
+     "Decode token IDs into str, undoing bytes_maps.\n\n"
+     "Accepts what decode() accepts; invalid UTF-8 raises\n"
+     "UnicodeDecodeError."},
+    {"encode_text",  (PyCFunction)tokenizer_encode_text,  METH_O,
+     "Pre-tokenize, remap and encode a str in one native pass.\n\n"
+     "Requires the tokenizer to be constructed with a pretokenizer."},
+    {"encode_chunks", (PyCFunction)(void (*)(void))tokenizer_encode_chunks,
+     METH_VARARGS | METH_KEYWORDS,
+     "Encode a list of str chunks (already pre-tokenized), remapping\n"
+     "bytes and, unless match_special=False, matching special tokens as\n"
+     "encode_text() does.  With max_tokens >= 0, return only the first\n"
+     "max_tokens IDs and stop encoding there."},
+    {"count_chunks", (PyCFunction)(void (*)(void))tokenizer_count_chunks,
+     METH_VARARGS | METH_KEYWORDS,
+     "len(encode_chunks(chunks, match_special)) without building the\n"
+     "list."},
+    {"encode_special", (PyCFunction)(void (*)(void))tokenizer_encode_special,
+     METH_VARARGS | METH_KEYWORDS,
+     "Encode str, cutting it at special tokens found anywhere in it.\n\n"
+     "mask is None (every special token allowed) or bytes with one code\n"
+     "per special token in dict order: 0 = encode as text, 1 = allowed,\n"
+     "2 = disallowed (ValueError if present).  With max_tokens >= 0,\n"
+     "return only the first max_tokens IDs and stop encoding there.\n"
+     "Requires a pretokenizer."},
+    {"count_special", (PyCFunction)(void (*)(void))tokenizer_count_special,
+     METH_VARARGS | METH_KEYWORDS,
+     "len(encode_special(text, mask)) without building the list."},
+    {"split_special", (PyCFunction)(void (*)(void))tokenizer_split_special,
+     METH_VARARGS | METH_KEYWORDS,
+     "Split str at the special tokens allowed by mask (as in\n"
+     "encode_special()): text between them as str, each token as its ID."},
+    {"stable_prefix", (PyCFunction)tokenizer_stable_prefix, METH_O,
+     "Length in characters of the prefix of a str whose chunks cannot\n"
+     "change when more text is appended (all but the last two chunks).\n\n"
+     "Requires the tokenizer to be constructed with a pretokenizer."},
+    {"encode_batch", (PyCFunction)(void (*)(void))tokenizer_encode_batch,
+     METH_VARARGS | METH_KEYWORDS,
+     "Encode documents on a native thread pool.\n\n"
+     "chunks is a list of documents, each a list of bytes chunks\n"
+     "(or str segments, pre-tokenized natively when a pretokenizer is\n"
+     "set); returns one list of token IDs per document.\n"
+     "num_threads=0 uses every core.  The GIL is released while encoding."},
+    {"encode_to_array", (PyCFunction)(void (*)(void))tokenizer_encode_to_array,
+     METH_VARARGS | METH_KEYWORDS,
+     "Encode one document (a list of chunks, as in encode_batch) without\n"
+     "boxing each ID.\n\n"
+     "Returns an array.array('I'), or, if out is a writable contiguous\n"
+     "buffer of 4- or 8-byte integers, fills it and returns the number\n"
+     "of IDs written (ValueError if it is too small)."},
+    {"encode_to_shard", (PyCFunction)(void (*)(void))tokenizer_encode_to_shard,
+     METH_VARARGS | METH_KEYWORDS,
+     "Encode a buffer of UTF-8 documents into a packed token file.\n\n"
+     "encode_to_shard(data, path, index_path, separator=b'\\n', eot=-1,\n"
+     "                itemsize=4, num_threads=0) -> (n_docs, n_tokens)\n\n"
+     "data (e.g. an mmap) is split on separator; empty documents are\n"
+     "skipped.  Each document is encoded as by encode_text(), followed by\n"
+     "eot if >= 0, and written to path as native-endian integers of\n"
+     "itemsize bytes.  index_path receives n_docs + 1 uint64 token\n"
+     "offsets.  Documents are encoded on a native thread pool with the\n"
+     "GIL released."},
     {"cache_decode", (PyCFunction)tokenizer_cache_decode, METH_O,
      "Streaming decode: accept one token ID, return decoded bytes or None."},
     {"cache_clean",  (PyCFunction)tokenizer_cache_clean,  METH_NOARGS,
      "Clear the streaming decode cache."},
+    {"to_image",     (PyCFunction)(void (*)(void))tokenizer_to_image,
+     METH_VARARGS | METH_KEYWORDS,
+     "Serialize the merges table and vocabulary as a binary model image.\n\n"
+     "The bytes_maps permutation, if given, is stored alongside.  Pass the\n"
+     "image (or an mmap of a file holding it) back as `merges` to load it."},
+    {"encode_cache_info",  (PyCFunction)tokenizer_encode_cache_info,
+     METH_NOARGS,
+     "Encode cache counters: dict with hits, misses, size and capacity.\n\n"
+     "All zero when the tokenizer has no cache (encode_cache_size=0)."},
+    {"encode_cache_clear", (PyCFunction)tokenizer_encode_cache_clear,
+     METH_NOARGS,
+     "Drop every cached chunk encoding and reset the counters."},
     {NULL}  /* Sentinel */
 };
 
@@ -741,8 +3755,13 @@ static PyTypeObject tokenizer_type = {
     .ob_base = PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "bpe.Tokenizer",
     .tp_doc = PyDoc_STR("BPE tokenizer implemented in C.\n\n"
-                         "Construct with a list of merge pairs and optionally\n"
-                         "a dict of special tokens (bytes → id)."),
+                         "Construct with a list of merge pairs, a binary\n"
+                         "model image from to_image() or a shared Model, and\n"
+                         "optionally a dict of special tokens (bytes → id), a\n"
+                         "native pretokenizer (\"bytelevel\" or \"none\") and\n"
+                         "a bytes_maps permutation applied before encoding.\n"
+                         "encode_cache_size > 0 keeps an LRU cache of that\n"
+                         "many short chunk encodings."),
     .tp_basicsize = sizeof(TokenizerObject),
     .tp_itemsize = 0,
     .tp_flags = Py_TPFLAGS_DEFAULT,
@@ -767,6 +3786,104 @@ static PyTypeObject bytes_remap_type = {
     .tp_call = (ternaryfunc)bytes_remap_call,
 };
 
+static PyGetSetDef stream_decoder_getset[] = {
+    {"pending", (getter)stream_decoder_get_pending, NULL,
+     "Bytes of an incomplete character held for the next push.", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef stream_decoder_methods[] = {
+    {"push",  (PyCFunction)stream_decoder_push,  METH_O,
+     "Decode one token ID, a list of IDs or a buffer of integers.\n\n"
+     "Returns the text completed so far (possibly \"\"); bytes of an\n"
+     "unfinished character are held for the next push."},
+    {"flush", (PyCFunction)stream_decoder_flush, METH_NOARGS,
+     "End the stream: decode the held bytes through the error handler\n"
+     "and clear them."},
+    {"reset", (PyCFunction)stream_decoder_reset, METH_NOARGS,
+     "Drop the held bytes."},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject stream_decoder_type = {
+    .ob_base = PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "bpe.StreamDecoder",
+    .tp_doc = PyDoc_STR("Incremental decoder for one token stream.\n\n"
+                         "Construct with a Tokenizer and a codec error\n"
+                         "handler (default \"strict\").  Each stream needs\n"
+                         "its own decoder; any number can share a\n"
+                         "Tokenizer."),
+    .tp_basicsize = sizeof(StreamDecoderObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)stream_decoder_init,
+    .tp_dealloc = (destructor)stream_decoder_dealloc,
+    .tp_getset = stream_decoder_getset,
+    .tp_methods = stream_decoder_methods,
+};
+
+/* =========================================================================
+ * pretokenize() — expose the native scanner for inspection and testing
+ * ========================================================================= */
+
+static PyObject *module_pretokenize(PyObject *Py_UNUSED(module), PyObject *args,
+                                    PyObject *kwds) {
+    static char *kwlist[] = {"text", "pretokenizer", NULL};
+    PyObject *text_o = NULL;
+    const char *name = "bytelevel";
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "U|s", kwlist,
+                                     &text_o, &name)) {
+        return NULL;
+    }
+
+    enum bpe_pretokenizer kind;
+    if (strcmp(name, "bytelevel") == 0) {
+        kind = BPE_PRETOK_BYTELEVEL;
+    }
+    else if (strcmp(name, "none") == 0) {
+        kind = BPE_PRETOK_NONE;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+                     "Unknown pretokenizer \"%s\" "
+                     "(expected \"bytelevel\" or \"none\").", name);
+        return NULL;
+    }
+
+    Py_ssize_t size;
+    const char *text = PyUnicode_AsUTF8AndSize(text_o, &size);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    PyObject *chunks = PyList_New(0);
+    size_t pos = 0;
+    while (chunks && pos < (size_t)size) {
+        size_t end = bpe_pretokenize_next(kind, (const unsigned char *)text,
+                                          (size_t)size, pos);
+        PyObject *chunk = PyBytes_FromStringAndSize(text + pos,
+                                                    (Py_ssize_t)(end - pos));
+        if (chunk == NULL || PyList_Append(chunks, chunk) < 0) {
+            Py_XDECREF(chunk);
+            Py_CLEAR(chunks);
+            break;
+        }
+        Py_DECREF(chunk);
+        pos = end;
+    }
+    return chunks;
+}
+
+static PyMethodDef module_methods[] = {
+    {"pretokenize", (PyCFunction)(void (*)(void))module_pretokenize,
+     METH_VARARGS | METH_KEYWORDS,
+     "pretokenize(text, pretokenizer=\"bytelevel\") -> list[bytes]\n\n"
+     "Split text with a native pre-tokenizer; returns UTF-8 chunks."},
+    {NULL}  /* Sentinel */
+};
+
 /* =========================================================================
  * Module definition
  * ========================================================================= */
@@ -776,13 +3893,38 @@ static PyModuleDef bpe_module = {
     .m_name = "bpe",
     .m_doc = "TinyBPE C extension — ultra-fast BPE tokenizer and trainer.",
     .m_size = -1,
+    .m_methods = module_methods,
 };
 
 PyMODINIT_FUNC PyInit_bpe(void) {
     /* Ready the types */
     if (PyType_Ready(&trainer_type) < 0
+        || PyType_Ready(&model_type) < 0
         || PyType_Ready(&tokenizer_type) < 0
-        || PyType_Ready(&bytes_remap_type) < 0) {
+        || PyType_Ready(&bytes_remap_type) < 0
+        || PyType_Ready(&stream_decoder_type) < 0) {
+        return NULL;
+    }
+
+    /* encode_to_array() results are array('I'); its items must be 32-bit */
+    PyObject *array_module = PyImport_ImportModule("array");
+    if (array_module == NULL) {
+        return NULL;
+    }
+    ids_array_template = PyObject_CallMethod(array_module, "array", "s[i]",
+                                             "I", 0);
+    Py_DECREF(array_module);
+    if (ids_array_template == NULL) {
+        return NULL;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(ids_array_template, &view, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+    PyBuffer_Release(&view);
+    if (view.len != 4) {
+        PyErr_SetString(PyExc_ImportError,
+                        "tinybpe requires a 32-bit C unsigned int.");
         return NULL;
     }
 
@@ -800,10 +3942,20 @@ PyMODINIT_FUNC PyInit_bpe(void) {
         return NULL;
     }
 
+    /* Add Model */
+    Py_INCREF(&model_type);
+    if (PyModule_AddObject(m, "Model", (PyObject *)&model_type) < 0) {
+        Py_DECREF(&trainer_type);
+        Py_DECREF(&model_type);
+        Py_DECREF(m);
+        return NULL;
+    }
+
     /* Add Tokenizer */
     Py_INCREF(&tokenizer_type);
     if (PyModule_AddObject(m, "Tokenizer", (PyObject *)&tokenizer_type) < 0) {
         Py_DECREF(&trainer_type);
+        Py_DECREF(&model_type);
         Py_DECREF(&tokenizer_type);
         Py_DECREF(m);
         return NULL;
@@ -813,8 +3965,22 @@ PyMODINIT_FUNC PyInit_bpe(void) {
     Py_INCREF(&bytes_remap_type);
     if (PyModule_AddObject(m, "BytesRemap", (PyObject *)&bytes_remap_type) < 0) {
         Py_DECREF(&trainer_type);
+        Py_DECREF(&model_type);
+        Py_DECREF(&tokenizer_type);
+        Py_DECREF(&bytes_remap_type);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    /* Add StreamDecoder */
+    Py_INCREF(&stream_decoder_type);
+    if (PyModule_AddObject(m, "StreamDecoder",
+                           (PyObject *)&stream_decoder_type) < 0) {
+        Py_DECREF(&trainer_type);
+        Py_DECREF(&model_type);
         Py_DECREF(&tokenizer_type);
         Py_DECREF(&bytes_remap_type);
+        Py_DECREF(&stream_decoder_type);
         Py_DECREF(m);
         return NULL;
     }
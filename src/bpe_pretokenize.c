@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Native pre-tokenizer — see bpe_pretokenize.h.
+ *
+ * The "bytelevel" scanner tries the seven alternatives of the pattern
+ * in order at the current position, mirroring the regex engine's
+ * leftmost-first semantics, including the backtracking that
+ * `\s*[\r\n]+` and `\s+(?!\S)` perform inside a whitespace run.
+ */
+
+#include "bpe_pretokenize.h"
+#include "bpe_common.h"
+#include "bpe_unicode_tables.h"
+
+/* --------------------------------------------------------------------------
+ * Character classes (values match scripts/gen_unicode_tables.py).
+ * -------------------------------------------------------------------------- */
+enum bpe_char_class {
+    CLASS_OTHER = 0,
+    CLASS_LETTER = 1,    /* \p{L} */
+    CLASS_NUMBER = 2,    /* \p{N} */
+    CLASS_SPACE = 3,     /* \s    */
+};
+
+/* Decoded codepoint for a byte that does not start valid UTF-8 */
+#define CP_INVALID 0xFFFFFFFFu
+
+static inline int char_class(uint32_t cp) {
+    if (cp >= 0x110000) {
+        return CLASS_OTHER;
+    }
+    return bpe_ucd_stage2[((size_t)bpe_ucd_stage1[cp >> BPE_UCD_BLOCK_SHIFT]
+                           << BPE_UCD_BLOCK_SHIFT)
+                          + (cp & BPE_UCD_BLOCK_MASK)];
+}
+
+/* --------------------------------------------------------------------------
+ * Decode the UTF-8 character at s[pos] into *cp; return its byte length.
+ * Malformed or truncated sequences decode as CP_INVALID, length 1.
+ * -------------------------------------------------------------------------- */
+static inline size_t utf8_decode(const unsigned char *s, size_t len,
+                                 size_t pos, uint32_t *cp) {
+    unsigned char b = s[pos];
+    if (b < 0x80) {
+        *cp = b;
+        return 1;
+    }
+
+    size_t n = (size_t)bpe_utf8_length_from_head(b);
+    if (n < 2 || n > len - pos) {
+        *cp = CP_INVALID;
+        return 1;
+    }
+
+    uint32_t c = b & (0x7F >> n);
+    for (size_t k = 1; k < n; k++) {
+        if ((s[pos + k] & 0xC0) != 0x80) {
+            *cp = CP_INVALID;
+            return 1;
+        }
+        c = (c << 6) | (s[pos + k] & 0x3F);
+    }
+    *cp = c;
+    return n;
+}
+
+static inline int is_crlf(uint32_t cp) {
+    return cp == '\r' || cp == '\n';
+}
+
+/* Advance past a run of characters of class `cls` starting at pos. */
+static size_t skip_class(const unsigned char *s, size_t len, size_t pos,
+                         int cls) {
+    while (pos < len) {
+        uint32_t cp;
+        size_t n = utf8_decode(s, len, pos, &cp);
+        if (char_class(cp) != cls) {
+            break;
+        }
+        pos += n;
+    }
+    return pos;
+}
+
+static size_t skip_crlf(const unsigned char *s, size_t len, size_t pos) {
+    while (pos < len && is_crlf(s[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+/* --------------------------------------------------------------------------
+ * (?i:'s|'t|'re|'ve|'m|'ll|'d) — s[pos] is the character after the
+ * apostrophe.  Returns the byte length of the suffix, or 0.
+ *
+ * Under the regex module's case folding, U+017F LATIN SMALL LETTER LONG S
+ * also matches `s`; no other non-ASCII codepoint folds to these letters.
+ * -------------------------------------------------------------------------- */
+static size_t contraction_length(const unsigned char *s, size_t len,
+                                 size_t pos) {
+    unsigned char c = s[pos] | 0x20;
+
+    switch (c) {
+    case 's':
+    case 't':
+    case 'm':
+    case 'd':
+        return 1;
+    case 'r':
+    case 'v':
+        return (pos + 1 < len && (s[pos + 1] | 0x20) == 'e') ? 2 : 0;
+    case 'l':
+        return (pos + 1 < len && (s[pos + 1] | 0x20) == 'l') ? 2 : 0;
+    default:
+        break;
+    }
+
+    /* U+017F ſ */
+    if (s[pos] == 0xC5 && pos + 1 < len && s[pos + 1] == 0xBF) {
+        return 2;
+    }
+    return 0;
+}
+
+static size_t bytelevel_next(const unsigned char *s, size_t len, size_t pos) {
+    uint32_t cp;
+    size_t next = pos + utf8_decode(s, len, pos, &cp);
+    int cls = char_class(cp);
+
+    /* 1. (?i:'s|'t|'re|'ve|'m|'ll|'d) */
+    if (cp == '\'' && next < len) {
+        size_t m = contraction_length(s, len, next);
+        if (m) {
+            return next + m;
+        }
+    }
+
+    /* 2. [^\r\n\p{L}\p{N}]?\p{L}+ */
+    if (cls == CLASS_LETTER) {
+        return skip_class(s, len, next, CLASS_LETTER);
+    }
+    if (cls != CLASS_NUMBER && !is_crlf(cp) && next < len) {
+        uint32_t cp1;
+        size_t n1 = utf8_decode(s, len, next, &cp1);
+        if (char_class(cp1) == CLASS_LETTER) {
+            return skip_class(s, len, next + n1, CLASS_LETTER);
+        }
+    }
+
+    /* 3. \p{N} */
+    if (cls == CLASS_NUMBER) {
+        return next;
+    }
+
+    /* 4.  ?[^\s\p{L}\p{N}]+[\r\n]* */
+    if (cls == CLASS_OTHER) {
+        return skip_crlf(s, len, skip_class(s, len, next, CLASS_OTHER));
+    }
+    if (cp == ' ' && next < len) {
+        uint32_t cp1;
+        size_t n1 = utf8_decode(s, len, next, &cp1);
+        if (char_class(cp1) == CLASS_OTHER) {
+            return skip_crlf(s, len,
+                             skip_class(s, len, next + n1, CLASS_OTHER));
+        }
+    }
+
+    /* cls == CLASS_SPACE: measure the whole whitespace run */
+    size_t end = next;
+    size_t last_start = pos;                  /* start of the run's last char */
+    size_t crlf_end = is_crlf(cp) ? next : 0; /* end of the run's last CR/LF  */
+    while (end < len) {
+        uint32_t c;
+        size_t n = utf8_decode(s, len, end, &c);
+        if (char_class(c) != CLASS_SPACE) {
+            break;
+        }
+        last_start = end;
+        end += n;
+        if (is_crlf(c)) {
+            crlf_end = end;
+        }
+    }
+
+    /* 5. \s*[\r\n]+ — backtracks to the last CR/LF of the run */
+    if (crlf_end) {
+        return crlf_end;
+    }
+
+    /* 6. \s+(?!\S) — whole run at end of text, else all but its last char */
+    if (end == len) {
+        return end;
+    }
+    if (last_start > pos) {
+        return last_start;
+    }
+
+    /* 7. \s+ — a single space before a non-space */
+    return end;
+}
+
+size_t bpe_pretokenize_next(enum bpe_pretokenizer kind,
+                            const unsigned char *text, size_t len,
+                            size_t pos) {
+    switch (kind) {
+    case BPE_PRETOK_BYTELEVEL:
+        return bytelevel_next(text, len, pos);
+    case BPE_PRETOK_NONE:
+    default:
+        return len;
+    }
+}
+
+/* Does the chunk s[start, end) end with a \s character? */
+static int ends_in_space(const unsigned char *s, size_t start, size_t end) {
+    size_t pos = end - 1;
+    while (pos > start && end - pos < 4 && (s[pos] & 0xC0) == 0x80) {
+        pos--;
+    }
+    uint32_t cp;
+    if (utf8_decode(s, end, pos, &cp) != end - pos) {
+        return 0;
+    }
+    return char_class(cp) == CLASS_SPACE;
+}
+
+size_t bpe_pretokenize_stable_prefix(enum bpe_pretokenizer kind,
+                                     const unsigned char *text, size_t len) {
+    /* A cut right after whitespace is never used: scanned on its own, the
+     * prefix would end in a run that \s+(?!\S) takes whole, where the
+     * full text split it.  `clean` is the last usable chunk start seen;
+     * `prev` and `stable` lag it by one and two chunks. */
+    size_t stable = 0, prev = 0, clean = 0;
+    for (size_t pos = 0; pos < len;) {
+        stable = prev;
+        prev = clean;
+        size_t end = bpe_pretokenize_next(kind, text, len, pos);
+        if (end < len && !ends_in_space(text, pos, end)) {
+            clean = end;
+        }
+        pos = end;
+    }
+    return stable;
+}
+
+size_t bpe_pretokenize_line_cut(enum bpe_pretokenizer kind,
+                                const unsigned char *text, size_t len) {
+    if (kind != BPE_PRETOK_BYTELEVEL) {
+        return 0;
+    }
+    for (size_t p = len ? len - 1 : 0; p > 0; p--) {
+        if (text[p - 1] == '\n' && text[p] > ' ' && text[p] < 0x7F) {
+            return p;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Native pre-tokenizer — splits UTF-8 text into BPE chunks.
+ *
+ * A hand-written scanner (no regex engine) for the built-in patterns of
+ * models/models.json:
+ *
+ *   "bytelevel" — (?i:'s|'t|'re|'ve|'m|'ll|'d)
+ *                 |[^\r\n\p{L}\p{N}]?\p{L}+
+ *                 |\p{N}
+ *                 | ?[^\s\p{L}\p{N}]+[\r\n]*
+ *                 |\s*[\r\n]+
+ *                 |\s+(?!\S)
+ *                 |\s+
+ *   "none"      — the whole text is one chunk
+ *
+ * The scanner produces exactly the chunks `regex.findall` would, using
+ * the codepoint class tables generated by scripts/gen_unicode_tables.py.
+ * Every byte of the input belongs to exactly one chunk.
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It is pure C99.
+ */
+
+#ifndef SRC_BPE_PRETOKENIZE_H
+#define SRC_BPE_PRETOKENIZE_H
+
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+ * Built-in pre-tokenization patterns.
+ * -------------------------------------------------------------------------- */
+enum bpe_pretokenizer {
+    BPE_PRETOK_NONE = 0,         /* whole input as one chunk     */
+    BPE_PRETOK_BYTELEVEL = 1,    /* the "bytelevel" regex above  */
+};
+
+/* --------------------------------------------------------------------------
+ * Return the end offset of the chunk that starts at text[pos].
+ *
+ * Requires pos < len.  The result is always > pos, so repeatedly calling
+ * with pos = previous end walks the whole input.  Invalid UTF-8 bytes
+ * are treated as one-byte "other" characters.
+ * -------------------------------------------------------------------------- */
+size_t bpe_pretokenize_next(enum bpe_pretokenizer kind,
+                            const unsigned char *text, size_t len,
+                            size_t pos);
+
+/* --------------------------------------------------------------------------
+ * Return the length of a prefix of text that pre-tokenizes the same on
+ * its own as inside text + anything appended: it ends at the start of
+ * the second to last chunk, or earlier, at a chunk start not preceded by
+ * whitespace.  More text may merge into or re-split the last two chunks
+ * (a run of spaces, digits or letters cut by a block boundary), but not
+ * the ones before them, so a stream can encode the prefix now and carry
+ * the rest into the next block.
+ * -------------------------------------------------------------------------- */
+size_t bpe_pretokenize_stable_prefix(enum bpe_pretokenizer kind,
+                                     const unsigned char *text, size_t len);
+
+/* --------------------------------------------------------------------------
+ * Return the last offset p (0 < p < len) where text can be split into
+ * two parts that pre-tokenize on their own exactly as inside text, or 0
+ * if there is none (always for BPE_PRETOK_NONE).
+ *
+ * Only line breaks are considered: a "\n" followed by printable ASCII.
+ * No bytelevel chunk runs on past a line break into a non-space
+ * character, so p is a chunk boundary, and chunks never look behind
+ * their start.  Unlike bpe_pretokenize_stable_prefix() this scans
+ * backwards and stops at the first match, so it costs little on text
+ * with lines.
+ * -------------------------------------------------------------------------- */
+size_t bpe_pretokenize_line_cut(enum bpe_pretokenizer kind,
+                                const unsigned char *text, size_t len);
+
+#endif  /* SRC_BPE_PRETOKENIZE_H */
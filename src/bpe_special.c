@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Special-token scanner — see bpe_special.h.
+ */
+
+#include "bpe_special.h"
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+ * Trie node.  Node 0 is the root; 0 also terminates child and sibling
+ * lists, since the root is nobody's child.
+ * -------------------------------------------------------------------------- */
+struct scanner_node {
+    uint32_t child;                 /* first child, 0 = leaf             */
+    uint32_t sibling;               /* next child of the same parent     */
+    uint32_t pattern;               /* index + 1 of the pattern ending
+                                       here, 0 = none                    */
+    unsigned char byte;             /* edge label from the parent        */
+};
+
+struct bpe_scanner {
+    struct scanner_node *nodes;
+    uint32_t root[256];             /* root children by byte, 0 = none   */
+    int single_first;               /* the one first byte, or -1         */
+    size_t n_patterns;
+    size_t *offsets;                /* n_patterns + 1 offsets into blob  */
+    unsigned char *blob;            /* all pattern bytes                 */
+};
+
+/* Child of `node` labelled `byte`, or 0. */
+static uint32_t scanner_child(const struct bpe_scanner *s, uint32_t node,
+                              unsigned char byte) {
+    if (node == 0) {
+        return s->root[byte];
+    }
+    uint32_t c = s->nodes[node].child;
+    while (c != 0 && s->nodes[c].byte != byte) {
+        c = s->nodes[c].sibling;
+    }
+    return c;
+}
+
+struct bpe_scanner *bpe_scanner_build(const unsigned char *const *patterns,
+                                      const size_t *sizes, size_t n) {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (sizes[i] == 0 || sizes[i] > UINT32_MAX - 1 - total) {
+            return NULL;
+        }
+        total += sizes[i];
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    struct bpe_scanner *s = bpe_malloc(sizeof(struct bpe_scanner));
+    if (s == NULL) {
+        return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->nodes = bpe_malloc((total + 1) * sizeof(struct scanner_node));
+    s->offsets = bpe_malloc((n + 1) * sizeof(size_t));
+    s->blob = bpe_malloc(total);
+    if (s->nodes == NULL || s->offsets == NULL || s->blob == NULL) {
+        bpe_scanner_free(s);
+        return NULL;
+    }
+    memset(&s->nodes[0], 0, sizeof(struct scanner_node));
+    s->n_patterns = n;
+
+    /* Insert each pattern, sharing prefixes */
+    uint32_t n_nodes = 1;
+    size_t offset = 0;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(s->blob + offset, patterns[i], sizes[i]);
+        s->offsets[i] = offset;
+        offset += sizes[i];
+
+        uint32_t node = 0;
+        for (size_t k = 0; k < sizes[i]; k++) {
+            unsigned char byte = patterns[i][k];
+            uint32_t next = scanner_child(s, node, byte);
+            if (next == 0) {
+                next = n_nodes++;
+                struct scanner_node *nn = &s->nodes[next];
+                nn->child = 0;
+                nn->pattern = 0;
+                nn->byte = byte;
+                if (node == 0) {
+                    nn->sibling = 0;
+                    s->root[byte] = next;
+                }
+                else {
+                    nn->sibling = s->nodes[node].child;
+                    s->nodes[node].child = next;
+                }
+            }
+            node = next;
+        }
+        /* A duplicate keeps its first index */
+        if (s->nodes[node].pattern == 0) {
+            s->nodes[node].pattern = (uint32_t)(i + 1);
+        }
+    }
+    s->offsets[n] = offset;
+
+    /* Prefilter: one shared first byte lets memchr() do the skipping */
+    s->single_first = patterns[0][0];
+    for (size_t i = 1; i < n; i++) {
+        if (patterns[i][0] != patterns[0][0]) {
+            s->single_first = -1;
+            break;
+        }
+    }
+    return s;
+}
+
+void bpe_scanner_free(struct bpe_scanner *s) {
+    if (s) {
+        bpe_free(s->nodes);
+        bpe_free(s->offsets);
+        bpe_free(s->blob);
+        bpe_free(s);
+    }
+}
+
+size_t bpe_scanner_count(const struct bpe_scanner *s) {
+    return s->n_patterns;
+}
+
+const unsigned char *bpe_scanner_pattern(const struct bpe_scanner *s,
+                                         size_t i, size_t *size) {
+    *size = s->offsets[i + 1] - s->offsets[i];
+    return s->blob + s->offsets[i];
+}
+
+size_t bpe_scanner_find(const struct bpe_scanner *s,
+                        const unsigned char *text, size_t len, size_t pos,
+                        const unsigned char *select, unsigned char want,
+                        size_t *index, size_t *size) {
+    for (size_t p = pos; p < len; p++) {
+        /* Skip to the next byte that starts a pattern */
+        if (s->single_first >= 0) {
+            const unsigned char *q = memchr(text + p, s->single_first,
+                                            len - p);
+            if (q == NULL) {
+                break;
+            }
+            p = (size_t)(q - text);
+        }
+        else {
+            while (p < len && s->root[text[p]] == 0) {
+                p++;
+            }
+            if (p == len) {
+                break;
+            }
+        }
+
+        /* Longest selected pattern starting at p */
+        uint32_t best = 0;
+        size_t best_end = p;
+        uint32_t node = s->root[text[p]];
+        for (size_t k = p + 1;; k++) {
+            uint32_t pattern = s->nodes[node].pattern;
+            if (pattern != 0
+                && (select == NULL || select[pattern - 1] == want)) {
+                best = pattern;
+                best_end = k;
+            }
+            if (k == len) {
+                break;
+            }
+            node = scanner_child(s, node, text[k]);
+            if (node == 0) {
+                break;
+            }
+        }
+        if (best != 0) {
+            *index = best - 1;
+            *size = best_end - p;
+            return p;
+        }
+    }
+    return len;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Special-token scanner: finds special token strings anywhere in UTF-8
+ * text in one pass.
+ *
+ * Tokenizer.encode() has to cut the text at every special token before
+ * pre-tokenizing the pieces in between.  Doing that with a regex
+ * alternation of all tokens costs a lot per call for models with
+ * hundreds of them; this scanner compiles the set once.
+ *
+ * ## Design
+ *
+ * The patterns form a byte trie whose root has a dense 256-entry child
+ * table; deeper nodes keep sibling lists, which stay short because
+ * special tokens share long prefixes ("<|", "<｜").  A 256-entry table of
+ * first bytes is the prefilter: text is skipped until a byte that starts
+ * some pattern, with memchr() (vectorized by the C library) when every
+ * pattern starts with the same byte, as most sets do.  From a candidate
+ * position the trie walk records the longest selected pattern.
+ *
+ * Matches are leftmost-longest, like a regex alternation sorted by
+ * length and then split from left to right: the earliest start wins,
+ * then the longest pattern at that start.
+ *
+ * Callers pick which patterns count per call with a `select` array of
+ * one code per pattern (see bpe_scanner_find), so allowed and disallowed
+ * sets need no rebuild.
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It is pure C99.
+ */
+
+#ifndef SRC_BPE_SPECIAL_H
+#define SRC_BPE_SPECIAL_H
+
+#include "bpe_common.h"
+
+struct bpe_scanner;
+
+/* --------------------------------------------------------------------------
+ * Compile n non-empty patterns; pattern i is patterns[i][0 .. sizes[i]).
+ * The bytes are copied.  Returns NULL on allocation failure or if n is 0.
+ * -------------------------------------------------------------------------- */
+struct bpe_scanner *bpe_scanner_build(const unsigned char *const *patterns,
+                                      const size_t *sizes, size_t n);
+
+/* --------------------------------------------------------------------------
+ * Free a scanner.  Safe to call with NULL.
+ * -------------------------------------------------------------------------- */
+void bpe_scanner_free(struct bpe_scanner *s);
+
+/* Number of patterns. */
+size_t bpe_scanner_count(const struct bpe_scanner *s);
+
+/* Bytes of pattern i (*size receives its length). */
+const unsigned char *bpe_scanner_pattern(const struct bpe_scanner *s,
+                                         size_t i, size_t *size);
+
+/* --------------------------------------------------------------------------
+ * Find the leftmost-longest occurrence in text[pos .. len) of a pattern i
+ * with select[i] == want (select NULL: every pattern counts).
+ *
+ * Returns the match start and sets *index and *size, or returns len if
+ * there is none.  Read-only: callable from any thread.
+ * -------------------------------------------------------------------------- */
+size_t bpe_scanner_find(const struct bpe_scanner *s,
+                        const unsigned char *text, size_t len, size_t pos,
+                        const unsigned char *select, unsigned char want,
+                        size_t *index, size_t *size);
+
+#endif /* SRC_BPE_SPECIAL_H */
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * File-backed growable buffer — see bpe_store.h.
+ *
+ * A resize maps the file at its new size before unmapping the old view
+ * (both views share the file's pages), so a failed resize leaves the
+ * old mapping intact.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bpe_store.h"
+#include "bpe_common.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct bpe_store {
+    void *data;              /* current view, NULL while size is 0 */
+    size_t size;             /* bytes mapped                        */
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+bpe_store_t *bpe_store_new(const char *dir) {
+    size_t path_size = strlen(dir) + 32;
+#ifdef _WIN32
+    if (path_size < MAX_PATH) {
+        path_size = MAX_PATH;  /* GetTempFileNameA writes up to MAX_PATH */
+    }
+#endif
+    char *path = bpe_malloc(path_size);
+    bpe_store_t *store = bpe_malloc(sizeof(bpe_store_t));
+    if (path == NULL || store == NULL) {
+        bpe_free(path);
+        bpe_free(store);
+        return NULL;
+    }
+    memset(store, 0, sizeof(*store));
+
+#ifdef _WIN32
+    store->file = INVALID_HANDLE_VALUE;
+    if (GetTempFileNameA(dir, "tbp", 0, path) != 0) {
+        store->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0,
+                                  NULL, CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_TEMPORARY
+                                  | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    }
+    if (store->file == INVALID_HANDLE_VALUE) {
+        bpe_free(path);
+        bpe_free(store);
+        return NULL;
+    }
+#else
+    snprintf(path, path_size, "%s/tinybpe-XXXXXX", dir);
+    store->fd = mkstemp(path);
+    if (store->fd < 0) {
+        bpe_free(path);
+        bpe_free(store);
+        return NULL;
+    }
+    unlink(path);
+#endif
+
+    bpe_free(path);
+    return store;
+}
+
+#ifndef _WIN32
+/* Grow the file from `from` to `to` bytes with its disk blocks
+ * allocated: a store on a full disk then fails here, rather than with
+ * SIGBUS on the first write to a page that has no block.  File systems
+ * without fallocate() (and macOS, which lacks posix_fallocate()) get a
+ * sparse file.  Returns 0 or an errno value. */
+static int store_reserve(int fd, size_t from, size_t to) {
+#ifndef __APPLE__
+    int err = posix_fallocate(fd, (off_t)from, (off_t)(to - from));
+    if (err != EINVAL && err != EOPNOTSUPP) {
+        return err;
+    }
+#endif
+    (void)from;
+    return ftruncate(fd, (off_t)to) < 0 ? errno : 0;
+}
+#endif
+
+void *bpe_store_resize(bpe_store_t *store, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    ULARGE_INTEGER n;
+    n.QuadPart = size > store->size ? size : store->size;
+    HANDLE mapping = CreateFileMappingA(store->file, NULL, PAGE_READWRITE,
+                                        n.HighPart, n.LowPart, NULL);
+    if (mapping == NULL) {
+        errno = GetLastError() == ERROR_DISK_FULL ? ENOSPC : EIO;
+        return NULL;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (store->data) {
+        UnmapViewOfFile(store->data);
+        CloseHandle(store->mapping);
+    }
+    store->mapping = mapping;
+#else
+    int err = size > store->size
+              ? store_reserve(store->fd, store->size, size) : 0;
+    void *data = MAP_FAILED;
+    if (err == 0) {
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    store->fd, 0);
+        err = data == MAP_FAILED ? errno : 0;
+    }
+    if (err) {
+        if (size > store->size && ftruncate(store->fd, (off_t)store->size)) {
+            /* the file stays larger than the mapping; harmless */
+        }
+        errno = err;
+        return NULL;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    if (store->data) {
+        munmap(store->data, store->size);
+    }
+    if (size < store->size && ftruncate(store->fd, (off_t)size)) {
+        /* as above: only disk space is left unreclaimed */
+    }
+#endif
+
+    store->data = data;
+    store->size = size;
+    return data;
+}
+
+void bpe_store_free(bpe_store_t *store) {
+    if (store == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    if (store->data) {
+        UnmapViewOfFile(store->data);
+        CloseHandle(store->mapping);
+    }
+    CloseHandle(store->file);
+#else
+    if (store->data) {
+        munmap(store->data, store->size);
+    }
+    close(store->fd);
+#endif
+    bpe_free(store);
+}
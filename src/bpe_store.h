@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * File-backed growable buffer for data larger than RAM.
+ *
+ * A store is an anonymous scratch file, memory-mapped read-write.  It
+ * stands in for a bpe_malloc() buffer: the caller resizes it like
+ * bpe_realloc() and reads and writes through the returned pointer.
+ * The OS pages the data in and out, so only the parts being touched
+ * stay resident; sequential passes are advised to the kernel.
+ *
+ * The file is removed as soon as it is created (POSIX) or when it is
+ * closed (Win32), so nothing is left behind if the process dies.
+ *
+ * Stores are not thread-safe; threads may access the mapped data
+ * concurrently between resizes.
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It uses POSIX mmap(), or
+ * Win32 file mappings when built with MSVC.
+ */
+
+#ifndef SRC_BPE_STORE_H
+#define SRC_BPE_STORE_H
+
+#include <stddef.h>
+
+typedef struct bpe_store bpe_store_t;
+
+/* --------------------------------------------------------------------------
+ * Create an empty store backed by a new scratch file in directory `dir`.
+ * Returns NULL if the file cannot be created or on allocation failure.
+ * -------------------------------------------------------------------------- */
+bpe_store_t *bpe_store_new(const char *dir);
+
+/* --------------------------------------------------------------------------
+ * Resize the store to `size` bytes (> 0), keeping the first
+ * min(old, new) bytes.  Returns the new address of the data, which may
+ * differ from the previous one, or NULL with errno set on failure
+ * (the store is then unchanged).  Growing allocates the new disk
+ * blocks, so a full disk fails here (ENOSPC) rather than on a later
+ * write through the mapping.
+ * -------------------------------------------------------------------------- */
+void *bpe_store_resize(bpe_store_t *store, size_t size);
+
+/* --------------------------------------------------------------------------
+ * Unmap and delete the store.  Safe to call with NULL.
+ * -------------------------------------------------------------------------- */
+void bpe_store_free(bpe_store_t *store);
+
+#endif  /* SRC_BPE_STORE_H */
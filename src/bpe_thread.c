@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Native worker pool — see bpe_thread.h.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bpe_thread.h"
+#include "bpe_common.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* Blocks handed out per thread on average; smaller blocks balance
+ * better, larger ones touch the shared counter less often. */
+#define BPE_PARALLEL_BLOCKS_PER_THREAD 16
+
+/* --------------------------------------------------------------------------
+ * Shared loop state: the next unclaimed index, guarded by a mutex.
+ * -------------------------------------------------------------------------- */
+struct bpe_parallel {
+    bpe_task_fn fn;
+    void *ctx;
+    size_t n_tasks;
+    size_t grain;            /* indices claimed per lock acquisition */
+    size_t next;             /* first unclaimed index                */
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+unsigned int bpe_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (unsigned int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+#endif
+}
+
+/* Claim the next block of indices.  Returns 0 when the loop is done. */
+static int parallel_claim(struct bpe_parallel *p, size_t *begin, size_t *end) {
+    int more;
+
+#ifdef _WIN32
+    EnterCriticalSection(&p->lock);
+#else
+    pthread_mutex_lock(&p->lock);
+#endif
+    *begin = p->next;
+    more = *begin < p->n_tasks;
+    if (more) {
+        *end = p->n_tasks - *begin > p->grain ? *begin + p->grain : p->n_tasks;
+        p->next = *end;
+    }
+#ifdef _WIN32
+    LeaveCriticalSection(&p->lock);
+#else
+    pthread_mutex_unlock(&p->lock);
+#endif
+
+    return more;
+}
+
+static void parallel_work(struct bpe_parallel *p) {
+    size_t begin, end;
+
+    while (parallel_claim(p, &begin, &end)) {
+        for (size_t i = begin; i < end; i++) {
+            p->fn(p->ctx, i);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_thread_main(LPVOID arg) {
+    parallel_work((struct bpe_parallel *)arg);
+    return 0;
+}
+#else
+static void *parallel_thread_main(void *arg) {
+    parallel_work((struct bpe_parallel *)arg);
+    return NULL;
+}
+#endif
+
+void bpe_parallel_for(size_t n_tasks, unsigned int n_threads,
+                      bpe_task_fn fn, void *ctx) {
+    if (n_tasks == 0) {
+        return;
+    }
+    if (n_threads == 0) {
+        n_threads = bpe_cpu_count();
+    }
+    if ((size_t)n_threads > n_tasks) {
+        n_threads = (unsigned int)n_tasks;
+    }
+
+    /* Single thread: no locking, no spawning */
+    if (n_threads == 1) {
+        for (size_t i = 0; i < n_tasks; i++) {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    struct bpe_parallel p;
+    p.fn = fn;
+    p.ctx = ctx;
+    p.n_tasks = n_tasks;
+    p.next = 0;
+    p.grain = n_tasks / ((size_t)n_threads * BPE_PARALLEL_BLOCKS_PER_THREAD);
+    if (p.grain == 0) {
+        p.grain = 1;
+    }
+
+#ifdef _WIN32
+    HANDLE *threads = bpe_malloc((n_threads - 1) * sizeof(HANDLE));
+    InitializeCriticalSection(&p.lock);
+#else
+    pthread_t *threads = bpe_malloc((n_threads - 1) * sizeof(pthread_t));
+    pthread_mutex_init(&p.lock, NULL);
+#endif
+
+    /* Spawn helpers; on any failure the caller simply does more work */
+    unsigned int started = 0;
+    if (threads) {
+        for (; started < n_threads - 1; started++) {
+#ifdef _WIN32
+            threads[started] = CreateThread(NULL, 0, parallel_thread_main,
+                                            &p, 0, NULL);
+            if (threads[started] == NULL) {
+                break;
+            }
+#else
+            if (pthread_create(&threads[started], NULL,
+                               parallel_thread_main, &p) != 0) {
+                break;
+            }
+#endif
+        }
+    }
+
+    parallel_work(&p);
+
+    for (unsigned int t = 0; t < started; t++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+#else
+        pthread_join(threads[t], NULL);
+#endif
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(&p.lock);
+#else
+    pthread_mutex_destroy(&p.lock);
+#endif
+    bpe_free(threads);
+}
+
+/* --------------------------------------------------------------------------
+ * Mutex
+ * -------------------------------------------------------------------------- */
+struct bpe_mutex {
+#ifdef _WIN32
+    CRITICAL_SECTION cs;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+bpe_mutex_t *bpe_mutex_new(void) {
+    bpe_mutex_t *m = bpe_malloc(sizeof(bpe_mutex_t));
+    if (m == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    InitializeCriticalSection(&m->cs);
+#else
+    if (pthread_mutex_init(&m->mutex, NULL) != 0) {
+        bpe_free(m);
+        return NULL;
+    }
+#endif
+    return m;
+}
+
+void bpe_mutex_free(bpe_mutex_t *m) {
+    if (m) {
+#ifdef _WIN32
+        DeleteCriticalSection(&m->cs);
+#else
+        pthread_mutex_destroy(&m->mutex);
+#endif
+        bpe_free(m);
+    }
+}
+
+void bpe_mutex_lock(bpe_mutex_t *m) {
+#ifdef _WIN32
+    EnterCriticalSection(&m->cs);
+#else
+    pthread_mutex_lock(&m->mutex);
+#endif
+}
+
+void bpe_mutex_unlock(bpe_mutex_t *m) {
+#ifdef _WIN32
+    LeaveCriticalSection(&m->cs);
+#else
+    pthread_mutex_unlock(&m->mutex);
+#endif
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2025-2026 Yinan Liao and other contributors.
+ * SPDX-License-Identifier: MIT
+ *
+ * Minimal native worker pool for data-parallel loops.
+ *
+ * bpe_parallel_for() runs fn(ctx, i) for every i in [0, n_tasks) on up
+ * to n_threads OS threads (the calling thread is one of them).  Workers
+ * claim small blocks of indices from a shared counter, so uneven task
+ * sizes (short vs long documents) balance automatically.
+ *
+ * bpe_mutex_* is a portable mutex for data shared between such tasks
+ * (or between Python threads that run with the GIL released).
+ *
+ * Task functions run without the Python GIL and must not touch Python
+ * objects; they may call bpe_malloc() / bpe_free().
+ *
+ * ## Pure C Portability
+ *
+ * This module does NOT include <Python.h>.  It uses POSIX threads, or
+ * Win32 threads when built with MSVC.
+ */
+
+#ifndef SRC_BPE_THREAD_H
+#define SRC_BPE_THREAD_H
+
+#include <stddef.h>
+
+typedef void (*bpe_task_fn)(void *ctx, size_t index);
+
+/* --------------------------------------------------------------------------
+ * Number of online CPUs (at least 1).  Used when the caller asks for
+ * num_threads = 0 ("use every core").
+ * -------------------------------------------------------------------------- */
+unsigned int bpe_cpu_count(void);
+
+/* --------------------------------------------------------------------------
+ * Run fn(ctx, i) for i in [0, n_tasks) on up to n_threads threads.
+ *
+ * n_threads = 0 means bpe_cpu_count().  The pool never starts more
+ * threads than there are tasks.  If a thread cannot be created, the
+ * threads that did start (at minimum the caller) finish the remaining
+ * work, so every index is always processed exactly once.  Returns once
+ * all tasks are done.
+ * -------------------------------------------------------------------------- */
+void bpe_parallel_for(size_t n_tasks, unsigned int n_threads,
+                      bpe_task_fn fn, void *ctx);
+
+/* --------------------------------------------------------------------------
+ * Opaque mutex.  bpe_mutex_new() returns NULL on allocation failure;
+ * bpe_mutex_free() is safe to call with NULL.
+ * -------------------------------------------------------------------------- */
+typedef struct bpe_mutex bpe_mutex_t;
+
+bpe_mutex_t *bpe_mutex_new(void);
+void bpe_mutex_free(bpe_mutex_t *m);
+void bpe_mutex_lock(bpe_mutex_t *m);
+void bpe_mutex_unlock(bpe_mutex_t *m);
+
+#endif  /* SRC_BPE_THREAD_H */
@@ -9,7 +9,7 @@
  * Greedy lowest-rank-first algorithm:
  *   1. Each byte becomes a base token ID (0-255)
  *   2. Each iteration:
- *      a. Look up the merge rank of every adjacent pair in the AVL tree
+ *      a. Look up the merge rank of every adjacent pair in the hash table
  *      b. Find the pair with the smallest (lowest) rank
  *      c. If no pair has a valid rank, stop — encoding complete
  *      d. Compact the sequence by replacing all occurrences of the
@@ -27,7 +27,7 @@
  *
  * ## Data Structures
  *
- *   bpe_merges     — AVL tree: (left, right) pair → rank
+ *   bpe_merges     — open-addressing hash table: (left, right) → rank
  *   bpe_vocab      — flat array: token ID → byte sequence
  *   bytes_cache[4] — streaming decode reassembly buffer
  */
@@ -36,148 +36,376 @@
 #include <string.h>
 
 /* --------------------------------------------------------------------------
- * AVL tree node for the merges search tree.  Maps a (left, right) pair
- * to its merge rank (256 + index).
+ * Chunks of at most this many bytes are encoded with the in-place rank
+ * scan; longer chunks switch to the linked-list + min-heap engine.
  * -------------------------------------------------------------------------- */
-struct bpe_merges_node {
-    struct avl_node node;
-    bpe_pair_t pair;
-    unsigned long rank;
-};
+#define BPE_ENCODE_SCAN_MAX 64
 
 /* --------------------------------------------------------------------------
- * Temporary record for pair-to-rank lookup during encoding.
- * ULONG_MAX (= ~0UL) serves as the "no merge found" sentinel.
+ * Min-heap entry for the long-chunk merge engine: (rank << 32) | pos.
+ *
+ * Packing both fields into one integer makes the heap order — by rank,
+ * then by position so equal-rank merges are applied left to right — a
+ * single comparison.  Ranks always fit in 32 bits; positions do because
+ * bpe_encode() rejects chunks longer than BPE_ENCODE_MAX_BYTES.
  * -------------------------------------------------------------------------- */
-struct bpe_pair_stats {
-    bpe_pair_t pair;
-    unsigned long merges_rank;
-};
-
-static int merges_cmp_func(struct avl_node *a, struct avl_node *b) {
-    struct bpe_merges_node *n1, *n2;
+typedef uint64_t bpe_heap_entry_t;
 
-    n1 = _get_entry(a, struct bpe_merges_node, node);
-    n2 = _get_entry(b, struct bpe_merges_node, node);
+#define BPE_HEAP_ENTRY(rank, pos) (((uint64_t)(rank) << 32) | (uint64_t)(pos))
+#define BPE_HEAP_ARITY 4
 
-    return bpe_pair_cmp(&n1->pair, &n2->pair);
-}
+/* Linked-list terminator for the 32-bit prev/next arrays. */
+#define BPE_POS_NONE UINT32_MAX
 
 /* --------------------------------------------------------------------------
- * Build the merges search tree.
+ * Build the merges lookup table.
  *
- * Each pair gets rank = 256 + index.  All nodes are allocated in a
- * single contiguous block for cache efficiency.
+ * Each pair gets rank = 256 + index.  The table capacity is the
+ * smallest power of two ≥ 2 × len (minimum 16), keeping the load
+ * factor at or below 0.5 so probe sequences stay short.  If a pair
+ * appears more than once, the first (lowest) rank wins.
  * -------------------------------------------------------------------------- */
-struct bpe_merges *bpe_merges_build(bpe_pair_t *pairs, size_t len) {
-    struct bpe_merges *merges = bpe_malloc(sizeof(struct bpe_merges));
+struct bpe_merges *bpe_merges_build(const bpe_pair_t *pairs, size_t len) {
+    unsigned int bits = 4;
+    while (((size_t)1 << bits) < len * 2) {
+        bits++;
+    }
+    size_t capacity = (size_t)1 << bits;
 
-    avl_init(&merges->tree);
+    struct bpe_merges *merges = bpe_malloc(sizeof(struct bpe_merges));
+    if (merges == NULL) {
+        return NULL;
+    }
 
-    struct bpe_merges_node *node_buf =
-        bpe_malloc(len * sizeof(struct bpe_merges_node));
-    merges->nodes_mem = node_buf;
+    struct bpe_merges_entry *table =
+        bpe_malloc(capacity * sizeof(struct bpe_merges_entry));
+    if (table == NULL) {
+        bpe_free(merges);
+        return NULL;
+    }
+    memset(table, 0, capacity * sizeof(struct bpe_merges_entry));
+    merges->table = table;
+    merges->mask = capacity - 1;
+    merges->bits = bits;
+    merges->n_merges = 0;
+    merges->mem = table;
 
     for (size_t i = 0; i < len; i++) {
-        node_buf[i].pair = pairs[i];
-        node_buf[i].rank = (unsigned long)(256 + i);
+        uint64_t key = bpe_pair_key(pairs[i].left, pairs[i].right);
+        size_t slot = bpe_pair_hash(key, bits);
+
+        while (table[slot].rank != 0 && table[slot].key != key) {
+            slot = (slot + 1) & merges->mask;
+        }
 
-        avl_insert(&merges->tree, &node_buf[i].node, merges_cmp_func);
+        if (table[slot].rank == 0) {
+            table[slot].key = key;
+            table[slot].rank = (uint32_t)(256 + i);
+            merges->n_merges++;
+        }
     }
 
     return merges;
 }
 
 /* --------------------------------------------------------------------------
- * Free the merges search tree.
+ * Free the merges lookup table.
  * -------------------------------------------------------------------------- */
 void bpe_merges_free(struct bpe_merges *m) {
     if (m) {
-        bpe_free(m->nodes_mem);
-        m->nodes_mem = NULL;
+        bpe_free(m->mem);
+        m->mem = NULL;
+        m->table = NULL;
         bpe_free(m);
     }
 }
 
 /* --------------------------------------------------------------------------
- * Encode bytes → token IDs via greedy lowest-rank-first merging.
+ * Short-chunk engine: greedy merging with a cached rank array.
  *
- * The output buffer starts at the same size as the input (worst case:
- * no merges applied).  Each merge iteration compacts the buffer
- * in-place (new_ids_i ≤ current index, so no overwrite risk).
+ * ranks[i] holds the merge rank of (ids[i], ids[i + 1]).  Each round
+ * merges the leftmost lowest-rank pair, shifts the tail down by one and
+ * re-ranks only the two pairs that touch the merged token.
  *
- * The stats array is allocated once and reused across iterations.
- * Its size shrinks with the sequence length.
+ * Merging one occurrence per round is equivalent to merging every
+ * occurrence of the winning pair at once: a merged token X can only
+ * appear in pairs whose rank is greater than X, so the remaining
+ * occurrences of the same pair still win the following rounds, in
+ * left-to-right order.
  * -------------------------------------------------------------------------- */
-unsigned long *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
-                          const char *bytes, size_t bytes_size) {
-    /* Guard against overflow */
-    if (bytes_size > SIZE_MAX / sizeof(unsigned long)) {
-        *ids_len = 0;
-        return NULL;
-    }
-    unsigned long *buf_ids = bpe_malloc(bytes_size * sizeof(unsigned long));
+static size_t encode_scan(bpe_id_t *ids, size_t len,
+                          const struct bpe_merges *merges) {
+    bpe_id_t ranks[BPE_ENCODE_SCAN_MAX];
 
-    /* Initialize: each byte → base token ID (0-255) */
-    for (size_t i = 0; i < bytes_size; i++) {
-        buf_ids[i] = (unsigned long)((unsigned char)bytes[i]);
+    for (size_t i = 0; i + 1 < len; i++) {
+        ranks[i] = bpe_merges_rank(merges, ids[i], ids[i + 1]);
     }
 
-    size_t len = bytes_size;
-    struct bpe_pair_stats *stats =
-        bpe_malloc((len - 1) * sizeof(struct bpe_pair_stats));
-
-    struct bpe_merges_node lookup;
     while (len > 1) {
-        /* Phase 1: look up the merge rank for every adjacent pair */
-        for (size_t i = 0; i < len - 1; i++) {
-            lookup.pair.left = buf_ids[i];
-            lookup.pair.right = buf_ids[i + 1];
-            stats[i].pair = lookup.pair;
-
-            struct avl_node *_node =
-                avl_search(&merges->tree, &lookup.node, merges_cmp_func);
-            if (_node) {
-                struct bpe_merges_node *_n =
-                    _get_entry(_node, struct bpe_merges_node, node);
-                stats[i].merges_rank = _n->rank;
-            }
-            else {
-                stats[i].merges_rank = (unsigned long)(-1); /* no merge */
+        /* Find the leftmost pair with the lowest merge rank */
+        size_t min_i = 0;
+        for (size_t i = 1; i < len - 1; i++) {
+            if (ranks[i] < ranks[min_i]) {
+                min_i = i;
             }
         }
 
-        /* Phase 2: find the pair with the lowest merge rank */
-        struct bpe_pair_stats *_min = &stats[0];
-        for (size_t i = 1; i < len - 1; i++) {
-            if (stats[i].merges_rank < _min->merges_rank) {
-                _min = &stats[i];
+        if (ranks[min_i] == BPE_RANK_NONE) {
+            break; /* no more merges possible */
+        }
+
+        /* Replace the pair with its merged ID and drop the right half */
+        ids[min_i] = ranks[min_i];
+        for (size_t i = min_i + 1; i + 1 < len; i++) {
+            ids[i] = ids[i + 1];
+        }
+        for (size_t i = min_i + 1; i + 2 < len; i++) {
+            ranks[i] = ranks[i + 1];
+        }
+        len--;
+
+        /* Re-rank the pairs on both sides of the merged token */
+        if (min_i + 1 < len) {
+            ranks[min_i] = bpe_merges_rank(merges, ids[min_i], ids[min_i + 1]);
+        }
+        if (min_i > 0) {
+            ranks[min_i - 1] = bpe_merges_rank(merges, ids[min_i - 1], ids[min_i]);
+        }
+    }
+
+    return len;
+}
+
+/* --------------------------------------------------------------------------
+ * 4-ary min-heap primitives.  A wider node halves the depth of a binary
+ * heap, and the four children share one cache line.
+ * -------------------------------------------------------------------------- */
+static void heap_sift_down(bpe_heap_entry_t *heap, size_t size, size_t i) {
+    bpe_heap_entry_t e = heap[i];
+
+    for (;;) {
+        size_t first = BPE_HEAP_ARITY * i + 1;
+        if (first >= size) {
+            break;
+        }
+        size_t last = first + BPE_HEAP_ARITY;
+        if (last > size) {
+            last = size;
+        }
+
+        size_t child = first;
+        for (size_t c = first + 1; c < last; c++) {
+            if (heap[c] < heap[child]) {
+                child = c;
             }
         }
+        if (heap[child] >= e) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = e;
+}
 
-        if (_min->merges_rank == (unsigned long)(-1)) {
-            break; /* no more merges possible */
+static void heap_push(bpe_heap_entry_t *heap, size_t *size, bpe_heap_entry_t e) {
+    size_t i = (*size)++;
+
+    while (i > 0) {
+        size_t parent = (i - 1) / BPE_HEAP_ARITY;
+        if (heap[parent] <= e) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = e;
+}
+
+/* --------------------------------------------------------------------------
+ * LSD radix sort of 64-bit keys, 11 bits per pass.  Passes in which every
+ * key shares the same digit are skipped, so (rank, pos) keys usually take
+ * four passes.  Returns whichever of the two buffers holds the result.
+ * -------------------------------------------------------------------------- */
+static bpe_heap_entry_t *radix_sort_keys(bpe_heap_entry_t *keys,
+                                         bpe_heap_entry_t *tmp, size_t n) {
+    size_t count[2048 + 1];
+
+    for (unsigned int shift = 0; shift < 64; shift += 11) {
+        memset(count, 0, sizeof(count));
+        for (size_t k = 0; k < n; k++) {
+            count[((keys[k] >> shift) & 2047) + 1]++;
         }
 
-        /* Phase 3: compact the sequence by merging the winning pair.
-         * new_ids_i ≤ i always holds, so in-place is safe. */
-        size_t new_ids_i = 0;
-        for (size_t i = 0; i < len; i++) {
-            if (buf_ids[i] == _min->pair.left
-                && i < len - 1
-                && buf_ids[i + 1] == _min->pair.right) {
-                buf_ids[new_ids_i++] = _min->merges_rank;
-                i++; /* skip right half */
+        int trivial = 0;
+        for (size_t d = 0; d < 2048; d++) {
+            if (count[d + 1] == n) {
+                trivial = 1;
             }
-            else {
-                buf_ids[new_ids_i++] = buf_ids[i];
+            count[d + 1] += count[d];
+        }
+        if (trivial) {
+            continue;
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            tmp[count[(keys[k] >> shift) & 2047]++] = keys[k];
+        }
+        bpe_heap_entry_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+
+    return keys;
+}
+
+/* --------------------------------------------------------------------------
+ * Long-chunk engine: doubly linked token list + lazy priority queue.
+ *
+ * Every live position i stores the rank of the pair that starts at it
+ * (rank[i]); dead positions and the tail store BPE_RANK_NONE.  Candidate
+ * merges are (rank, pos) keys drawn from two sources: the initial pairs,
+ * radix-sorted once up front, and a min-heap of pairs created by later
+ * merges.  A popped key is stale — and skipped — when rank[pos] no
+ * longer equals its rank.  Applying a merge removes the right token from
+ * the list and re-ranks only its two neighbours, so a chunk of n bytes
+ * is encoded in O(n log n).
+ *
+ * As in encode_scan(), every pair created by a merge ranks higher than
+ * the merge itself, so popping by (rank, pos) reproduces the classic
+ * round-by-round result exactly.  The per-position arrays are 32-bit to
+ * keep the randomly accessed working set small.
+ *
+ * Returns the final length, or 0 if the scratch allocation failed.
+ * -------------------------------------------------------------------------- */
+static size_t encode_heap(bpe_id_t *ids, size_t len,
+                          const struct bpe_merges *merges) {
+    /* Scratch: initial keys + sort buffer (len each), the heap (each of
+     * the < len merges pushes at most two keys), then rank/prev/next. */
+    char *scratch = bpe_malloc(4 * len * sizeof(bpe_heap_entry_t)
+                               + 3 * len * sizeof(uint32_t));
+    if (scratch == NULL) {
+        return 0;
+    }
+    bpe_heap_entry_t *initial = (bpe_heap_entry_t *)scratch;
+    bpe_heap_entry_t *heap = initial + 2 * len;
+    uint32_t *rank = (uint32_t *)(heap + 2 * len);
+    uint32_t *prev = rank + len;
+    uint32_t *next = prev + len;
+    size_t n_initial = 0;
+    size_t heap_size = 0;
+
+    /* Build the list and collect the initial candidates */
+    for (size_t i = 0; i < len; i++) {
+        bpe_id_t r = (i + 1 < len)
+                         ? bpe_merges_rank(merges, ids[i], ids[i + 1])
+                         : BPE_RANK_NONE;
+        prev[i] = (i > 0) ? (uint32_t)(i - 1) : BPE_POS_NONE;
+        next[i] = (i + 1 < len) ? (uint32_t)(i + 1) : BPE_POS_NONE;
+        rank[i] = r;
+        if (r != BPE_RANK_NONE) {
+            initial[n_initial++] = BPE_HEAP_ENTRY(r, i);
+        }
+    }
+    initial = radix_sort_keys(initial, initial + len, n_initial);
+
+    size_t initial_i = 0;
+    while (initial_i < n_initial || heap_size) {
+        bpe_heap_entry_t top;
+        if (heap_size
+            && (initial_i == n_initial || heap[0] < initial[initial_i])) {
+            top = heap[0];
+            heap[0] = heap[--heap_size];
+            heap_sift_down(heap, heap_size, 0);
+        }
+        else {
+            top = initial[initial_i++];
+        }
+
+        uint32_t i = (uint32_t)top;
+        uint32_t top_rank = (uint32_t)(top >> 32);
+        if (rank[i] != top_rank) {
+            continue; /* stale: the pair at i has changed since the push */
+        }
+
+        /* Merge (i, j) into i and unlink j */
+        uint32_t j = next[i];
+        ids[i] = top_rank;
+        next[i] = next[j];
+        if (next[j] != BPE_POS_NONE) {
+            prev[next[j]] = i;
+        }
+        rank[j] = BPE_RANK_NONE;
+
+        /* Re-rank the pair starting at i */
+        rank[i] = (next[i] != BPE_POS_NONE)
+                      ? bpe_merges_rank(merges, ids[i], ids[next[i]])
+                      : BPE_RANK_NONE;
+        if (rank[i] != BPE_RANK_NONE) {
+            heap_push(heap, &heap_size, BPE_HEAP_ENTRY(rank[i], i));
+        }
+
+        /* Re-rank the pair ending at i */
+        uint32_t p = prev[i];
+        if (p != BPE_POS_NONE) {
+            rank[p] = bpe_merges_rank(merges, ids[p], ids[i]);
+            if (rank[p] != BPE_RANK_NONE) {
+                heap_push(heap, &heap_size, BPE_HEAP_ENTRY(rank[p], p));
             }
         }
+    }
+
+    /* Compact the surviving tokens (position 0 is never unlinked) */
+    size_t new_len = 0;
+    for (uint32_t i = 0; i != BPE_POS_NONE; i = next[i]) {
+        ids[new_len++] = ids[i];
+    }
+
+    bpe_free(scratch);
+    return new_len;
+}
+
+/* --------------------------------------------------------------------------
+ * Encode bytes → token IDs via greedy lowest-rank-first merging.
+ *
+ * The output buffer starts at the same size as the input (worst case:
+ * no merges applied) and is compacted in place.  Short chunks — the
+ * common case after regex pre-tokenization — use encode_scan(); long
+ * chunks (e.g. unsplit documents) use the O(n log n) encode_heap().
+ * -------------------------------------------------------------------------- */
+size_t bpe_encode_inplace(bpe_id_t *ids, size_t len,
+                          const struct bpe_merges *merges) {
+    if (len <= BPE_ENCODE_SCAN_MAX) {
+        return encode_scan(ids, len, merges);
+    }
+    return encode_heap(ids, len, merges);
+}
+
+/* --------------------------------------------------------------------------
+ * Allocate the output buffer, seed it with base IDs, encode in place.
+ * -------------------------------------------------------------------------- */
+bpe_id_t *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
+                     const char *bytes, size_t bytes_size) {
+    *ids_len = 0;
 
-        len = new_ids_i;
+    /* Guard against overflow; encode_heap() indexes positions in 32 bits */
+    if (bytes_size > BPE_ENCODE_MAX_BYTES
+        || bytes_size > SIZE_MAX / sizeof(bpe_id_t)) {
+        return NULL;
+    }
+    bpe_id_t *buf_ids = bpe_malloc(bytes_size * sizeof(bpe_id_t));
+    if (buf_ids == NULL) {
+        return NULL;
     }
 
-    bpe_free(stats);
+    /* Initialize: each byte → base token ID (0-255) */
+    bpe_encode_seed(buf_ids, (const unsigned char *)bytes, bytes_size, NULL);
+
+    size_t len = bpe_encode_inplace(buf_ids, bytes_size, merges);
+    if (len == 0 && bytes_size != 0) {
+        bpe_free(buf_ids);
+        return NULL;
+    }
 
     *ids_len = len;
     return buf_ids;
@@ -191,58 +419,65 @@ unsigned long *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
  * the left token's bytes and the right token's bytes.
  *
  * Two-pass approach:
- *   Pass 1: calculate total memory needed for all token byte sequences
- *   Pass 2: fill the single contiguous bytes_mem allocation
+ *   Pass 1: compute every token's end offset (a prefix sum of sizes)
+ *   Pass 2: fill the bytes array, which follows the offsets in one
+ *           allocation
  * -------------------------------------------------------------------------- */
 struct bpe_vocab *bpe_vocab_build(bpe_pair_t *pairs, size_t len) {
-    struct bpe_vocab *vocab = bpe_malloc(sizeof(struct bpe_vocab));
-    vocab->vocab_size = 256 + len;
+    size_t vocab_size = 256 + len;
 
-    /* Pass 1: calculate sizes */
-    size_t total_bytes_size = 256;
-    size_t *id_bytes_size_buf = bpe_malloc(len * sizeof(size_t));
+    uint64_t *offsets = bpe_malloc((vocab_size + 1) * sizeof(uint64_t));
+    if (offsets == NULL) {
+        return NULL;
+    }
 
+    /* Pass 1: offsets */
+    for (size_t i = 0; i <= 256; i++) {
+        offsets[i] = i;
+    }
     for (size_t i = 0; i < len; i++) {
-        size_t _size = 0;
-        _size += (pairs[i].left < 256)
-                     ? 1
-                     : id_bytes_size_buf[pairs[i].left - 256];
-        _size += (pairs[i].right < 256)
-                     ? 1
-                     : id_bytes_size_buf[pairs[i].right - 256];
+        uint64_t left_size = offsets[pairs[i].left + 1] - offsets[pairs[i].left];
+        uint64_t right_size = offsets[pairs[i].right + 1] - offsets[pairs[i].right];
+        offsets[257 + i] = offsets[256 + i] + left_size + right_size;
+    }
 
-        id_bytes_size_buf[i] = _size;
-        total_bytes_size += _size;
+    size_t offsets_mem = (vocab_size + 1) * sizeof(uint64_t);
+    uint64_t total_bytes_size = offsets[vocab_size];
+    if (total_bytes_size > SIZE_MAX - offsets_mem - BPE_DECODE_WIDE) {
+        bpe_free(offsets);
+        return NULL;
     }
 
-    vocab->bytes_mem = bpe_malloc(total_bytes_size);
-    vocab->tokens = bpe_malloc(vocab->vocab_size * sizeof(struct bpe_token_bytes));
+    struct bpe_vocab *vocab = bpe_malloc(sizeof(struct bpe_vocab));
+    void *mem = bpe_realloc(offsets, offsets_mem + (size_t)total_bytes_size
+                                     + BPE_DECODE_WIDE);
+    if (vocab == NULL || mem == NULL) {
+        bpe_free(vocab);
+        bpe_free(mem == NULL ? offsets : mem);
+        return NULL;
+    }
+    offsets = mem;
+    unsigned char *bytes = (unsigned char *)mem + offsets_mem;
 
-    /* Initialize base tokens: IDs 0-255 map to single bytes */
+    /* Pass 2: base tokens are single bytes, merged tokens concatenate
+     * their (already built) left and right halves */
     for (size_t i = 0; i < 256; i++) {
-        vocab->bytes_mem[i] = (unsigned char)i;
-        vocab->tokens[i].bytes = &vocab->bytes_mem[i];
-        vocab->tokens[i].size = 1;
+        bytes[i] = (unsigned char)i;
     }
-
-    /* Pass 2: build merged tokens by concatenating left + right bytes */
-    unsigned char *bytes_mem_p = vocab->bytes_mem + 256;
     for (size_t i = 0; i < len; i++) {
-        memcpy(bytes_mem_p,
-               vocab->tokens[pairs[i].left].bytes,
-               vocab->tokens[pairs[i].left].size);
-        size_t left_size = vocab->tokens[pairs[i].left].size;
-        memcpy(bytes_mem_p + left_size,
-               vocab->tokens[pairs[i].right].bytes,
-               vocab->tokens[pairs[i].right].size);
-
-        vocab->tokens[i + 256].bytes = bytes_mem_p;
-        vocab->tokens[i + 256].size = id_bytes_size_buf[i];
-
-        bytes_mem_p += id_bytes_size_buf[i];
+        unsigned char *dst = bytes + offsets[256 + i];
+        size_t left_size = (size_t)(offsets[pairs[i].left + 1] - offsets[pairs[i].left]);
+        memcpy(dst, bytes + offsets[pairs[i].left], left_size);
+        memcpy(dst + left_size, bytes + offsets[pairs[i].right],
+               (size_t)(offsets[pairs[i].right + 1] - offsets[pairs[i].right]));
     }
+    memset(bytes + total_bytes_size, 0, BPE_DECODE_WIDE);
 
-    bpe_free(id_bytes_size_buf);
+    vocab->offsets = offsets;
+    vocab->bytes = bytes;
+    vocab->vocab_size = vocab_size;
+    vocab->wide_end = total_bytes_size + 1;
+    vocab->mem = mem;
     return vocab;
 }
 
@@ -251,10 +486,10 @@ struct bpe_vocab *bpe_vocab_build(bpe_pair_t *pairs, size_t len) {
  * -------------------------------------------------------------------------- */
 void bpe_vocab_free(struct bpe_vocab *v) {
     if (v) {
-        bpe_free(v->tokens);
-        v->tokens = NULL;
-        bpe_free(v->bytes_mem);
-        v->bytes_mem = NULL;
+        bpe_free(v->mem);
+        v->mem = NULL;
+        v->offsets = NULL;
+        v->bytes = NULL;
         bpe_free(v);
     }
 }
@@ -266,7 +501,7 @@ void bpe_vocab_free(struct bpe_vocab *v) {
  * Returns NULL (with *bytes_size = 0) if any token ID is out of range.
  * -------------------------------------------------------------------------- */
 char *bpe_decode(size_t *bytes_size, const struct bpe_vocab *vocab,
-                 const unsigned long *ids, size_t ids_len) {
+                 const bpe_id_t *ids, size_t ids_len) {
     /* Calculate total output size */
     size_t buf_size = 0;
     for (size_t i = 0; i < ids_len; i++) {
@@ -274,20 +509,56 @@ char *bpe_decode(size_t *bytes_size, const struct bpe_vocab *vocab,
             *bytes_size = 0;
             return NULL;
         }
-        buf_size += vocab->tokens[ids[i]].size;
+        buf_size += bpe_vocab_token_size(vocab, ids[i]);
     }
 
     *bytes_size = buf_size;
-    char *buf_bytes = bpe_malloc(buf_size);
-    char *p = buf_bytes;
+    unsigned char *buf_bytes = bpe_malloc(buf_size ? buf_size : 1);
+    if (buf_bytes != NULL) {
+        bpe_decode_into(buf_bytes, buf_bytes + buf_size, vocab, ids, ids_len);
+    }
+    return (char *)buf_bytes;
+}
 
-    /* Concatenate token byte sequences */
-    for (size_t i = 0; i < ids_len; i++) {
-        memcpy(p, vocab->tokens[ids[i]].bytes, vocab->tokens[ids[i]].size);
-        p += vocab->tokens[ids[i]].size;
+/* --------------------------------------------------------------------------
+ * Decode kernel.
+ *
+ * Most tokens are 1-8 bytes, where a memcpy call of the exact length
+ * costs more than the copy.  A fixed BPE_DECODE_WIDE-byte memcpy compiles
+ * to one unaligned vector load and store (SSE2 on x86-64, NEON on
+ * AArch64, both baseline), so short tokens are moved in one such block
+ * and dst advances by the true length; the next token overwrites the
+ * excess.  Long tokens, and the few a block could not read or write
+ * safely (see bpe_vocab.wide_end and dst_end), use an exact memcpy.
+ * -------------------------------------------------------------------------- */
+unsigned char *bpe_decode_into(unsigned char *dst, const unsigned char *dst_end,
+                               const struct bpe_vocab *vocab,
+                               const bpe_id_t *ids, size_t ids_len) {
+    const uint64_t *offsets = vocab->offsets;
+    const unsigned char *bytes = vocab->bytes;
+    uint64_t wide_end = vocab->wide_end;
+    size_t i = 0;
+
+    /* Wide stores: stop once a block could pass dst_end */
+    for (; i < ids_len && dst_end - dst >= BPE_DECODE_WIDE; i++) {
+        uint64_t offset = offsets[ids[i]];
+        size_t size = (size_t)(offsets[ids[i] + 1] - offset);
+        if (size <= BPE_DECODE_WIDE && offset < wide_end) {
+            memcpy(dst, bytes + offset, BPE_DECODE_WIDE);
+        }
+        else {
+            memcpy(dst, bytes + offset, size);
+        }
+        dst += size;
     }
 
-    return buf_bytes;
+    /* Tail: exact copies */
+    for (; i < ids_len; i++) {
+        size_t size = bpe_vocab_token_size(vocab, ids[i]);
+        memcpy(dst, bpe_vocab_token(vocab, ids[i]), size);
+        dst += size;
+    }
+    return dst;
 }
 
 /* --------------------------------------------------------------------------
@@ -304,7 +575,7 @@ char *bpe_decode(size_t *bytes_size, const struct bpe_vocab *vocab,
  * forward progress — this handles edge cases with malformed input.
  * -------------------------------------------------------------------------- */
 char *bpe_decode_one(size_t *bytes_size, const struct bpe_vocab *vocab,
-                     unsigned long id, unsigned char *cache,
+                     bpe_id_t id, unsigned char *cache,
                      unsigned long *cache_size) {
     /* Validate cache: if it starts with an invalid UTF-8 lead byte,
      * flush it as a raw byte to ensure forward progress */
@@ -312,7 +583,8 @@ char *bpe_decode_one(size_t *bytes_size, const struct bpe_vocab *vocab,
         *cache_size = 0;
     }
 
-    size_t buf_size = vocab->tokens[id].size + (size_t)(*cache_size);
+    size_t token_size = bpe_vocab_token_size(vocab, id);
+    size_t buf_size = token_size + (size_t)(*cache_size);
     unsigned char *buf_bytes = bpe_malloc(buf_size);
     unsigned char *p = buf_bytes;
 
@@ -323,7 +595,7 @@ char *bpe_decode_one(size_t *bytes_size, const struct bpe_vocab *vocab,
     }
 
     /* Append the new token's bytes */
-    memcpy(p, vocab->tokens[id].bytes, vocab->tokens[id].size);
+    memcpy(p, bpe_vocab_token(vocab, id), token_size);
 
     /* Walk through the buffer consuming complete UTF-8 characters.
      * If a lead byte is invalid (continuation / >0xF4), treat it as
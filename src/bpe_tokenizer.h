@@ -9,11 +9,15 @@
  * Greedy lowest-rank-first merging:
  *   1. Convert input bytes to base token IDs (0-255)
  *   2. In each iteration:
- *      a. Look up every adjacent pair in the merges AVL tree
+ *      a. Look up every adjacent pair in the merges hash table
  *      b. Find the pair with the smallest (lowest) merge rank
  *      c. Replace all occurrences of that pair with its merged token ID
  *   3. Repeat until no more merges are possible
  *
+ * Short chunks run this loop directly over a cached rank array.  Long
+ * chunks use a linked list plus a priority queue of candidate pairs and
+ * only re-rank the neighbours of each merge — O(n log n) overall.
+ *
  * ## Decoding (token IDs → bytes)
  *
  * Direct O(1) lookup: the flat bpe_vocab array maps each token ID to
@@ -39,68 +43,173 @@
 #include "bpe_common.h"
 
 /* --------------------------------------------------------------------------
- * Merges search tree: maps (left, right) pair → rank.
+ * Merges lookup table: maps (left, right) pair → rank.
+ *
+ * A flat open-addressing hash table (linear probing, power-of-two
+ * capacity, load factor ≤ 0.5) keyed on the packed 64-bit pair.  Each
+ * lookup touches one or two adjacent 16-byte slots instead of walking
+ * ~18 levels of a pointer-chasing tree.
  *
- * Used during encoding for O(log n) lookup of the merge rank of any
- * adjacent pair of token IDs.
+ * The rank doubles as the merged token ID (256 + merge index).  Valid
+ * ranks are always ≥ 256, so rank == 0 marks an empty slot.
+ *
+ * Entries have a fixed-width layout so a table can be stored verbatim in
+ * a binary model image (bpe_image.h) and used straight from the mapping;
+ * `mem` is NULL for such a borrowed table.
  * -------------------------------------------------------------------------- */
+struct bpe_merges_entry {
+    uint64_t key;            /* bpe_pair_key(left, right)       */
+    uint32_t rank;           /* merged token ID, 0 = empty slot */
+    uint32_t reserved;       /* zero; pads the slot to 16 bytes */
+};
+
 struct bpe_merges {
-    struct avl_tree tree;    /* AVL tree root                      */
-    void *nodes_mem;         /* contiguous allocation for all nodes */
+    const struct bpe_merges_entry *table;  /* 2^bits slots           */
+    size_t mask;                           /* capacity - 1           */
+    unsigned int bits;                     /* log2(capacity)         */
+    size_t n_merges;                       /* occupied slots         */
+    void *mem;                             /* owned table, or NULL   */
 };
 
+/* Returned by bpe_merges_rank() when the pair has no merge rule. */
+#define BPE_RANK_NONE BPE_ID_MAX
+
 /* --------------------------------------------------------------------------
- * Individual token entry in the flat vocabulary.
+ * Look up the merge rank of a pair.  Returns BPE_RANK_NONE if absent.
  * -------------------------------------------------------------------------- */
-struct bpe_token_bytes {
-    unsigned char *bytes;    /* pointer into vocab->bytes_mem */
-    size_t size;             /* number of bytes for this token */
-};
+static inline bpe_id_t bpe_merges_rank(const struct bpe_merges *merges,
+                                       bpe_id_t left, bpe_id_t right) {
+    uint64_t key = bpe_pair_key(left, right);
+    size_t i = bpe_pair_hash(key, merges->bits);
+
+    for (;;) {
+        const struct bpe_merges_entry *e = &merges->table[i];
+        if (e->rank == 0) {
+            return BPE_RANK_NONE;
+        }
+        if (e->key == key) {
+            return e->rank;
+        }
+        i = (i + 1) & merges->mask;
+    }
+}
 
 /* --------------------------------------------------------------------------
  * Flat vocabulary: (token ID) → bytes.
  *
- * tokens[] is indexed by token ID (0 to vocab_size-1).  All byte
- * sequences are packed into a single bytes_mem allocation for
- * cache efficiency.
+ * All byte sequences are packed back to back in `bytes`; token `id`
+ * spans bytes[offsets[id] .. offsets[id + 1]).  Like the merges table,
+ * both arrays may live in a binary model image, in which case `mem` is
+ * NULL; otherwise they share the single allocation `mem`.
+ *
+ * Decoding copies short tokens in fixed BPE_DECODE_WIDE-byte blocks, which
+ * may read past the token's end.  `wide_end` bounds where that is safe:
+ * a built vocab pads `bytes` with BPE_DECODE_WIDE zero bytes so every
+ * token qualifies; an image has no padding, so its last few tokens take
+ * the exact-length path.
  * -------------------------------------------------------------------------- */
+#define BPE_DECODE_WIDE 16
+
 struct bpe_vocab {
-    struct bpe_token_bytes *tokens;  /* array indexed by token ID    */
+    const uint64_t *offsets;         /* vocab_size + 1 byte offsets  */
+    const unsigned char *bytes;      /* concatenated token bytes     */
     size_t vocab_size;               /* 256 + n_merges               */
-    unsigned char *bytes_mem;        /* single allocation for bytes  */
+    uint64_t wide_end;               /* tokens starting below may be
+                                        read BPE_DECODE_WIDE bytes   */
+    void *mem;                       /* owned arrays, or NULL        */
 };
 
+/* Byte length of token `id` (id < vocab->vocab_size). */
+static inline size_t bpe_vocab_token_size(const struct bpe_vocab *vocab,
+                                          size_t id) {
+    return (size_t)(vocab->offsets[id + 1] - vocab->offsets[id]);
+}
+
+/* First byte of token `id` (id < vocab->vocab_size). */
+static inline const unsigned char *bpe_vocab_token(const struct bpe_vocab *vocab,
+                                                   size_t id) {
+    return vocab->bytes + vocab->offsets[id];
+}
+
 /* --------------------------------------------------------------------------
- * Build the merges search tree from an array of merge pairs.
+ * Build the merges lookup table from an array of merge pairs.
  *
  * Each pair's rank is 256 + its index in the array.  Returns NULL on
  * allocation failure (MemoryError already set by bpe_malloc).
  * -------------------------------------------------------------------------- */
-struct bpe_merges *bpe_merges_build(bpe_pair_t *pairs, size_t len);
+struct bpe_merges *bpe_merges_build(const bpe_pair_t *pairs, size_t len);
 
 /* --------------------------------------------------------------------------
- * Free a merges search tree.  Safe to call with NULL.
+ * Free a merges lookup table (and its table, unless borrowed).  Safe to
+ * call with NULL.
  * -------------------------------------------------------------------------- */
 void bpe_merges_free(struct bpe_merges *m);
 
+/* Longest chunk bpe_encode() accepts (positions are indexed in 32 bits). */
+#define BPE_ENCODE_MAX_BYTES ((size_t)UINT32_MAX - 1)
+
 /* --------------------------------------------------------------------------
  * Encode a byte sequence into BPE token IDs.
  *
  * Uses greedy lowest-rank-first merging.  The returned array must be
- * freed by the caller via bpe_free().  On allocation failure, returns
- * NULL with *ids_len = 0.
+ * freed by the caller via bpe_free().  On allocation failure, or if
+ * bytes_size exceeds BPE_ENCODE_MAX_BYTES, returns NULL with
+ * *ids_len = 0.
  *
  * Parameters:
  *   ids_len    — [out] number of token IDs produced
- *   merges     — the merges search tree
+ *   merges     — the merges lookup table
  *   bytes      — input byte sequence
  *   bytes_size — number of input bytes
  *
- * Returns: dynamically allocated array of unsigned long token IDs.
+ * Returns: dynamically allocated array of token IDs.
  *          Caller must bpe_free() it.
  * -------------------------------------------------------------------------- */
-unsigned long *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
-                          const char *bytes, size_t bytes_size);
+bpe_id_t *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
+                     const char *bytes, size_t bytes_size);
+
+/* --------------------------------------------------------------------------
+ * Encode in place: on entry ids[0..len) hold base token IDs (byte
+ * values, possibly remapped); on return the first N entries hold the
+ * merged IDs and N is returned.
+ *
+ * Lets callers that split text into many chunks encode them straight
+ * into one output buffer without a per-chunk allocation.  Chunks longer
+ * than 64 bytes need scratch memory; on allocation failure returns 0
+ * (for len > 0).  len must not exceed BPE_ENCODE_MAX_BYTES.
+ * -------------------------------------------------------------------------- */
+size_t bpe_encode_inplace(bpe_id_t *ids, size_t len,
+                          const struct bpe_merges *merges);
+
+/* --------------------------------------------------------------------------
+ * Seed ids[0..len) with the base token IDs of `bytes` for
+ * bpe_encode_inplace(): each byte, or remap[byte] when the model permutes
+ * bytes before BPE (remap NULL = identity).  Applying the permutation
+ * here spares callers a remapped copy of the text.
+ * -------------------------------------------------------------------------- */
+static inline void bpe_encode_seed(bpe_id_t *ids, const unsigned char *bytes,
+                                   size_t len, const unsigned char *remap) {
+    if (remap) {
+        for (size_t i = 0; i < len; i++) {
+            ids[i] = remap[bytes[i]];
+        }
+    }
+    else {
+        for (size_t i = 0; i < len; i++) {
+            ids[i] = bytes[i];
+        }
+    }
+}
+
+/* Apply a 256-entry byte permutation: dst[i] = table[src[i]] (dst may be
+ * src). */
+static inline void bpe_remap_bytes(unsigned char *dst,
+                                   const unsigned char *src, size_t len,
+                                   const unsigned char *table) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = table[src[i]];
+    }
+}
 
 /* --------------------------------------------------------------------------
  * Build the flat vocabulary from merge pairs.
@@ -112,7 +221,8 @@ unsigned long *bpe_encode(size_t *ids_len, const struct bpe_merges *merges,
 struct bpe_vocab *bpe_vocab_build(bpe_pair_t *pairs, size_t len);
 
 /* --------------------------------------------------------------------------
- * Free a vocabulary.  Safe to call with NULL.
+ * Free a vocabulary (and its arrays, unless borrowed).  Safe to call
+ * with NULL.
  * -------------------------------------------------------------------------- */
 void bpe_vocab_free(struct bpe_vocab *v);
 
@@ -124,7 +234,20 @@ void bpe_vocab_free(struct bpe_vocab *v);
  * Caller must bpe_free() the returned buffer.
  * -------------------------------------------------------------------------- */
 char *bpe_decode(size_t *bytes_size, const struct bpe_vocab *vocab,
-                 const unsigned long *ids, size_t ids_len);
+                 const bpe_id_t *ids, size_t ids_len);
+
+/* --------------------------------------------------------------------------
+ * Decode into a caller-sized buffer.
+ *
+ * Writes the bytes of ids[0 .. ids_len) (all < vocab->vocab_size) at dst
+ * and returns the end of what was written.  dst_end is the end of the
+ * whole buffer: tokens are stored BPE_DECODE_WIDE bytes at a time while
+ * that fits before it, so bytes past the returned pointer are scratch
+ * until the caller writes them.
+ * -------------------------------------------------------------------------- */
+unsigned char *bpe_decode_into(unsigned char *dst, const unsigned char *dst_end,
+                               const struct bpe_vocab *vocab,
+                               const bpe_id_t *ids, size_t ids_len);
 
 /* --------------------------------------------------------------------------
  * Decode a single token ID (streaming mode).
@@ -149,7 +272,7 @@ char *bpe_decode(size_t *bytes_size, const struct bpe_vocab *vocab,
  *          be 0 if no complete character could be formed yet.
  * -------------------------------------------------------------------------- */
 char *bpe_decode_one(size_t *bytes_size, const struct bpe_vocab *vocab,
-                     unsigned long id, unsigned char *cache,
+                     bpe_id_t id, unsigned char *cache,
                      unsigned long *cache_size);
 
 #endif  /* SRC_BPE_TOKENIZER_H */
@@ -7,168 +7,1220 @@
  * ## How It Works
  *
  * The trainer learns merge pairs from byte-level token sequences.
- * Starting from the 256 base byte tokens, each training step:
+ * Starting from the 256 base byte tokens, each training step picks the
+ * most frequent adjacent pair and replaces all its occurrences with a
+ * new token ID.
  *
- *   1. Scan all adjacent pairs across all training pieces
- *   2. Count frequencies using an AVL tree (O(n log n))
- *   3. Find the pair with the highest count (linear scan over unique pairs)
- *   4. Replace all occurrences of the winning pair with a new token ID
+ * ## Incremental Engine
+ *
+ * On the first step the pieces are moved into one token array with
+ * prev/next links (merged-away tokens are unlinked) and every adjacent
+ * pair is counted once.  From then on the statistics are maintained
+ * incrementally:
+ *
+ *   - a hash table maps each pair to its count and to the ascending
+ *     list of positions where it occurred;
+ *   - a max-heap orders pairs by (count, first position);
+ *   - merging a pair walks only its own position list, decrementing the
+ *     neighbouring pairs it destroys and counting the ones it creates.
+ *
+ * A pair can only gain occurrences in the step that creates its newest
+ * token, so afterwards its count and first position only get worse.
+ * Heap entries are therefore optimistic; a stale top entry is refreshed
+ * and pushed back, and the first entry that is up to date is the winner.
+ * Ties go to the pair that occurs first in the corpus — exactly what the
+ * full rescan picked — so both engines learn identical merges.
+ *
+ * Corpora of 2^32 - 1 tokens or more do not fit the 32-bit positions
+ * and fall back to the full rescan below.
+ *
+ * ## Rescan Engine
+ *
+ *   1. Count all adjacent pairs across all training pieces
+ *   2. Find the pair with the highest count (linear scan over unique pairs)
+ *   3. Replace all occurrences of the winning pair with a new token ID
+ *
+ * It only makes sequential passes over the piece arena, so it also runs
+ * out of core: the arena may be a memory-mapped scratch file
+ * (bpe_train_ctx_spill), and steps use it until the incremental engine
+ * fits ctx->memory_limit.
+ *
+ * ## Threads
+ *
+ * Counting (the engine build, or every rescan) splits the corpus into
+ * shards of consecutive positions, counts each shard into its own table
+ * on the bpe_thread pool, and merges the tables in shard order.  Rescan
+ * merges run as a parallel loop over pieces.  Pair numbering, occurrence
+ * order and tie-breaking never depend on the thread count, so the merges
+ * are the same for any ctx->n_threads.
  *
  * ## Data Structures
  *
- *   bpe_train_ctx_t      — training context (pieces[], rank)
- *   bpe_pair_stats_node  — AVL tree node: {pair, count}
+ *   bpe_train_ctx_t      — training context (pieces[], token arena, rank,
+ *                          stats)
+ *   bpe_piece_t          — one distinct piece: its span of the arena and
+ *                          its occurrence count
+ *   bpe_pair_stats       — pair table; with token links, the engine state
+ *   shard / shard_pair   — per-thread pair counts
  *
  * ## Pure C Portability
  *
- * This file uses only standard C (C99) and the bpe_common / AVL tree
+ * This file uses only standard C (C99) and the bpe_common / bpe_thread
  * headers.  No Python.h dependency — portable to embedded devices.
  */
 
 #include "bpe_trainer.h"
+#include "bpe_store.h"
+#include "bpe_thread.h"
+#include "bpe_tokenizer.h"
+#include <errno.h>
+#include <string.h>
+
+/* =========================================================================
+ * Pieces
+ * ========================================================================= */
 
 /* --------------------------------------------------------------------------
- * AVL tree node for pair frequency tracking.
+ * Piece deduplication: open addressing over piece numbers, keyed by the
+ * piece's bytes.  Only valid until the first merge rewrites the pieces.
  * -------------------------------------------------------------------------- */
-struct bpe_pair_stats_node {
-    struct avl_node node;
-    bpe_pair_t pair;
-    size_t count;
-};
+static uint64_t piece_hash(const bpe_id_t *ids, size_t len) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);  /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)ids[i]) * UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+static uint64_t bytes_hash(const unsigned char *bytes, size_t len) {
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ bytes[i]) * UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+static int piece_equals(const bpe_train_ctx_t *ctx, const bpe_piece_t *piece,
+                        const unsigned char *bytes, size_t len) {
+    if (piece->len != len) {
+        return 0;
+    }
+    const bpe_id_t *ids = ctx->ids + piece->start;
+    for (size_t i = 0; i < len; i++) {
+        if (ids[i] != bytes[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int dedup_grow(bpe_train_ctx_t *ctx) {
+    size_t capacity = ctx->dedup_mask ? (ctx->dedup_mask + 1) * 2 : 1024;
+    while (capacity < (ctx->pieces_len + 1) * 2) {
+        capacity *= 2;  /* rebuilding after pieces_compact() */
+    }
+    size_t *table = bpe_malloc(capacity * sizeof(size_t));
+    if (table == NULL) {
+        return -1;
+    }
+    memset(table, 0, capacity * sizeof(size_t));
+
+    for (size_t n = 0; n < ctx->pieces_len; n++) {
+        const bpe_piece_t *piece = &ctx->pieces[n];
+        size_t i = (size_t)piece_hash(ctx->ids + piece->start, piece->len)
+                   & (capacity - 1);
+        while (table[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        table[i] = n + 1;
+    }
+
+    bpe_free(ctx->dedup);
+    ctx->dedup = table;
+    ctx->dedup_mask = capacity - 1;
+    return 0;
+}
+
+static void dedup_free(bpe_train_ctx_t *ctx) {
+    bpe_free(ctx->dedup);
+    ctx->dedup = NULL;
+    ctx->dedup_mask = 0;
+}
+
+/* Resize one of the piece buffers, on the heap or in its scratch file. */
+static void *buffer_resize(bpe_store_t *store, void *data, size_t size) {
+    return store ? bpe_store_resize(store, size) : bpe_realloc(data, size);
+}
+
+static void buffer_free(bpe_store_t **store, void *data) {
+    if (*store) {
+        bpe_store_free(*store);
+        *store = NULL;
+    }
+    else {
+        bpe_free(data);
+    }
+}
 
 /* --------------------------------------------------------------------------
- * Replace all occurrences of a pair in-place across all training pieces.
+ * Close the gaps merges left in the arena, in one streaming pass.
  *
- * Scans each piece's ids[] array left-to-right, compacting as it goes.
- * When the pair is found, the two tokens are replaced by the merged ID
- * and the right half is skipped.  The piece length is updated to the
- * compacted size.
+ * Pieces of fewer than two tokens hold no pair and can never gain one,
+ * so they are dropped; the order of the rest, and thus every
+ * first-occurrence tie-break, is unchanged.  Piece numbers change, so
+ * this is only called once no more pieces can be added.
+ * -------------------------------------------------------------------------- */
+static void pieces_compact(bpe_train_ctx_t *ctx) {
+    size_t kept = 0;
+    size_t pos = 0;
+
+    dedup_free(ctx);
+    for (size_t i = 0; i < ctx->pieces_len; i++) {
+        bpe_piece_t piece = ctx->pieces[i];
+        if (piece.len < 2) {
+            continue;
+        }
+        if (piece.start != pos) {
+            memmove(ctx->ids + pos, ctx->ids + piece.start,
+                    piece.len * sizeof(bpe_id_t));
+            piece.start = pos;
+        }
+        pos += piece.len;
+        ctx->pieces[kept++] = piece;
+    }
+    ctx->pieces_len = kept;
+    ctx->ids_len = pos;
+}
+
+/* Release the arena and pieces[] (their tokens now live elsewhere). */
+static void pieces_free(bpe_train_ctx_t *ctx) {
+    buffer_free(&ctx->ids_store, ctx->ids);
+    ctx->ids = NULL;
+    ctx->ids_len = ctx->ids_cap = 0;
+    buffer_free(&ctx->pieces_store, ctx->pieces);
+    ctx->pieces = NULL;
+    ctx->pieces_len = ctx->pieces_cap = 0;
+    dedup_free(ctx);
+}
+
+/* =========================================================================
+ * Pair table
+ * ========================================================================= */
+
+/* Linked-list terminator and "no position" marker. */
+#define STATS_POS_NONE UINT32_MAX
+
+/* Token ID of a position that was merged into its left neighbour. */
+#define STATS_TOKEN_DEAD UINT32_MAX
+
+/* Engine memory per token position, at most: ids, prev, next, one
+ * occurrence list entry and a weight. */
+#define STATS_TOKEN_BYTES 24
+
+/* --------------------------------------------------------------------------
+ * Per-pair statistics.  `count` is weighted by piece frequency.
  *
- * Example: piece = [h, e, l, l, o], pair = (h, e), id = 256
- *          → piece = [256, l, l, o], len = 4
+ * occ[] lists the positions of the pair's left token in ascending order.
+ * Entries go stale as merges destroy occurrences; occ_head skips the
+ * stale prefix, so occ[occ_head] is the pair's first live occurrence.
+ * Pairs present at build time share one pool (occ_cap == 0); pairs
+ * created by merges own their array.
+ * -------------------------------------------------------------------------- */
+struct pair_stat {
+    bpe_id_t left;
+    bpe_id_t right;
+    uint64_t count;
+    uint32_t *occ;
+    size_t occ_len;
+    size_t occ_head;
+    size_t occ_cap;
+};
+
+/* Max-heap entry: higher count first, then lower first position. */
+struct stats_heap_entry {
+    uint64_t count;
+    uint32_t first;
+    uint32_t pair;
+};
+
+struct bpe_pair_stats {
+    bpe_id_t *ids;               /* token at each position, or DEAD     */
+    uint32_t *prev;              /* previous live position in the piece */
+    uint32_t *next;              /* next live position in the piece     */
+    uint64_t *weight;            /* piece count per position, or NULL   */
+                                 /* when every piece occurs once        */
+
+    uint32_t *occ_pool;          /* occurrence lists of initial pairs   */
+
+    struct pair_stat *pairs;     /* indexed by pair number              */
+    size_t pairs_len;
+    size_t pairs_cap;
+
+    uint32_t *table;             /* pair number + 1, 0 = empty slot     */
+    size_t mask;
+    unsigned int bits;
+
+    struct stats_heap_entry *heap;
+    size_t heap_len;
+    size_t heap_cap;
+
+    uint32_t *created;           /* pairs created by the current merge  */
+    size_t created_len;
+    size_t created_cap;
+};
+
+static inline int heap_entry_above(const struct stats_heap_entry *a,
+                                   const struct stats_heap_entry *b) {
+    return a->count > b->count
+           || (a->count == b->count && a->first < b->first);
+}
+
+static void stats_heap_sift_down(struct stats_heap_entry *heap, size_t len,
+                                 size_t i) {
+    struct stats_heap_entry e = heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= len) {
+            break;
+        }
+        if (child + 1 < len && heap_entry_above(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!heap_entry_above(&heap[child], &e)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = e;
+}
+
+static int stats_heap_push(struct bpe_pair_stats *st, uint64_t count,
+                           uint32_t first, uint32_t pair) {
+    if (st->heap_len == st->heap_cap) {
+        size_t cap = st->heap_cap ? st->heap_cap * 2 : 64;
+        struct stats_heap_entry *heap =
+            bpe_realloc(st->heap, cap * sizeof(struct stats_heap_entry));
+        if (heap == NULL) {
+            return -1;
+        }
+        st->heap = heap;
+        st->heap_cap = cap;
+    }
+
+    struct stats_heap_entry e = {count, first, pair};
+    size_t i = st->heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_entry_above(&e, &st->heap[parent])) {
+            break;
+        }
+        st->heap[i] = st->heap[parent];
+        i = parent;
+    }
+    st->heap[i] = e;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Pair table: open addressing over pair numbers, load factor ≤ 0.5.
+ * -------------------------------------------------------------------------- */
+static int stats_table_grow(struct bpe_pair_stats *st) {
+    unsigned int bits = st->bits ? st->bits + 1 : 10;
+    size_t capacity = (size_t)1 << bits;
+
+    uint32_t *table = bpe_malloc(capacity * sizeof(uint32_t));
+    if (table == NULL) {
+        return -1;
+    }
+    memset(table, 0, capacity * sizeof(uint32_t));
+
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        const struct pair_stat *s = &st->pairs[n];
+        size_t i = bpe_pair_hash(bpe_pair_key(s->left, s->right), bits);
+        while (table[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        table[i] = (uint32_t)(n + 1);
+    }
+
+    bpe_free(st->table);
+    st->table = table;
+    st->bits = bits;
+    st->mask = capacity - 1;
+    return 0;
+}
+
+/* Pair number of (left, right), or STATS_POS_NONE if unseen. */
+static inline uint32_t stats_find(const struct bpe_pair_stats *st,
+                                  bpe_id_t left, bpe_id_t right) {
+    size_t i = bpe_pair_hash(bpe_pair_key(left, right), st->bits);
+    for (;;) {
+        uint32_t slot = st->table[i];
+        if (slot == 0) {
+            return STATS_POS_NONE;
+        }
+        const struct pair_stat *s = &st->pairs[slot - 1];
+        if (s->left == left && s->right == right) {
+            return slot - 1;
+        }
+        i = (i + 1) & st->mask;
+    }
+}
+
+/* Pair number of (left, right), adding a zero-count entry if unseen.
+ * Returns STATS_POS_NONE on allocation failure. */
+static uint32_t stats_intern(struct bpe_pair_stats *st, bpe_id_t left,
+                             bpe_id_t right) {
+    uint32_t n = stats_find(st, left, right);
+    if (n != STATS_POS_NONE) {
+        return n;
+    }
+
+    if ((st->pairs_len + 1) * 2 > st->mask + 1) {
+        if (st->pairs_len + 1 >= STATS_POS_NONE || stats_table_grow(st) < 0) {
+            return STATS_POS_NONE;
+        }
+    }
+    if (st->pairs_len == st->pairs_cap) {
+        size_t cap = st->pairs_cap ? st->pairs_cap * 2 : 1024;
+        struct pair_stat *pairs =
+            bpe_realloc(st->pairs, cap * sizeof(struct pair_stat));
+        if (pairs == NULL) {
+            return STATS_POS_NONE;
+        }
+        st->pairs = pairs;
+        st->pairs_cap = cap;
+    }
+
+    n = (uint32_t)st->pairs_len++;
+    struct pair_stat *s = &st->pairs[n];
+    memset(s, 0, sizeof(*s));
+    s->left = left;
+    s->right = right;
+
+    size_t i = bpe_pair_hash(bpe_pair_key(left, right), st->bits);
+    while (st->table[i]) {
+        i = (i + 1) & st->mask;
+    }
+    st->table[i] = n + 1;
+    return n;
+}
+
+static void stats_free(struct bpe_pair_stats *st) {
+    if (st == NULL) {
+        return;
+    }
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        if (st->pairs[n].occ_cap) {
+            bpe_free(st->pairs[n].occ);
+        }
+    }
+    bpe_free(st->ids);
+    bpe_free(st->prev);
+    bpe_free(st->next);
+    bpe_free(st->weight);
+    bpe_free(st->occ_pool);
+    bpe_free(st->pairs);
+    bpe_free(st->table);
+    bpe_free(st->heap);
+    bpe_free(st->created);
+    bpe_free(st);
+}
+
+/* =========================================================================
+ * Parallel pair counting
+ * ========================================================================= */
+
+/* Counting is split into shards of consecutive token positions (a shard
+ * may start or end inside a piece).  Each shard counts into its own
+ * table; the tables are then merged in shard order. */
+#define SHARD_MIN_TOKENS 65536
+#define SHARDS_PER_THREAD 4
+
+struct shard_pair {
+    bpe_id_t left;
+    bpe_id_t right;
+    uint64_t count;          /* weighted by piece count               */
+    size_t n_occ;            /* occurrences in this shard             */
+    uint32_t global;         /* pair number in the merged table       */
+    size_t occ_at;           /* next slot of this shard's occurrences */
+};
+
+struct shard {
+    size_t begin;            /* first token position                  */
+    size_t end;              /* one past the last token position      */
+    size_t piece;            /* piece containing `begin`              */
+    struct shard_pair *pairs;     /* in order of first occurrence     */
+    size_t pairs_len;
+    size_t pairs_cap;
+    size_t *table;           /* pair index + 1, 0 = empty slot        */
+    size_t mask;
+    unsigned int bits;
+    int failed;
+};
+
+struct shard_set {
+    const bpe_train_ctx_t *ctx;
+    struct shard *shards;
+    size_t len;
+    struct bpe_pair_stats *st;    /* engine being built, or NULL      */
+};
+
+static inline unsigned int train_threads(const bpe_train_ctx_t *ctx) {
+    return ctx->n_threads ? ctx->n_threads : bpe_cpu_count();
+}
+
+static int shard_table_grow(struct shard *sh) {
+    unsigned int bits = sh->bits ? sh->bits + 1 : 10;
+    size_t capacity = (size_t)1 << bits;
+
+    size_t *table = bpe_malloc(capacity * sizeof(size_t));
+    if (table == NULL) {
+        return -1;
+    }
+    memset(table, 0, capacity * sizeof(size_t));
+
+    for (size_t n = 0; n < sh->pairs_len; n++) {
+        const struct shard_pair *p = &sh->pairs[n];
+        size_t i = bpe_pair_hash(bpe_pair_key(p->left, p->right), bits);
+        while (table[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        table[i] = n + 1;
+    }
+
+    bpe_free(sh->table);
+    sh->table = table;
+    sh->bits = bits;
+    sh->mask = capacity - 1;
+    return 0;
+}
+
+/* Entry for (left, right), added if unseen.  NULL on allocation failure. */
+static struct shard_pair *shard_intern(struct shard *sh, bpe_id_t left,
+                                       bpe_id_t right) {
+    size_t i = bpe_pair_hash(bpe_pair_key(left, right), sh->bits);
+    while (sh->table[i]) {
+        struct shard_pair *p = &sh->pairs[sh->table[i] - 1];
+        if (p->left == left && p->right == right) {
+            return p;
+        }
+        i = (i + 1) & sh->mask;
+    }
+
+    if ((sh->pairs_len + 1) * 2 > sh->mask + 1) {
+        if (shard_table_grow(sh) < 0) {
+            return NULL;
+        }
+        i = bpe_pair_hash(bpe_pair_key(left, right), sh->bits);
+        while (sh->table[i]) {
+            i = (i + 1) & sh->mask;
+        }
+    }
+    if (sh->pairs_len == sh->pairs_cap) {
+        size_t cap = sh->pairs_cap ? sh->pairs_cap * 2 : 1024;
+        struct shard_pair *pairs =
+            bpe_realloc(sh->pairs, cap * sizeof(struct shard_pair));
+        if (pairs == NULL) {
+            return NULL;
+        }
+        sh->pairs = pairs;
+        sh->pairs_cap = cap;
+    }
+
+    struct shard_pair *p = &sh->pairs[sh->pairs_len];
+    memset(p, 0, sizeof(*p));
+    p->left = left;
+    p->right = right;
+    sh->table[i] = ++sh->pairs_len;
+    return p;
+}
+
+static void shards_free(struct shard_set *set) {
+    for (size_t s = 0; s < set->len; s++) {
+        bpe_free(set->shards[s].pairs);
+        bpe_free(set->shards[s].table);
+    }
+    bpe_free(set->shards);
+}
+
+/* --------------------------------------------------------------------------
+ * Split the current pieces into shards of roughly equal token count.
+ *
+ * The arena must be compact (pieces_compact()), so a token's position
+ * is its offset in the arena and the corpus size is ctx->ids_len, which
+ * goes to *n_tokens.  Returns -1 on allocation failure.
  * -------------------------------------------------------------------------- */
-static inline void merge_piece(bpe_piece_t *pieces, size_t pieces_len,
-                               const bpe_pair_t *pair, unsigned long id) {
-    for (size_t i = 0; i < pieces_len; i++) {
-        if (pieces[i].len > 1) {
-            unsigned long *p_ids = pieces[i].ids;
-
-            size_t new_ids_i = 0;
-            for (size_t j = 0; j < pieces[i].len; j++) {
-                if (p_ids[j] == pair->left
-                    && j < pieces[i].len - 1
-                    && p_ids[j + 1] == pair->right) {
-                    p_ids[new_ids_i++] = id;
-                    j++; /* skip the right half */
+static int shards_init(struct shard_set *set, const bpe_train_ctx_t *ctx,
+                       size_t *n_tokens) {
+    memset(set, 0, sizeof(*set));
+    set->ctx = ctx;
+
+    size_t total = ctx->ids_len;
+    *n_tokens = total;
+
+    size_t len = 1;
+    unsigned int threads = train_threads(ctx);
+    if (threads > 1) {
+        len = (size_t)threads * SHARDS_PER_THREAD;
+        if (len > total / SHARD_MIN_TOKENS) {
+            len = total / SHARD_MIN_TOKENS ? total / SHARD_MIN_TOKENS : 1;
+        }
+    }
+
+    set->shards = bpe_malloc(len * sizeof(struct shard));
+    if (set->shards == NULL) {
+        return -1;
+    }
+    memset(set->shards, 0, len * sizeof(struct shard));
+    set->len = len;
+
+    size_t piece = 0;
+    for (size_t s = 0; s < len; s++) {
+        struct shard *sh = &set->shards[s];
+        sh->begin = total / len * s;
+        sh->end = s + 1 == len ? total : total / len * (s + 1);
+        while (piece + 1 < ctx->pieces_len
+               && ctx->pieces[piece + 1].start <= sh->begin) {
+            piece++;
+        }
+        sh->piece = piece;
+        if (shard_table_grow(sh) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Count the pairs whose left token lies in shard s.  When building the
+ * incremental engine, also copy the shard's tokens into it.
+ * -------------------------------------------------------------------------- */
+static void shard_count_task(void *arg, size_t s) {
+    struct shard_set *set = arg;
+    struct shard *sh = &set->shards[s];
+    const bpe_train_ctx_t *ctx = set->ctx;
+    struct bpe_pair_stats *st = set->st;
+
+    size_t pos = sh->begin;
+    for (size_t i = sh->piece; pos < sh->end; i++) {
+        const bpe_piece_t *piece = &ctx->pieces[i];
+        const bpe_id_t *ids = ctx->ids + piece->start;
+        size_t start = piece->start;
+        size_t stop = start + piece->len < sh->end ? piece->len
+                                                   : sh->end - start;
+
+        for (size_t j = pos - start; j < stop; j++, pos++) {
+            if (st) {
+                st->ids[pos] = ids[j];
+                st->prev[pos] = j ? (uint32_t)(pos - 1) : STATS_POS_NONE;
+                st->next[pos] = j + 1 < piece->len ? (uint32_t)(pos + 1)
+                                                   : STATS_POS_NONE;
+                if (st->weight) {
+                    st->weight[pos] = piece->count;
                 }
-                else {
-                    p_ids[new_ids_i++] = p_ids[j];
+            }
+            if (j + 1 < piece->len) {
+                struct shard_pair *p = shard_intern(sh, ids[j], ids[j + 1]);
+                if (p == NULL) {
+                    sh->failed = 1;
+                    return;
                 }
+                p->count += piece->count;
+                p->n_occ++;
             }
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Count all adjacent pairs on ctx->n_threads threads and merge the shard
+ * tables into `st` (which must have an empty pair table).
+ *
+ * Shards are merged in position order, so a pair gets its number in
+ * `st` at its first occurrence in the corpus, whatever the thread count.
+ * Each pair's occ_len is set to its total number of occurrences, and
+ * each shard entry's occ_at to the offset of its first occurrence within
+ * that total.  Returns -1 on allocation failure.
+ * -------------------------------------------------------------------------- */
+static int shards_count(struct shard_set *set, struct bpe_pair_stats *st) {
+    bpe_parallel_for(set->len, train_threads(set->ctx), shard_count_task, set);
 
-            pieces[i].len = new_ids_i;
+    for (size_t s = 0; s < set->len; s++) {
+        struct shard *sh = &set->shards[s];
+        if (sh->failed) {
+            return -1;
+        }
+        for (size_t k = 0; k < sh->pairs_len; k++) {
+            struct shard_pair *p = &sh->pairs[k];
+            uint32_t n = stats_intern(st, p->left, p->right);
+            if (n == STATS_POS_NONE) {
+                return -1;
+            }
+            p->global = n;
+            p->occ_at = st->pairs[n].occ_len;
+            st->pairs[n].count += p->count;
+            st->pairs[n].occ_len += p->n_occ;
         }
     }
+    return 0;
 }
 
-static int pair_stat_cmp_func(struct avl_node *a, struct avl_node *b) {
-    struct bpe_pair_stats_node *n1, *n2;
+/* =========================================================================
+ * Incremental engine
+ * ========================================================================= */
 
-    n1 = _get_entry(a, struct bpe_pair_stats_node, node);
-    n2 = _get_entry(b, struct bpe_pair_stats_node, node);
+/* Write each occurrence of a shard's pairs to its slot in the pool. */
+static void shard_fill_task(void *arg, size_t s) {
+    struct shard_set *set = arg;
+    struct shard *sh = &set->shards[s];
+    struct bpe_pair_stats *st = set->st;
 
-    return bpe_pair_cmp(&n1->pair, &n2->pair);
+    for (size_t pos = sh->begin; pos < sh->end; pos++) {
+        uint32_t next = st->next[pos];
+        if (next != STATS_POS_NONE) {
+            struct shard_pair *p = shard_intern(sh, st->ids[pos], st->ids[next]);
+            st->occ_pool[p->occ_at++] = (uint32_t)pos;
+        }
+    }
 }
 
 /* --------------------------------------------------------------------------
- * Perform one BPE training step — find and apply the most frequent pair.
+ * Build the engine state from the current pieces.
  *
- * Algorithm:
- *   1. Count total adjacent pairs across all pieces (stats_len)
- *   2. Allocate buffer for all possible unique pair nodes
- *   3. Scan every piece: for each adjacent pair, insert into AVL tree;
- *      if already present, increment count; otherwise record as new
- *   4. Linear scan over unique pairs to find max frequency
- *   5. Apply the winning merge to all pieces
- *
- * Returns the frequency count (> 0) on success, or 0 if no pairs remain
- * (when stats_len == 0, i.e. no piece has len ≥ 2).
- * -------------------------------------------------------------------------- */
-unsigned long bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx) {
-    struct avl_tree tree;
-    avl_init(&tree);
-
-    /* Count total adjacent pairs */
-    size_t stats_len = 0;
+ * Tokens are copied and pairs counted shard by shard on the worker
+ * threads.  Every shard then writes its occurrences into its own slice
+ * of each pair's list; slices follow shard order, so lists come out
+ * sorted.  Returns NULL on allocation failure.
+ * -------------------------------------------------------------------------- */
+static struct bpe_pair_stats *stats_build(const bpe_train_ctx_t *ctx,
+                                          size_t n_tokens) {
+    struct shard_set set;
+    struct bpe_pair_stats *st = bpe_malloc(sizeof(struct bpe_pair_stats));
+    if (st == NULL) {
+        return NULL;
+    }
+    memset(st, 0, sizeof(*st));
+
+    if (shards_init(&set, ctx, &n_tokens) < 0) {
+        goto fail;
+    }
+
+    size_t alloc = n_tokens ? n_tokens : 1;
+    st->ids = bpe_malloc(alloc * sizeof(bpe_id_t));
+    st->prev = bpe_malloc(alloc * sizeof(uint32_t));
+    st->next = bpe_malloc(alloc * sizeof(uint32_t));
+    if (st->ids == NULL || st->prev == NULL || st->next == NULL
+        || stats_table_grow(st) < 0) {
+        goto fail;
+    }
+
     for (size_t i = 0; i < ctx->pieces_len; i++) {
-        if (ctx->pieces[i].len >= 2) {
-            stats_len += ctx->pieces[i].len - 1;
+        if (ctx->pieces[i].count != 1) {
+            st->weight = bpe_malloc(alloc * sizeof(uint64_t));
+            if (st->weight == NULL) {
+                goto fail;
+            }
+            break;
+        }
+    }
+
+    set.st = st;
+    if (shards_count(&set, st) < 0) {
+        goto fail;
+    }
+
+    /* Carve the occurrence lists out of one pool, then fill them */
+    size_t n_pairs_total = 0;
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        n_pairs_total += st->pairs[n].occ_len;
+    }
+    st->occ_pool = bpe_malloc((n_pairs_total ? n_pairs_total : 1)
+                              * sizeof(uint32_t));
+    if (st->occ_pool == NULL) {
+        goto fail;
+    }
+    size_t offset = 0;
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        st->pairs[n].occ = st->occ_pool + offset;
+        offset += st->pairs[n].occ_len;
+    }
+    for (size_t sh = 0; sh < set.len; sh++) {
+        for (size_t k = 0; k < set.shards[sh].pairs_len; k++) {
+            struct shard_pair *p = &set.shards[sh].pairs[k];
+            p->occ_at += (size_t)(st->pairs[p->global].occ - st->occ_pool);
+        }
+    }
+    bpe_parallel_for(set.len, train_threads(ctx), shard_fill_task, &set);
+    shards_free(&set);
+
+    /* Every pair enters the heap with its exact key */
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        if (stats_heap_push(st, st->pairs[n].count, st->pairs[n].occ[0],
+                            (uint32_t)n) < 0) {
+            stats_free(st);
+            return NULL;
+        }
+    }
+    return st;
+
+fail:
+    shards_free(&set);
+    stats_free(st);
+    return NULL;
+}
+
+/* First live occurrence of pair n (advancing past stale entries), or
+ * STATS_POS_NONE if the pair no longer occurs. */
+static uint32_t stats_first(struct bpe_pair_stats *st, uint32_t n) {
+    struct pair_stat *s = &st->pairs[n];
+    while (s->occ_head < s->occ_len) {
+        uint32_t pos = s->occ[s->occ_head];
+        uint32_t next = st->next[pos];
+        if (st->ids[pos] == s->left && next != STATS_POS_NONE
+            && st->ids[next] == s->right) {
+            return pos;
+        }
+        s->occ_head++;
+    }
+    return STATS_POS_NONE;
+}
+
+/* An occurrence of (left, right) in a piece of weight w was destroyed
+ * by a merge. */
+static inline void stats_remove(struct bpe_pair_stats *st, uint32_t left,
+                                uint32_t right, uint64_t w) {
+    st->pairs[stats_find(st, left, right)].count -= w;
+}
+
+/* An occurrence of (left, right) at pos was created by a merge. */
+static int stats_add(struct bpe_pair_stats *st, uint32_t left,
+                     uint32_t right, uint32_t pos, uint64_t w) {
+    size_t pairs_len = st->pairs_len;
+    uint32_t n = stats_intern(st, left, right);
+    if (n == STATS_POS_NONE) {
+        return -1;
+    }
+
+    if (st->pairs_len != pairs_len) {
+        if (st->created_len == st->created_cap) {
+            size_t cap = st->created_cap ? st->created_cap * 2 : 64;
+            uint32_t *created = bpe_realloc(st->created, cap * sizeof(uint32_t));
+            if (created == NULL) {
+                return -1;
+            }
+            st->created = created;
+            st->created_cap = cap;
+        }
+        st->created[st->created_len++] = n;
+    }
+
+    struct pair_stat *s = &st->pairs[n];
+    if (s->occ_len == s->occ_cap) {
+        size_t cap = s->occ_cap ? s->occ_cap * 2 : 4;
+        uint32_t *occ = bpe_realloc(s->occ, cap * sizeof(uint32_t));
+        if (occ == NULL) {
+            return -1;
+        }
+        s->occ = occ;
+        s->occ_cap = cap;
+    }
+    s->occ[s->occ_len++] = pos;
+    s->count += w;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Merge every occurrence of pair n into token `id`, left to right.
+ *
+ * Each merge at pos (left token) / q (right token):
+ *
+ *   ... a [x y] b ...   →   ... a [id] b ...
+ *
+ * destroys (a, x), (x, y), (y, b) and creates (a, id), (id, b).  New
+ * pairs are pushed on the heap once the whole pass is done.  Returns
+ * -1 on allocation failure (the state is then unusable).
+ * -------------------------------------------------------------------------- */
+static int stats_merge(struct bpe_pair_stats *st, uint32_t n, bpe_id_t id) {
+    const bpe_id_t x = st->pairs[n].left;
+    const bpe_id_t y = st->pairs[n].right;
+    const uint32_t *occ = st->pairs[n].occ;
+    const size_t occ_len = st->pairs[n].occ_len;
+
+    st->created_len = 0;
+    for (size_t k = st->pairs[n].occ_head; k < occ_len; k++) {
+        uint32_t pos = occ[k];
+        uint32_t q = st->next[pos];
+        if (st->ids[pos] != x || q == STATS_POS_NONE || st->ids[q] != y) {
+            continue;  /* destroyed by an earlier merge */
+        }
+        uint32_t a = st->prev[pos];
+        uint32_t b = st->next[q];
+        uint64_t w = st->weight ? st->weight[pos] : 1;
+
+        if (a != STATS_POS_NONE) {
+            stats_remove(st, st->ids[a], x, w);
+        }
+        if (b != STATS_POS_NONE) {
+            stats_remove(st, y, st->ids[b], w);
+        }
+        st->pairs[n].count -= w;
+
+        st->ids[pos] = id;
+        st->ids[q] = STATS_TOKEN_DEAD;
+        st->next[pos] = b;
+        if (b != STATS_POS_NONE) {
+            st->prev[b] = pos;
+        }
+
+        if (a != STATS_POS_NONE && stats_add(st, st->ids[a], id, a, w) < 0) {
+            return -1;
+        }
+        if (b != STATS_POS_NONE && stats_add(st, id, st->ids[b], pos, w) < 0) {
+            return -1;
+        }
+    }
+
+    struct pair_stat *s = &st->pairs[n];
+    s->occ_head = s->occ_len;
+    if (s->occ_cap) {
+        bpe_free(s->occ);
+        s->occ = NULL;
+        s->occ_len = s->occ_head = s->occ_cap = 0;
+    }
+
+    for (size_t k = 0; k < st->created_len; k++) {
+        uint32_t c = st->created[k];
+        if (st->pairs[c].count
+            && stats_heap_push(st, st->pairs[c].count, stats_first(st, c),
+                               c) < 0) {
+            return -1;
         }
     }
+    return 0;
+}
 
-    if (stats_len == 0) {
-        return 0; /* no more pairs available */
+/* --------------------------------------------------------------------------
+ * Pop the pair with the highest (count, -first position), refreshing
+ * stale heap entries on the way.  Returns its number, or STATS_POS_NONE
+ * when no pair is left (or on allocation failure, with *err set).
+ * -------------------------------------------------------------------------- */
+static uint32_t stats_pop_max(struct bpe_pair_stats *st, int *err) {
+    while (st->heap_len) {
+        struct stats_heap_entry top = st->heap[0];
+        st->heap[0] = st->heap[--st->heap_len];
+        stats_heap_sift_down(st->heap, st->heap_len, 0);
+
+        struct pair_stat *s = &st->pairs[top.pair];
+        if (s->count == 0) {
+            if (s->occ_cap) {
+                bpe_free(s->occ);
+                s->occ = NULL;
+                s->occ_len = s->occ_head = s->occ_cap = 0;
+            }
+            continue;
+        }
+
+        uint32_t first = stats_first(st, top.pair);
+        if (top.count == s->count && top.first == first) {
+            return top.pair;
+        }
+        if (stats_heap_push(st, s->count, first, top.pair) < 0) {
+            *err = 1;
+            return STATS_POS_NONE;
+        }
     }
+    return STATS_POS_NONE;
+}
 
-    if (stats_len > SIZE_MAX / sizeof(struct bpe_pair_stats_node)) {
+/* --------------------------------------------------------------------------
+ * Build the incremental state on first use.  Returns 1 if ctx->stats is
+ * ready, 0 if the corpus is too large for it (use the rescan engine),
+ * -1 on allocation failure.
+ *
+ * Only pieces of two tokens or more take positions.  The arena and
+ * pieces are released once their tokens live in the engine.  Until the
+ * engine fits ctx->memory_limit, steps rescan the arena instead (and
+ * shrink it), so the check is repeated every step.
+ * -------------------------------------------------------------------------- */
+static int stats_ensure(bpe_train_ctx_t *ctx) {
+    if (ctx->stats) {
+        return 1;
+    }
+    if (ctx->failed) {
+        return -1;
+    }
+
+    pieces_compact(ctx);
+    size_t n_tokens = ctx->ids_len;
+    if (n_tokens >= STATS_POS_NONE
+        || (ctx->memory_limit
+            && n_tokens > ctx->memory_limit / STATS_TOKEN_BYTES)) {
         return 0;
     }
 
-    struct bpe_pair_stats_node *buf_nodes =
-        bpe_malloc(stats_len * sizeof(struct bpe_pair_stats_node));
+    ctx->stats = stats_build(ctx, n_tokens);
+    if (ctx->stats == NULL) {
+        ctx->failed = 1;
+        return -1;
+    }
+    pieces_free(ctx);
+    return 1;
+}
+
+/* Record a failed merge: the state is half-updated and must not be used. */
+static void stats_fail(bpe_train_ctx_t *ctx) {
+    stats_free(ctx->stats);
+    ctx->stats = NULL;
+    ctx->failed = 1;
+}
 
-    size_t node_buf_i = 0;
+/* =========================================================================
+ * Rescan engine
+ * ========================================================================= */
 
-    /* Collect and count all adjacent pairs */
-    for (size_t i = 0; i < ctx->pieces_len; i++) {
-        for (size_t j = 0; j + 1 < ctx->pieces[i].len; j++) {
-            buf_nodes[node_buf_i].pair.left = ctx->pieces[i].ids[j];
-            buf_nodes[node_buf_i].pair.right = ctx->pieces[i].ids[j + 1];
-
-            struct avl_node *_node = avl_insert(
-                &tree, &buf_nodes[node_buf_i].node, pair_stat_cmp_func);
-
-            if (_node != &buf_nodes[node_buf_i].node) {
-                /* Pair already in tree — increment existing counter */
-                struct bpe_pair_stats_node *_n =
-                    _get_entry(_node, struct bpe_pair_stats_node, node);
-                _n->count++;
+struct merge_job {
+    bpe_piece_t *pieces;
+    bpe_id_t *ids;
+    bpe_pair_t pair;
+    bpe_id_t id;
+};
+
+/* --------------------------------------------------------------------------
+ * Replace all occurrences of a pair in-place in one training piece.
+ *
+ * Scans the piece's IDs left-to-right, compacting as it goes.
+ * When the pair is found, the two tokens are replaced by the merged ID
+ * and the right half is skipped.  The piece length is updated to the
+ * compacted size.
+ *
+ * Example: piece = [h, e, l, l, o], pair = (h, e), id = 256
+ *          → piece = [256, l, l, o], len = 4
+ * -------------------------------------------------------------------------- */
+static void merge_piece_task(void *arg, size_t i) {
+    const struct merge_job *job = arg;
+    bpe_piece_t *piece = &job->pieces[i];
+
+    if (piece->len > 1) {
+        bpe_id_t *p_ids = job->ids + piece->start;
+
+        size_t new_ids_i = 0;
+        for (size_t j = 0; j < piece->len; j++) {
+            if (p_ids[j] == job->pair.left
+                && j < piece->len - 1
+                && p_ids[j + 1] == job->pair.right) {
+                p_ids[new_ids_i++] = job->id;
+                j++; /* skip the right half */
             }
             else {
-                /* New pair — initialise counter and advance buffer index */
-                struct bpe_pair_stats_node *_n =
-                    _get_entry(_node, struct bpe_pair_stats_node, node);
-                _n->count = 1;
-                node_buf_i++;
+                p_ids[new_ids_i++] = p_ids[j];
             }
         }
+
+        piece->len = new_ids_i;
     }
+}
 
-    if (tree.root) {
-        /* Find the node with the highest frequency */
-        struct bpe_pair_stats_node *p_max = buf_nodes;
-        for (size_t i = 1; i < node_buf_i; i++) {
-            struct bpe_pair_stats_node *p = buf_nodes + i;
-            if (p->count > p_max->count) {
-                p_max = p;
-            }
+/* Apply a merge to every piece; pieces are independent, so they are
+ * spread over the worker threads.  The arena is left with gaps for
+ * pieces_compact(). */
+static void merge_pieces(bpe_train_ctx_t *ctx, const bpe_pair_t *pair,
+                         bpe_id_t id) {
+    struct merge_job job = {ctx->pieces, ctx->ids, *pair, id};
+    bpe_parallel_for(ctx->pieces_len, train_threads(ctx), merge_piece_task,
+                     &job);
+}
+
+struct encode_job {
+    bpe_piece_t *pieces;
+    bpe_id_t *ids;
+    const struct bpe_merges *merges;
+};
+
+/* Encode one piece in place with the tokenizer's lowest-rank-first
+ * merging.  A piece of two or more tokens never encodes to nothing, so
+ * len = 0 marks a failed scratch allocation. */
+static void encode_piece_task(void *arg, size_t i) {
+    const struct encode_job *job = arg;
+    bpe_piece_t *piece = &job->pieces[i];
+
+    if (piece->len > 1) {
+        piece->len = bpe_encode_inplace(job->ids + piece->start, piece->len,
+                                        job->merges);
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Apply a whole merge sequence to pieces that hold only byte tokens, in
+ * one pass: build the merges table once and encode every piece to its
+ * final IDs on the worker threads.
+ *
+ * For a valid sequence this equals replaying the merges one by one.  A
+ * merge only creates pairs that contain its new token, and those rank
+ * after it, so the lowest-rank pair left in a piece is always the next
+ * one a replay would apply; both merge its occurrences left to right.
+ * -------------------------------------------------------------------------- */
+static int encode_pieces(bpe_train_ctx_t *ctx, const bpe_pair_t *pairs,
+                         size_t pairs_len) {
+    struct bpe_merges *merges = bpe_merges_build(pairs, pairs_len);
+    if (merges == NULL) {
+        return -1;
+    }
+
+    struct encode_job job = {ctx->pieces, ctx->ids, merges};
+    bpe_parallel_for(ctx->pieces_len, train_threads(ctx), encode_piece_task,
+                     &job);
+    bpe_merges_free(merges);
+
+    for (size_t i = 0; i < ctx->pieces_len; i++) {
+        if (ctx->pieces[i].len == 0) {
+            return -1;
         }
+    }
+    return 0;
+}
 
-        pair->left = p_max->pair.left;
-        pair->right = p_max->pair.right;
-        unsigned long count = (unsigned long)p_max->count;
+/* --------------------------------------------------------------------------
+ * Full-rescan training step — used when the corpus is too large for the
+ * incremental engine's 32-bit positions.
+ *
+ * Algorithm:
+ *   1. Count every adjacent pair, shard by shard on the worker threads
+ *   2. Merge the shard tables in order (pairs numbered by first occurrence)
+ *   3. Linear scan over unique pairs to find max frequency
+ *   4. Apply the winning merge to all pieces, unless it occurs fewer
+ *      than min_count times
+ *
+ * Returns the frequency count (> 0) on success, or 0 if no pair occurs
+ * min_count times or memory ran out (ctx->failed is then set).
+ * -------------------------------------------------------------------------- */
+static uint64_t rescan_max_count_pair(bpe_pair_t *pair,
+                                      bpe_train_ctx_t *ctx,
+                                      uint64_t min_count) {
+    struct shard_set set;
+    size_t n_tokens;
+    struct bpe_pair_stats *st = bpe_malloc(sizeof(struct bpe_pair_stats));
+    if (st == NULL) {
+        ctx->failed = 1;
+        return 0;
+    }
+    memset(st, 0, sizeof(*st));
+
+    if (shards_init(&set, ctx, &n_tokens) < 0 || stats_table_grow(st) < 0
+        || shards_count(&set, st) < 0) {
+        shards_free(&set);
+        stats_free(st);
+        ctx->failed = 1;
+        return 0;
+    }
+    shards_free(&set);
 
-        bpe_free(buf_nodes);
+    /* Find the pair with the highest frequency (first on ties) */
+    const struct pair_stat *p_max = NULL;
+    for (size_t n = 0; n < st->pairs_len; n++) {
+        if (p_max == NULL || st->pairs[n].count > p_max->count) {
+            p_max = &st->pairs[n];
+        }
+    }
+
+    uint64_t count = 0;
+    if (p_max && p_max->count >= min_count) {
+        pair->left = p_max->left;
+        pair->right = p_max->right;
+        count = p_max->count;
 
         ctx->rank++;
+        merge_pieces(ctx, pair, ctx->rank);
+        pieces_compact(ctx);
+    }
+
+    stats_free(st);
+    return count;
+}
 
-        /* Apply the winning merge to all pieces in-place */
-        merge_piece(ctx->pieces, ctx->pieces_len, pair, ctx->rank);
-        return count;
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/* --------------------------------------------------------------------------
+ * One training step: find the most frequent pair and apply it, unless
+ * it occurs fewer than min_count times (it then stays unmerged).
+ *
+ * Uses the incremental engine unless the corpus is too large for it.
+ * Returns the frequency count (> 0) on success, or 0 if no pair occurs
+ * min_count times or memory ran out.
+ * -------------------------------------------------------------------------- */
+static uint64_t train_step(bpe_pair_t *pair, bpe_train_ctx_t *ctx,
+                           uint64_t min_count) {
+    /* The 32-bit ID space is exhausted (BPE_ID_MAX is reserved) */
+    if (ctx->rank >= BPE_ID_MAX - 1) {
+        return 0;
     }
 
-    bpe_free(buf_nodes);
-    return 0;
+    int ready = stats_ensure(ctx);
+    if (ready == 0) {
+        return rescan_max_count_pair(pair, ctx, min_count);
+    }
+    if (ready < 0) {
+        return 0;
+    }
+
+    struct bpe_pair_stats *st = ctx->stats;
+    int err = 0;
+    uint32_t n = stats_pop_max(st, &err);
+    if (n == STATS_POS_NONE) {
+        if (err) {
+            stats_fail(ctx);
+        }
+        return 0;
+    }
+
+    uint64_t count = st->pairs[n].count;
+    if (count < min_count) {
+        /* Put the winner back so a later call with a lower bound sees it */
+        if (stats_heap_push(st, count, stats_first(st, n), n) < 0) {
+            stats_fail(ctx);
+        }
+        return 0;
+    }
+    pair->left = st->pairs[n].left;
+    pair->right = st->pairs[n].right;
+
+    ctx->rank++;
+    if (stats_merge(st, n, ctx->rank) < 0) {
+        stats_fail(ctx);
+        return 0;
+    }
+    return count;
+}
+
+uint64_t bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx) {
+    return train_step(pair, ctx, 1);
+}
+
+/* --------------------------------------------------------------------------
+ * Run up to n training steps back to back.
+ *
+ * Each step's pair and count go to pairs[i] / counts[i] (counts may be
+ * NULL).  Stops early when no pair occurs min_count times or memory runs
+ * out (ctx->failed).  Returns the number of steps done.
+ * -------------------------------------------------------------------------- */
+size_t bpe_train(bpe_train_ctx_t *ctx, size_t n, uint64_t min_count,
+                 bpe_pair_t *pairs, uint64_t *counts) {
+    if (min_count == 0) {
+        min_count = 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t count = train_step(&pairs[i], ctx, min_count);
+        if (count == 0) {
+            return i;
+        }
+        if (counts) {
+            counts[i] = count;
+        }
+    }
+    return n;
 }
 
 /* --------------------------------------------------------------------------
@@ -176,40 +1228,153 @@ unsigned long bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx) {
  *
  * Used for "continue training": load an existing model's merges, apply
  * them to the training data in order, then continue learning from that
- * state.  Each merge increments the rank and transforms the pieces.
+ * state.  Before training has started the pieces are encoded in a
+ * single pass (encode_pieces); otherwise each merge increments the rank
+ * and transforms the pieces (or the engine state) in turn.
  * -------------------------------------------------------------------------- */
-void bpe_apply_merges(bpe_train_ctx_t *ctx, const bpe_pair_t *pairs,
-                      size_t pairs_len) {
+int bpe_apply_merges(bpe_train_ctx_t *ctx, const bpe_pair_t *pairs,
+                     size_t pairs_len) {
+    if (ctx->failed) {
+        return -1;
+    }
+
+    if (ctx->stats == NULL && ctx->rank == BPE_TRAIN_RANK_INIT
+        && pairs_len > 0) {
+        if (pairs_len > BPE_ID_MAX - 1 - BPE_TRAIN_RANK_INIT
+            || encode_pieces(ctx, pairs, pairs_len) < 0) {
+            ctx->failed = 1;
+            return -1;
+        }
+        ctx->rank += (bpe_id_t)pairs_len;
+        pieces_compact(ctx);
+        return 0;
+    }
+
     for (size_t i = 0; i < pairs_len; i++) {
         ctx->rank++;
-        merge_piece(ctx->pieces, ctx->pieces_len, &pairs[i], ctx->rank);
+        if (ctx->stats == NULL) {
+            merge_pieces(ctx, &pairs[i], ctx->rank);
+            continue;
+        }
+
+        uint32_t n = stats_find(ctx->stats, pairs[i].left, pairs[i].right);
+        if (n != STATS_POS_NONE && ctx->stats->pairs[n].count
+            && stats_merge(ctx->stats, n, ctx->rank) < 0) {
+            stats_fail(ctx);
+            return -1;
+        }
     }
+    if (ctx->stats == NULL && pairs_len > 0) {
+        pieces_compact(ctx);
+    }
+    return 0;
 }
 
 /* --------------------------------------------------------------------------
- * Initialize one training piece from raw bytes.
- *
- * Each byte becomes a base token ID (0-255).  The resulting piece is
- * a sequence of unsigned long token IDs allocated via bpe_malloc().
+ * Initialize an empty training context.
  * -------------------------------------------------------------------------- */
-void bpe_train_ctx_idx_init(bpe_train_ctx_t *ctx, size_t idx,
-                            const char *bytes, size_t size) {
-    ctx->pieces[idx].ids = bpe_malloc(size * sizeof(unsigned long));
-    ctx->pieces[idx].len = size;
-    for (size_t i = 0; i < size; i++) {
-        ctx->pieces[idx].ids[i] = (unsigned long)((unsigned char)bytes[i]);
+void bpe_train_ctx_init(bpe_train_ctx_t *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->rank = BPE_TRAIN_RANK_INIT;
+}
+
+/* --------------------------------------------------------------------------
+ * Move the (still empty) piece buffers to scratch files in `dir`.
+ * -------------------------------------------------------------------------- */
+int bpe_train_ctx_spill(bpe_train_ctx_t *ctx, const char *dir) {
+    if (ctx->pieces_len || ctx->ids_store || ctx->pieces_store) {
+        return -1;
+    }
+    ctx->ids_store = bpe_store_new(dir);
+    ctx->pieces_store = bpe_store_new(dir);
+    if (ctx->ids_store == NULL || ctx->pieces_store == NULL) {
+        pieces_free(ctx);
+        return -1;
     }
+    return 0;
 }
 
 /* --------------------------------------------------------------------------
- * Free all resources held by the training context.
+ * Add `count` occurrences of a piece.
  *
- * Frees each piece's ids[] array.  The caller is responsible for
- * freeing the pieces[] array itself (if dynamically allocated).
+ * A piece whose bytes were added before only has its count increased,
+ * so the context holds each distinct piece once, in first-seen order.
+ * That order keeps the "first occurrence" tie-break of the original
+ * corpus.  Each byte becomes a base token ID (0-255) appended to the
+ * arena.
  * -------------------------------------------------------------------------- */
-void bpe_train_ctx_free(bpe_train_ctx_t *ctx) {
-    for (size_t i = 0; i < ctx->pieces_len; i++) {
-        bpe_free(ctx->pieces[i].ids);
-        ctx->pieces[i].ids = NULL;
+int bpe_train_ctx_add(bpe_train_ctx_t *ctx, const char *bytes, size_t size,
+                      uint64_t count) {
+    const unsigned char *data = (const unsigned char *)bytes;
+
+    if (size < 2 || count == 0) {
+        return 0;  /* contributes no pairs */
+    }
+    ctx->store_error = 0;
+    if (ctx->stats || ctx->rank != BPE_TRAIN_RANK_INIT) {
+        return -1;  /* pieces have already been rewritten by merges */
+    }
+
+    if ((ctx->pieces_len + 1) * 2 > ctx->dedup_mask + 1 && dedup_grow(ctx) < 0) {
+        return -1;
+    }
+
+    size_t i = (size_t)bytes_hash(data, size) & ctx->dedup_mask;
+    while (ctx->dedup[i]) {
+        bpe_piece_t *piece = &ctx->pieces[ctx->dedup[i] - 1];
+        if (piece_equals(ctx, piece, data, size)) {
+            piece->count += count;
+            return 0;
+        }
+        i = (i + 1) & ctx->dedup_mask;
+    }
+
+    if (ctx->pieces_len == ctx->pieces_cap) {
+        size_t cap = ctx->pieces_cap ? ctx->pieces_cap * 2 : 64;
+        bpe_piece_t *pieces = buffer_resize(ctx->pieces_store, ctx->pieces,
+                                            cap * sizeof(bpe_piece_t));
+        if (pieces == NULL) {
+            ctx->store_error = ctx->pieces_store ? errno : 0;
+            return -1;
+        }
+        ctx->pieces = pieces;
+        ctx->pieces_cap = cap;
     }
+    if (size > ctx->ids_cap - ctx->ids_len) {
+        size_t cap = ctx->ids_cap ? ctx->ids_cap * 2 : 4096;
+        while (cap - ctx->ids_len < size) {
+            cap *= 2;
+        }
+        bpe_id_t *ids = buffer_resize(ctx->ids_store, ctx->ids,
+                                      cap * sizeof(bpe_id_t));
+        if (ids == NULL) {
+            ctx->store_error = ctx->ids_store ? errno : 0;
+            return -1;
+        }
+        ctx->ids = ids;
+        ctx->ids_cap = cap;
+    }
+
+    bpe_id_t *ids = ctx->ids + ctx->ids_len;
+    for (size_t k = 0; k < size; k++) {
+        ids[k] = data[k];
+    }
+
+    bpe_piece_t *piece = &ctx->pieces[ctx->pieces_len];
+    piece->start = ctx->ids_len;
+    piece->len = size;
+    piece->count = count;
+    ctx->ids_len += size;
+    ctx->dedup[i] = ++ctx->pieces_len;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Free all resources held by the training context, including the
+ * pieces[] array and the arena.
+ * -------------------------------------------------------------------------- */
+void bpe_train_ctx_free(bpe_train_ctx_t *ctx) {
+    pieces_free(ctx);
+    stats_free(ctx->stats);
+    ctx->stats = NULL;
 }
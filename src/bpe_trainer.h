@@ -7,19 +7,28 @@
  * ## Algorithm
  *
  * Starting from the 256 base byte tokens (IDs 0-255), each training step:
- *   1. Scans all adjacent pairs across all training pieces
- *   2. Builds an AVL tree counting pair frequencies
- *   3. Finds the most frequent pair
- *   4. Replaces all occurrences of that pair with a new token ID
- *   5. The new token ID becomes available for future merges
+ *   1. Finds the most frequent adjacent pair across all training pieces
+ *      (ties go to the pair that occurs first)
+ *   2. Replaces all occurrences of that pair with a new token ID
+ *   3. The new token ID becomes available for future merges
+ *
+ * Pair counts are computed once and then maintained incrementally: a
+ * merge only touches the positions where the merged pair occurs and
+ * their neighbours, instead of recounting the whole corpus each step.
+ * Identical pieces are stored once with an occurrence count, and every
+ * pair they contain is counted that many times.
+ *
+ * The initial count runs on ctx->n_threads threads; the learned merges
+ * do not depend on the thread count.
  *
  * ## Usage
  *
- *   1. Create a bpe_train_ctx_t and initialize each piece via
- *      bpe_train_ctx_idx_init().
+ *   1. Initialize a bpe_train_ctx_t with bpe_train_ctx_init() and add
+ *      the training data with bpe_train_ctx_add().
  *   2. Call bpe_get_max_count_pair() repeatedly — one training step
  *      per call.  The function returns the pair, its rank, and its
- *      frequency, or 0 when no more merges are possible.
+ *      frequency, or 0 when no more merges are possible.  bpe_train()
+ *      runs many steps per call.
  *   3. Optionally use bpe_apply_merges() to pre-load existing merges
  *      for "continue training" scenarios.
  *   4. Free the context with bpe_train_ctx_free() when done.
@@ -27,48 +36,108 @@
  * ## Pure C
  *
  * This module does NOT include <Python.h>.  It is portable to any
- * platform with a C99 compiler and the bpe_common / AVL tree modules.
+ * platform with a C99 compiler and the bpe_common / bpe_thread modules.
+ * Training steps never touch Python objects, so callers may release the
+ * GIL around them (one step at a time per context).
  */
 
 #ifndef SRC_BPE_TRAINER_H
 #define SRC_BPE_TRAINER_H
 
 #include "bpe_common.h"
+#include "bpe_store.h"
 
 /* Token IDs 0-255 are reserved for the base byte tokens.
  * The first learned merge gets ID 256. */
 #define BPE_TRAIN_RANK_INIT 255
 
+/* Incremental pair statistics (private to bpe_trainer.c). */
+struct bpe_pair_stats;
+
 /* --------------------------------------------------------------------------
  * Training context — holds all state during BPE learning.
+ *
+ * All token IDs live in one arena, piece after piece in CSR layout: a
+ * piece's IDs are ids[start .. start + len).  Merges compact the arena
+ * in place and drop pieces that shrank to one token, as they hold no
+ * pairs.  The first training step moves the remaining tokens into
+ * `stats` and frees the arena and pieces[].
+ *
+ * Out of core: after bpe_train_ctx_spill() the arena and pieces[] live
+ * in memory-mapped scratch files.  With a memory_limit, steps stream
+ * over the arena (rescan engine) until the incremental engine for what
+ * is left needs at most memory_limit bytes, then switch to it.
  * -------------------------------------------------------------------------- */
 typedef struct {
-    bpe_piece_t *pieces;      /* array of training data chunks (caller-owned) */
+    bpe_piece_t *pieces;      /* distinct training chunks, first-seen order   */
     size_t pieces_len;        /* number of pieces                              */
+    size_t pieces_cap;        /* allocated capacity of pieces[]                */
+
+    bpe_id_t *ids;            /* token arena shared by all pieces              */
+    size_t ids_len;           /* arena slots in use                            */
+    size_t ids_cap;           /* allocated capacity of ids[]                   */
 
-    unsigned long rank;       /* next available token ID (starts at 256)      */
+    bpe_store_t *ids_store;   /* scratch file holding ids[], or NULL (heap)   */
+    bpe_store_t *pieces_store; /* scratch file holding pieces[], or NULL      */
+    size_t memory_limit;      /* incremental engine budget in bytes, 0 = none */
+    int store_error;          /* errno of the last failed scratch-file resize */
+
+    size_t *dedup;            /* piece lookup by bytes (piece index + 1)      */
+    size_t dedup_mask;        /* dedup capacity - 1                            */
+
+    bpe_id_t rank;            /* last assigned token ID (starts at 255)        */
+
+    unsigned int n_threads;   /* worker threads, 0 = one per CPU              */
+
+    struct bpe_pair_stats *stats;  /* incremental engine, built lazily        */
+    int failed;                    /* ran out of memory; context unusable     */
 } bpe_train_ctx_t;
 
 /* --------------------------------------------------------------------------
- * Initialize one training piece from raw bytes.
+ * Initialize an empty training context (no pieces, rank 255, one
+ * thread per CPU).
+ * -------------------------------------------------------------------------- */
+void bpe_train_ctx_init(bpe_train_ctx_t *ctx);
+
+/* --------------------------------------------------------------------------
+ * Keep the piece arena and pieces[] in scratch files under directory
+ * `dir` instead of on the heap (see bpe_store.h).  The files are
+ * deleted with the context.
+ *
+ * Must be called before the first piece is added.  Returns -1 if a
+ * file cannot be created or pieces were already added.
+ * -------------------------------------------------------------------------- */
+int bpe_train_ctx_spill(bpe_train_ctx_t *ctx, const char *dir);
+
+/* --------------------------------------------------------------------------
+ * Add `count` occurrences of one training piece.
+ *
+ * Each byte becomes a base token ID (0-255).  If the same bytes were
+ * added before, only that piece's count grows; otherwise a new piece is
+ * appended to pieces[] and its IDs to the arena.  Pieces shorter than
+ * two bytes (they hold no pair) and count = 0 are ignored.  Training is
+ * identical to adding every occurrence separately.
  *
- * Each byte becomes a base token ID (0-255).  The piece's ids[] array
- * is allocated dynamically via bpe_malloc().
+ * Pieces must be added before the first training step or
+ * bpe_apply_merges().  Returns 0 on success, -1 on allocation failure
+ * or if training has already started.  A failure to grow a scratch
+ * file (see bpe_train_ctx_spill()) sets ctx->store_error to its errno;
+ * other failures reset it to 0.
  *
  * Parameters:
  *   ctx   — training context
- *   idx   — piece index (0-indexed, must be < ctx->pieces_len)
  *   bytes — raw training data for this piece
  *   size  — number of bytes
+ *   count — number of occurrences (≥ 1)
  * -------------------------------------------------------------------------- */
-void bpe_train_ctx_idx_init(bpe_train_ctx_t *ctx, size_t idx,
-                            const char *bytes, size_t size);
+int bpe_train_ctx_add(bpe_train_ctx_t *ctx, const char *bytes, size_t size,
+                      uint64_t count);
 
 /* --------------------------------------------------------------------------
  * Free all resources within the training context.
  *
- * Frees each piece's ids[] array.  The caller must free ctx->pieces
- * separately if it was dynamically allocated.
+ * Frees the pieces and the engine state.  The context can be reused
+ * after another bpe_train_ctx_init().
  * -------------------------------------------------------------------------- */
 void bpe_train_ctx_free(bpe_train_ctx_t *ctx);
 
@@ -81,9 +150,24 @@ void bpe_train_ctx_free(bpe_train_ctx_t *ctx);
  *
  * On success, *pair is filled with the winning pair and ctx->rank is
  * incremented.  Returns the frequency count (> 0), or 0 if no more
- * pairs are available (training complete).
+ * pairs are available (training complete) or memory ran out — in the
+ * latter case ctx->failed is set and every later call returns 0.
  * -------------------------------------------------------------------------- */
-unsigned long bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx);
+uint64_t bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx);
+
+/* --------------------------------------------------------------------------
+ * Perform up to n training steps in one call.
+ *
+ * Equivalent to calling bpe_get_max_count_pair() n times, except that
+ * training also stops before a pair occurring fewer than min_count
+ * times (0 counts as 1); that pair is left unmerged.  Step i stores its
+ * pair in pairs[i] and its frequency in counts[i] (counts may be NULL).
+ *
+ * Returns the number of steps performed (≤ n).  A short count means no
+ * pair qualifies, or memory ran out — then ctx->failed is set.
+ * -------------------------------------------------------------------------- */
+size_t bpe_train(bpe_train_ctx_t *ctx, size_t n, uint64_t min_count,
+                 bpe_pair_t *pairs, uint64_t *counts);
 
 /* --------------------------------------------------------------------------
  * Pre-apply an existing sequence of merges to the training context.
@@ -95,8 +179,10 @@ unsigned long bpe_get_max_count_pair(bpe_pair_t *pair, bpe_train_ctx_t *ctx);
  *   ctx       — training context
  *   pairs     — array of merge pairs to apply in order
  *   pairs_len — number of pairs
+ *
+ * Returns 0 on success, -1 on allocation failure.
  * -------------------------------------------------------------------------- */
-void bpe_apply_merges(bpe_train_ctx_t *ctx, const bpe_pair_t *pairs,
-                      size_t pairs_len);
+int bpe_apply_merges(bpe_train_ctx_t *ctx, const bpe_pair_t *pairs,
+                     size_t pairs_len);
 
 #endif  /* SRC_BPE_TRAINER_H */
@@ -1,6 +1,64 @@
 """Unit tests for the C extension directly (bpe.Trainer, bpe.Tokenizer, bpe.BytesRemap)."""
 
+import array
+import random
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+import pytest
+import regex
+
 import tinybpe.bpe as bpe
+from tinybpe._registry import _PATTERNS
+
+
+def _reference_encode(merges: list[tuple[int, int]], data: bytes) -> list[int]:
+    """Naive round-by-round BPE: merge every occurrence of the lowest-rank pair."""
+    ranks = {pair: 256 + i for i, pair in enumerate(merges)}
+    ids = list(data)
+    while len(ids) > 1:
+        best = min(zip(ids, ids[1:]), key=lambda p: ranks.get(p, float("inf")))
+        if best not in ranks:
+            break
+        out: list[int] = []
+        i = 0
+        while i < len(ids):
+            if i + 1 < len(ids) and (ids[i], ids[i + 1]) == best:
+                out.append(ranks[best])
+                i += 2
+            else:
+                out.append(ids[i])
+                i += 1
+        ids = out
+    return ids
+
+
+def _reference_train(pieces: list[bytes], n: int) -> list[tuple[tuple[int, int], int, int]]:
+    """Naive trainer: recount every step, ties go to the first occurring pair."""
+    seqs = [list(p) for p in pieces]
+    steps = []
+    for rank in range(256, 256 + n):
+        counts: dict[tuple[int, int], int] = {}
+        for seq in seqs:
+            for pair in zip(seq, seq[1:]):
+                counts[pair] = counts.get(pair, 0) + 1
+        if not counts:
+            break
+        best = max(counts.values())
+        pair = next(p for p, c in counts.items() if c == best)
+        for k, seq in enumerate(seqs):
+            out: list[int] = []
+            i = 0
+            while i < len(seq):
+                if i + 1 < len(seq) and (seq[i], seq[i + 1]) == pair:
+                    out.append(rank)
+                    i += 2
+                else:
+                    out.append(seq[i])
+                    i += 1
+            seqs[k] = out
+        steps.append((pair, rank, best))
+    return steps
 
 
 class TestCTrainer:
@@ -40,6 +98,227 @@ class TestCTrainer:
         result = trainer2.step()
         assert result is not None
 
+    def test_steps_match_reference(self):
+        """Incremental pair counts must pick the same pairs, ties included."""
+        rng = random.Random(0)
+        for alphabet in (b"ab", b"abc", b"hello world"):
+            pieces = [bytes(rng.choice(alphabet) for _ in range(rng.randint(0, 40))) for _ in range(rng.randint(1, 30))]
+            trainer = bpe.Trainer(pieces)
+            steps = []
+            while (result := trainer.step()) is not None:
+                steps.append(result)
+            assert steps == _reference_train(pieces, 10_000)
+
+    def test_overlapping_runs(self):
+        pieces = [b"a" * 7, b"aaXaaa"]
+        trainer = bpe.Trainer(pieces)
+        assert [trainer.step() for _ in range(4)] == _reference_train(pieces, 4)
+
+    def test_load_merges_then_train(self):
+        """Pieces that loaded merges shrink to one token drop out unchanged."""
+        rng = random.Random(2)
+        pieces = [bytes(rng.choice(b"abcd") for _ in range(rng.randint(0, 9))) for _ in range(300)]
+        expected = _reference_train(pieces, 60)
+        trainer = bpe.Trainer(pieces)
+        trainer.load_merges([pair for pair, _, _ in expected[:20]])
+        assert [trainer.step() for _ in range(40)] == expected[20:]
+
+    def test_load_merges_encodes_pieces(self):
+        """Loading merges leaves each piece as the tokenizer would encode it."""
+        rng = random.Random(4)
+        pieces = [bytes(rng.choice(b"aab") for _ in range(rng.randint(0, 200))) for _ in range(50)]
+        merges = [(97, 97), (97, 98), (256, 97), (257, 256), (98, 258), (256, 256)]
+        counts: dict[tuple[int, int], int] = {}
+        for piece in pieces:
+            ids = _reference_encode(merges, piece)
+            for pair in zip(ids, ids[1:]):
+                counts[pair] = counts.get(pair, 0) + 1
+        pair, count = max(counts.items(), key=lambda item: item[1])
+        rank = 256 + len(merges)
+
+        trainer = bpe.Trainer(pieces, num_threads=3)
+        trainer.load_merges(merges)
+        assert trainer.step() == (pair, rank, count)
+
+    def test_rescan_engine_matches(self, tmp_path):
+        """memory_limit forces streaming rescans; spill_dir moves pieces to disk."""
+        rng = random.Random(3)
+        pieces = [bytes(rng.choice(b"abcde ") for _ in range(rng.randint(0, 20))) for _ in range(500)]
+        counts = [rng.randint(1, 3) for _ in pieces]
+        reference = bpe.Trainer(pieces, counts)
+        reference.train(80)
+        for kwargs in ({"memory_limit": 1}, {"spill_dir": tmp_path}, {"spill_dir": tmp_path, "memory_limit": 1}):
+            trainer = bpe.Trainer(pieces[:100], counts[:100], num_threads=2, **kwargs)
+            trainer.add(pieces[100:], counts[100:])
+            trainer.load_merges(reference.merges[:5])
+            assert trainer.train(75) == 75
+            assert trainer.merges == reference.merges
+        del trainer
+        assert list(tmp_path.iterdir()) == []
+
+    def test_add_after_training(self):
+        trainer = bpe.Trainer([b"abab"])
+        trainer.add([b"cdcd"], [3])
+        assert trainer.step() == ((99, 100), 256, 6)
+        with pytest.raises(RuntimeError, match="training has started"):
+            trainer.add([b"ab"])
+
+    def test_spill_dir_missing(self, tmp_path):
+        with pytest.raises(FileNotFoundError):
+            bpe.Trainer([b"ab"], spill_dir=tmp_path / "missing")
+
+    @pytest.mark.skipif(sys.platform == "win32", reason="needs RLIMIT_FSIZE")
+    def test_spill_file_full(self, tmp_path):
+        """A spill file that cannot grow raises OSError, not MemoryError."""
+        import errno
+        import os
+        import resource
+        import signal
+
+        (tmp_path / "big.txt").write_bytes(b"xy" * (1 << 19))
+        handler = signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+        soft, hard = resource.getrlimit(resource.RLIMIT_FSIZE)
+        resource.setrlimit(resource.RLIMIT_FSIZE, (1 << 20, hard))
+        try:
+            with pytest.raises(OSError, match=os.strerror(errno.EFBIG)):
+                bpe.Trainer([b"xy" * (1 << 19)], spill_dir=tmp_path)
+            trainer = bpe.Trainer([b""], spill_dir=tmp_path)
+            with pytest.raises(OSError, match=os.strerror(errno.EFBIG)):
+                trainer.add_files([tmp_path / "big.txt"], pretokenizer="none")
+        finally:
+            resource.setrlimit(resource.RLIMIT_FSIZE, (soft, hard))
+            signal.signal(signal.SIGXFSZ, handler)
+
+    def test_add_files_matches_pieces(self, tmp_path):
+        pat = regex.compile(_PATTERNS["bytelevel"])
+        random.seed(7)
+        words = ["hello", " world", "\n", "\r\n", "  ", "\u00e9t\u00e9", "\u4e2d\u6587", "123", "'s", "!!", "\t", "A"]
+        texts = ["".join(random.choice(words) for _ in range(2000)) for _ in range(3)]
+        paths = []
+        for i, text in enumerate(texts):
+            paths.append(tmp_path / f"{i}.txt")
+            paths[-1].write_bytes(text.encode())
+
+        reference = bpe.Trainer([ch.encode() for text in texts for ch in pat.findall(text)])
+        reference.train(100)
+        for segment_size in (0, 1, 64):
+            trainer = bpe.Trainer([b""], num_threads=3)
+            trainer.add_files(paths, segment_size=segment_size)
+            trainer.train(100)
+            assert trainer.merges == reference.merges
+
+        whole = bpe.Trainer([b""])
+        whole.add_files([str(p) for p in paths], pretokenizer="none")
+        assert whole.step() == bpe.Trainer([t.encode() for t in texts]).step()
+
+    def test_add_files_errors(self, tmp_path):
+        trainer = bpe.Trainer([b""])
+        with pytest.raises(FileNotFoundError) as info:
+            trainer.add_files([tmp_path / "missing.txt"])
+        assert info.value.filename == tmp_path / "missing.txt"
+        with pytest.raises(ValueError, match="Unknown pretokenizer"):
+            trainer.add_files([], pretokenizer="gpt2")
+        trainer.add([b"abab"])
+        trainer.step()
+        with pytest.raises(RuntimeError, match="training has started"):
+            trainer.add_files([])
+
+    def test_counts_match_repeated_pieces(self):
+        pieces = [b"low", b"lower", b"newest", b"widest"]
+        counts = [5, 2, 6, 3]
+        repeated = [p for p, c in zip(pieces, counts) for _ in range(c)]
+        weighted = bpe.Trainer(pieces, counts)
+        plain = bpe.Trainer(repeated)
+        for _ in range(12):
+            assert weighted.step() == plain.step()
+
+    def test_counts_invalid(self):
+        with pytest.raises(TypeError):
+            bpe.Trainer([b"ab"], [1, 2])
+        with pytest.raises(ValueError, match="positive"):
+            bpe.Trainer([b"ab"], [0])
+        with pytest.raises(ValueError, match="positive"):
+            bpe.Trainer([b"ab"], [-1])
+
+    def test_large_counts(self):
+        trainer = bpe.Trainer([b"ab"], [2**40])
+        assert trainer.step() == ((97, 98), 256, 2**40)
+
+    def test_num_threads_deterministic(self):
+        """Sharded counting must not change the merges (shards split pieces)."""
+        rng = random.Random(1)
+        words = [bytes(rng.choice(b"abcdefgh ") for _ in range(rng.randint(1, 12))) for _ in range(2000)]
+        pieces = [b"".join(rng.choice(words) for _ in range(100)) for _ in range(30)]
+        pieces.append(b"ab" * 100_000)
+        steps = None
+        for num_threads in (1, 3, 8):
+            trainer = bpe.Trainer(pieces, num_threads=num_threads)
+            result = [trainer.step() for _ in range(200)]
+            assert steps is None or result == steps
+            steps = result
+
+    def test_num_threads_invalid(self):
+        with pytest.raises(ValueError, match="num_threads"):
+            bpe.Trainer([b"ab"], num_threads=-1)
+
+    def test_step_releases_gil(self):
+        """Steps on different trainers may run concurrently."""
+        pieces = [b"hello world " * 2000, b"lower newer " * 2000]
+        expected = bpe.Trainer(pieces)
+        reference = [expected.step() for _ in range(50)]
+
+        def run(_: int) -> list:
+            trainer = bpe.Trainer(pieces)
+            return [trainer.step() for _ in range(50)]
+
+        with ThreadPoolExecutor(max_workers=4) as pool:
+            assert all(r == reference for r in pool.map(run, range(8)))
+
+    def test_train_in_c(self):
+        pieces = [b"hello world " * 2000, b"lower newer " * 2000]
+        reference = bpe.Trainer(pieces)
+        steps = [reference.step() for _ in range(30)]
+
+        calls: list = []
+        trainer = bpe.Trainer(pieces)
+        assert trainer.train(30, progress_every=7, callback=lambda *a: calls.append(a)) == 30
+        assert trainer.merges == reference.merges
+        assert [c[0] for c in calls] == [7, 14, 21, 28, 30]
+        assert all(c[1] == 30 for c in calls)
+        assert calls[-1][2:] == steps[-1]
+
+        with pytest.raises(ValueError, match="n_merges"):
+            trainer.train(-1)
+        with pytest.raises(TypeError, match="callback"):
+            trainer.train(1, callback=1)
+
+    def test_train_reports_exhaustion_at_batch_boundary(self):
+        """Pairs that run out after exactly one full batch still get the final report."""
+        pieces = [bytes([a, b]) for a in range(64) for b in range(64)]
+        calls: list = []
+        trainer = bpe.Trainer(pieces)
+        assert trainer.train(None, progress_every=10_000, callback=lambda *a: calls.append(a)) == 4096
+        assert calls == [(4096, 0, (63, 63), 255 + 4096, 1)]
+
+    def test_train_callback_error(self):
+        trainer = bpe.Trainer([b"hello world " * 50])
+
+        def stop(step, *_):
+            if step == 4:
+                raise KeyError(step)
+
+        with pytest.raises(KeyError):
+            trainer.train(10, progress_every=2, callback=stop)
+        # Merges done before the error are kept
+        assert trainer.n_merges == 4
+        assert trainer.train(1) == 1
+
+    def test_load_merges_after_exhaustion(self):
+        trainer = bpe.Trainer([b"a"])
+        assert trainer.step() is None
+        trainer.load_merges([(97, 97)])
+        assert trainer.step() is None
+
     def test_empty_list_raises(self):
         try:
             bpe.Trainer([])
@@ -128,6 +407,317 @@ class TestCTokenizer:
         tok = bpe.Tokenizer(self.merges)
         tok.cache_clean()  # Should not raise
 
+    def test_encode_long_chunk_matches_reference(self):
+        """Long chunks take the heap-based engine; results must not change."""
+        tok = bpe.Tokenizer(self.merges)
+        rng = random.Random(0)
+        alphabet = b"helo wrd"
+        for size in (63, 64, 65, 200, 1000):
+            data = bytes(rng.choice(alphabet) for _ in range(size))
+            assert tok.encode(data) == _reference_encode(self.merges, data)
+        data = b"l" * 500 + b"hello world " * 40
+        assert tok.encode(data) == _reference_encode(self.merges, data)
+
+    def test_encode_batch(self):
+        tok = bpe.Tokenizer(self.merges, {b"<eot>": 1000})
+        docs = [[b"hello", b" world"], [], [b"<eot>", b""], [b"hello world " * 50]]
+        expected = [[i for chunk in doc for i in tok.encode(chunk)] for doc in docs]
+        for num_threads in (0, 1, 2, 8):
+            assert tok.encode_batch(docs, num_threads) == expected
+
+    def test_encode_batch_invalid(self):
+        tok = bpe.Tokenizer(self.merges)
+        with pytest.raises(TypeError):
+            tok.encode_batch([b"hello"])  # type: ignore[list-item]
+        with pytest.raises(TypeError):
+            tok.encode_batch([["hello"]])  # type: ignore[list-item]
+        with pytest.raises(ValueError, match="num_threads"):
+            tok.encode_batch([[b"hello"]], -1)
+
+    def test_encode_decode_concurrent(self):
+        """encode/decode release the GIL; concurrent calls must stay correct."""
+        tok = bpe.Tokenizer(self.merges)
+        data = b"hello world " * 500
+        expected = tok.encode(data)
+
+        def roundtrip(_: int) -> bool:
+            ids = tok.encode(data)
+            return ids == expected and tok.decode(ids) == data
+
+        with ThreadPoolExecutor(max_workers=4) as pool:
+            assert all(pool.map(roundtrip, range(16)))
+
+    def test_encode_text(self):
+        tok = bpe.Tokenizer(self.merges, pretokenizer="bytelevel")
+        text = "hello world, hello  world!\n"
+        expected = [i for chunk in bpe.pretokenize(text) for i in tok.encode(chunk)]
+        assert tok.encode_text(text) == expected
+        assert tok.encode_text("") == []
+
+    def test_encode_text_remap_and_special(self):
+        remap = list(reversed(range(256)))
+        tok = bpe.Tokenizer(
+            self.merges, {bytes(255 - b for b in b"<eot>"): 1000}, pretokenizer="none", bytes_maps=remap
+        )
+        assert tok.encode_text("<eot>") == [1000]
+        assert tok.encode_text("hi") == [255 - ord("h"), 255 - ord("i")]
+
+    def test_encode_chunks_and_decode_text(self):
+        """Remap is applied in C on both sides; chunks are not re-split."""
+        remap = list(reversed(range(256)))
+        special = {bytes(255 - b for b in b"<eot>"): 1000}
+        tok = bpe.Tokenizer(self.merges, special, bytes_maps=remap)
+        chunks = ["héllo", " wörld", "<eot>", "", "!"]
+        expected = [i for c in chunks if c for i in tok.encode(bytes(255 - b for b in c.encode()))]
+        assert tok.encode_chunks(chunks) == expected
+        assert 1000 in expected
+        assert tok.decode_text(expected) == "héllo wörld<eot>!"
+        assert tok.decode_text(array.array("I", expected)) == "héllo wörld<eot>!"
+        assert bpe.BytesRemap(remap)(b"\x00ab") == bytes([255, 255 - 97, 255 - 98])
+        with pytest.raises(TypeError, match="list of str"):
+            tok.encode_chunks([b"hello"])  # type: ignore[list-item]
+        with pytest.raises(UnicodeDecodeError):
+            bpe.Tokenizer(self.merges).decode_text([0xFF])
+
+    def test_encode_special_scanner(self):
+        """Special tokens are found anywhere, leftmost-longest; mask picks the set."""
+        special = {b"<a>": 1000, b"<ab>": 1001, b"\xc3\xa9!": 1002}
+        tok = bpe.Tokenizer(self.merges, special, pretokenizer="bytelevel")
+        ordinary = tok.encode_text
+
+        assert tok.encode_special("x<ab>y<a>é!") == [*ordinary("x"), 1001, *ordinary("y"), 1000, 1002]
+        assert tok.split_special("x<ab>y<a>é!") == ["x", 1001, "y", 1000, 1002]
+        assert tok.split_special("") == []
+        # <ab> as plain text, <a> still a special token
+        assert tok.encode_special("<ab><a>", b"\x01\x00\x01") == [*ordinary("<ab>"), 1000]
+        # Ordinary tokens are not matched as whole chunks either
+        assert tok.encode_special("<a>", b"\x00\x00\x00") == ordinary("<a>") != [1000]
+        with pytest.raises(ValueError, match="disallowed special token '<ab>'"):
+            tok.encode_special("text <ab>", b"\x01\x02\x01")
+        with pytest.raises(ValueError, match="disallowed special token 'é!'"):
+            tok.split_special("é!", b"\x00\x00\x02")
+        with pytest.raises(ValueError, match="one byte per special token"):
+            tok.encode_special("x", b"\x01")
+        with pytest.raises(ValueError, match="mask codes"):
+            tok.split_special("x", b"\x01\x01\x03")
+        with pytest.raises(ValueError, match="pretokenizer"):
+            bpe.Tokenizer(self.merges, special).encode_special("x")
+
+    def test_count_and_max_tokens(self):
+        special = {b"<a>": 1000}
+        tok = bpe.Tokenizer(self.merges, special, pretokenizer="bytelevel")
+        text = "héllo<a> wörld" * 20
+        ids = tok.encode_special(text)
+        assert tok.count_special(text) == len(ids)
+        assert tok.count_special("hi") == len(tok.encode_special("hi"))
+        assert tok.encode_special(text, None, 7) == ids[:7]
+        assert tok.encode_special(text, max_tokens=0) == []
+        chunks = ["héllo", "<a>", " wörld"] * 20
+        ids = tok.encode_chunks(chunks)
+        assert tok.count_chunks(chunks) == len(ids)
+        assert tok.count_chunks(chunks, False) == len(tok.encode_chunks(chunks, False)) > len(ids)
+        assert tok.encode_chunks(chunks, max_tokens=5) == ids[:5]
+        with pytest.raises(TypeError, match="count_chunks"):
+            tok.count_chunks([b"x"])  # type: ignore[list-item]
+
+    def test_encode_text_requires_pretokenizer(self):
+        tok = bpe.Tokenizer(self.merges)
+        with pytest.raises(ValueError, match="pretokenizer"):
+            tok.encode_text("hello")
+        with pytest.raises(ValueError, match="pretokenizer"):
+            bpe.Tokenizer(self.merges, pretokenizer="gpt2")
+        with pytest.raises(ValueError, match="permutation"):
+            bpe.Tokenizer(self.merges, bytes_maps=[0] * 256)
+
+    def test_stable_prefix(self):
+        tok = bpe.Tokenizer(self.merges, pretokenizer="bytelevel")
+        # Chunks: "héllo", " wörld", " ", " foo" — hold back the last two
+        assert tok.stable_prefix("héllo wörld  foo") == len("héllo wörld")
+        # Never cut right after whitespace: "a", " ", "\t", "!!" cuts after "a"
+        assert tok.stable_prefix("a \t!!") == 1
+        assert tok.stable_prefix("ab cd") == tok.stable_prefix("") == 0
+        assert bpe.Tokenizer(self.merges, pretokenizer="none").stable_prefix("a b c") == 0
+        with pytest.raises(ValueError, match="pretokenizer"):
+            bpe.Tokenizer(self.merges).stable_prefix("hello")
+
+    def test_image_roundtrip(self):
+        tok = bpe.Tokenizer(self.merges)
+        image = tok.to_image()
+        assert image[:8] == b"TinyBPEB"
+        tok2 = bpe.Tokenizer(image, {b"<eot>": 1000}, pretokenizer="bytelevel")
+        assert tok2.merges == self.merges
+        assert tok2.vocab == {**tok.vocab, 1000: b"<eot>"}
+        assert tok2.n_vocab == tok.n_vocab + 1
+        text = "hello world <eot>"
+        assert tok2.encode(text.encode()) == tok.encode(text.encode())
+        assert tok2.decode(tok2.encode_text(text)) == text.encode()
+        assert tok2.to_image() == image
+
+    def test_shared_model(self):
+        model = bpe.Model(self.merges, list(range(256)))
+        assert model.merges == self.merges
+        assert model.n_vocab == 256 + len(self.merges)
+        assert model.bytes_maps == list(range(256))
+        assert bpe.Model(self.merges).bytes_maps is None
+        tok1 = bpe.Tokenizer(model)
+        tok2 = bpe.Tokenizer(model, {b"<eot>": 1000})
+        assert tok1.model is tok2.model is model
+        assert tok2.vocab == {**model.vocab, 1000: b"<eot>"}
+        assert tok1.encode(b"hello world") == bpe.Tokenizer(self.merges).encode(b"hello world")
+        with pytest.raises(ValueError, match="not initialized"):
+            bpe.Tokenizer(bpe.Model.__new__(bpe.Model))
+
+    def test_encode_to_array(self):
+        tok = bpe.Tokenizer(self.merges, {b"<eot>": 1000}, pretokenizer="bytelevel")
+        chunks = ["hello world", b"<eot>", b"hello", ""]
+        expected = tok.encode_batch([chunks])[0]
+        ids = tok.encode_to_array(chunks)
+        assert ids.typecode == "I"
+        assert ids.tolist() == expected
+        assert tok.encode_to_array([]).tolist() == []
+        out = array.array("Q", [0] * len(expected))
+        assert tok.encode_to_array(chunks, out) == len(expected)
+        assert out.tolist() == expected
+        with pytest.raises(TypeError, match="list of bytes"):
+            tok.encode_to_array(b"hello")  # type: ignore[arg-type]
+
+    def test_decode_buffer(self):
+        tok = bpe.Tokenizer(self.merges, {b"<eot>": 1000})
+        ids = [*tok.encode(b"hello world"), 1000, *tok.encode(b" hello")]
+        for typecode in ("H", "I", "l", "Q"):
+            assert tok.decode(array.array(typecode, ids)) == b"hello world<eot> hello"
+        assert tok.decode(array.array("I")) == b""
+        with pytest.warns(UserWarning, match="Unknown token"):
+            assert tok.decode(array.array("q", [-1, 104])) == b"h"
+        with pytest.raises(TypeError, match="buffer of integers"):
+            tok.decode("hello")  # type: ignore[arg-type]
+
+    def test_decode_every_token(self):
+        """Wide copies match exact ones for every token, incl. an image's tail."""
+        special = {b"<eot>": 1000}
+        built = bpe.Tokenizer(self.merges, special)
+        mapped = bpe.Tokenizer(built.to_image(), special)
+        vocab = {**built.vocab, 1000: b"<eot>"}
+        ids = sorted(built.vocab, key=lambda i: -len(vocab[i]))
+        ids = [*ids, 1000, *reversed(ids), 1000, *sorted(built.vocab)]
+        for tok in (built, mapped):
+            for n in range(40):
+                for part in (ids[:n], ids[n:], ids[-n:]):
+                    expected = b"".join(vocab[i] for i in part)
+                    assert tok.decode(part) == expected
+                    assert tok.decode(array.array("I", part)) == expected
+
+    def test_id_range(self):
+        """Token IDs are 32-bit; 2**32 - 1 is reserved."""
+        with pytest.raises(OverflowError, match="2\\*\\*32"):
+            bpe.Tokenizer([(104, 2**32 - 1)])
+        with pytest.raises(OverflowError, match="2\\*\\*32"):
+            bpe.Tokenizer(self.merges, {b"<eot>": 2**32})
+        tok = bpe.Tokenizer(self.merges, {b"<eot>": 2**32 - 2})
+        assert tok.encode(b"<eot>") == [2**32 - 2]
+        assert tok.decode([2**32 - 2]) == b"<eot>"
+        assert tok.encode_batch([[b"<eot>"]]) == [[2**32 - 2]]
+        special = {b"<eot>": 1000}
+        changed = bpe.Tokenizer(self.merges, special)
+        special[b"<eot>"] = 2**40
+        with pytest.raises(OverflowError, match="2\\*\\*32"):
+            changed.encode_batch([[b"<eot>"]])
+        with pytest.warns(UserWarning, match="Unknown token"):
+            assert tok.decode([104, 2**40]) == b"h"
+        with pytest.warns(UserWarning, match="Unknown token"):
+            assert tok.decode(array.array("Q", [2**32, 104])) == b"h"
+
+    def test_encode_cache(self):
+        plain = bpe.Tokenizer(self.merges, pretokenizer="bytelevel")
+        tok = bpe.Tokenizer(self.merges, pretokenizer="bytelevel", encode_cache_size=64)
+        assert plain.encode_cache_info() == {"hits": 0, "misses": 0, "size": 0, "capacity": 0}
+        text = "hello world, hello  world!\n" * 3
+        assert tok.encode_text(text) == plain.encode_text(text)
+        assert tok.encode(b"hello") == tok.encode(b"hello") == plain.encode(b"hello")
+        info = tok.encode_cache_info()
+        assert info["capacity"] == 64
+        assert info["hits"] > 0
+        assert 0 < info["size"] <= info["misses"]
+        tok.encode_cache_clear()
+        assert tok.encode_cache_info() == {"hits": 0, "misses": 0, "size": 0, "capacity": 64}
+        with pytest.raises(ValueError, match="encode_cache_size"):
+            bpe.Tokenizer(self.merges, encode_cache_size=-1)
+
+    def test_encode_cache_eviction(self):
+        """A full cache evicts; results match the uncached path, also on threads."""
+        remap = list(reversed(range(256)))
+        plain = bpe.Tokenizer(self.merges, pretokenizer="bytelevel", bytes_maps=remap)
+        tok = bpe.Tokenizer(self.merges, pretokenizer="bytelevel", bytes_maps=remap, encode_cache_size=5)
+        words = [f" w{chr(97 + i % 26)}{chr(97 + i // 26)}" for i in range(200)] + [" hello", " world"] * 50
+        docs = [[w] for w in words]
+        for num_threads in (1, 4):
+            assert tok.encode_batch(docs, num_threads) == plain.encode_batch(docs, num_threads)
+        assert tok.encode_text("".join(words)) == plain.encode_text("".join(words))
+        assert tok.encode_cache_info()["size"] == 5
+
+    def test_image_invalid(self):
+        image = bytearray(bpe.Tokenizer(self.merges).to_image())
+        with pytest.raises(ValueError, match="Not a TinyBPE"):
+            bpe.Tokenizer(b"not an image" * 40)
+        with pytest.raises(ValueError, match="truncated"):
+            bpe.Tokenizer(bytes(image[:-1]))
+        newer = bytearray(image)
+        newer[8:12] = (2).to_bytes(4, sys.byteorder)
+        with pytest.raises(ValueError, match="newer"):
+            bpe.Tokenizer(bytes(newer))
+        swapped = bytearray(image)
+        swapped[12:16] = swapped[12:16][::-1]
+        with pytest.raises(ValueError, match="byte order"):
+            bpe.Tokenizer(bytes(swapped))
+
+    def test_image_corrupt_merges_table(self):
+        """A table without an empty slot would make lookups probe forever."""
+        image = bytearray(bpe.Tokenizer(self.merges).to_image())
+        n_merges = int.from_bytes(image[16:24], sys.byteorder)
+        table_bits = int.from_bytes(image[24:28], sys.byteorder)
+        table_offset = int.from_bytes(image[32:40], sys.byteorder)
+        ranks = [table_offset + 16 * i + 8 for i in range(1 << table_bits)]
+
+        full = bytearray(image)
+        for at in ranks:
+            full[at : at + 4] = (256).to_bytes(4, sys.byteorder)
+        out_of_range = bytearray(image)
+        at = next(at for at in ranks if image[at : at + 4] != bytes(4))
+        out_of_range[at : at + 4] = (256 + n_merges).to_bytes(4, sys.byteorder)
+        for corrupt in (full, out_of_range):
+            with pytest.raises(ValueError, match="corrupt"):
+                bpe.Tokenizer(bytes(corrupt))
+
+
+class TestCPretokenize:
+    """bpe.pretokenize must split exactly like regex.findall with the registry pattern."""
+
+    PATTERN = regex.compile(_PATTERNS["bytelevel"])
+
+    def test_matches_regex(self):
+        samples = [
+            "Hello, world! It's 2026 and we'LL see what they've DONE.",
+            "  leading and trailing spaces   ",
+            "tabs\tand\r\nnewlines\n\n  \n x",
+            "    indented code():\n        return x + 1\n",
+            "数字١٢٣ and 你好世界 ǅungla ſ 'ſ ½ éclair",
+            "emoji 😀😀 !!! ??? ...\r\r\n",
+            "\u00a0\u3000mixed\u2028spaces\u0085x",
+        ]
+        for text in samples:
+            assert bpe.pretokenize(text) == [c.encode() for c in self.PATTERN.findall(text)]
+
+    def test_fuzz_matches_regex(self):
+        rng = random.Random(1)
+        alphabet = " \t\n\r\x0b\xa0'sStRrEeVvMmLlDdſ!?.,_<|>0129½abcé你😀\u0301\x00"
+        for _ in range(3000):
+            text = "".join(rng.choice(alphabet) for _ in range(rng.randint(0, 20)))
+            assert bpe.pretokenize(text) == [c.encode() for c in self.PATTERN.findall(text)]
+
+    def test_none(self):
+        assert bpe.pretokenize("a b\nc", "none") == [b"a b\nc"]
+        assert bpe.pretokenize("", "none") == []
+
 
 class TestCBytesRemap:
     """Tests for bpe.BytesRemap (C-level)."""
@@ -86,6 +86,30 @@ class TestFromPretrained:
         assert len(ids) > 0
         assert tok.decode(ids) == "hello world"
 
+    def test_shares_model(self) -> None:
+        """Tokenizers for one model share its C tables until the last is gone."""
+        from tinybpe import tokenizer as tokenizer_mod
+
+        tok1 = Tokenizer.from_pretrained("r50k_base")
+        tok2 = Tokenizer.from_pretrained("r50k_base")
+        assert tok1._enc is not tok2._enc
+        assert tok1._enc.model is tok2._enc.model
+        assert tok1._bytes_maps == tok2._bytes_maps is not None
+
+        # Per-instance streaming state stays separate
+        out1: list[str] = []
+        out2: list[str] = []
+        d1, d2 = tok1.stream_decode(out1.append), tok2.stream_decode(out2.append)
+        for i in tok1.encode("héllo"):
+            d1(i)
+        d2(tok2.encode("x")[0])
+        assert "".join(out1) == "héllo"
+        assert out2 == ["x"]
+
+        n_cached = len(tokenizer_mod._MODEL_CACHE)
+        del tok1, tok2, d1, d2
+        assert len(tokenizer_mod._MODEL_CACHE) == n_cached - 1
+
     def test_o200k_base_loads(self) -> None:
         """o200k_base model should load."""
         tok = Tokenizer.from_pretrained("o200k_base")
@@ -123,3 +123,76 @@ class TestModelStreaming:
         for tid in ids:
             decoder(tid)
         assert "".join(parts) == text
+
+
+class TestStreamDecoder:
+    """The native per-stream decoder behind stream_decode."""
+
+    TEXT = "héllo 世界 🎉 ok <|endoftext|> ünïcödé 👩‍👩‍👧"
+
+    @pytest.mark.parametrize("model_name", ["cl100k_base", "qwen35"])
+    def test_push_any_split(self, model_name: str) -> None:
+        """Pushing IDs one by one or in slices yields the decoded text."""
+        tok = Tokenizer.from_pretrained(model_name)
+        ids = tok.encode(self.TEXT)
+        decoder = tok.stream_decoder()
+        assert "".join(decoder.push(i) for i in ids) + decoder.flush() == self.TEXT
+        for step in (2, 3, 7):
+            parts = [decoder.push(ids[k : k + step]) for k in range(0, len(ids), step)]
+            assert "".join(parts) == self.TEXT
+            assert decoder.pending == b""
+
+    def test_streams_are_independent(self) -> None:
+        """Interleaved streams on one tokenizer do not share held bytes."""
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        a_ids, b_ids = tok.encode("世界🎉"), tok.encode("你好👋")
+        a, b = tok.stream_decoder(), tok.stream_decoder()
+        out_a, out_b = [], []
+        for k in range(max(len(a_ids), len(b_ids))):
+            out_a.append(a.push(a_ids[k : k + 1]))
+            out_b.append(b.push(b_ids[k : k + 1]))
+        assert "".join(out_a) == "世界🎉"
+        assert "".join(out_b) == "你好👋"
+
+    def test_partial_char_before_special(self) -> None:
+        """Held bytes are flushed before a special token, through `errors`."""
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        eot = tok.encode("<|endoftext|>")
+        first = [i for i in tok.encode("🎉") if len(tok.vocab[i]) < 4][:1]
+        replace = tok.stream_decoder(errors="replace")
+        assert replace.push(first) == ""
+        assert replace.pending != b""
+        assert replace.push(eot) == "�<|endoftext|>"
+        strict = tok.stream_decoder()
+        strict.push(first)
+        with pytest.raises(UnicodeDecodeError):
+            strict.push(eot)
+        assert strict.push(eot) == "<|endoftext|>"
+
+    def test_stream_decode_partial_char_before_special(self) -> None:
+        """stream_decode() replaces a cut-off character instead of raising."""
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        eot = tok.encode("<|endoftext|>")
+        first = [i for i, piece in tok.vocab.items() if piece == b"\xc3"]
+        assert len(first) == 1
+        out: list[str] = []
+        decode = tok.stream_decode(out.append)
+        for token_id in first + eot:
+            decode(token_id)
+        assert "".join(out) == "�<|endoftext|>"
+
+    def test_flush_and_reset(self, tokenizer: Tokenizer) -> None:
+        decoder = tokenizer.stream_decoder(errors="replace")
+        assert decoder.push(tokenizer.encode("你")[:1]) == ""
+        assert decoder.flush() == "�"
+        assert decoder.pending == b""
+        decoder.push(tokenizer.encode("你")[:1])
+        decoder.reset()
+        assert decoder.push(tokenizer.encode("a")) == "a"
+        with pytest.raises(LookupError):
+            tokenizer.stream_decoder(errors="no-such-handler")
+
+    def test_unknown_id(self, tokenizer: Tokenizer) -> None:
+        decoder = tokenizer.stream_decoder()
+        with pytest.warns(UserWarning, match="special_tokens"):
+            assert decoder.push([104, 10**6, 105]) == "hi"
@@ -1,7 +1,11 @@
 """Integration tests for the TinyBPE Tokenizer."""
 
+import array
+import sys
 from pathlib import Path
 
+import pytest
+
 from tinybpe import Tokenizer, load_model, load_vocab, save_model, save_vocab
 
 TESTS_DIR = Path(__file__).parent
@@ -55,6 +59,26 @@ class TestTokenizer:
         assert tok.merges == merges2
         assert bm is None
 
+    def test_save_load_binary(self, tmp_path):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
+        out = str(tmp_path / "simple.tbmb")
+        tok.save(out)
+        tok2 = Tokenizer.from_file(out, special_tokens={"<eot>": 2000})
+        assert tok2.merges == tok.merges
+        text = "hello world, old man! <eot>"
+        assert tok2.encode(text) == [*tok.encode(text.replace("<eot>", "")), 2000]
+        assert tok2.decode(tok2.encode(text)) == text
+
+    def test_save_load_binary_remap(self, tmp_path):
+        remap = list(reversed(range(256)))
+        tok = Tokenizer([(104, 101), (256, 108)], bytes_maps=remap)
+        out = str(tmp_path / "remap.tbmb")
+        tok.save(out)
+        tok2 = Tokenizer.from_file(out)
+        assert tok2._bytes_maps == remap
+        assert tok2.vocab == tok.vocab
+        assert tok2.decode(tok2.encode("hello")) == "hello"
+
     def test_save_load_vocab(self):
         tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
         save_vocab(str(TESTS_DIR / "t_simple"), tok.vocab)
@@ -294,6 +318,63 @@ class TestTokenizerSpecialEdgeCases:
         assert tok.decode(ids) == "<eot>"
 
 
+class TestTokenizerAllowedSpecial:
+    """allowed_special / disallowed_special follow tiktoken."""
+
+    SPECIAL = {"<eot>": 1000, "<bos>": 1001}
+
+    @pytest.mark.parametrize("pat_str", [None, r"\w+|\s+|[^\w\s]+"])
+    def test_allowed_subset(self, pat_str):
+        tok = Tokenizer([(104, 101)], pat_str=pat_str, special_tokens=self.SPECIAL)
+        text = "<bos>hello<eot>"
+        assert tok.encode(text) == tok.encode(text, allowed_special={"<eot>", "<bos>"})
+        ids = tok.encode(text, allowed_special={"<eot>"})
+        assert ids[-1] == 1000
+        assert 1001 not in ids
+        assert tok.decode(ids) == text
+        # Nothing allowed: plain text, even a chunk equal to a special token
+        assert tok.encode("<eot>", allowed_special=set()) == list(b"<eot>")
+
+    @pytest.mark.parametrize("pat_str", [None, r"\w+|\s+|[^\w\s]+"])
+    def test_disallowed(self, pat_str):
+        tok = Tokenizer([(104, 101)], pat_str=pat_str, special_tokens=self.SPECIAL)
+        with pytest.raises(ValueError, match="disallowed special token '<bos>'"):
+            tok.encode("hi <bos>", allowed_special=set(), disallowed_special="all")
+        with pytest.raises(ValueError, match="disallowed special token '<eot>'"):
+            # A token in both sets is disallowed
+            tok.encode("<eot>", disallowed_special={"<eot>"})
+        assert tok.encode("hi <bos>", allowed_special={"<bos>"}, disallowed_special="all")[-1] == 1001
+        assert tok.encode("hello", allowed_special=set(), disallowed_special="all") == tok.encode_ordinary("hello")
+        # Names that are not special tokens are ignored
+        assert tok.encode("<x>", allowed_special={"<x>"}, disallowed_special={"<y>"}) == list(b"<x>")
+
+
+class TestTokenizerCountTruncate:
+    """count_tokens and truncate_to agree with encode() without building it."""
+
+    @pytest.mark.parametrize("pat_str", [None, r"\w+|\s+|[^\w\s]+"])
+    def test_count_and_truncate(self, pat_str):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=pat_str, special_tokens={"<eot>": 2000})
+        text = "hello world<eot> hi  there<eot>\nbye"
+        for kwargs in ({}, {"allowed_special": set()}):
+            ids = tok.encode(text, **kwargs)
+            assert tok.count_tokens(text, **kwargs) == len(ids)
+            for k in range(len(ids) + 2):
+                assert tok.truncate_to(text, k, **kwargs) == ids[:k]
+        assert tok.count_tokens("") == 0
+        assert tok.truncate_to("", 5) == []
+        with pytest.raises(ValueError, match="max_tokens"):
+            tok.truncate_to(text, -1)
+        with pytest.raises(ValueError, match="disallowed"):
+            tok.truncate_to(text, 1, allowed_special=set(), disallowed_special="all")
+
+    def test_without_special_tokens(self):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
+        text = "hello world " * 50
+        assert tok.count_tokens(text) == len(tok.encode(text))
+        assert tok.truncate_to(text, 7) == tok.encode(text)[:7]
+
+
 class TestTokenizerFromFile:
     """Additional tests for Tokenizer.from_file()."""
 
@@ -315,3 +396,252 @@ class TestTokenizerFromFile:
         tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm", special_tokens=special)
         ids = tok.encode("<eot>")
         assert ids == [2000]
+
+
+class TestTokenizerNativePretokenizer:
+    """The bytelevel pattern and the default are split in C; results must not change."""
+
+    TEXTS = [
+        "Hello, world! It's 2026.\n\n  def f(x):\n    return x  \n",
+        "你好，世界 😀 ſ'LL ½ <|endoftext|> trailing   ",
+        "",
+    ]
+
+    def _regex_tokenizer(self, name: str) -> Tokenizer:
+        tok = Tokenizer.from_pretrained(name)
+        tok._native_pretok = None  # force the Python regex path
+        return tok
+
+    def test_bytelevel_matches_regex(self):
+        for name in ("cl100k_base", "qwen35"):
+            native = Tokenizer.from_pretrained(name)
+            assert native._native_pretok == "bytelevel"
+            ref = self._regex_tokenizer(name)
+            for text in self.TEXTS:
+                assert native.encode(text) == ref.encode(text)
+                assert native.encode_ordinary(text) == ref.encode_ordinary(text)
+
+    def test_default_pattern_is_native(self):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
+        assert tok._native_pretok == "none"
+        assert tok.decode(tok.encode(self.TEXTS[0])) == self.TEXTS[0]
+
+    def test_custom_pattern_uses_regex(self):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=r"\w+|\s+")
+        assert tok._native_pretok is None
+
+
+class TestTokenizerEncodeBatch:
+    """Tests for Tokenizer.encode_batch()."""
+
+    TEXTS = ["hello world", "", "<eot>hi<eot>", "hello " * 200, "你好，世界"]
+
+    def test_matches_encode(self):
+        """encode_batch should equal per-text encode for any thread count."""
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=r"\w+|\s+", special_tokens={"<eot>": 2000})
+        expected = [tok.encode(t) for t in self.TEXTS]
+        for num_threads in (0, 1, 3):
+            assert tok.encode_batch(self.TEXTS, num_threads=num_threads) == expected
+
+    def test_native_pretokenizer_with_special(self):
+        """Special tokens must stay whole when segments are split in C."""
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        texts = ["hello<|endoftext|>world", "<|fim_prefix|>x = 1<|fim_suffix|>", "plain text"]
+        assert tok.encode_batch(texts, num_threads=2) == [tok.encode(t) for t in texts]
+
+    def test_with_byte_remap(self):
+        """Byte remapping and special tokens are applied as in encode()."""
+        tok = Tokenizer([(104, 101)], bytes_maps=list(reversed(range(256))), special_tokens={"<eot>": 1000})
+        assert tok.encode_batch(self.TEXTS) == [tok.encode(t) for t in self.TEXTS]
+
+    def test_empty_batch(self):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
+        assert tok.encode_batch([]) == []
+
+    def test_negative_threads_raises(self):
+        tok = Tokenizer.from_file(FILE_SIMPLE + ".tbm")
+        with __import__("pytest").raises(ValueError):
+            tok.encode_batch(["hello"], num_threads=-1)
+
+
+class TestTokenizerEncodeToArray:
+    """Tests for Tokenizer.encode_to_array() and decode() of buffers."""
+
+    TEXTS = TestTokenizerEncodeBatch.TEXTS
+
+    def test_matches_encode(self):
+        for tok in (
+            Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=r"\w+|\s+", special_tokens={"<eot>": 2000}),
+            Tokenizer([(104, 101)], bytes_maps=list(reversed(range(256))), special_tokens={"<eot>": 1000}),
+            Tokenizer.from_pretrained("cl100k_base"),
+        ):
+            for text in self.TEXTS:
+                ids = tok.encode_to_array(text)
+                assert ids.typecode == "I"
+                assert ids.tolist() == tok.encode(text)
+                assert tok.decode(ids) == tok.decode(memoryview(ids)) == tok.decode(tok.encode(text))
+
+    def test_out_buffer(self):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        expected = tok.encode("hello world " * 10)
+        for typecode in ("I", "q"):
+            out = array.array(typecode, [7]) * (len(expected) + 2)
+            assert tok.encode_to_array("hello world " * 10, out=out) == len(expected)
+            assert out.tolist() == [*expected, 7, 7]
+        with pytest.raises(ValueError, match="needed"):
+            tok.encode_to_array("hello world", out=array.array("I", [0]))
+        with pytest.raises(TypeError, match="4- or 8-byte"):
+            tok.encode_to_array("hello", out=array.array("H", [0] * 8))
+        with pytest.raises(BufferError, match="not writable"):
+            tok.encode_to_array("hello", out=b"\0" * 64)
+
+    def test_decode_buffer_types(self):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        ids = tok.encode("hello world")
+        for typecode in ("H", "i", "L", "Q"):
+            assert tok.decode(array.array(typecode, ids)) == "hello world"
+        with pytest.raises(TypeError, match="integers"):
+            tok.decode(array.array("d", ids))
+
+
+class TestTokenizerEncodeStream:
+    """Tests for Tokenizer.encode_stream() and encode_file()."""
+
+    TEXT = "héllo  world\n\n<|endoftext|>  x = 12345;\t日本語 <|endoftext|>　end  "
+
+    def _tokenizers(self):
+        return (
+            Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=r"\w+|\s+", special_tokens={"<eot>": 2000}),
+            Tokenizer([(104, 101)], bytes_maps=list(reversed(range(256))), special_tokens={"<|endoftext|>": 1000}),
+            Tokenizer.from_pretrained("cl100k_base"),
+            Tokenizer.from_pretrained("deepseek-v4"),
+        )
+
+    def test_every_split_matches_encode(self):
+        """Blocks may cut UTF-8 sequences, chunks and special tokens anywhere."""
+        data = self.TEXT.encode()
+        for tok in self._tokenizers():
+            expected = tok.encode(self.TEXT)
+            for cut in range(len(data) + 1):
+                ids = [i for a in tok.encode_stream([data[:cut], data[cut:]]) for i in a]
+                assert ids == expected, cut
+            singles = [data[i : i + 1] for i in range(len(data))]
+            assert [i for a in tok.encode_stream(singles) for i in a] == expected
+            assert [i for a in tok.encode_stream(list(self.TEXT)) for i in a] == expected
+
+    def test_invalid_utf8(self):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        with pytest.raises(UnicodeDecodeError):
+            list(tok.encode_stream([b"hello \xe6\x97"]))
+
+    def test_encode_file_sinks(self, tmp_path):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        src = tmp_path / "corpus.txt"
+        src.write_text(self.TEXT * 50, encoding="utf-8")
+        expected = tok.encode(self.TEXT * 50)
+
+        out = array.array("I")
+        assert tok.encode_file(src, out, block_size=7) == len(expected)
+        assert out.tolist() == expected
+
+        out_q = array.array("q")
+        tok.encode_file(src, out_q, block_size=64)
+        assert out_q.tolist() == expected
+
+        chunks: list[array.array] = []
+        tok.encode_file(str(src), chunks.append, block_size=100)
+        assert [i for a in chunks for i in a] == expected
+
+        assert tok.encode_file(src, tmp_path / "ids.bin") == len(expected)
+        from_file = array.array("I")
+        from_file.frombytes((tmp_path / "ids.bin").read_bytes())
+        assert from_file.tolist() == expected
+
+        with pytest.raises(ValueError, match="block_size"):
+            tok.encode_file(src, out, block_size=0)
+
+
+class TestTokenizerTokenizeToShard:
+    """Tests for Tokenizer.tokenize_to_shard()."""
+
+    DOCS = ["hello world", "", "日本語 text\twith  spaces ", "<|endoftext|> stays ordinary", "x" * 5000]
+
+    @staticmethod
+    def _read(path, typecode):
+        values = array.array(typecode)
+        values.frombytes(Path(path).read_bytes())
+        return values.tolist()
+
+    def test_matches_encode_ordinary(self, tmp_path):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        src = tmp_path / "corpus.txt"
+        src.write_text("\n".join(self.DOCS) + "\n", encoding="utf-8")
+        docs = [d for d in self.DOCS if d]
+
+        for num_threads in (1, 3):
+            out = tmp_path / f"shard{num_threads}.bin"
+            n = tok.tokenize_to_shard(src, out, eot=100257, num_threads=num_threads)
+            ids = self._read(out, "I")
+            index = self._read(str(out) + ".idx", "Q")
+            assert n == len(ids) == index[-1]
+            assert len(index) == len(docs) + 1
+            for i, doc in enumerate(docs):
+                assert ids[index[i] : index[i + 1]] == [*tok.encode_ordinary(doc), 100257]
+
+    def test_dtype_and_separator(self, tmp_path):
+        tok = Tokenizer.from_pretrained("r50k_base")
+        src = tmp_path / "corpus.txt"
+        src.write_text("<sep>".join(self.DOCS), encoding="utf-8")
+        out, index = tmp_path / "shard.bin", tmp_path / "docs.idx"
+        n = tok.tokenize_to_shard(src, out, index_path=index, separator="<sep>")
+        assert self._read(out, "H") == [i for d in self.DOCS for i in tok.encode_ordinary(d)]
+        assert len(self._read(index, "Q")) == len(self.DOCS)  # one empty document skipped
+        whole = tok.encode_ordinary("<sep>".join(self.DOCS))
+        assert tok.tokenize_to_shard(src, out, separator="", dtype="uint32") == len(whole) > n
+        assert self._read(out, "I") == whole
+
+    def test_empty_input(self, tmp_path):
+        tok = Tokenizer.from_pretrained("cl100k_base")
+        src = tmp_path / "empty.txt"
+        src.write_bytes(b"")
+        assert tok.tokenize_to_shard(src, tmp_path / "e.bin") == 0
+        assert (tmp_path / "e.bin").read_bytes() == b""
+        assert self._read(tmp_path / "e.bin.idx", "Q") == [0]
+
+    def test_invalid(self, tmp_path):
+        src = tmp_path / "corpus.txt"
+        src.write_text("hello", encoding="utf-8")
+        with pytest.raises(ValueError, match="do not fit"):
+            Tokenizer.from_pretrained("cl100k_base").tokenize_to_shard(src, tmp_path / "a.bin", dtype="uint16")
+        assert not (tmp_path / "a.bin").exists()
+        with pytest.raises(ValueError, match="dtype"):
+            Tokenizer.from_pretrained("cl100k_base").tokenize_to_shard(src, tmp_path / "a.bin", dtype="int8")
+        with pytest.raises(ValueError, match="pre-tokenizer"):
+            Tokenizer.from_file(FILE_SIMPLE + ".tbm", pat_str=r"\w+|\s+").tokenize_to_shard(src, tmp_path / "a.bin")
+        with pytest.raises(FileNotFoundError, match=r"a\.bin"):
+            Tokenizer.from_pretrained("cl100k_base").tokenize_to_shard(src, tmp_path / "missing" / "a.bin")
+
+    @pytest.mark.skipif(sys.platform == "win32", reason="needs RLIMIT_FSIZE")
+    def test_write_error_names_file(self, tmp_path):
+        """A failed write reports the shard or index file it went to."""
+        import resource
+        import signal
+
+        tok = Tokenizer.from_pretrained("r50k_base")
+        long_doc, many_docs = tmp_path / "long.txt", tmp_path / "many.txt"
+        long_doc.write_text("hello world " * 4000, encoding="utf-8")
+        many_docs.write_text("a\n" * 4000, encoding="utf-8")
+        out, index = tmp_path / "shard.bin", tmp_path / "docs.idx"
+        handler = signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+        soft, hard = resource.getrlimit(resource.RLIMIT_FSIZE)
+        resource.setrlimit(resource.RLIMIT_FSIZE, (1 << 12, hard))
+        try:
+            with pytest.raises(OSError, match=r"shard\.bin"):
+                tok.tokenize_to_shard(long_doc, out, index_path=index)
+            with pytest.raises(OSError, match=r"docs\.idx"):
+                tok.tokenize_to_shard(many_docs, out, index_path=index)
+        finally:
+            resource.setrlimit(resource.RLIMIT_FSIZE, (soft, hard))
+            signal.signal(signal.SIGXFSZ, handler)
+        assert not out.exists()
+        assert not index.exists()
@@ -1,8 +1,11 @@
 """Tests for the TinyBPE Trainer."""
 
+import random
 from pathlib import Path
 
-from tinybpe import Tokenizer, Trainer, load_model
+import regex
+
+from tinybpe import Tokenizer, Trainer, get_model_info, load_model
 
 TESTS_DIR = Path(__file__).parent
 
@@ -69,6 +72,77 @@ class TestTrainer:
         assert steps[0][0] == 1  # step count
         assert steps[-1][0] == 10
 
+    def test_train_matches_step(self):
+        text = "the quick brown fox jumps over the lazy dog " * 50
+        stepped = Trainer(text)
+        while stepped.step() is not None:
+            pass
+        trained = Trainer(text)
+        assert trained.train() == stepped.n_merges
+        assert trained.merges == stepped.merges
+
+    def test_train_min_frequency(self):
+        text = "the quick brown fox jumps over the lazy dog " * 50
+        freqs = []
+        reference = Trainer(text, callback=lambda s, t, pair, r, f: freqs.append(f))
+        reference.train()
+        trainer = Trainer(text)
+        n = trainer.train(min_frequency=100)
+        assert n == sum(f >= 100 for f in freqs) > 0
+        assert trainer.merges == reference.merges[:n]
+        # The pair below the threshold is left for later steps
+        assert trainer.step() == (reference.merges[n], 256 + n, freqs[n])
+
+    def test_train_target_vocab_size(self):
+        text = "hello world " * 500
+        trainer = Trainer(text)
+        trainer.train(3)
+        assert trainer.train(100, target_vocab_size=256 + 10) == 7
+        assert trainer.n_merges == 10
+        assert trainer.train(target_vocab_size=200) == 0
+
+    def test_train_progress_every(self):
+        steps: list[int] = []
+        trainer = Trainer("hello world " * 500, callback=lambda s, t, pair, r, f: steps.append(s))
+        trainer.train(3)
+        assert trainer.train(20, progress_every=8) == 20
+        assert steps == [1, 2, 3, 11, 19, 23]
+        assert trainer.step() is not None
+        assert steps[-1] == 24
+
+    def test_from_iterator(self, tmp_path):
+        lines = ["hello world\n", "lower newer\n", b"raw bytes"] * 300
+
+        def preprocess(t: str) -> list[bytes]:
+            return [w.encode() for w in t.split()]
+
+        pieces = [w for line in lines for w in (preprocess(line) if isinstance(line, str) else [line])]
+        reference = Trainer("", preprocess=lambda _: pieces)
+        reference.train(20)
+
+        trainer = Trainer.from_iterator(iter(lines), preprocess, batch_size=7)
+        trainer.train(20)
+        assert trainer.merges == reference.merges
+
+        spilled = Trainer.from_iterator(lines, preprocess, spill_dir=tmp_path, memory_limit=1)
+        spilled.train(20)
+        assert spilled.merges == reference.merges
+
+    def test_from_files(self, tmp_path):
+        texts = ["hello world\r\nlower newer 42\n", "caf\u00e9 hello\n\n  newest"] * 50
+        paths = [tmp_path / f"{i}.txt" for i in range(len(texts))]
+        for path, text in zip(paths, texts):
+            path.write_bytes(text.encode())
+
+        for pat_str in (get_model_info("cl100k_base")["pat_str"], r"\w+|\s+", None):
+            pat = regex.compile(pat_str or r"(?s)^.*$")
+            pieces = [ch.encode() for t in texts for ch in pat.findall(t)]
+            reference = Trainer("", preprocess=lambda _, pieces=pieces: pieces)
+            reference.train(30)
+            trainer = Trainer.from_files(paths, pat_str)
+            trainer.train(30)
+            assert trainer.merges == reference.merges
+
     def test_preprocess(self):
         text = "hello world   testing"
 
@@ -94,6 +168,47 @@ class TestTrainer:
         n = trainer2.train(5)
         assert trainer2.n_merges == 20 + n
 
+    def test_from_counts(self):
+        words = [b"hug", b" pug", b" pun", b" bun", b" hugs"]
+        counts = dict(zip(words, (10, 5, 12, 4, 5)))
+        steps: list[tuple[int, int]] = []
+        trainer = Trainer.from_counts(counts, callback=lambda s, t, pair, r, f: steps.append(pair))
+        trainer.train(8)
+
+        reference = Trainer("", preprocess=lambda t: [w for w, n in counts.items() for _ in range(n)])
+        reference.train(8)
+        assert trainer.merges == reference.merges
+        assert steps == trainer.merges
+
+    def test_duplicate_pieces_match_from_counts(self):
+        """Repeated pieces are stored once in the arena and their counts summed."""
+        rng = random.Random(5)
+        words = [b"low", b"lower", b"newest", b"widest", b"a", b"lowlow", b" est"]
+        pieces: list[bytes | bytearray] = [rng.choice(words) for _ in range(600)]
+        pieces[1::7] = [bytearray(p) for p in pieces[1::7]]
+        counts: dict[bytes, int] = {}
+        for piece in pieces:
+            counts[bytes(piece)] = counts.get(bytes(piece), 0) + 1
+
+        expected = Trainer.from_counts(counts)
+        steps = []
+        while (result := expected.step()) is not None:
+            steps.append(result)
+        # Merging shrinks duplicates identically; every frequency is the summed count
+        for trainer in (
+            Trainer("", preprocess=lambda _: pieces),
+            Trainer.from_iterator([bytes(p) for p in pieces], batch_size=7),
+        ):
+            assert [trainer.step() for _ in steps] == steps
+            assert trainer.step() is None
+
+    def test_num_threads(self):
+        text = "the quick brown fox jumps over the lazy dog " * 200
+        single = Trainer(text, num_threads=1)
+        multi = Trainer(text, num_threads=4)
+        assert single.train(40) == multi.train(40)
+        assert single.merges == multi.merges
+
     def test_tokenizer_from_trainer(self):
         text = "hello world " * 100
         trainer = Trainer(text)
@@ -1,7 +1,8 @@
 """Model file I/O for TinyBPE.
 
 Provides functions to save and load BPE model parameters to/from
-``.tbm`` (TinyBPE Model) and ``.vocab`` files.
+``.tbm`` (TinyBPE Model), ``.tbmb`` (binary model image) and ``.vocab``
+files.
 
 .tbm format (text)::
 
@@ -10,6 +11,12 @@ Provides functions to save and load BPE model parameters to/from
     [256 lines of remap values if remap_flag=256]
     <left> <right>      # one merge pair per line, left and right are ints
 
+.tbmb format (binary)::
+
+    The C tokenizer's merges hash table, vocab offsets and token bytes,
+    stored in their in-memory layout behind a 320-byte header (see
+    src/bpe_image.h).  Loaded with ``mmap`` and used in place.
+
 .vocab format (text)::
 
     TinyBPE Vocabulary v1
@@ -19,10 +26,17 @@ Provides functions to save and load BPE model parameters to/from
 
 from __future__ import annotations
 
+import mmap
+import struct
 from pathlib import Path
 
 MODEL_VERSION = 1
 
+# .tbmb header fields read from Python: magic, then has_remap at offset 28
+# and the 256-byte remap table at offset 64.
+_BINARY_MAGIC = b"TinyBPEB"
+_BINARY_HEADER_SIZE = 320
+
 
 # ---------------------------------------------------------------------------
 # .tbm — model file
@@ -132,6 +146,68 @@ def load_model(path: str) -> tuple[list[tuple[int, int]], list[int] | None]:
     return merges, bytes_maps
 
 
+# ---------------------------------------------------------------------------
+# .tbmb — binary model image
+# ---------------------------------------------------------------------------
+
+
+def save_model_binary(path: str, image: bytes) -> None:
+    """Write a binary model image to a ``.tbmb`` file.
+
+    If ``path`` does not end with ``.tbmb``, the extension is appended.
+
+    Parameters
+    ----------
+    path : str
+        Output file path (``.tbmb`` appended if missing).
+    image : bytes
+        Image produced by the C tokenizer's ``to_image()``.
+    """
+    if Path(path).suffix != ".tbmb":
+        path += ".tbmb"
+
+    with open(path, "wb") as f:
+        f.write(image)
+
+
+def map_model_binary(path: str) -> tuple[mmap.mmap, list[int] | None]:
+    """Memory-map a ``.tbmb`` file read-only.
+
+    The mapping is shared: every process that maps the same file
+    (including forked workers) uses the same physical pages.  Only the
+    header is read here; the C tokenizer validates the rest.
+
+    Parameters
+    ----------
+    path : str
+        Path to the ``.tbmb`` file.
+
+    Returns
+    -------
+    tuple
+        ``(image, bytes_maps)`` where ``image`` is the read-only mapping
+        and ``bytes_maps`` may be ``None``.
+
+    Raises
+    ------
+    ValueError
+        If the file is not a binary model image.
+    """
+    with open(path, "rb") as f:
+        size = f.seek(0, 2)
+        if size < _BINARY_HEADER_SIZE:
+            raise ValueError(f"Not a TinyBPE binary model: {path}")
+        image = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    if image[:8] != _BINARY_MAGIC:
+        image.close()
+        raise ValueError(f"Not a TinyBPE binary model: {path}")
+
+    (has_remap,) = struct.unpack_from("=I", image, 28)
+    bytes_maps = list(image[64:320]) if has_remap else None
+    return image, bytes_maps
+
+
 # ---------------------------------------------------------------------------
 # .vocab — vocabulary file
 # ---------------------------------------------------------------------------
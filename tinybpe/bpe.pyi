@@ -1,34 +1,120 @@
 """Type stubs for the TinyBPE C extension module."""
 
+import array
+import mmap
+import os
+from collections.abc import Sequence
+from typing import Callable, overload
+
+from typing_extensions import Buffer
+
 class Trainer:
-    """C-level BPE trainer.  Construct with a list of bytes/bytearray chunks."""
+    """C-level BPE trainer.  Construct with a list of bytes/bytearray chunks and optional counts."""
 
     merges: list[tuple[int, int]]
     n_merges: int
 
-    def __init__(self, list_bytes: list[bytes | bytearray]) -> None: ...
+    def __init__(
+        self,
+        list_bytes: list[bytes | bytearray],
+        counts: list[int] | None = None,
+        num_threads: int = 0,
+        spill_dir: str | os.PathLike[str] | None = None,
+        memory_limit: int = 0,
+    ) -> None: ...
+    def add(self, list_bytes: list[bytes | bytearray], counts: list[int] | None = None) -> None: ...
+    def add_files(
+        self,
+        paths: Sequence[str | os.PathLike[str]],
+        pretokenizer: str = "bytelevel",
+        segment_size: int = 0,
+    ) -> None: ...
     def step(self) -> tuple[tuple[int, int], int, int] | None: ...
+    def train(
+        self,
+        n_merges: int | None = None,
+        min_frequency: int = 1,
+        target_vocab_size: int = 0,
+        progress_every: int = 0,
+        callback: Callable[[int, int, tuple[int, int], int, int], object] | None = None,
+    ) -> int: ...
     def load_merges(self, merges: list[tuple[int, int]]) -> None: ...
 
+class Model:
+    """Immutable merges table and vocabulary, shareable between Tokenizers."""
+
+    merges: list[tuple[int, int]]
+    vocab: dict[int, bytes]
+    n_vocab: int
+    bytes_maps: list[int] | None
+
+    def __init__(
+        self,
+        merges: list[tuple[int, int]] | bytes | mmap.mmap,
+        bytes_maps: list[int] | None = None,
+    ) -> None: ...
+
 class Tokenizer:
     """C-level BPE tokenizer.  Construct with merges and optional special tokens."""
 
     merges: list[tuple[int, int]]
+    model: Model
     vocab: dict[int, bytes]
     n_vocab: int
 
     def __init__(
         self,
-        merges: list[tuple[int, int]],
+        merges: list[tuple[int, int]] | bytes | mmap.mmap | Model,
         special_tokens: dict[bytes, int] | None = None,
+        pretokenizer: str | None = None,
+        bytes_maps: list[int] | None = None,
+        encode_cache_size: int = 0,
     ) -> None: ...
     def encode(self, data: bytes) -> list[int]: ...
-    def decode(self, ids: list[int]) -> bytes: ...
+    def encode_text(self, text: str) -> list[int]: ...
+    def encode_chunks(self, chunks: list[str], match_special: bool = True, max_tokens: int = -1) -> list[int]: ...
+    def count_chunks(self, chunks: list[str], match_special: bool = True) -> int: ...
+    def encode_special(self, text: str, mask: bytes | None = None, max_tokens: int = -1) -> list[int]: ...
+    def count_special(self, text: str, mask: bytes | None = None) -> int: ...
+    def split_special(self, text: str, mask: bytes | None = None) -> list[str | int]: ...
+    def stable_prefix(self, text: str) -> int: ...
+    def decode(self, ids: list[int] | Buffer) -> bytes: ...
+    def decode_text(self, ids: list[int] | Buffer) -> str: ...
+    def encode_batch(self, chunks: list[list[str | bytes]], num_threads: int = 0) -> list[list[int]]: ...
+    @overload
+    def encode_to_array(self, chunks: list[str | bytes], out: None = None) -> array.array[int]: ...
+    @overload
+    def encode_to_array(self, chunks: list[str | bytes], out: Buffer) -> int: ...
+    def encode_to_shard(
+        self,
+        data: Buffer,
+        path: str | os.PathLike[str],
+        index_path: str | os.PathLike[str],
+        separator: bytes = b"\n",
+        eot: int = -1,
+        itemsize: int = 4,
+        num_threads: int = 0,
+    ) -> tuple[int, int]: ...
     def cache_decode(self, id: int) -> bytes | None: ...
     def cache_clean(self) -> None: ...
+    def to_image(self, bytes_maps: list[int] | None = None) -> bytes: ...
+    def encode_cache_info(self) -> dict[str, int]: ...
+    def encode_cache_clear(self) -> None: ...
+
+class StreamDecoder:
+    """Incremental decoder for one token stream."""
+
+    def __init__(self, tokenizer: Tokenizer, errors: str = "strict") -> None: ...
+    @property
+    def pending(self) -> bytes: ...
+    def push(self, ids: int | list[int] | Buffer) -> str: ...
+    def flush(self) -> str: ...
+    def reset(self) -> None: ...
 
 class BytesRemap:
     """Callable byte-level permutation (0-255)."""
 
     def __init__(self, _remap: list[int]) -> None: ...
     def __call__(self, _bytes: bytes) -> bytes: ...
+
+def pretokenize(text: str, pretokenizer: str = "bytelevel") -> list[bytes]: ...
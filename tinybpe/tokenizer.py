@@ -11,12 +11,57 @@ Provides the :class:`Tokenizer` class which wraps the C-level
 
 from __future__ import annotations
 
-from typing import Callable
+import array
+import codecs
+import mmap
+import os
+import threading
+import weakref
+from pathlib import Path
+from typing import TYPE_CHECKING, BinaryIO, Callable, Literal, overload
 
 import regex as re
 
 import tinybpe.bpe as bpe
-from tinybpe._model_io import load_model, save_model, save_vocab
+from tinybpe._model_io import load_model, map_model_binary, save_model, save_model_binary, save_vocab
+from tinybpe._registry import _PATTERNS
+
+if TYPE_CHECKING:
+    from collections.abc import Collection, Iterable, Iterator
+    from collections.abc import Set as AbstractSet
+
+    from typing_extensions import Buffer
+
+# Pre-tokenization patterns the C extension implements natively.  Text
+# split with one of these never goes through ``re.findall``.
+_DEFAULT_PATTERN = r"(?s)^.*$"
+_NATIVE_PRETOKENIZERS: dict[str, str] = {_DEFAULT_PATTERN: "none"}
+if _PATTERNS.get("bytelevel"):
+    _NATIVE_PRETOKENIZERS[_PATTERNS["bytelevel"]] = "bytelevel"  # type: ignore[index]
+
+
+# Process-wide cache of built-in models.  Every Tokenizer created by
+# from_pretrained() for the same model file shares one bpe.Model (the C
+# merges table and vocabulary); the entry disappears with the last one.
+_MODEL_CACHE: weakref.WeakValueDictionary[tuple[object, ...], bpe.Model] = weakref.WeakValueDictionary()
+_MODEL_CACHE_LOCK = threading.Lock()
+
+
+def _shared_model(name: str, path: str) -> bpe.Model:
+    """Return the cached :class:`bpe.Model` for a model file, loading it once.
+
+    The cache key includes the file's identity (device, inode, size and
+    modification time), so a model file replaced on disk is reloaded.
+    """
+    st = os.stat(path)
+    key = (name, os.path.realpath(path), st.st_dev, st.st_ino, st.st_size, st.st_mtime_ns)
+    with _MODEL_CACHE_LOCK:
+        model = _MODEL_CACHE.get(key)
+        if model is None:
+            merges, bytes_maps = load_model(path)
+            model = bpe.Model(merges, bytes_maps)
+            _MODEL_CACHE[key] = model
+    return model
 
 
 def _find_package_file(rel_path: str) -> str:
@@ -76,17 +121,27 @@ class Tokenizer:
 
     Parameters
     ----------
-    merges : list[tuple[int, int]]
-        BPE merge pairs defining the vocabulary.
+    merges : list[tuple[int, int]] or bytes or mmap.mmap or bpe.Model
+        BPE merge pairs defining the vocabulary, or a binary model image
+        (the contents of a ``.tbmb`` file, see :meth:`from_file`).  An
+        image is used in place, without rebuilding any table.  A
+        ``bpe.Model`` is shared: its tables are not copied.
     bytes_maps : list[int] or None
         Optional byte remapping table of 256 integers.  When provided,
         input bytes are permuted before encoding and inverse-permuted
         after decoding (required for tiktoken-compatible models).
     pat_str : str or None
         Regex pattern for pre-tokenization.  Defaults to ``r"^.*$"``
-        (no splitting — treat entire input as one chunk).
+        (no splitting — treat entire input as one chunk).  The built-in
+        ``"bytelevel"`` pattern and the default are pre-tokenized in C;
+        any other pattern goes through the ``regex`` module.
     special_tokens : dict[str, int] or None
         Mapping from special token strings to their IDs.
+    encode_cache_size : int
+        Capacity of the native LRU cache of short chunk encodings
+        (``0``, the default, disables it).  Pre-tokenized text repeats
+        the same chunks constantly; around ``10_000`` entries usually
+        cover most of them.  See :meth:`encode_cache_info`.
 
     Examples
     --------
@@ -99,11 +154,12 @@ class Tokenizer:
 
     def __init__(
         self,
-        merges: list[tuple[int, int]],
+        merges: list[tuple[int, int]] | bytes | mmap.mmap | bpe.Model,
         *,
         bytes_maps: list[int] | None = None,
         pat_str: str | None = None,
         special_tokens: dict[str, int] | None = None,
+        encode_cache_size: int = 0,
     ) -> None:
         # ---- byte remapping ----
         if bytes_maps is not None:
@@ -119,9 +175,12 @@ class Tokenizer:
             self._inv_map = None
 
         # ---- special tokens ----
+        # Masks for encode(allowed_special=..., disallowed_special=...)
+        self._special_masks: dict[tuple[object, object], bytes | None] = {}
         if special_tokens is None:
             self._special_tokens: dict[str, int] | None = None
             self._special_pattern: str | None = None
+            self._max_special_len = 0
             _mapped: dict[bytes, int] | None = None
         else:
             self._special_tokens = special_tokens
@@ -130,31 +189,34 @@ class Tokenizer:
             self._special_pattern = (
                 "(" + "|".join(re.escape(k) for k in sorted(special_tokens, key=len, reverse=True)) + ")"
             )
+            self._max_special_len = max(map(len, special_tokens), default=0)
 
             if self._bytes_maps is None:
                 _mapped = {k.encode("utf-8"): v for k, v in special_tokens.items()}
             else:
                 assert self._map is not None
                 _mapped = {self._map(k.encode("utf-8")): v for k, v in special_tokens.items()}
-        self._enc = bpe.Tokenizer(merges, _mapped)
+            # ID → token bytes as keyed in C, for encode_batch chunks
+            self._special_ids = {v: k for k, v in _mapped.items()}
 
         # ---- pre-tokenization pattern ----
         if pat_str is None:
             # Match the entire input including newlines (DOTALL).
-            pat_str = r"(?s)^.*$"
+            pat_str = _DEFAULT_PATTERN
         self._compiled_pattern = re.compile(pat_str)
+        # Name of the equivalent C pre-tokenizer, or None for regex splitting
+        self._native_pretok: str | None = _NATIVE_PRETOKENIZERS.get(pat_str)
 
-        # ---- streaming decode state ----
-        self._stream_cache: bytes = b""
+        self._enc = bpe.Tokenizer(
+            merges,
+            _mapped,
+            pretokenizer=self._native_pretok,
+            bytes_maps=bytes_maps,
+            encode_cache_size=encode_cache_size,
+        )
 
-        # ---- cached inverse-remapped vocab for fast streaming decode ----
-        # When bytes_maps is set, _decode_remap needs O(1) single-token
-        # lookup.  self._enc.vocab rebuilds the dict on every access,
-        # so we build it once here and cache the inverse-remapped result.
-        self._vocab_cache: dict[int, bytes] | None = None
-        if bytes_maps is not None:
-            assert self._inv_map is not None  # guaranteed when bytes_maps is set
-            self._vocab_cache = {k: self._inv_map(v) for k, v in self._enc.vocab.items()}
+        # ---- decoder of the latest stream_decode(), for stream_decode_reset ----
+        self._stream: bpe.StreamDecoder | None = None
 
     # ------------------------------------------------------------------
     # Encoding
@@ -197,94 +259,585 @@ class Tokenizer:
         encode : Encode with special-token-aware regex splitting.
         count_tokens : Count tokens without building the full ID list.
         """
-        chunks = re.findall(self._compiled_pattern, text)
-        chunk_bytes = [ch.encode("utf-8") for ch in chunks]
+        if self._native_pretok is not None:
+            # Split + remap + BPE in a single C call
+            return self._enc.encode_text(text)
 
-        if self._bytes_maps is not None:
-            assert self._map is not None
-            chunk_bytes = [self._map(b) for b in chunk_bytes]
-        ids: list[int] = []
-        for chunk in chunk_bytes:
-            ids.extend(self._enc.encode(chunk))
-        return ids
+        # Regex split in Python; UTF-8 + remap + BPE in one C call
+        return self._enc.encode_chunks(re.findall(self._compiled_pattern, text))
 
-    def encode(self, text: str) -> list[int]:
+    def encode(
+        self,
+        text: str,
+        *,
+        allowed_special: Literal["all"] | AbstractSet[str] = "all",
+        disallowed_special: Literal["all"] | Collection[str] = (),
+    ) -> list[int]:
         """Encode text, respecting special tokens.
 
+        Special tokens are found anywhere in ``text`` by a native scanner
+        (longest token first where several start at the same place).
+        ``allowed_special`` and ``disallowed_special`` follow tiktoken:
+        allowed tokens become their IDs, disallowed ones raise
+        ``ValueError``, and any other special token is encoded as plain
+        text.  ``disallowed_special="all"`` means every special token that
+        is not allowed.  A token in both sets is disallowed; names that
+        are not special tokens are ignored.
+
         Parameters
         ----------
         text : str
             The input text to encode.
+        allowed_special : "all" or set of str
+            Special tokens to encode as their IDs.  Default: all of them.
+        disallowed_special : "all" or collection of str
+            Special tokens whose presence in ``text`` is an error.
+            Default: none.
 
         Returns
         -------
         list[int]
             Token ID sequence (including special token IDs).
+
+        Raises
+        ------
+        ValueError
+            If ``text`` contains a disallowed special token.
         """
-        if self._special_pattern is None:
+        if not self._special_tokens:
             return self.encode_ordinary(text)
 
-        special_chunks = re.split(self._special_pattern, text)
+        mask = self._special_mask(allowed_special, disallowed_special)
+        if self._native_pretok is not None:
+            # Special-token scan + split + remap + BPE in a single C call
+            return self._enc.encode_special(text, mask)
+
         ids: list[int] = []
-        for part in special_chunks:
-            if part in self._special_tokens:  # type: ignore[operator]
-                ids.append(self._special_tokens[part])  # type: ignore[index]
+        for part in self._enc.split_special(text, mask):
+            if isinstance(part, int):
+                ids.append(part)
             else:
-                ids.extend(self.encode_ordinary(part))
+                ids.extend(self._enc.encode_chunks(re.findall(self._compiled_pattern, part), False))
         return ids
 
-    def count_tokens(self, text: str) -> int:
+    def _special_mask(
+        self,
+        allowed_special: Literal["all"] | AbstractSet[str],
+        disallowed_special: Literal["all"] | Collection[str],
+    ) -> bytes | None:
+        """Per-token codes for ``bpe.Tokenizer.encode_special``.
+
+        One byte per non-empty special token in dict order: 0 = plain
+        text, 1 = allowed, 2 = disallowed; ``None`` when all are allowed.
+        """
+        key = (
+            allowed_special if isinstance(allowed_special, str) else frozenset(allowed_special),
+            disallowed_special if isinstance(disallowed_special, str) else frozenset(disallowed_special),
+        )
+        if key in self._special_masks:
+            return self._special_masks[key]
+
+        assert self._special_tokens is not None
+        names = [k for k in self._special_tokens if k]
+        allowed = set(names) if allowed_special == "all" else set(allowed_special)
+        disallowed = set(names) - allowed if disallowed_special == "all" else set(disallowed_special)
+        codes = bytes(2 if k in disallowed else 1 if k in allowed else 0 for k in names)
+        mask = None if codes == b"\x01" * len(names) else codes
+
+        if len(self._special_masks) >= 64:
+            self._special_masks.clear()
+        self._special_masks[key] = mask
+        return mask
+
+    def encode_batch(self, texts: list[str], *, num_threads: int = 0) -> list[list[int]]:
+        """Encode many texts in parallel on a native thread pool.
+
+        Each text is pre-tokenized exactly as in :meth:`encode`; the BPE
+        merging of all documents then runs in C across ``num_threads``
+        cores with the GIL released.  The result is identical to
+        ``[self.encode(t) for t in texts]``.
+
+        Parameters
+        ----------
+        texts : list[str]
+            The documents to encode.
+        num_threads : int
+            Number of worker threads.  ``0`` (default) uses every core;
+            ``1`` encodes on the calling thread.
+
+        Returns
+        -------
+        list[list[int]]
+            One token ID sequence per input text, in input order.
+        """
+        return self._enc.encode_batch([self._pre_tokenize(t) for t in texts], num_threads)
+
+    @overload
+    def encode_to_array(self, text: str, *, out: None = None) -> array.array[int]: ...
+    @overload
+    def encode_to_array(self, text: str, *, out: Buffer) -> int: ...
+    def encode_to_array(self, text: str, *, out: Buffer | None = None) -> array.array[int] | int:
+        """Encode text into a compact array of IDs, without Python ints.
+
+        Produces the same IDs as :meth:`encode`, but the C extension
+        writes them straight into 32-bit storage instead of creating one
+        Python ``int`` per token.  The result can be passed to
+        ``numpy.frombuffer`` / ``torch.frombuffer`` without copying, and
+        back to :meth:`decode`.
+
+        Parameters
+        ----------
+        text : str
+            The input text to encode.
+        out : writable buffer or None
+            Optional C-contiguous buffer of 4- or 8-byte integers (e.g. a
+            ``numpy.uint32`` or ``numpy.int64`` array) to fill instead of
+            allocating a new array.
+
+        Returns
+        -------
+        array.array or int
+            An ``array.array("I")`` of token IDs or, when *out* is given,
+            the number of IDs written to its start.
+
+        Raises
+        ------
+        ValueError
+            If *out* is too small to hold every ID.
+        TypeError
+            If *out* is not a writable buffer of 4- or 8-byte integers.
+        """
+        if out is None:
+            return self._enc.encode_to_array(self._pre_tokenize(text))
+        return self._enc.encode_to_array(self._pre_tokenize(text), out)
+
+    def encode_stream(self, blocks: Iterable[bytes | str]) -> Iterator[array.array[int]]:
+        """Encode a stream of text blocks in bounded memory.
+
+        Blocks may split the text anywhere, even inside a UTF-8 sequence,
+        a pre-tokenizer chunk or a special token: the encoder carries the
+        unfinished tail into the next block, so the concatenated output
+        equals ``encode(b"".join(blocks).decode())``.  Only the current
+        block and that tail are held in memory.
+
+        With the default no-split pattern the whole input is a single
+        chunk, which cannot be encoded before the stream ends.
+
+        Parameters
+        ----------
+        blocks : iterable of bytes or str
+            UTF-8 bytes (e.g. ``file.read(n)`` results) or text.  Do not
+            mix bytes and str within one stream.
+
+        Yields
+        ------
+        array.array
+            ``array.array("I")`` of the token IDs completed by each block.
+
+        Raises
+        ------
+        UnicodeDecodeError
+            If the bytes are not valid UTF-8.
+
+        See Also
+        --------
+        encode_file : Encode a file into a callback, array or file.
+        """
+        decoder = codecs.getincrementaldecoder("utf-8")()
+        if self._native_pretok == "none":
+            # One chunk: nothing is final before the end of the stream
+            text = "".join(b if isinstance(b, str) else decoder.decode(b) for b in blocks)
+            text += decoder.decode(b"", final=True)
+            ids = self._enc.encode_to_array(self._pre_tokenize(text))
+            if ids:
+                yield ids
+            return
+
+        pending = ""
+        for block in blocks:
+            text = block if isinstance(block, str) else decoder.decode(block)
+            if not text:
+                continue
+            pending += text
+            segments, n_done = self._stream_segments(pending, final=False)
+            if n_done:
+                pending = pending[n_done:]
+                ids = self._enc.encode_to_array(segments)
+                if ids:
+                    yield ids
+
+        pending += decoder.decode(b"", final=True)
+        if pending:
+            segments, _ = self._stream_segments(pending, final=True)
+            ids = self._enc.encode_to_array(segments)
+            if ids:
+                yield ids
+
+    def encode_file(
+        self,
+        path: str | os.PathLike[str],
+        out: Callable[[array.array[int]], object] | array.array[int] | BinaryIO | str | os.PathLike[str],
+        *,
+        block_size: int = 1 << 20,
+    ) -> int:
+        """Encode a UTF-8 text file block by block, in bounded memory.
+
+        Reads ``block_size`` bytes at a time through :meth:`encode_stream`
+        and hands the token IDs to ``out`` as soon as they are final.  The
+        IDs are the same as ``encode()`` of the whole file.
+
+        Parameters
+        ----------
+        path : str or os.PathLike
+            The text file to encode.
+        out : callable, array.array, binary file or path
+            Where the IDs go: a callable receives each ``array.array("I")``
+            of IDs; an ``array.array`` is extended; a binary file object
+            (anything with ``write``), or a new file at a path, receives
+            the IDs as native-endian ``uint32`` values.
+        block_size : int
+            Bytes read per block.
+
+        Returns
+        -------
+        int
+            The number of token IDs written.
+        """
+        if block_size <= 0:
+            raise ValueError(f"block_size must be positive, got {block_size}")
+        if isinstance(out, (str, os.PathLike)):
+            with open(out, "wb") as f:
+                return self.encode_file(path, f, block_size=block_size)
+
+        n = 0
+        with open(path, "rb") as src:
+            for ids in self.encode_stream(iter(lambda: src.read(block_size), b"")):
+                n += len(ids)
+                if isinstance(out, array.array):
+                    out.extend(ids if out.typecode == ids.typecode else iter(ids))
+                elif callable(out):
+                    out(ids)
+                else:
+                    out.write(ids)
+        return n
+
+    def tokenize_to_shard(
+        self,
+        input_path: str | os.PathLike[str],
+        output_path: str | os.PathLike[str],
+        *,
+        index_path: str | os.PathLike[str] | None = None,
+        separator: str = "\n",
+        eot: int | None = None,
+        dtype: str | None = None,
+        num_threads: int = 0,
+    ) -> int:
+        """Tokenize a UTF-8 corpus file into a packed binary token shard.
+
+        The input is memory-mapped and split into documents on
+        ``separator``.  Documents are encoded on a native thread pool and
+        written in input order, with no Python objects per document or
+        token, to ``output_path`` as a flat array of native-endian
+        ``uint16`` or ``uint32`` IDs (the nanoGPT ``.bin`` layout, readable
+        with ``numpy.memmap``).  Only a few MiB of text per thread are in
+        flight at a time.
+
+        Each document is encoded like :meth:`encode_ordinary`: special
+        token strings inside it are not matched.  Requires a built-in
+        pre-tokenizer (the ``bytelevel`` or default pattern).
+
+        Parameters
+        ----------
+        input_path : str or os.PathLike
+            UTF-8 text file.  Invalid UTF-8 is encoded byte by byte.
+        output_path : str or os.PathLike
+            Token file to create.
+        index_path : str or os.PathLike or None
+            Document index to create: ``n_docs + 1`` native-endian
+            ``uint64`` token offsets, so document ``i`` is
+            ``tokens[index[i]:index[i + 1]]``.  Defaults to
+            ``output_path`` + ``".idx"``.
+        separator : str
+            Document separator, not encoded.  Empty documents are
+            skipped.  ``""`` makes the whole file one document.
+        eot : int or None
+            Token ID appended to every document, e.g. the ID of
+            ``"<|endoftext|>"``.
+        dtype : {"uint16", "uint32"} or None
+            ID width.  ``None`` picks ``uint16`` when every ID fits.
+        num_threads : int
+            Worker threads (``0`` = all cores).
+
+        Returns
+        -------
+        int
+            The number of tokens written.
+
+        Raises
+        ------
+        ValueError
+            If the tokenizer uses a regex pattern, ``dtype`` is too narrow
+            for its IDs, or a document is 4 GiB or longer.
+        """
+        if self._native_pretok is None:
+            raise ValueError("tokenize_to_shard() requires a built-in pre-tokenizer pattern")
+        if dtype is None:
+            max_id = max(self._enc.n_vocab - 1, *(self._special_tokens or {}).values(), eot or 0)
+            dtype = "uint16" if max_id < 1 << 16 else "uint32"
+        itemsize = {"uint16": 2, "uint32": 4}.get(dtype)
+        if itemsize is None:
+            raise ValueError(f'dtype must be "uint16" or "uint32", got {dtype!r}')
+        if index_path is None:
+            index_path = os.fspath(output_path) + ".idx"
+
+        with open(input_path, "rb") as f:
+            if os.fstat(f.fileno()).st_size == 0:
+                data: bytes | mmap.mmap = b""
+            else:
+                data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            _, n_tokens = self._enc.encode_to_shard(
+                data,
+                output_path,
+                index_path,
+                separator.encode("utf-8"),
+                -1 if eot is None else eot,
+                itemsize,
+                num_threads,
+            )
+        finally:
+            if isinstance(data, mmap.mmap):
+                data.close()
+        return n_tokens
+
+    def _stream_segments(self, text: str, *, final: bool) -> tuple[list[str | bytes], int]:
+        """Chunks of the part of ``text`` that more input cannot change.
+
+        Returns the chunks of ``text[:n]`` (as :meth:`_pre_tokenize`) and
+        ``n``.  Unless ``final``, a special token may still begin in the
+        last ``max_special_len - 1`` characters, and the last two
+        pre-tokenizer chunks before them could still grow or re-split, so
+        both are left for the next block.  A special token found earlier
+        is final: any longer one starting there would already be visible.
+        """
+        hold = len(text)
+        if not final:
+            hold -= max(self._max_special_len - 1, 0)
+
+        segments: list[str | bytes] = []
+        pos = 0
+        if self._special_pattern is not None:
+            for m in re.finditer(self._special_pattern, text):
+                if m.start() >= hold:
+                    break
+                segments.extend(self._ordinary_segments(text[pos : m.start()]))
+                segments.append(self._special_bytes(m.group()))
+                pos = m.end()
+
+        if final:
+            segments.extend(self._ordinary_segments(text[pos:]))
+            return segments, len(text)
+
+        tail = text[pos : max(hold, pos)]
+        if self._native_pretok is not None:
+            done = self._enc.stable_prefix(tail)
+            segments.extend(self._ordinary_segments(tail[:done]))
+        else:
+            matches = list(re.finditer(self._compiled_pattern, tail))
+            done = matches[-2].start() if len(matches) >= 2 else 0
+            segments.extend(self._chunk_bytes([m.group() for m in matches[:-2]]))
+        return segments, pos + done
+
+    def _pre_tokenize(self, text: str) -> list[str | bytes]:
+        """Split ``text`` into the chunks :meth:`encode` would feed to C.
+
+        Special tokens stay whole; the C tokenizer maps them to their IDs.
+        With a native pre-tokenizer, ordinary text is passed through as
+        ``str`` segments and split in C by the worker threads.
+        """
+        if self._special_pattern is None:
+            return self._ordinary_segments(text)
+
+        segments: list[str | bytes] = []
+        for part in self._enc.split_special(text):
+            if isinstance(part, int):
+                segments.append(self._special_ids[part])
+            else:
+                segments.extend(self._ordinary_segments(part))
+        return segments
+
+    def _ordinary_segments(self, text: str) -> list[str | bytes]:
+        """Chunks of text that holds no special token (see :meth:`_pre_tokenize`)."""
+        if self._native_pretok is not None:
+            return [text] if text else []
+        return self._chunk_bytes(re.findall(self._compiled_pattern, text))
+
+    def _chunk_bytes(self, chunks: list[str]) -> list[str | bytes]:
+        """Encode regex-split chunks to UTF-8, remapped for the C tokenizer."""
+        if self._map is not None:
+            return [self._map(c.encode("utf-8")) for c in chunks]
+        return [c.encode("utf-8") for c in chunks]
+
+    def _special_bytes(self, token: str) -> bytes:
+        """Byte form of a special token, as keyed in the C tokenizer."""
+        special = token.encode("utf-8")
+        return self._map(special) if self._map is not None else special
+
+    def count_tokens(
+        self,
+        text: str,
+        *,
+        allowed_special: Literal["all"] | AbstractSet[str] = "all",
+        disallowed_special: Literal["all"] | Collection[str] = (),
+    ) -> int:
         """Return the number of tokens ``text`` would produce when encoded.
 
-        This is a convenience method equivalent to ``len(self.encode(text))``
-        but communicates intent more clearly.
+        Equal to ``len(self.encode(text, ...))``, but counted in C: no list
+        and no ``int`` object is created per token.
 
         Parameters
         ----------
         text : str
             The input text to measure.
+        allowed_special, disallowed_special
+            As in :meth:`encode`.
 
         Returns
         -------
         int
             Number of BPE tokens (including any special tokens).
         """
-        return len(self.encode(text))
+        mask = self._special_mask(allowed_special, disallowed_special) if self._special_tokens else None
+        if self._native_pretok is not None:
+            return self._enc.count_special(text, mask)
+
+        n = 0
+        for part in self._enc.split_special(text, mask):
+            if isinstance(part, int):
+                n += 1
+            else:
+                n += self._enc.count_chunks(re.findall(self._compiled_pattern, part), False)
+        return n
+
+    def truncate_to(
+        self,
+        text: str,
+        max_tokens: int,
+        *,
+        allowed_special: Literal["all"] | AbstractSet[str] = "all",
+        disallowed_special: Literal["all"] | Collection[str] = (),
+    ) -> list[int]:
+        """Encode at most the first ``max_tokens`` tokens of ``text``.
+
+        Equal to ``self.encode(text, ...)[:max_tokens]``, but encoding
+        stops at the pre-tokenizer chunk that reaches the budget, so a
+        long text costs no more than its kept prefix.  Disallowed special
+        tokens are still checked in the whole text.  ``decode()`` of the
+        result gives the kept text.
+
+        Parameters
+        ----------
+        text : str
+            The input text to encode.
+        max_tokens : int
+            Token budget (``>= 0``).
+        allowed_special, disallowed_special
+            As in :meth:`encode`.
+
+        Returns
+        -------
+        list[int]
+            At most ``max_tokens`` token IDs.
+        """
+        if max_tokens < 0:
+            raise ValueError(f"max_tokens must be >= 0, got {max_tokens}")
+        mask = self._special_mask(allowed_special, disallowed_special) if self._special_tokens else None
+        if self._native_pretok is not None:
+            return self._enc.encode_special(text, mask, max_tokens)
+
+        ids: list[int] = []
+        for part in self._enc.split_special(text, mask):
+            if len(ids) >= max_tokens:
+                break
+            if isinstance(part, int):
+                ids.append(part)
+            else:
+                chunks = re.findall(self._compiled_pattern, part)
+                ids.extend(self._enc.encode_chunks(chunks, False, max_tokens - len(ids)))
+        return ids
+
+    def encode_cache_info(self) -> dict[str, int]:
+        """Return the encode cache counters.
+
+        Returns
+        -------
+        dict[str, int]
+            ``hits``, ``misses``, ``size`` (cached chunks) and
+            ``capacity``.  Single-byte and long chunks bypass the cache
+            and are not counted.  All zero when the cache is disabled.
+        """
+        return self._enc.encode_cache_info()
+
+    def encode_cache_clear(self) -> None:
+        """Drop every cached chunk encoding and reset the counters."""
+        self._enc.encode_cache_clear()
 
     # ------------------------------------------------------------------
     # Decoding
     # ------------------------------------------------------------------
 
-    def decode(self, ids: list[int]) -> str:
+    def decode(self, ids: list[int] | Buffer) -> str:
         """Decode a list of token IDs back to a string.
 
         Parameters
         ----------
-        ids : list[int]
-            The token IDs to decode.
+        ids : list[int] or buffer
+            The token IDs to decode: a list, or any C-contiguous buffer of
+            integers such as the result of :meth:`encode_to_array` or a
+            numpy array.  A buffer is read without creating Python ints.
 
         Returns
         -------
         str
             The decoded text.
         """
-        text_bytes = self._enc.decode(ids)
-
-        if self._bytes_maps is not None:
-            assert self._inv_map is not None
-            text_bytes = self._inv_map(text_bytes)
-        return text_bytes.decode("utf-8")
+        return self._enc.decode_text(ids)
 
     # ------------------------------------------------------------------
     # Streaming decode
     # ------------------------------------------------------------------
 
+    def stream_decoder(self, *, errors: str = "strict") -> bpe.StreamDecoder:
+        """Create a native incremental decoder for one token stream.
+
+        ``push(ids)`` takes one ID, a list or a buffer of IDs and returns
+        the text they complete; bytes of an unfinished character are held
+        for the next push.  ``flush()`` ends the stream and ``reset()``
+        drops held bytes.  Each stream needs its own decoder, and any
+        number of decoders can share this tokenizer.
+
+        Parameters
+        ----------
+        errors : str
+            Codec error handler for invalid UTF-8 (``"strict"``,
+            ``"replace"``, ...).  A partial character followed by a
+            special token is invalid and goes through it.
+
+        Returns
+        -------
+        bpe.StreamDecoder
+            A new decoder with nothing held.
+        """
+        return bpe.StreamDecoder(self._enc, errors)
+
     def stream_decode(self, callback: Callable[[str], None]) -> Callable[[int], None]:
         """Create a streaming decoder.
 
         Processes one token ID at a time and calls ``callback`` with
         each complete text fragment.  Handles partial UTF-8 sequences
-        by caching incomplete bytes across calls.
+        by caching incomplete bytes across calls.  Invalid UTF-8, such
+        as a partial character followed by a special token, becomes
+        U+FFFD instead of raising.
 
         Parameters
         ----------
@@ -295,46 +848,24 @@ class Tokenizer:
         -------
         Callable[[int], None]
             A function that accepts one token ID at a time.
+
+        See Also
+        --------
+        stream_decoder : The native decoder this wraps.
         """
-        if self._bytes_maps is None:
-            self._enc.cache_clean()
-
-            def _decode(token_id: int) -> None:
-                text_bytes = self._enc.cache_decode(token_id)
-                if text_bytes is not None:
-                    callback(text_bytes.decode("utf-8"))
-
-            return _decode
-
-        # With byte remapping: use Python-level cache
-        self._enc.cache_clean()
-        self._stream_cache = b""
-
-        def _decode_remap(token_id: int) -> None:
-            assert self._vocab_cache is not None
-            # Fast path: O(1) lookup in cached inverse-remapped vocab.
-            # Falls back to batch decode only for special token IDs
-            # (which sit outside the normal vocab range).
-            token_bytes = self._vocab_cache.get(token_id)
-            if token_bytes is None:
-                # Special token (or unknown ID) — use batch decode
-                assert self._inv_map is not None
-                token_bytes = self._enc.decode([token_id])
-                token_bytes = self._inv_map(token_bytes)
-            text_bytes = self._stream_cache + token_bytes
-            try:
-                text = text_bytes.decode("utf-8")
-                self._stream_cache = b""
+        decoder = self._stream = self.stream_decoder(errors="replace")
+
+        def _decode(token_id: int) -> None:
+            text = decoder.push(token_id)
+            if text:
                 callback(text)
-            except UnicodeDecodeError:
-                self._stream_cache = text_bytes
 
-        return _decode_remap
+        return _decode
 
     def stream_decode_reset(self) -> None:
-        """Clear the streaming decode cache."""
-        self._enc.cache_clean()
-        self._stream_cache = b""
+        """Clear the bytes held by the latest :meth:`stream_decode` decoder."""
+        if self._stream is not None:
+            self._stream.reset()
 
     # ------------------------------------------------------------------
     # Properties
@@ -369,17 +900,25 @@ class Tokenizer:
     # ------------------------------------------------------------------
 
     def save(self, path: str) -> None:
-        """Save the model to a ``.tbm`` file.
+        """Save the model to a ``.tbm`` or ``.tbmb`` file.
 
         Only the BPE merge pairs and byte remapping (if present) are
         saved.  The regex pattern and special tokens are NOT preserved.
 
+        A path ending in ``.tbmb`` writes the binary model image: the
+        ready-built merges table and vocabulary, which :meth:`from_file`
+        memory-maps instead of parsing.
+
         Parameters
         ----------
         path : str
-            Output path (``.tbm`` appended if missing).
+            Output path (``.tbm`` appended unless it ends in ``.tbm`` or
+            ``.tbmb``).
         """
-        save_model(path, self.merges, self._bytes_maps)
+        if Path(path).suffix == ".tbmb":
+            save_model_binary(path, self._enc.to_image(self._bytes_maps))
+        else:
+            save_model(path, self.merges, self._bytes_maps)
 
     def save_vocab(self, path: str) -> None:
         """Save the vocabulary to a ``.vocab`` file.
@@ -398,33 +937,51 @@ class Tokenizer:
         *,
         pat_str: str | None = None,
         special_tokens: dict[str, int] | None = None,
+        encode_cache_size: int = 0,
     ) -> Tokenizer:
-        """Create a Tokenizer from a ``.tbm`` model file.
+        """Create a Tokenizer from a ``.tbm`` or ``.tbmb`` model file.
+
+        A ``.tbmb`` file is memory-mapped read-only and used in place:
+        loading costs the same for any vocabulary size, and processes
+        that map the same file share its pages.
 
         Parameters
         ----------
         path : str
-            Path to the ``.tbm`` file.
+            Path to the ``.tbm`` or ``.tbmb`` file.
         pat_str : str or None
             Regex pattern for pre-tokenization.
         special_tokens : dict[str, int] or None
             Mapping from special token strings to their IDs.
+        encode_cache_size : int
+            Capacity of the encode cache (``0`` disables it).
 
         Returns
         -------
         Tokenizer
             The loaded tokenizer.
         """
+        if Path(path).suffix == ".tbmb":
+            image, bytes_maps = map_model_binary(path)
+            return cls(
+                image,
+                bytes_maps=bytes_maps,
+                pat_str=pat_str,
+                special_tokens=special_tokens,
+                encode_cache_size=encode_cache_size,
+            )
+
         merges, bytes_maps = load_model(path)
         return cls(
             merges,
             bytes_maps=bytes_maps,
             pat_str=pat_str,
             special_tokens=special_tokens,
+            encode_cache_size=encode_cache_size,
         )
 
     @classmethod
-    def from_pretrained(cls, name: str) -> Tokenizer:
+    def from_pretrained(cls, name: str, *, encode_cache_size: int = 0) -> Tokenizer:
         """Load a built-in model by name.
 
         Models ship with the package — no network download required.
@@ -434,12 +991,17 @@ class Tokenizer:
         ----------
         name : str
             Model name (e.g. ``"cl100k_base"``, ``"qwen35"``, ``"minicpm5"``).
+        encode_cache_size : int
+            Capacity of this tokenizer's encode cache (``0`` disables it).
+            The cache is per tokenizer, not shared with the model.
 
         Returns
         -------
         Tokenizer
             Fully configured tokenizer with the model's regex pattern
-            and special tokens (when applicable).
+            and special tokens (when applicable).  Tokenizers for the
+            same model share one copy of its merges table and vocabulary,
+            which is loaded on first use and freed with the last of them.
 
         Raises
         ------
@@ -465,10 +1027,11 @@ class Tokenizer:
         info: ModelInfo = _MODEL_REGISTRY[name]
         model_path = _find_package_file(info["path"])
 
-        merges, bytes_maps = load_model(model_path)
+        model = _shared_model(name, model_path)
         return cls(
-            merges,
-            bytes_maps=bytes_maps,
+            model,
+            bytes_maps=model.bytes_maps,
             pat_str=info.get("pat_str"),
             special_tokens=info.get("special_tokens"),
+            encode_cache_size=encode_cache_size,
         )
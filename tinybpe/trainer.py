@@ -7,10 +7,18 @@ preprocessing.
 
 from __future__ import annotations
 
-from typing import Callable
+from itertools import islice
+from typing import TYPE_CHECKING, Callable
+
+import regex as re
 
 import tinybpe.bpe as bpe
 from tinybpe._model_io import save_model
+from tinybpe.tokenizer import _DEFAULT_PATTERN, _NATIVE_PRETOKENIZERS
+
+if TYPE_CHECKING:
+    import os
+    from collections.abc import Iterable
 
 
 class Trainer(bpe.Trainer):
@@ -28,9 +36,23 @@ class Trainer(bpe.Trainer):
         ``bytes`` or ``bytearray`` chunks.  Use this for regex
         pre-tokenization (splitting text before training).
     callback : callable or None
-        Optional progress callback called after each training step.
+        Optional progress callback called after each training step
+        (every ``progress_every`` steps in :meth:`train`).
         Receives ``(step, total, pair, rank, frequency)`` where
         ``total`` may be 0 if the total is unknown.
+    num_threads : int
+        Worker threads for pair counting (0 = all cores).  The learned
+        merges are the same for any value.  The GIL is released while
+        a step runs.
+    spill_dir : str or path-like or None
+        Keep the training pieces in memory-mapped scratch files in this
+        directory instead of in RAM.  The files are deleted with the
+        trainer.
+    memory_limit : int
+        Bytes the in-memory training engine may use (0 = no limit).
+        While it would need more, each step streams over the pieces
+        instead; training switches to the engine once enough merges
+        have shrunk the corpus.  The merges are the same either way.
 
     Examples
     --------
@@ -56,6 +78,25 @@ class Trainer(bpe.Trainer):
         ...     print(f"Step {step}: {pair} -> {rank}")
         >>> trainer = Trainer("hello world", callback=on_step)
 
+    Training on a corpus larger than RAM::
+
+        >>> lines = (line for path in paths for line in open(path))
+        >>> trainer = Trainer.from_iterator(
+        ...     lines, preprocess, spill_dir="/scratch", memory_limit=8 << 30
+        ... )
+
+    Training on text files with a built-in model's pattern::
+
+        >>> from tinybpe import get_model_info
+        >>> pat_str = get_model_info("cl100k_base")["pat_str"]
+        >>> trainer = Trainer.from_files(["a.txt", "b.txt"], pat_str)
+
+    Training from pre-counted words::
+
+        >>> trainer = Trainer.from_counts({b"hello": 3, b" world": 2})
+        >>> trainer.step()
+        ((104, 101), 256, 3)
+
     Continue training from an existing model::
 
         >>> trainer = Trainer("new text")
@@ -73,16 +114,201 @@ class Trainer(bpe.Trainer):
         preprocess: Callable[[str], list[bytes | bytearray]] | None = None,
         *,
         callback: (Callable[[int, int, tuple[int, int], int, int], None] | None) = None,
+        num_threads: int = 0,
+        spill_dir: str | os.PathLike[str] | None = None,
+        memory_limit: int = 0,
     ) -> None:
         if preprocess is None:
             pieces: list[bytes | bytearray] = [text.encode("utf-8")]
         else:
             pieces = preprocess(text)
 
-        super().__init__(pieces)
+        super().__init__(pieces, num_threads=num_threads, spill_dir=spill_dir, memory_limit=memory_limit)
         self._callback = callback
         self._step_count = 0
 
+    @classmethod
+    def from_counts(
+        cls,
+        counts: dict[bytes, int],
+        *,
+        callback: (Callable[[int, int, tuple[int, int], int, int], None] | None) = None,
+        num_threads: int = 0,
+        spill_dir: str | os.PathLike[str] | None = None,
+        memory_limit: int = 0,
+    ) -> Trainer:
+        """Create a trainer from pre-counted pieces.
+
+        Training on ``{piece: n}`` learns the same merges as training on
+        a corpus where each piece occurs ``n`` times.  Pair frequency
+        ties go to the piece that comes first in ``counts``.
+
+        Identical pieces are always stored once, so this mainly saves
+        building the full piece list when word counts are already
+        available (e.g. from a streaming counter).
+
+        Parameters
+        ----------
+        counts : dict[bytes, int]
+            Piece bytes → number of occurrences (must be positive).
+        callback : callable or None
+            Optional progress callback, as in the constructor.
+        num_threads : int
+            Worker threads for pair counting (0 = all cores).
+        spill_dir, memory_limit
+            Out-of-core options, as in the constructor.
+
+        Returns
+        -------
+        Trainer
+        """
+        trainer = cls.__new__(cls)
+        bpe.Trainer.__init__(
+            trainer,
+            list(counts.keys()),
+            list(counts.values()),
+            num_threads=num_threads,
+            spill_dir=spill_dir,
+            memory_limit=memory_limit,
+        )
+        trainer._callback = callback
+        trainer._step_count = 0
+        return trainer
+
+    @classmethod
+    def from_iterator(
+        cls,
+        texts: Iterable[str | bytes],
+        preprocess: Callable[[str], list[bytes | bytearray]] | None = None,
+        *,
+        callback: (Callable[[int, int, tuple[int, int], int, int], None] | None) = None,
+        num_threads: int = 0,
+        spill_dir: str | os.PathLike[str] | None = None,
+        memory_limit: int = 0,
+        batch_size: int = 1024,
+    ) -> Trainer:
+        """Create a trainer from an iterable of texts, e.g. file lines.
+
+        Texts are consumed ``batch_size`` at a time, so the corpus never
+        has to be held as one string.  Only the distinct pieces are
+        kept, with their counts.  Training on ``texts`` learns the same
+        merges as ``Trainer`` on the pieces of all texts in order.
+
+        Parameters
+        ----------
+        texts : iterable of str or bytes
+            A ``str`` is split by ``preprocess`` (or UTF-8 encoded as
+            one piece); ``bytes`` are used as one piece as they are.
+        preprocess : callable or None
+            As in the constructor, applied to each ``str`` text.
+        callback, num_threads, spill_dir, memory_limit
+            As in the constructor.
+        batch_size : int
+            Texts preprocessed and handed to the C trainer per batch.
+
+        Returns
+        -------
+        Trainer
+        """
+        trainer = cls.__new__(cls)
+        bpe.Trainer.__init__(
+            trainer,
+            [b""],
+            num_threads=num_threads,
+            spill_dir=spill_dir,
+            memory_limit=memory_limit,
+        )
+        trainer._callback = callback
+        trainer._step_count = 0
+
+        it = iter(texts)
+        while batch := list(islice(it, batch_size)):
+            pieces: list[bytes | bytearray] = []
+            for text in batch:
+                if isinstance(text, (bytes, bytearray)):
+                    pieces.append(text)
+                elif preprocess is None:
+                    pieces.append(text.encode("utf-8"))
+                else:
+                    pieces.extend(preprocess(text))
+            trainer.add(pieces)
+        return trainer
+
+    @classmethod
+    def from_files(
+        cls,
+        paths: Iterable[str | os.PathLike[str]],
+        pat_str: str | None = None,
+        *,
+        callback: (Callable[[int, int, tuple[int, int], int, int], None] | None) = None,
+        num_threads: int = 0,
+        spill_dir: str | os.PathLike[str] | None = None,
+        memory_limit: int = 0,
+    ) -> Trainer:
+        """Create a trainer from UTF-8 text files, split by ``pat_str``.
+
+        Learns the same merges as ``Trainer`` on the ``pat_str`` chunks
+        of all files in order.  For the byte-level pattern of the
+        built-in models, or ``pat_str=None`` (each file is one piece),
+        the files are read, pre-tokenized and counted in C on
+        ``num_threads`` threads with the GIL released, without creating
+        a Python object per piece.  Any other pattern falls back to
+        :meth:`from_iterator` with a ``regex`` preprocess, one file at a
+        time.
+
+        Parameters
+        ----------
+        paths : iterable of str or path-like
+            Files to read, as raw bytes (no newline translation).
+        pat_str : str or None
+            Regex pattern for pre-tokenization, as in
+            :class:`~tinybpe.Tokenizer`.
+        callback, num_threads, spill_dir, memory_limit
+            As in the constructor.
+
+        Returns
+        -------
+        Trainer
+
+        Raises
+        ------
+        OSError
+            If a file cannot be read.
+        """
+        paths = list(paths)
+        if pat_str is None:
+            pat_str = _DEFAULT_PATTERN
+        native = _NATIVE_PRETOKENIZERS.get(pat_str)
+        if native is None:
+            pat = re.compile(pat_str)
+
+            def read(path: str | os.PathLike[str]) -> str:
+                with open(path, encoding="utf-8", newline="") as f:
+                    return f.read()
+
+            return cls.from_iterator(
+                (read(path) for path in paths),
+                lambda text: [ch.encode("utf-8") for ch in pat.findall(text)],
+                callback=callback,
+                num_threads=num_threads,
+                spill_dir=spill_dir,
+                memory_limit=memory_limit,
+                batch_size=1,
+            )
+
+        trainer = cls.__new__(cls)
+        bpe.Trainer.__init__(
+            trainer,
+            [b""],
+            num_threads=num_threads,
+            spill_dir=spill_dir,
+            memory_limit=memory_limit,
+        )
+        trainer._callback = callback
+        trainer._step_count = 0
+        trainer.add_files(paths, pretokenizer=native)
+        return trainer
+
     # ------------------------------------------------------------------
     # Training
     # ------------------------------------------------------------------
@@ -104,26 +330,55 @@ class Trainer(bpe.Trainer):
                 self._callback(self._step_count, 0, pair, rank, freq)
         return result
 
-    def train(self, n_merges: int) -> int:
-        """Train for ``n_merges`` steps.
+    def train(  # type: ignore[override]
+        self,
+        n_merges: int | None = None,
+        *,
+        min_frequency: int = 1,
+        target_vocab_size: int | None = None,
+        progress_every: int = 1,
+    ) -> int:
+        """Train for up to ``n_merges`` steps.
 
-        Training stops early if no more merges are possible.
+        The whole loop runs in C with the GIL released; merges are
+        appended to :attr:`merges` in batches.  Training stops early if
+        no more merges are possible.
 
         Parameters
         ----------
-        n_merges : int
-            Number of merges to learn.
+        n_merges : int or None
+            Number of merges to learn (``None`` = no limit).
+        min_frequency : int
+            Stop before a pair that occurs fewer times than this.
+        target_vocab_size : int or None
+            Stop once the vocabulary (256 bytes + all merges, including
+            loaded ones) reaches this size.
+        progress_every : int
+            Call the callback every this many steps, and after the last
+            one.  Larger values keep Python out of the training loop.
 
         Returns
         -------
         int
             The actual number of merges performed.
         """
-        for i in range(n_merges):
-            result = self.step()
-            if result is None:
-                return i
-        return n_merges
+        callback = None
+        if self._callback is not None:
+            user_callback = self._callback
+            offset = self._step_count
+
+            def callback(step: int, total: int, pair: tuple[int, int], rank: int, freq: int) -> None:
+                user_callback(offset + step, 0, pair, rank, freq)
+
+        done: int = super().train(
+            n_merges,
+            min_frequency=min_frequency,
+            target_vocab_size=target_vocab_size or 0,
+            progress_every=progress_every if callback is not None else 0,
+            callback=callback,
+        )
+        self._step_count += done
+        return done
 
     # ------------------------------------------------------------------
     # Properties